@@ -0,0 +1,124 @@
+// Planar (SoA) vs interleaved RGBA (AoS) throughput of the transform
+// pipeline on the same plate and the same transforms.
+//
+// usage: bench_aos [repeats]
+
+#include <cstdio>
+#include <vector>
+
+#include "bench/BenchUtils.h"
+#include "include/TransformPlan.h"
+
+namespace
+{
+  struct Case
+  {
+    const char* name;
+    int colorIn;
+    int colorOut;
+  };
+
+  const Case kCases[] = {
+      {"AlexaV3LogC -> linear", Constants::COLOR_ALEXAV3LOGC,
+       Constants::COLOR_LINEAR},
+      {"linear -> gamma 2.2", Constants::COLOR_LINEAR,
+       Constants::COLOR_GAMMA_2_20},
+      {"SLog3 -> ARRILogC4", Constants::COLOR_SLOG3,
+       Constants::COLOR_ARRI_LOG_C4},
+      {"YCbCr -> linear", Constants::COLOR_Y_CB_CR, Constants::COLOR_LINEAR},
+      {"sRGB -> L*a*b* (scalar)", Constants::COLOR_SRGB,
+       Constants::COLOR_LAB},
+  };
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int width = 1920;
+  const int height = 1080;
+  const int repeats = Bench::Repeats(argc, argv, 5);
+  const size_t pixels = static_cast<size_t>(width) * height;
+
+  std::vector<float> r, g, b;
+  Bench::MakePlate(width, height, r, g, b);
+
+  std::vector<float> rgba(pixels * 4);
+  std::vector<uint16_t> rgbaHalf(pixels * 4);
+
+  std::printf("%dx%d, best of %d, Mpixel/s\n", width, height, repeats);
+  std::printf("%-28s %10s %10s %10s\n", "transform", "planar", "rgba f32",
+              "rgba f16");
+
+  for(const Case& c : kCases) {
+    TransformSettings settings;
+    settings.colorIn = c.colorIn;
+    settings.colorOut = c.colorOut;
+    const TransformPlan plan = MakeTransformPlan(settings);
+
+    // planar rows, the way pixel_engine hands them over
+    std::vector<float> pr, pg, pb;
+    const double planar = Bench::Time(repeats, [&]() {
+      pr = r;
+      pg = g;
+      pb = b;
+      for(int y = 0; y < height; ++y) {
+        const size_t row = static_cast<size_t>(y) * width;
+        ApplyPlanar(plan, &pr[row], &pg[row], &pb[row], width);
+      }
+    });
+
+    const double interleaved = Bench::Time(repeats, [&]() {
+      for(size_t i = 0; i < pixels; ++i) {
+        rgba[4 * i] = r[i];
+        rgba[4 * i + 1] = g[i];
+        rgba[4 * i + 2] = b[i];
+        rgba[4 * i + 3] = 1.0f;
+      }
+      for(int y = 0; y < height; ++y) {
+        ApplyRGBA(plan, &rgba[static_cast<size_t>(y) * width * 4], width);
+      }
+    });
+
+    const double half = Bench::Time(repeats, [&]() {
+      for(size_t i = 0; i < pixels; ++i) {
+        rgbaHalf[4 * i] = FloatToHalf(r[i]);
+        rgbaHalf[4 * i + 1] = FloatToHalf(g[i]);
+        rgbaHalf[4 * i + 2] = FloatToHalf(b[i]);
+        rgbaHalf[4 * i + 3] = 0x3c00;
+      }
+      for(int y = 0; y < height; ++y) {
+        ApplyRGBA(plan, &rgbaHalf[static_cast<size_t>(y) * width * 4],
+                  width);
+      }
+    });
+
+    // the refill of the buffers is timed separately and taken out
+    const double refillPlanar = Bench::Time(repeats, [&]() {
+      pr = r;
+      pg = g;
+      pb = b;
+    });
+    const double refillRGBA = Bench::Time(repeats, [&]() {
+      for(size_t i = 0; i < pixels; ++i) {
+        rgba[4 * i] = r[i];
+        rgba[4 * i + 1] = g[i];
+        rgba[4 * i + 2] = b[i];
+        rgba[4 * i + 3] = 1.0f;
+      }
+    });
+    const double refillHalf = Bench::Time(repeats, [&]() {
+      for(size_t i = 0; i < pixels; ++i) {
+        rgbaHalf[4 * i] = FloatToHalf(r[i]);
+        rgbaHalf[4 * i + 1] = FloatToHalf(g[i]);
+        rgbaHalf[4 * i + 2] = FloatToHalf(b[i]);
+        rgbaHalf[4 * i + 3] = 0x3c00;
+      }
+    });
+
+    std::printf("%-28s %10.1f %10.1f %10.1f\n", c.name,
+                Bench::MegaPixels(pixels, planar - refillPlanar),
+                Bench::MegaPixels(pixels, interleaved - refillRGBA),
+                Bench::MegaPixels(pixels, half - refillHalf));
+  }
+
+  return 0;
+}
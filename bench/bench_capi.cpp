@@ -0,0 +1,144 @@
+// C API: the shared library as a player or thumbnailer uses it. A UHD
+// frame in each buffer layout, on the calling thread and on the library's
+// team, then many thumbnail sized calls where the persistent team is
+// compared to starting threads per call (what ParallelFor does).
+//
+// usage: bench_capi [repeats]
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "bench/BenchUtils.h"
+#include "capi/gcolorspace.h"
+#include "include/Half.h"
+
+namespace
+{
+  // 'threads' row bands on short-lived threads, one call each
+  void SpawnPerCall(gcs_transform* t, uint16_t* pixels, int width,
+                    int height, int threads)
+  {
+    std::vector<std::thread> pool;
+    const int band = (height + threads - 1) / threads;
+    for(int y = 0; y < height; y += band) {
+      const int rows = std::min(band, height - y);
+      uint16_t* p = pixels + static_cast<size_t>(y) * width * 4;
+      pool.emplace_back([=]() {
+        gcs_apply_interleaved(t, GCS_FLOAT16, p, width, rows, 4, 0, 1);
+      });
+    }
+    for(std::thread& th : pool) th.join();
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int repeats = Bench::Repeats(argc, argv, 5);
+  const int width = 3840, height = 2160;
+  const size_t n = static_cast<size_t>(width) * height;
+
+  gcs_settings s;
+  gcs_settings_init(&s, sizeof(s));
+  s.color_in = GCS_COLOR_ARRI_LOG_C4;
+  s.primary_in = GCS_PRIM_ARRI_WIDE_GAMUT4;
+  s.color_out = GCS_COLOR_SRGB;
+  s.precision = GCS_PRECISION_LUT_3D_33;
+  gcs_transform* t = nullptr;
+  char error[256];
+  if(gcs_transform_create(&s, sizeof(s), &t, error, sizeof(error)) !=
+     GCS_OK) {
+    std::printf("create failed: %s\n", error);
+    return 1;
+  }
+
+  std::vector<float> r, g, b;
+  Bench::MakePlate(width, height, r, g, b);
+  std::vector<float> planar(3 * n), rgb(3 * n), rgba(4 * n);
+  std::vector<uint16_t> half(4 * n), halfPlate(4 * n);
+  for(size_t i = 0; i < n; ++i) {
+    halfPlate[4 * i] = FloatToHalf(r[i]);
+    halfPlate[4 * i + 1] = FloatToHalf(g[i]);
+    halfPlate[4 * i + 2] = FloatToHalf(b[i]);
+    halfPlate[4 * i + 3] = FloatToHalf(1.0f);
+  }
+
+  // fresh input every run, so the timing includes the copy in all columns
+  auto fill = [&]() {
+    for(size_t i = 0; i < n; ++i) {
+      planar[i] = r[i];
+      planar[n + i] = g[i];
+      planar[2 * n + i] = b[i];
+      rgb[3 * i] = rgba[4 * i] = r[i];
+      rgb[3 * i + 1] = rgba[4 * i + 1] = g[i];
+      rgb[3 * i + 2] = rgba[4 * i + 2] = b[i];
+      rgba[4 * i + 3] = 1.0f;
+    }
+    std::copy(halfPlate.begin(), halfPlate.end(), half.begin());
+  };
+  const double copy = Bench::Time(repeats, fill);
+  auto run = [&](int threads, int layout) {
+    return Bench::Time(repeats, [&]() {
+             fill();
+             if(layout == 0) {
+               gcs_apply_planar(t, GCS_FLOAT32, planar.data(),
+                                planar.data() + n, planar.data() + 2 * n,
+                                width, height, 0, threads);
+             }
+             else if(layout == 1) {
+               gcs_apply_interleaved(t, GCS_FLOAT32, rgb.data(), width,
+                                     height, 3, 0, threads);
+             }
+             else if(layout == 2) {
+               gcs_apply_interleaved(t, GCS_FLOAT32, rgba.data(), width,
+                                     height, 4, 0, threads);
+             }
+             else {
+               gcs_apply_interleaved(t, GCS_FLOAT16, half.data(), width,
+                                     height, 4, 0, threads);
+             }
+           }) -
+           copy;
+  };
+
+  const char* layouts[] = {"planar float", "RGB float", "RGBA float",
+                           "RGBA half"};
+  std::printf("LogC4/AWG4 -> sRGB, 3D LUT 33, %dx%d, best of %d, "
+              "Mpixel/s\n",
+              width, height, repeats);
+  std::printf("%-14s %10s %10s\n", "", "1 thread", "all");
+  for(int layout = 0; layout < 4; ++layout) {
+    std::printf("%-14s %10.1f %10.1f\n", layouts[layout],
+                Bench::MegaPixels(n, run(1, layout)),
+                Bench::MegaPixels(n, run(0, layout)));
+  }
+
+  // thumbnails: small images back to back
+  const int tw = 320, th = 180, calls = 2000;
+  const int threads = static_cast<int>(std::thread::hardware_concurrency());
+  const size_t thumbSize = static_cast<size_t>(tw) * th * 4;
+  std::vector<uint16_t> thumb(halfPlate.begin(),
+                              halfPlate.begin() + thumbSize);
+  const double team = Bench::Time(repeats, [&]() {
+    for(int i = 0; i < calls; ++i) {
+      gcs_apply_interleaved(t, GCS_FLOAT16, thumb.data(), tw, th, 4, 0, 0);
+    }
+  });
+  const double single = Bench::Time(repeats, [&]() {
+    for(int i = 0; i < calls; ++i) {
+      gcs_apply_interleaved(t, GCS_FLOAT16, thumb.data(), tw, th, 4, 0, 1);
+    }
+  });
+  const double spawn = Bench::Time(repeats, [&]() {
+    for(int i = 0; i < calls; ++i) {
+      SpawnPerCall(t, thumb.data(), tw, th, threads);
+    }
+  });
+  std::printf("\n%d RGBA half %dx%d calls, calls/s\n", calls, tw, th);
+  std::printf("team %10.0f   1 thread %10.0f   threads per call %10.0f\n",
+              calls / team, calls / single, calls / spawn);
+
+  gcs_transform_destroy(t);
+  return 0;
+}
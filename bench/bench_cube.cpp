@@ -0,0 +1,156 @@
+// .cube LUT files: loading a 65^3 cube with the mapped hand rolled parser
+// against an iostream reader and a cache hit, then applying it with a
+// Cineon -> sRGB conversion as a second pass (a separate LUT node) against
+// the fused plan, exact and baked into the 3D LUT 65 tier.
+//
+// usage: bench_cube [repeats]
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench/BenchUtils.h"
+#include "include/TransformPlan.h"
+
+namespace
+{
+  // a mild print-like film look, written the way grading tools do
+  std::string WriteCube(int size)
+  {
+    const char* dir = std::getenv("TMPDIR");
+    const std::string path =
+        std::string(dir ? dir : "/tmp") + "/bench_cube_65.cube";
+    FILE* f = std::fopen(path.c_str(), "w");
+    std::fprintf(f, "TITLE \"bench look\"\nLUT_3D_SIZE %d\n\n", size);
+    const float step = 1.0f / (size - 1);
+    for(int b = 0; b < size; ++b) {
+      for(int g = 0; g < size; ++g) {
+        for(int r = 0; r < size; ++r) {
+          const float x = r * step, y = g * step, z = b * step;
+          const float luma = 0.2126f * x + 0.7152f * y + 0.0722f * z;
+          std::fprintf(f, "%.6f %.6f %.6f\n", luma + 0.9f * (x - luma),
+                       luma + 0.85f * (y - luma) + 0.01f,
+                       luma + 0.8f * (z - luma) * (1.0f - 0.1f * z));
+        }
+      }
+    }
+    std::fclose(f);
+    return path;
+  }
+
+  // what a straightforward reader does, for reference
+  std::vector<float> ReadStream(const std::string& path)
+  {
+    std::ifstream in(path);
+    std::string line;
+    std::vector<float> data;
+    while(std::getline(in, line)) {
+      if(line.empty() || line[0] == '#' || std::isalpha(line[0])) continue;
+      float r, g, b;
+      std::istringstream(line) >> r >> g >> b;
+      data.insert(data.end(), {r, g, b});
+    }
+    return data;
+  }
+
+  // entries that differ from strtof on the same text
+  int CountMismatches(const std::string& path, const CubeLut& lut)
+  {
+    std::ifstream in(path);
+    std::string line;
+    size_t i = 0;
+    int bad = 0;
+    while(std::getline(in, line)) {
+      if(line.empty() || std::isalpha(line[0])) continue;
+      const char* p = line.c_str();
+      char* next;
+      for(int c = 0; c < 3; ++c, p = next) {
+        bad += std::strtof(p, &next) != lut.cube.table[i++];
+      }
+    }
+    return bad;
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int width = 2048;
+  const int height = 1080;
+  const int repeats = Bench::Repeats(argc, argv, 3);
+  const size_t pixels = static_cast<size_t>(width) * height;
+
+  const std::string path = WriteCube(65);
+  std::shared_ptr<const CubeLut> lut;
+  const double parse = Bench::Time(
+      repeats, [&]() { lut = ReadCubeLut(path, nullptr); });
+  const double stream =
+      Bench::Time(repeats, [&]() { ReadStream(path).size(); });
+  CubeLutCache::instance().load(path, nullptr);
+  const double hit = Bench::Time(
+      repeats, [&]() { CubeLutCache::instance().load(path, nullptr); });
+  if(lut == nullptr) {
+    std::printf("parse failed\n");
+    return 1;
+  }
+
+  std::printf(".cube 65^3, best of %d, ms\n", repeats);
+  std::printf("mapped parse %8.2f   iostream %8.2f   cache hit %8.4f\n",
+              parse * 1e3, stream * 1e3, hit * 1e3);
+  std::printf("entries differing from strtof: %d\n",
+              CountMismatches(path, *lut));
+
+  std::vector<float> r0, g0, b0;
+  Bench::MakePlate(width, height, r0, g0, b0);
+  std::vector<float> r(pixels), g(pixels), b(pixels);
+
+  TransformSettings settings;
+  settings.colorIn = Constants::COLOR_CINEON;
+  settings.colorOut = Constants::COLOR_SRGB;
+  const TransformPlan curves = MakeTransformPlan(settings);
+  settings.lutFile = lut;
+  settings.lutFilePosition = Constants::LUT_FILE_AFTER;
+  const TransformPlan fused = MakeTransformPlan(settings);
+  settings.precision = Constants::PRECISION_LUT_3D_65;
+  const TransformPlan baked = MakeTransformPlan(settings);
+
+  auto run = [&](auto fn) {
+    return Bench::Time(repeats, [&]() {
+      for(int y = 0; y < height; ++y) {
+        const size_t row = static_cast<size_t>(y) * width;
+        fn(&r0[row], &g0[row], &b0[row], &r[row], &g[row], &b[row]);
+      }
+    });
+  };
+  const double twoPasses = run([&](const float* R, const float* G,
+                                   const float* B, float* ro, float* go,
+                                   float* bo) {
+    ApplyPlanar(curves, R, G, B, ro, go, bo, width);
+    Simd::forEach3(ro, go, bo, width,
+                   [&](Simd::vfloat& x, Simd::vfloat& y, Simd::vfloat& z) {
+                     ApplyCubeLut(*lut, x, y, z);
+                   });
+  });
+  const double onePass = run([&](const float* R, const float* G,
+                                 const float* B, float* ro, float* go,
+                                 float* bo) {
+    ApplyPlanar(fused, R, G, B, ro, go, bo, width);
+  });
+  const double bakedPass = run([&](const float* R, const float* G,
+                                   const float* B, float* ro, float* go,
+                                   float* bo) {
+    ApplyPlanar(baked, R, G, B, ro, go, bo, width);
+  });
+
+  std::printf("\nCineon -> sRGB + LUT on %dx%d, one thread, Mpixel/s\n", width,
+              height);
+  std::printf("two passes %8.1f   one pass %8.1f   3D LUT 65 %8.1f\n",
+              Bench::MegaPixels(pixels, twoPasses),
+              Bench::MegaPixels(pixels, onePass),
+              Bench::MegaPixels(pixels, bakedPass));
+  std::remove(path.c_str());
+  return 0;
+}
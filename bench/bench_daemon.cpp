@@ -0,0 +1,253 @@
+// Conversion daemon load generator: starts gcolorspace_daemon on a private
+// socket, then clients convert thumbnail sized RGBA half frames with a mix
+// of transforms, back to back, while requests/s and latency are measured.
+// The reference columns are what the daemon replaces: a process per
+// conversion (this binary with --cold, creating its transform and baking
+// its LUT like a standalone tool), and the warm floor, a transform applied
+// in process.
+//
+// usage: bench_daemon [requests per client]
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "bench/BenchUtils.h"
+#include "capi/gcolorspace.h"
+#include "include/Half.h"
+
+extern char** environ;
+
+namespace
+{
+  constexpr int kWidth = 256;
+  constexpr int kHeight = 144;
+  constexpr size_t kFrameBytes = kWidth * kHeight * 4 * sizeof(uint16_t);
+
+  // the publish mix: camera logs to display, some through a 3D LUT tier
+  gcs_settings Settings(int i)
+  {
+    static const int ins[] = {GCS_COLOR_ARRI_LOG_C4, GCS_COLOR_SLOG3,
+                              GCS_COLOR_LOG3G10, GCS_COLOR_CINEON};
+    static const int prims[] = {GCS_PRIM_ARRI_WIDE_GAMUT4,
+                                GCS_PRIM_SONY_S_GAMUT, GCS_PRIM_REC_2020,
+                                GCS_PRIM_SRGB};
+    gcs_settings s;
+    gcs_settings_init(&s, sizeof(s));
+    s.color_in = ins[i % 4];
+    s.primary_in = prims[i % 4];
+    s.color_out = i % 2 ? GCS_COLOR_SRGB : GCS_COLOR_REC709;
+    s.precision = i < 4 ? GCS_PRECISION_LUT_3D_33 : GCS_PRECISION_EXACT;
+    return s;
+  }
+
+  void FillThumbnail(uint16_t* pixels)
+  {
+    std::vector<float> r, g, b;
+    Bench::MakePlate(kWidth, kHeight, r, g, b);
+    for(size_t i = 0; i < r.size(); ++i) {
+      pixels[4 * i] = FloatToHalf(r[i]);
+      pixels[4 * i + 1] = FloatToHalf(g[i]);
+      pixels[4 * i + 2] = FloatToHalf(b[i]);
+      pixels[4 * i + 3] = FloatToHalf(1.0f);
+    }
+  }
+
+  double Seconds(std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  }
+
+  pid_t Spawn(std::vector<std::string> args)
+  {
+    std::vector<char*> argv;
+    for(std::string& a : args) argv.push_back(&a[0]);
+    argv.push_back(nullptr);
+    pid_t pid = -1;
+    if(posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ)) {
+      return -1;
+    }
+    return pid;
+  }
+
+  // one conversion the way a standalone tool does it
+  int Cold(int which)
+  {
+    gcs_settings s = Settings(which);
+    gcs_transform* t = nullptr;
+    if(gcs_transform_create(&s, sizeof(s), &t, nullptr, 0) != GCS_OK) {
+      return 1;
+    }
+    std::vector<uint16_t> pixels(kFrameBytes / sizeof(uint16_t));
+    FillThumbnail(pixels.data());
+    gcs_apply_interleaved(t, GCS_FLOAT16, pixels.data(), kWidth, kHeight, 4,
+                          0, 1);
+    gcs_transform_destroy(t);
+    return 0;
+  }
+
+  struct Load
+  {
+    double seconds = 0;
+    std::vector<double> latencies;
+    int failed = 0;
+  };
+
+  Load RunClients(const std::string& socket, int clients, int requests)
+  {
+    Load load;
+    std::vector<std::vector<double>> latencies(clients);
+    std::vector<int> failed(clients, 0);
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(int c = 0; c < clients; ++c) {
+      threads.emplace_back([&, c]() {
+        gcs_client* client = nullptr;
+        gcs_frame frame;
+        if(gcs_client_connect(socket.c_str(), &client, nullptr, 0) !=
+               GCS_OK ||
+           gcs_frame_create(kFrameBytes, &frame) != GCS_OK) {
+          failed[c] = requests;
+          gcs_client_close(client);
+          return;
+        }
+        FillThumbnail(static_cast<uint16_t*>(frame.data));
+        latencies[c].reserve(requests);
+        for(int i = 0; i < requests; ++i) {
+          const gcs_settings s = Settings((c + i) % 8);
+          const auto sent = std::chrono::steady_clock::now();
+          if(gcs_client_apply_interleaved(client, &s, sizeof(s), &frame, 0,
+                                          GCS_FLOAT16, kWidth, kHeight, 4,
+                                          0, 1, nullptr, 0) != GCS_OK) {
+            ++failed[c];
+          }
+          latencies[c].push_back(Seconds(sent));
+        }
+        gcs_frame_destroy(&frame);
+        gcs_client_close(client);
+      });
+    }
+    for(std::thread& t : threads) t.join();
+    load.seconds = Seconds(start);
+    for(int c = 0; c < clients; ++c) {
+      load.latencies.insert(load.latencies.end(), latencies[c].begin(),
+                            latencies[c].end());
+      load.failed += failed[c];
+    }
+    std::sort(load.latencies.begin(), load.latencies.end());
+    return load;
+  }
+
+  double Percentile(const std::vector<double>& sorted, double p)
+  {
+    if(sorted.empty()) return 0;
+    return sorted[std::min(sorted.size() - 1,
+                           static_cast<size_t>(p * sorted.size()))];
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  if(argc == 3 && !std::strcmp(argv[1], "--cold")) {
+    return Cold(std::atoi(argv[2]));
+  }
+#if !defined(GCOLORSPACE_BENCH_DAEMON)
+  std::printf("built without gcolorspace_daemon\n");
+  return 0;
+#else
+  const int requests = argc > 1 ? std::max(1, std::atoi(argv[1])) : 2000;
+  const std::string socket =
+      "/tmp/bench_daemon-" + std::to_string(getpid()) + ".sock";
+  const pid_t daemon =
+      Spawn({GCOLORSPACE_BENCH_DAEMON, "--socket", socket, "--plans", "16"});
+  if(daemon < 0) {
+    std::printf("cannot start %s\n", GCOLORSPACE_BENCH_DAEMON);
+    return 1;
+  }
+  // up once it accepts, then warm its transforms like a running service
+  gcs_client* probe = nullptr;
+  for(int i = 0; i < 500 && gcs_client_connect(socket.c_str(), &probe,
+                                               nullptr, 0) != GCS_OK;
+      ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  if(probe == nullptr) {
+    std::printf("the daemon did not come up\n");
+    kill(daemon, SIGTERM);
+    waitpid(daemon, nullptr, 0);
+    return 1;
+  }
+  gcs_client_close(probe);
+  RunClients(socket, 1, 16);
+
+  std::printf("RGBA half %dx%d, 8 transforms\n", kWidth, kHeight);
+  std::printf("%-22s %10s %10s %10s\n", "", "req/s", "p50 us", "p99 us");
+  const int cores = static_cast<int>(std::thread::hardware_concurrency());
+  std::vector<int> counts = {1, 4, std::max(cores, 1) * 2};
+  std::sort(counts.begin(), counts.end());
+  counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+  for(int clients : counts) {
+    const Load load = RunClients(socket, clients, requests);
+    char label[32];
+    std::snprintf(label, sizeof(label), "daemon, %d clients", clients);
+    std::printf("%-22s %10.0f %10.1f %10.1f%s\n", label,
+                load.latencies.size() / load.seconds,
+                Percentile(load.latencies, 0.5) * 1e6,
+                Percentile(load.latencies, 0.99) * 1e6,
+                load.failed ? "  (failures)" : "");
+  }
+  kill(daemon, SIGTERM);
+  waitpid(daemon, nullptr, 0);
+
+  // a process per conversion
+  const int processes = 24;
+  std::vector<double> cold;
+  for(int i = 0; i < processes; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    const pid_t child =
+        Spawn({"/proc/self/exe", "--cold", std::to_string(i % 8)});
+    int status = 0;
+    if(child < 0 || waitpid(child, &status, 0) < 0 || status != 0) {
+      std::printf("--cold failed\n");
+      return 1;
+    }
+    cold.push_back(Seconds(start));
+  }
+  std::sort(cold.begin(), cold.end());
+  std::printf("%-22s %10.0f %10.1f %10.1f\n", "process per request",
+              processes / std::accumulate(cold.begin(), cold.end(), 0.0),
+              Percentile(cold, 0.5) * 1e6, Percentile(cold, 0.99) * 1e6);
+
+  // in process, transforms already compiled
+  std::vector<gcs_transform*> transforms(8);
+  for(int i = 0; i < 8; ++i) {
+    const gcs_settings s = Settings(i);
+    gcs_transform_create(&s, sizeof(s), &transforms[i], nullptr, 0);
+  }
+  std::vector<uint16_t> pixels(kFrameBytes / sizeof(uint16_t));
+  FillThumbnail(pixels.data());
+  const double warm = Bench::Time(3, [&]() {
+    for(int i = 0; i < requests; ++i) {
+      gcs_apply_interleaved(transforms[i % 8], GCS_FLOAT16, pixels.data(),
+                            kWidth, kHeight, 4, 0, 1);
+    }
+  });
+  std::printf("%-22s %10.0f %10.1f\n", "in process, warm", requests / warm,
+              warm / requests * 1e6);
+  for(gcs_transform* t : transforms) gcs_transform_destroy(t);
+  return 0;
+#endif
+}
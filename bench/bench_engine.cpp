@@ -0,0 +1,151 @@
+// The node's engines outside of Nuke. "copy" copies each input row to the
+// output row and converts it there, the former rows engine; "rows" converts
+// the input row straight into the output row; "bands" converts
+// BandCache::kDefaultRows rows of every layer in one call and then copies
+// rows out of the band. The input is an RGBA plate in memory, the output one
+// reused row, so only the engine overhead differs. Nuke itself adds the
+// upstream fetch to all of them.
+//
+// Two transforms: a log curve, bound by arithmetic, and a white adaptation
+// of linear pixels, a matrix that is bound by memory traffic.
+//
+// usage: bench_engine [repeats]
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "bench/BenchUtils.h"
+#include "include/BandCache.h"
+#include "include/TransformPlan.h"
+
+namespace
+{
+  struct Format
+  {
+    const char* name;
+    int width;
+    int height;
+  };
+
+  // planar RGBA, like the rows of an upstream Iop
+  struct Image
+  {
+    int width = 0;
+    int height = 0;
+    std::vector<float> channels[4];
+
+    const float* row(int c, int y) const
+    {
+      return channels[c].data() + static_cast<size_t>(y) * width;
+    }
+  };
+
+  double RunRows(const TransformPlan& plan, const Image& in, bool copy,
+                 int repeats)
+  {
+    std::vector<float> out[4];
+    for(std::vector<float>& c : out) c.resize(in.width);
+    const size_t bytes = sizeof(float) * in.width;
+
+    return Bench::Time(repeats, [&]() {
+      for(int y = 0; y < in.height; ++y) {
+        if(copy) {
+          for(int c = 0; c < 4; ++c) {
+            std::memcpy(out[c].data(), in.row(c, y), bytes);
+          }
+          ApplyPlanar(plan, out[0].data(), out[1].data(), out[2].data(),
+                      in.width);
+          continue;
+        }
+        std::memcpy(out[3].data(), in.row(3, y), bytes);
+        ApplyPlanar(plan, in.row(0, y), in.row(1, y), in.row(2, y),
+                    out[0].data(), out[1].data(), out[2].data(), in.width);
+      }
+    });
+  }
+
+  double RunBands(const TransformPlan& plan, const Image& in, int repeats)
+  {
+    std::vector<float> out[4];
+    for(std::vector<float>& c : out) c.resize(in.width);
+    const size_t bytes = sizeof(float) * in.width;
+
+    BandCache bands;
+    auto fill = [&](Band& band) {
+      band.rows = std::min(band.rows, in.height - band.y);
+      band.x = 0;
+      band.width = in.width;
+      if(band.rows <= 0) return false;
+      band.allocate({0, 1, 2, 3});
+      for(int c = 0; c < 4; ++c) {
+        std::memcpy(band.plane(c), in.row(c, band.y),
+                    sizeof(float) * band.planeSize());
+      }
+      ApplyPlanar(plan, band.plane(0), band.plane(1), band.plane(2),
+                  static_cast<int>(band.planeSize()));
+      return true;
+    };
+
+    return Bench::Time(repeats, [&]() {
+      bands.reset();
+      for(int y = 0; y < in.height; ++y) {
+        const BandCache::Entry band = bands.acquire(y, fill);
+        for(int c = 0; c < 4; ++c) {
+          std::memcpy(out[c].data(), band->line(c, y), bytes);
+        }
+        if(band->y + band->rows < in.height) bands.prefetch(y, fill);
+      }
+    });
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int repeats = Bench::Repeats(argc, argv, 3);
+  const Format formats[] = {
+      {"2K", 2048, 1080}, {"4K", 4096, 2160}, {"8K", 8192, 4320}};
+
+  struct Case
+  {
+    const char* name;
+    TransformSettings settings;
+  };
+  Case cases[3];
+  cases[0].name = "LogC4 exact";
+  cases[0].settings.colorIn = Constants::COLOR_ARRI_LOG_C4;
+  cases[0].settings.colorOut = Constants::COLOR_SRGB;
+  cases[1].name = "LogC4 1D LUT";
+  cases[1].settings = cases[0].settings;
+  cases[1].settings.precision = Constants::PRECISION_LUT_1D;
+  cases[2].name = "D65 -> D50";
+  cases[2].settings.whiteIn = Constants::WHITE_D50;
+
+  std::printf("RGBA, best of %d, Mpixel/s\n", repeats);
+  std::printf("%-4s %-14s %10s %10s %10s\n", "fmt", "transform", "copy",
+              "rows", "bands");
+
+  for(const Format& format : formats) {
+    Image in;
+    in.width = format.width;
+    in.height = format.height;
+    Bench::MakePlate(in.width, in.height, in.channels[0], in.channels[1],
+                     in.channels[2]);
+    in.channels[3].assign(in.channels[0].size(), 1.0f);
+    const size_t pixels = in.channels[0].size();
+
+    for(const Case& c : cases) {
+      const TransformPlan plan = MakeTransformPlan(c.settings);
+
+      const double copy = RunRows(plan, in, true, repeats);
+      const double rows = RunRows(plan, in, false, repeats);
+      const double bands = RunBands(plan, in, repeats);
+      std::printf("%-4s %-14s %10.1f %10.1f %10.1f\n", format.name, c.name,
+                  Bench::MegaPixels(pixels, copy),
+                  Bench::MegaPixels(pixels, rows),
+                  Bench::MegaPixels(pixels, bands));
+    }
+  }
+
+  return 0;
+}
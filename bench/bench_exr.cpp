@@ -0,0 +1,200 @@
+// Built-in EXR I/O: encode and decode throughput per compression on a 2K
+// RGBA half plate, on one thread and on all of them, and decode with the
+// transform run per chunk against decode then a separate transform pass.
+//
+// Built with zlib (GCOLORSPACE_BENCH_ZLIB) it also times the deflate core
+// against zlib's on the same predicted chunk bytes, which is what OpenEXR's
+// ZIP codec spends its time in.
+//
+// usage: bench_exr [repeats]
+
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "bench/BenchUtils.h"
+#include "include/ExrIO.h"
+#include "include/TransformPlan.h"
+
+#ifdef GCOLORSPACE_BENCH_ZLIB
+#include <zlib.h>
+#endif
+
+namespace
+{
+  Exr::Image MakeImage(int width, int height)
+  {
+    Exr::Image image;
+    image.dataWindow = {0, 0, width - 1, height - 1};
+    image.displayWindow = image.dataWindow;
+    for(const char* name : {"A", "B", "G", "R"}) {
+      image.addChannel(name, Exr::PIXEL_HALF);
+    }
+    image.allocate();
+    Bench::MakePlate(width, height, image.planes[3], image.planes[2],
+                     image.planes[1]);
+    std::fill(image.planes[0].begin(), image.planes[0].end(), 1.0f);
+    // through half and back, so encoded files round trip exactly
+    for(FloatBuffer& plane : image.planes) {
+      for(float& v : plane) v = HalfToFloat(FloatToHalf(v));
+    }
+    return image;
+  }
+
+  void Transform(const TransformPlan& plan, Exr::Image& image, int row,
+                 int rows)
+  {
+    for(int y = row; y < row + rows; ++y) {
+      ApplyPlanar(plan, image.line(3, y), image.line(2, y), image.line(1, y),
+                  image.width());
+    }
+  }
+
+#ifdef GCOLORSPACE_BENCH_ZLIB
+  // ZIP chunks of 'image' after the predictor, as both deflate cores see them
+  std::vector<std::vector<uint8_t>> PredictedChunks(const Exr::Image& image)
+  {
+    const int width = image.width();
+    std::vector<std::vector<uint8_t>> chunks;
+    for(int row = 0; row < image.height(); row += 16) {
+      const int rows = std::min(16, image.height() - row);
+      std::vector<uint8_t> raw(static_cast<size_t>(rows) * width * 8);
+      uint8_t* to = raw.data();
+      for(int r = 0; r < rows; ++r) {
+        for(int c = 0; c < 4; ++c) {
+          ExrDetail::PackLine(image.line(c, row + r), Exr::PIXEL_HALF, width,
+                              to);
+          to += 2 * width;
+        }
+      }
+      chunks.emplace_back(raw.size());
+      ExrDetail::Predict(raw.data(), raw.size(), chunks.back().data());
+    }
+    return chunks;
+  }
+
+  void CompareDeflate(const Exr::Image& image, int repeats)
+  {
+    const std::vector<std::vector<uint8_t>> chunks = PredictedChunks(image);
+    size_t rawBytes = 0;
+    for(const auto& c : chunks) rawBytes += c.size();
+
+    std::vector<std::vector<uint8_t>> ours(chunks.size());
+    std::vector<std::vector<uint8_t>> theirs(chunks.size());
+    size_t oursBytes = 0, theirsBytes = 0;
+    const double oursDeflate = Bench::Time(repeats, [&]() {
+      for(size_t k = 0; k < chunks.size(); ++k) {
+        ours[k].clear();
+        Deflate(chunks[k].data(), chunks[k].size(), ours[k]);
+      }
+    });
+    // OpenEXR 3 writes ZIP at level 4, 2.x at zlib's default 6
+    const double zlibDeflate = Bench::Time(repeats, [&]() {
+      for(size_t k = 0; k < chunks.size(); ++k) {
+        uLongf size = compressBound(chunks[k].size());
+        theirs[k].resize(size);
+        compress2(theirs[k].data(), &size, chunks[k].data(), chunks[k].size(),
+                  4);
+        theirs[k].resize(size);
+      }
+    });
+    for(size_t k = 0; k < chunks.size(); ++k) {
+      oursBytes += ours[k].size();
+      theirsBytes += theirs[k].size();
+    }
+
+    std::vector<uint8_t> out(16 * image.width() * 8);
+    const double oursInflate = Bench::Time(repeats, [&]() {
+      for(size_t k = 0; k < chunks.size(); ++k) {
+        Inflate(theirs[k].data(), theirs[k].size(), out.data(),
+                chunks[k].size());
+      }
+    });
+    const double zlibInflate = Bench::Time(repeats, [&]() {
+      for(size_t k = 0; k < chunks.size(); ++k) {
+        uLongf size = out.size();
+        uncompress(out.data(), &size, theirs[k].data(), theirs[k].size());
+      }
+    });
+
+    const double mb = rawBytes / 1048576.0;
+    std::printf("\ndeflate core on %zu ZIP chunks, one thread, MB/s of raw "
+                "data\n", chunks.size());
+    std::printf("%-10s %10s %10s %10s\n", "", "deflate", "inflate", "ratio");
+    std::printf("%-10s %10.1f %10.1f %10.2f\n", "built-in", mb / oursDeflate,
+                mb / oursInflate, double(rawBytes) / oursBytes);
+    std::printf("%-10s %10.1f %10.1f %10.2f\n", "zlib", mb / zlibDeflate,
+                mb / zlibInflate, double(rawBytes) / theirsBytes);
+  }
+#endif
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int width = 2048;
+  const int height = 1080;
+  const int repeats = Bench::Repeats(argc, argv, 3);
+  const size_t pixels = static_cast<size_t>(width) * height;
+  const int threads = Exr::DefaultThreads();
+
+  Exr::Image image = MakeImage(width, height);
+  TransformSettings settings;
+  settings.colorIn = Constants::COLOR_ARRI_LOG_C4;
+  settings.colorOut = Constants::COLOR_SRGB;
+  const TransformPlan plan = MakeTransformPlan(settings);
+
+  std::printf("RGBA half %dx%d, best of %d, %d thread(s), Mpixel/s\n", width,
+              height, repeats, threads);
+  std::printf("%-6s %8s %8s %8s %8s %8s %8s\n", "", "ratio", "enc 1t",
+              "enc Nt", "dec 1t", "dec Nt", "fused");
+
+  for(int c = 0; c < Exr::COMPRESSION_COUNT; ++c) {
+    image.compression = c;
+    std::vector<uint8_t> file;
+    const double encode1 =
+        Bench::Time(repeats, [&]() { Exr::Encode(image, file, nullptr, 1); });
+    const double encodeN = Bench::Time(
+        repeats, [&]() { Exr::Encode(image, file, nullptr, threads); });
+
+    Exr::Image back;
+    const double decode1 = Bench::Time(repeats, [&]() {
+      Exr::Decode(file.data(), file.size(), back, nullptr, nullptr, 1);
+    });
+    const double decodeN = Bench::Time(repeats, [&]() {
+      Exr::Decode(file.data(), file.size(), back, nullptr, nullptr, threads);
+    });
+    if(back.planes != image.planes) {
+      std::printf("%s: round trip mismatch\n", Exr::COMPRESSION[c]);
+      return 1;
+    }
+
+    // decode and transform: a second pass over the frame, then fused
+    const double separate = Bench::Time(repeats, [&]() {
+      Exr::Decode(file.data(), file.size(), back, nullptr, nullptr, threads);
+      Transform(plan, back, 0, height);
+    });
+    const double fused = Bench::Time(repeats, [&]() {
+      Exr::Decode(
+          file.data(), file.size(), back, nullptr,
+          [&](Exr::Image& img, int row, int rows) {
+            Transform(plan, img, row, rows);
+          },
+          threads);
+    });
+
+    const size_t raw = pixels * 4 * 2;
+    std::printf("%-6s %8.2f %8.1f %8.1f %8.1f %8.1f %8.1f (separate %.1f)\n",
+                Exr::COMPRESSION[c], double(raw) / file.size(),
+                Bench::MegaPixels(pixels, encode1),
+                Bench::MegaPixels(pixels, encodeN),
+                Bench::MegaPixels(pixels, decode1),
+                Bench::MegaPixels(pixels, decodeN),
+                Bench::MegaPixels(pixels, fused),
+                Bench::MegaPixels(pixels, separate));
+  }
+
+#ifdef GCOLORSPACE_BENCH_ZLIB
+  CompareDeflate(image, repeats);
+#endif
+  return 0;
+}
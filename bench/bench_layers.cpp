@@ -0,0 +1,79 @@
+// Multi-layer rows: a beauty plus AOVs with the same transform, converted
+// with one ApplyPlanar call per layer against one batched call per row.
+//
+// usage: bench_layers [repeats]
+
+#include <cstdio>
+#include <vector>
+
+#include "bench/BenchUtils.h"
+#include "include/TransformPlan.h"
+
+int main(int argc, char** argv)
+{
+  const int width = 2048;
+  const int height = 1080;
+  const int layerCount = 12;
+  const int repeats = Bench::Repeats(argc, argv, 3);
+  const size_t pixels = static_cast<size_t>(width) * height * layerCount;
+
+  std::vector<float> in[layerCount][3];
+  std::vector<float> out[layerCount][3];
+  for(int l = 0; l < layerCount; ++l) {
+    Bench::MakePlate(width, height, in[l][0], in[l][1], in[l][2], l + 1);
+    for(int c = 0; c < 3; ++c) out[l][c].resize(width);
+  }
+
+  struct Case
+  {
+    const char* name;
+    TransformSettings settings;
+  };
+  Case cases[3];
+  cases[0].name = "LogC4 exact";
+  cases[0].settings.colorIn = Constants::COLOR_ARRI_LOG_C4;
+  cases[0].settings.colorOut = Constants::COLOR_SRGB;
+  cases[1].name = "LogC4 3D LUT";
+  cases[1].settings = cases[0].settings;
+  cases[1].settings.precision = Constants::PRECISION_LUT_3D_33;
+  cases[2].name = "D65 -> D50";
+  cases[2].settings.whiteIn = Constants::WHITE_D50;
+
+  std::printf("%d layers of %dx%d, best of %d, Mpixel/s\n", layerCount,
+              width, height, repeats);
+  std::printf("%-14s %10s %10s\n", "transform", "per layer", "batched");
+
+  for(const Case& c : cases) {
+    const TransformPlan plan = MakeTransformPlan(c.settings);
+
+    const double perLayer = Bench::Time(repeats, [&]() {
+      for(int y = 0; y < height; ++y) {
+        const size_t row = static_cast<size_t>(y) * width;
+        for(int l = 0; l < layerCount; ++l) {
+          ApplyPlanar(plan, &in[l][0][row], &in[l][1][row], &in[l][2][row],
+                      out[l][0].data(), out[l][1].data(), out[l][2].data(),
+                      width);
+        }
+      }
+    });
+
+    PlanarLayer layers[layerCount];
+    const double batched = Bench::Time(repeats, [&]() {
+      for(int y = 0; y < height; ++y) {
+        const size_t row = static_cast<size_t>(y) * width;
+        for(int l = 0; l < layerCount; ++l) {
+          layers[l] = {&in[l][0][row],   &in[l][1][row],
+                       &in[l][2][row],   out[l][0].data(),
+                       out[l][1].data(), out[l][2].data()};
+        }
+        ApplyPlanar(plan, layers, layerCount, width);
+      }
+    });
+
+    std::printf("%-14s %10.1f %10.1f\n", c.name,
+                Bench::MegaPixels(pixels, perLayer),
+                Bench::MegaPixels(pixels, batched));
+  }
+
+  return 0;
+}
@@ -0,0 +1,97 @@
+// 3D LUT storage layouts: row-major float against half entries and tiled
+// bricks, on a smooth plate (neighbouring pixels hit neighbouring cells) and
+// on uniform noise (every pixel a random cell).
+//
+// usage: bench_lut [repeats]
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bench/BenchUtils.h"
+#include "include/TransformPlan.h"
+
+namespace
+{
+  // the LUT domain only, so no pixel falls back to the exact path
+  void Clamp01(std::vector<float>& v)
+  {
+    for(float& x : v) x = std::min(std::max(x, 0.0f), 1.0f);
+  }
+
+  void MakeNoise(size_t n, std::vector<float>& r, std::vector<float>& g,
+                 std::vector<float>& b)
+  {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    r.resize(n);
+    g.resize(n);
+    b.resize(n);
+    for(size_t i = 0; i < n; ++i) {
+      r[i] = u(rng);
+      g[i] = u(rng);
+      b[i] = u(rng);
+    }
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int width = 1920;
+  const int height = 1080;
+  const int repeats = Bench::Repeats(argc, argv, 5);
+  const size_t pixels = static_cast<size_t>(width) * height;
+
+  std::vector<float> plate[3], noise[3];
+  Bench::MakePlate(width, height, plate[0], plate[1], plate[2]);
+  for(std::vector<float>& c : plate) Clamp01(c);
+  MakeNoise(pixels, noise[0], noise[1], noise[2]);
+
+  std::printf("ARRILogC4 -> L*a*b*, %dx%d, best of %d, Mpixel/s\n", width,
+              height, repeats);
+  std::printf("%-8s %-12s %10s %10s %10s\n", "cube", "storage", "MB", "plate",
+              "noise");
+
+  const int tiers[] = {Constants::PRECISION_LUT_3D_33,
+                       Constants::PRECISION_LUT_3D_65};
+  for(int precision : tiers) {
+    for(int storage = 0; storage < Constants::LUT_STORAGE_COUNT; ++storage) {
+      TransformSettings settings;
+      settings.colorIn = Constants::COLOR_ARRI_LOG_C4;
+      settings.colorOut = Constants::COLOR_LAB;
+      settings.precision = precision;
+      settings.lutStorage = storage;
+      const TransformPlan plan = MakeTransformPlan(settings);
+      const BakedLut* lut = plan.lut->get();
+
+      std::vector<float> r, g, b;
+      auto run = [&](const std::vector<float>* src) {
+        return Bench::Time(repeats, [&]() {
+                 r = src[0];
+                 g = src[1];
+                 b = src[2];
+                 for(int y = 0; y < height; ++y) {
+                   const size_t row = static_cast<size_t>(y) * width;
+                   ApplyPlanar(plan, &r[row], &g[row], &b[row], width);
+                 }
+               }) -
+               Bench::Time(repeats, [&]() {
+                 r = src[0];
+                 g = src[1];
+                 b = src[2];
+               });
+      };
+      const double onPlate = run(plate);
+      const double onNoise = run(noise);
+
+      std::printf("%-8s %-12s %10.2f %10.1f %10.1f\n",
+                  Constants::PRECISION[precision],
+                  Constants::LUT_STORAGE[storage],
+                  lut->cube.words() * sizeof(float) / 1048576.0,
+                  Bench::MegaPixels(pixels, onPlate),
+                  Bench::MegaPixels(pixels, onNoise));
+    }
+  }
+
+  return 0;
+}
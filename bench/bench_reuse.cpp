@@ -0,0 +1,113 @@
+// Run and memo reuse on three kinds of content: a graded plate (noisy, the
+// probe should keep it on the plain kernel), a CG frame with letterbox bars
+// and a flat background, and a posterized graphic of a few colours.
+//
+// usage: bench_reuse [repeats]
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "bench/BenchUtils.h"
+#include "include/TransformPlan.h"
+
+namespace
+{
+  void MakeCG(int width, int height, std::vector<float>& r,
+              std::vector<float>& g, std::vector<float>& b)
+  {
+    Bench::MakePlate(width, height, r, g, b, 2);
+    const int bar = height / 8;
+    for(int y = 0; y < height; ++y) {
+      for(int x = 0; x < width; ++x) {
+        const size_t i = static_cast<size_t>(y) * width + x;
+        const bool letterbox = y < bar || y >= height - bar;
+        const bool background = x < width / 4 || x >= width * 3 / 4;
+        if(letterbox) {
+          r[i] = g[i] = b[i] = 0.0f;
+        }
+        else if(background) {
+          r[i] = 0.18f;
+          g[i] = 0.2f;
+          b[i] = 0.22f;
+        }
+      }
+    }
+  }
+
+  void MakePosterized(int width, int height, std::vector<float>& r,
+                      std::vector<float>& g, std::vector<float>& b)
+  {
+    const float palette[6][3] = {{0.9f, 0.1f, 0.1f}, {0.1f, 0.8f, 0.2f},
+                                 {0.1f, 0.2f, 0.9f}, {0.95f, 0.9f, 0.2f},
+                                 {0.5f, 0.5f, 0.5f}, {0.05f, 0.05f, 0.1f}};
+    std::mt19937 rng(5);
+    const size_t n = static_cast<size_t>(width) * height;
+    r.resize(n);
+    g.resize(n);
+    b.resize(n);
+    for(size_t i = 0; i < n; ++i) {
+      const float* c = palette[rng() % 6];
+      r[i] = c[0];
+      g[i] = c[1];
+      b[i] = c[2];
+    }
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const int width = 2048;
+  const int height = 1080;
+  const int repeats = Bench::Repeats(argc, argv, 3);
+  const size_t pixels = static_cast<size_t>(width) * height;
+
+  struct Plate
+  {
+    const char* name;
+    std::vector<float> r, g, b;
+  };
+  Plate plates[3];
+  plates[0].name = "graded plate";
+  Bench::MakePlate(width, height, plates[0].r, plates[0].g, plates[0].b);
+  plates[1].name = "CG letterbox";
+  MakeCG(width, height, plates[1].r, plates[1].g, plates[1].b);
+  plates[2].name = "posterized";
+  MakePosterized(width, height, plates[2].r, plates[2].g, plates[2].b);
+
+  TransformSettings settings;
+  settings.colorIn = Constants::COLOR_ARRI_LOG_C4;
+  settings.colorOut = Constants::COLOR_LAB;
+  const TransformPlan plan = MakeTransformPlan(settings);
+
+  std::printf("ARRILogC4 -> L*a*b*, %dx%d, best of %d, Mpixel/s\n", width,
+              height, repeats);
+  std::printf("%-14s %10s %10s\n", "content", "plain", "reuse");
+
+  std::vector<float> out[3];
+  for(std::vector<float>& c : out) c.resize(width);
+
+  for(const Plate& p : plates) {
+    const double plain = Bench::Time(repeats, [&]() {
+      for(int y = 0; y < height; ++y) {
+        const size_t row = static_cast<size_t>(y) * width;
+        ApplyPlanar(plan, &p.r[row], &p.g[row], &p.b[row], out[0].data(),
+                    out[1].data(), out[2].data(), width);
+      }
+    });
+    const double reuse = Bench::Time(repeats, [&]() {
+      for(int y = 0; y < height; ++y) {
+        const size_t row = static_cast<size_t>(y) * width;
+        const PlanarLayer layer = {&p.r[row],     &p.g[row],
+                                   &p.b[row],     out[0].data(),
+                                   out[1].data(), out[2].data()};
+        ApplyPlanar(plan, &layer, 1, width);
+      }
+    });
+    std::printf("%-14s %10.1f %10.1f\n", p.name,
+                Bench::MegaPixels(pixels, plain),
+                Bench::MegaPixels(pixels, reuse));
+  }
+
+  return 0;
+}
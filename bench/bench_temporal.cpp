@@ -0,0 +1,82 @@
+// Temporal row cache on a locked-off shot: a static plate where a small
+// object moves through a tenth of the rows every frame, converted frame by
+// frame with and without RowCache, the way the node's rows engine does.
+//
+// usage: bench_temporal [repeats]
+
+#include <cstdio>
+#include <vector>
+
+#include "bench/BenchUtils.h"
+#include "include/RowCache.h"
+#include "include/TransformPlan.h"
+
+int main(int argc, char** argv)
+{
+  const int width = 2048;
+  const int height = 1080;
+  const int frames = 8;
+  const int repeats = Bench::Repeats(argc, argv, 3);
+  const size_t pixels = static_cast<size_t>(width) * height * frames;
+
+  std::vector<float> r, g, b;
+  Bench::MakePlate(width, height, r, g, b);
+  std::vector<float> out[3];
+  for(std::vector<float>& c : out) c.resize(width);
+
+  TransformSettings settings;
+  settings.colorIn = Constants::COLOR_ARRI_LOG_C4;
+  settings.colorOut = Constants::COLOR_LAB;
+  const TransformPlan plan = MakeTransformPlan(settings);
+  const uint64_t salt = LutKeyHash()(TransformDetail::MakeLutKey(plan));
+
+  // the object covers rows [frame * step, frame * step + height / 10)
+  auto render = [&](std::vector<float>& red, int frame, bool cached) {
+    const int step = height / frames;
+    const int top = frame * step;
+    for(int y = top; y < top + height / 10 && y < height; ++y) {
+      for(int x = width / 3; x < width / 3 + 64; ++x) {
+        red[static_cast<size_t>(y) * width + x] += 0.25f;
+      }
+    }
+
+    for(int y = 0; y < height; ++y) {
+      const size_t row = static_cast<size_t>(y) * width;
+      PlanarLayer layer = {&red[row],     &g[row],       &b[row],
+                           out[0].data(), out[1].data(), out[2].data()};
+      if(!cached) {
+        ApplyPlanar(plan, &layer, 1, width);
+        continue;
+      }
+      const uint64_t hash = RowCache::Hash(salt, layer, width);
+      if(RowCache::instance().lookup(hash, salt, layer, width)) continue;
+      ApplyPlanar(plan, &layer, 1, width);
+      RowCache::instance().store(hash, salt, layer, width);
+    }
+
+    for(int y = top; y < top + height / 10 && y < height; ++y) {
+      for(int x = width / 3; x < width / 3 + 64; ++x) {
+        red[static_cast<size_t>(y) * width + x] -= 0.25f;
+      }
+    }
+  };
+
+  std::vector<float> red = r;
+  const double plain = Bench::Time(repeats, [&]() {
+    for(int f = 0; f < frames; ++f) render(red, f, false);
+  });
+  const double cached = Bench::Time(repeats, [&]() {
+    RowCache::instance().clear();
+    for(int f = 0; f < frames; ++f) render(red, f, true);
+  });
+  const RowCache::Stats stats = RowCache::instance().stats();
+
+  std::printf("ARRILogC4 -> L*a*b*, %d frames of %dx%d, best of %d\n", frames,
+              width, height, repeats);
+  std::printf("plain  %8.1f Mpixel/s\n", Bench::MegaPixels(pixels, plain));
+  std::printf("cached %8.1f Mpixel/s, %.1f%% rows reused, %zu MB\n",
+              Bench::MegaPixels(pixels, cached),
+              100.0 * stats.hits / (stats.hits + stats.misses),
+              stats.bytes >> 20);
+  return 0;
+}
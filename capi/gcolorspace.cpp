@@ -0,0 +1,460 @@
+// C interface of the transform core, see gcolorspace.h.
+//
+// Applying splits the image into row segments that the WorkerTeam threads
+// and the caller take in turn. Layouts the plan has no kernel for (planar
+// half, interleaved RGB) go through a small float block on the stack, so
+// nothing is allocated once the transform exists.
+
+#define GCOLORSPACE_C_BUILD
+
+#include "capi/gcolorspace.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include "include/Constants.h"
+#include "include/CubeLut.h"
+#include "include/Half.h"
+#include "include/ThreadPool.h"
+#include "include/TransformPlan.h"
+
+struct gcs_transform
+{
+  TransformPlan plan;
+};
+
+namespace
+{
+  // ABI value -> Constants value. The C enums never change, so a reordered
+  // menu only needs its table updated here.
+  const int kColorspaces[] = {
+      Constants::COLOR_GAMMA_1_80,    Constants::COLOR_GAMMA_2_20,
+      Constants::COLOR_GAMMA_2_40,    Constants::COLOR_GAMMA_2_60,
+      Constants::COLOR_REC709,        Constants::COLOR_SRGB,
+      Constants::COLOR_CINEON,        Constants::COLOR_LINEAR,
+      Constants::COLOR_HSV,           Constants::COLOR_HSL,
+      Constants::COLOR_Y_PB_PR,       Constants::COLOR_Y_CB_CR,
+      Constants::COLOR_CIE_XYZ,       Constants::COLOR_CIE_YXY,
+      Constants::COLOR_LAB,           Constants::COLOR_CIE_LCH,
+      Constants::COLOR_PANALOG,       Constants::COLOR_REDLOG,
+      Constants::COLOR_VIPERLOG,      Constants::COLOR_ALEXAV3LOGC,
+      Constants::COLOR_PLOGLIN,       Constants::COLOR_SLOG,
+      Constants::COLOR_SLOG1,         Constants::COLOR_SLOG2,
+      Constants::COLOR_SLOG3,         Constants::COLOR_CLOG,
+      Constants::COLOR_LOG3G10,       Constants::COLOR_LOG3G12,
+      Constants::COLOR_HYBRID_LOG_GAMMA, Constants::COLOR_PROTUNE,
+      Constants::COLOR_BT1886,        Constants::COLOR_ST2084,
+      Constants::COLOR_BLACKMAGIC_GEN5, Constants::COLOR_ARRI_LOG_C4};
+
+  const int kWhitepoints[] = {
+      Constants::WHITE_A,   Constants::WHITE_B,      Constants::WHITE_C,
+      Constants::WHITE_D50, Constants::WHITE_D55,    Constants::WHITE_D58,
+      Constants::WHITE_D65, Constants::WHITE_D75,    Constants::WHITE_9300,
+      Constants::WHITE_E,   Constants::WHITE_F2,     Constants::WHITE_F7,
+      Constants::WHITE_F11, Constants::WHITE_DCI_P3, Constants::WHITE_ACES};
+
+  const int kPrimaries[] = {
+      Constants::PRIM_COLOR_ADOBE_1998,    Constants::PRIM_COLOR_APPLE,
+      Constants::PRIM_COLOR_BEST_RGB,      Constants::PRIM_COLOR_BETA_RGB,
+      Constants::PRIM_COLOR_BRUCE_RGB,     Constants::PRIM_COLOR_CIE_1931,
+      Constants::PRIM_COLOR_COLORMATCH,    Constants::PRIM_COLOR_DCI_P3,
+      Constants::PRIM_COLOR_DON_RGB_4,     Constants::PRIM_COLOR_ECI_RGB,
+      Constants::PRIM_COLOR_EKTA_SPACE_PS5, Constants::PRIM_COLOR_NTSC_1953,
+      Constants::PRIM_COLOR_PAL_SECAM,     Constants::PRIM_COLOR_PROPHOTO,
+      Constants::PRIM_COLOR_SMPTE_C,       Constants::PRIM_COLOR_SRGB,
+      Constants::PRIM_COLOR_WIDE_GAMUT,    Constants::PRIM_COLOR_ALEXAV3LOGC,
+      Constants::PRIM_COLOR_SONY_S_GAMUT,  Constants::PRIM_COLOR_ACES,
+      Constants::PRIM_COLOR_REC_2020,
+      Constants::PRIM_COLOR_ARRI_WIDE_GAMUT4};
+
+  const int kPrecisions[] = {
+      Constants::PRECISION_EXACT, Constants::PRECISION_LUT_1D,
+      Constants::PRECISION_LUT_3D_33, Constants::PRECISION_LUT_3D_65,
+      Constants::PRECISION_AUTO};
+
+  // a new menu entry needs its ABI value first
+  static_assert(sizeof(kColorspaces) / sizeof(int) == GCS_COLOR_COUNT &&
+                    int(GCS_COLOR_COUNT) == Constants::COLORSPACE_COUNT,
+                "colorspaces out of sync");
+  static_assert(sizeof(kWhitepoints) / sizeof(int) == GCS_WHITE_COUNT &&
+                    int(GCS_WHITE_COUNT) == Constants::WHITE_COUNT,
+                "whitepoints out of sync");
+  static_assert(sizeof(kPrimaries) / sizeof(int) == GCS_PRIM_COUNT &&
+                    int(GCS_PRIM_COUNT) == Constants::PRIM_COLOR_COUNT,
+                "primaries out of sync");
+  static_assert(sizeof(kPrecisions) / sizeof(int) ==
+                    Constants::PRECISION_COUNT,
+                "precisions out of sync");
+
+  // pixels per work item and per stack block
+  constexpr int kSegment = 8192;
+  constexpr int kBlock = 512;
+
+  // one team for every transform, the caller is one of its threads
+  WorkerTeam& Team()
+  {
+    static WorkerTeam team([]() {
+      if(const char* env = std::getenv("GCOLORSPACE_API_THREADS")) {
+        const unsigned n =
+            static_cast<unsigned>(std::strtoul(env, nullptr, 10));
+        return n > 0 ? n - 1 : 0u;
+      }
+      const unsigned cores = std::thread::hardware_concurrency();
+      return cores > 1 ? cores - 1 : 0u;
+    }());
+    return team;
+  }
+
+  bool Lookup(const int* table, int count, int value, int& out)
+  {
+    if(value < 0 || value >= count) return false;
+    out = table[value];
+    return true;
+  }
+
+  const char* Name(const char* const* menu, const int* table, int count,
+                   int value)
+  {
+    return value >= 0 && value < count ? menu[table[value]] : nullptr;
+  }
+
+  int Find(const char* const* menu, const int* table, int count,
+           const char* name)
+  {
+    if(name == nullptr) return -1;
+    for(int i = 0; i < count; ++i) {
+      if(!std::strcmp(menu[table[i]], name)) return i;
+    }
+    return -1;
+  }
+
+  void SetError(char* error, size_t size, const std::string& message)
+  {
+    if(error != nullptr && size > 0) {
+      std::snprintf(error, size, "%s", message.c_str());
+    }
+  }
+
+  template <typename T>
+  T* Pixel(void* base, ptrdiff_t stride, int y, int x, int channels)
+  {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + stride * y) +
+           static_cast<ptrdiff_t>(x) * channels;
+  }
+
+  void HalfToFloats(const uint16_t* src, float* dst, int n)
+  {
+    int i = 0;
+    for(; i + Simd::kWidth <= n; i += Simd::kWidth) {
+      Simd::store(dst + i, Simd::loadHalf(src + i));
+    }
+    for(; i < n; ++i) dst[i] = HalfToFloat(src[i]);
+  }
+
+  void FloatsToHalf(const float* src, uint16_t* dst, int n)
+  {
+    int i = 0;
+    for(; i + Simd::kWidth <= n; i += Simd::kWidth) {
+      Simd::storeHalf(dst + i, Simd::load(src + i));
+    }
+    for(; i < n; ++i) dst[i] = FloatToHalf(src[i]);
+  }
+
+  void PlanarHalf(const TransformPlan& plan, uint16_t* r, uint16_t* g,
+                  uint16_t* b, int n)
+  {
+    float block[3][kBlock];
+    for(int x = 0; x < n; x += kBlock) {
+      const int count = std::min(kBlock, n - x);
+      HalfToFloats(r + x, block[0], count);
+      HalfToFloats(g + x, block[1], count);
+      HalfToFloats(b + x, block[2], count);
+      ApplyPlanar(plan, block[0], block[1], block[2], count);
+      FloatsToHalf(block[0], r + x, count);
+      FloatsToHalf(block[1], g + x, count);
+      FloatsToHalf(block[2], b + x, count);
+    }
+  }
+
+  // interleaved RGB through planar blocks
+  template <typename T>
+  void InterleavedRGB(const TransformPlan& plan, T* rgb, int n)
+  {
+    float block[3][kBlock];
+    float staged[3 * kBlock];
+    for(int x = 0; x < n; x += kBlock) {
+      const int count = std::min(kBlock, n - x);
+      T* p = rgb + 3 * static_cast<ptrdiff_t>(x);
+      const float* src = staged;
+      if(std::is_same<T, uint16_t>::value) {
+        HalfToFloats(reinterpret_cast<const uint16_t*>(p), staged, 3 * count);
+      }
+      else {
+        src = reinterpret_cast<const float*>(p);
+      }
+      for(int i = 0; i < count; ++i) {
+        block[0][i] = src[3 * i];
+        block[1][i] = src[3 * i + 1];
+        block[2][i] = src[3 * i + 2];
+      }
+      ApplyPlanar(plan, block[0], block[1], block[2], count);
+      float* dst = std::is_same<T, uint16_t>::value
+                       ? staged
+                       : reinterpret_cast<float*>(p);
+      for(int i = 0; i < count; ++i) {
+        dst[3 * i] = block[0][i];
+        dst[3 * i + 1] = block[1][i];
+        dst[3 * i + 2] = block[2][i];
+      }
+      if(std::is_same<T, uint16_t>::value) {
+        FloatsToHalf(staged, reinterpret_cast<uint16_t*>(p), 3 * count);
+      }
+    }
+  }
+
+  // fn(y, x, n) over row segments of at most kSegment pixels
+  template <typename Fn>
+  void Segments(int width, int height, int threads, Fn fn)
+  {
+    const int perRow = (width + kSegment - 1) / kSegment;
+    auto item = [&](int i) {
+      const int y = i / perRow;
+      const int x = (i % perRow) * kSegment;
+      fn(y, x, std::min(kSegment, width - x));
+    };
+    Team().run(perRow * height, threads, item);
+  }
+
+  bool ValidImage(const gcs_transform* transform, gcs_pixel_type type,
+                  int width, int height)
+  {
+    return transform != nullptr && width >= 0 && height >= 0 &&
+           (type == GCS_FLOAT32 || type == GCS_FLOAT16);
+  }
+}  // namespace
+
+extern "C" {
+
+int gcs_api_version(void)
+{
+  return GCS_API_VERSION;
+}
+
+void gcs_settings_init(gcs_settings* s, size_t size)
+{
+  if(s == nullptr) return;
+  gcs_settings d;
+  d.color_in = GCS_COLOR_LINEAR;
+  d.color_out = GCS_COLOR_LINEAR;
+  d.white_in = GCS_WHITE_D65;
+  d.white_out = GCS_WHITE_D65;
+  d.primary_in = GCS_PRIM_SRGB;
+  d.primary_out = GCS_PRIM_SRGB;
+  d.cat = GCS_CAT_CAT02;
+  d.ycbcr_matrix = GCS_YCC_REC709;
+  d.ycbcr_range = GCS_YCC_RANGE_LEGAL;
+  d.precision = GCS_PRECISION_EXACT;
+  d.tolerance = 1e-3f;
+  d.bit_exact = 0;
+  d.lut_file = nullptr;
+  d.lut_after = 0;
+  std::memcpy(s, &d, std::min(size, sizeof(d)));
+}
+
+gcs_status gcs_transform_create(const gcs_settings* settings, size_t size,
+                                gcs_transform** transform, char* error,
+                                size_t error_size)
+{
+  if(transform == nullptr) return GCS_ERROR_ARGUMENT;
+  *transform = nullptr;
+  if(settings == nullptr || size == 0) {
+    SetError(error, error_size, "no settings");
+    return GCS_ERROR_ARGUMENT;
+  }
+
+  // fields the caller does not know keep their defaults
+  gcs_settings c;
+  gcs_settings_init(&c, sizeof(c));
+  std::memcpy(&c, settings, std::min(size, sizeof(c)));
+
+  TransformSettings s;
+  const bool known =
+      Lookup(kColorspaces, GCS_COLOR_COUNT, c.color_in, s.colorIn) &&
+      Lookup(kColorspaces, GCS_COLOR_COUNT, c.color_out, s.colorOut) &&
+      Lookup(kWhitepoints, GCS_WHITE_COUNT, c.white_in, s.whiteIn) &&
+      Lookup(kWhitepoints, GCS_WHITE_COUNT, c.white_out, s.whiteOut) &&
+      Lookup(kPrimaries, GCS_PRIM_COUNT, c.primary_in, s.primaryIn) &&
+      Lookup(kPrimaries, GCS_PRIM_COUNT, c.primary_out, s.primaryOut) &&
+      Lookup(kPrecisions, Constants::PRECISION_COUNT, c.precision,
+             s.precision) &&
+      (c.cat == GCS_CAT_CAT02 || c.cat == GCS_CAT_BRADFORD) &&
+      c.ycbcr_matrix >= 0 && c.ycbcr_matrix < Constants::YCC_MATRIX_COUNT &&
+      c.ycbcr_range >= 0 && c.ycbcr_range < Constants::YCC_RANGE_COUNT;
+  if(!known) {
+    SetError(error, error_size, "unknown enum value in the settings");
+    return GCS_ERROR_ARGUMENT;
+  }
+  s.bradford = c.cat == GCS_CAT_BRADFORD;
+  s.ycbcrMatrix = c.ycbcr_matrix;
+  s.ycbcrRange = c.ycbcr_range;
+  s.tolerance = c.tolerance;
+  s.bitExact = c.bit_exact != 0;
+  s.lutFilePosition =
+      c.lut_after ? Constants::LUT_FILE_AFTER : Constants::LUT_FILE_BEFORE;
+  // bake now, applying must not wait or run exact meanwhile
+  s.backgroundBake = false;
+
+  try {
+    if(c.lut_file != nullptr) {
+      std::string message;
+      s.lutFile = CubeLutCache::instance().load(c.lut_file, &message);
+      if(s.lutFile == nullptr) {
+        SetError(error, error_size, message);
+        return GCS_ERROR_LUT_FILE;
+      }
+    }
+    // the threads start with the first transform, not the first apply
+    Team();
+    *transform = new gcs_transform{MakeTransformPlan(s)};
+  }
+  catch(const std::exception& e) {
+    SetError(error, error_size, e.what());
+    return GCS_ERROR_INTERNAL;
+  }
+  return GCS_OK;
+}
+
+void gcs_transform_destroy(gcs_transform* transform)
+{
+  delete transform;
+}
+
+gcs_status gcs_apply_planar(const gcs_transform* transform,
+                            gcs_pixel_type type, void* r, void* g, void* b,
+                            int width, int height, ptrdiff_t row_stride,
+                            int threads)
+{
+  if(!ValidImage(transform, type, width, height) || r == nullptr ||
+     g == nullptr || b == nullptr) {
+    return GCS_ERROR_ARGUMENT;
+  }
+  const TransformPlan& plan = transform->plan;
+  if(plan.identity) return GCS_OK;
+
+  if(type == GCS_FLOAT32) {
+    const ptrdiff_t stride =
+        row_stride ? row_stride : width * static_cast<ptrdiff_t>(4);
+    Segments(width, height, threads, [&](int y, int x, int n) {
+      ApplyPlanar(plan, Pixel<float>(r, stride, y, x, 1),
+                  Pixel<float>(g, stride, y, x, 1),
+                  Pixel<float>(b, stride, y, x, 1), n);
+    });
+  }
+  else {
+    const ptrdiff_t stride =
+        row_stride ? row_stride : width * static_cast<ptrdiff_t>(2);
+    Segments(width, height, threads, [&](int y, int x, int n) {
+      PlanarHalf(plan, Pixel<uint16_t>(r, stride, y, x, 1),
+                 Pixel<uint16_t>(g, stride, y, x, 1),
+                 Pixel<uint16_t>(b, stride, y, x, 1), n);
+    });
+  }
+  return GCS_OK;
+}
+
+gcs_status gcs_apply_interleaved(const gcs_transform* transform,
+                                 gcs_pixel_type type, void* pixels, int width,
+                                 int height, int channels,
+                                 ptrdiff_t row_stride, int threads)
+{
+  if(!ValidImage(transform, type, width, height) || pixels == nullptr ||
+     (channels != 3 && channels != 4)) {
+    return GCS_ERROR_ARGUMENT;
+  }
+  const TransformPlan& plan = transform->plan;
+  if(plan.identity) return GCS_OK;
+
+  const ptrdiff_t bytes = type == GCS_FLOAT32 ? 4 : 2;
+  const ptrdiff_t stride =
+      row_stride ? row_stride : width * channels * bytes;
+  if(type == GCS_FLOAT32) {
+    Segments(width, height, threads, [&](int y, int x, int n) {
+      float* p = Pixel<float>(pixels, stride, y, x, channels);
+      if(channels == 4) {
+        ApplyRGBA(plan, p, n);
+      }
+      else {
+        InterleavedRGB(plan, p, n);
+      }
+    });
+  }
+  else {
+    Segments(width, height, threads, [&](int y, int x, int n) {
+      uint16_t* p = Pixel<uint16_t>(pixels, stride, y, x, channels);
+      if(channels == 4) {
+        ApplyRGBA(plan, p, n);
+      }
+      else {
+        InterleavedRGB(plan, p, n);
+      }
+    });
+  }
+  return GCS_OK;
+}
+
+const char* gcs_colorspace_name(int colorspace)
+{
+  return Name(Constants::COLOR_CURVE, kColorspaces, GCS_COLOR_COUNT,
+              colorspace);
+}
+
+const char* gcs_whitepoint_name(int whitepoint)
+{
+  return Name(Constants::WHITEPOINT, kWhitepoints, GCS_WHITE_COUNT,
+              whitepoint);
+}
+
+const char* gcs_primaries_name(int primaries)
+{
+  return Name(Constants::PRIMARY_RGB, kPrimaries, GCS_PRIM_COUNT, primaries);
+}
+
+int gcs_colorspace_find(const char* name)
+{
+  return Find(Constants::COLOR_CURVE, kColorspaces, GCS_COLOR_COUNT, name);
+}
+
+int gcs_whitepoint_find(const char* name)
+{
+  return Find(Constants::WHITEPOINT, kWhitepoints, GCS_WHITE_COUNT, name);
+}
+
+int gcs_primaries_find(const char* name)
+{
+  return Find(Constants::PRIMARY_RGB, kPrimaries, GCS_PRIM_COUNT, name);
+}
+
+const char* gcs_status_string(gcs_status status)
+{
+  switch(status) {
+    case GCS_OK:
+      return "ok";
+    case GCS_ERROR_ARGUMENT:
+      return "invalid argument";
+    case GCS_ERROR_LUT_FILE:
+      return "LUT file error";
+    case GCS_ERROR_CONNECTION:
+      return "daemon connection error";
+    default:
+      return "internal error";
+  }
+}
+
+}  // extern "C"
@@ -0,0 +1,287 @@
+#ifndef GCOLORSPACE_C_H
+#define GCOLORSPACE_C_H
+
+/*
+ * C interface to the GColorspace transform core, for hosts that cannot link
+ * against DDImage (players, browsers, thumbnailers).
+ *
+ * A transform is compiled once from its settings and then applied to any
+ * number of images. Applying never allocates and may run on many threads at
+ * once on the same transform. The enum values below are part of the ABI:
+ * they never change, new entries are only appended.
+ *
+ *   gcs_settings s;
+ *   gcs_settings_init(&s, sizeof(s));
+ *   s.color_in = GCS_COLOR_ARRI_LOG_C4;
+ *   s.color_out = GCS_COLOR_SRGB;
+ *   gcs_transform* t;
+ *   if(gcs_transform_create(&s, sizeof(s), &t, error, sizeof(error)) ==
+ *      GCS_OK) {
+ *     gcs_apply_interleaved(t, GCS_FLOAT16, pixels, width, height, 4, 0, 0);
+ *     gcs_transform_destroy(t);
+ *   }
+ */
+
+#include <stddef.h>
+
+#if defined(_WIN32)
+#if defined(GCOLORSPACE_C_BUILD)
+#define GCS_API __declspec(dllexport)
+#else
+#define GCS_API __declspec(dllimport)
+#endif
+#else
+#define GCS_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GCS_API_VERSION 1
+
+typedef struct gcs_transform gcs_transform;
+
+typedef enum gcs_status {
+  GCS_OK = 0,
+  GCS_ERROR_ARGUMENT = 1, /* null pointer, unknown enum, bad size */
+  GCS_ERROR_LUT_FILE = 2, /* the .cube file could not be read */
+  GCS_ERROR_INTERNAL = 3,
+  GCS_ERROR_CONNECTION = 4 /* no daemon, or it went away: reconnect */
+} gcs_status;
+
+typedef enum gcs_colorspace {
+  GCS_COLOR_GAMMA_1_80 = 0,
+  GCS_COLOR_GAMMA_2_20 = 1,
+  GCS_COLOR_GAMMA_2_40 = 2,
+  GCS_COLOR_GAMMA_2_60 = 3,
+  GCS_COLOR_REC709 = 4,
+  GCS_COLOR_SRGB = 5,
+  GCS_COLOR_CINEON = 6,
+  GCS_COLOR_LINEAR = 7,
+  GCS_COLOR_HSV = 8,
+  GCS_COLOR_HSL = 9,
+  GCS_COLOR_Y_PB_PR = 10,
+  GCS_COLOR_Y_CB_CR = 11,
+  GCS_COLOR_CIE_XYZ = 12,
+  GCS_COLOR_CIE_YXY = 13,
+  GCS_COLOR_LAB = 14,
+  GCS_COLOR_CIE_LCH = 15,
+  GCS_COLOR_PANALOG = 16,
+  GCS_COLOR_REDLOG = 17,
+  GCS_COLOR_VIPERLOG = 18,
+  GCS_COLOR_ALEXAV3LOGC = 19,
+  GCS_COLOR_PLOGLIN = 20,
+  GCS_COLOR_SLOG = 21,
+  GCS_COLOR_SLOG1 = 22,
+  GCS_COLOR_SLOG2 = 23,
+  GCS_COLOR_SLOG3 = 24,
+  GCS_COLOR_CLOG = 25,
+  GCS_COLOR_LOG3G10 = 26,
+  GCS_COLOR_LOG3G12 = 27,
+  GCS_COLOR_HYBRID_LOG_GAMMA = 28,
+  GCS_COLOR_PROTUNE = 29,
+  GCS_COLOR_BT1886 = 30,
+  GCS_COLOR_ST2084 = 31,
+  GCS_COLOR_BLACKMAGIC_GEN5 = 32,
+  GCS_COLOR_ARRI_LOG_C4 = 33,
+  GCS_COLOR_COUNT
+} gcs_colorspace;
+
+typedef enum gcs_whitepoint {
+  GCS_WHITE_A = 0,
+  GCS_WHITE_B = 1,
+  GCS_WHITE_C = 2,
+  GCS_WHITE_D50 = 3,
+  GCS_WHITE_D55 = 4,
+  GCS_WHITE_D58 = 5,
+  GCS_WHITE_D65 = 6,
+  GCS_WHITE_D75 = 7,
+  GCS_WHITE_9300 = 8,
+  GCS_WHITE_E = 9,
+  GCS_WHITE_F2 = 10,
+  GCS_WHITE_F7 = 11,
+  GCS_WHITE_F11 = 12,
+  GCS_WHITE_DCI_P3 = 13,
+  GCS_WHITE_ACES = 14,
+  GCS_WHITE_COUNT
+} gcs_whitepoint;
+
+typedef enum gcs_primaries {
+  GCS_PRIM_ADOBE_1998 = 0,
+  GCS_PRIM_APPLE = 1,
+  GCS_PRIM_BEST_RGB = 2,
+  GCS_PRIM_BETA_RGB = 3,
+  GCS_PRIM_BRUCE_RGB = 4,
+  GCS_PRIM_CIE_1931 = 5,
+  GCS_PRIM_COLORMATCH = 6,
+  GCS_PRIM_DCI_P3 = 7,
+  GCS_PRIM_DON_RGB_4 = 8,
+  GCS_PRIM_ECI_RGB = 9,
+  GCS_PRIM_EKTA_SPACE_PS5 = 10,
+  GCS_PRIM_NTSC_1953 = 11,
+  GCS_PRIM_PAL_SECAM = 12,
+  GCS_PRIM_PROPHOTO = 13,
+  GCS_PRIM_SMPTE_C = 14,
+  GCS_PRIM_SRGB = 15,
+  GCS_PRIM_WIDE_GAMUT = 16,
+  GCS_PRIM_ALEXAV3LOGC = 17,
+  GCS_PRIM_SONY_S_GAMUT = 18,
+  GCS_PRIM_ACES = 19,
+  GCS_PRIM_REC_2020 = 20,
+  GCS_PRIM_ARRI_WIDE_GAMUT4 = 21,
+  GCS_PRIM_COUNT
+} gcs_primaries;
+
+typedef enum gcs_cat { GCS_CAT_CAT02 = 0, GCS_CAT_BRADFORD = 1 } gcs_cat;
+
+typedef enum gcs_ycbcr_matrix {
+  GCS_YCC_REC601 = 0,
+  GCS_YCC_REC709 = 1,
+  GCS_YCC_REC2020 = 2
+} gcs_ycbcr_matrix;
+
+typedef enum gcs_ycbcr_range {
+  GCS_YCC_RANGE_LEGAL = 0,
+  GCS_YCC_RANGE_FULL = 1
+} gcs_ycbcr_range;
+
+typedef enum gcs_precision {
+  GCS_PRECISION_EXACT = 0,
+  GCS_PRECISION_LUT_1D = 1,
+  GCS_PRECISION_LUT_3D_33 = 2,
+  GCS_PRECISION_LUT_3D_65 = 3,
+  GCS_PRECISION_AUTO = 4
+} gcs_precision;
+
+typedef enum gcs_pixel_type { GCS_FLOAT32 = 0, GCS_FLOAT16 = 1 } gcs_pixel_type;
+
+/*
+ * Transform settings, as on the node. Fields are only ever appended: fill
+ * the struct with gcs_settings_init() and pass sizeof(gcs_settings) along,
+ * older callers keep the defaults for fields they do not know.
+ */
+typedef struct gcs_settings {
+  int color_in;     /* gcs_colorspace, GCS_COLOR_LINEAR */
+  int color_out;    /* gcs_colorspace, GCS_COLOR_LINEAR */
+  int white_in;     /* gcs_whitepoint, GCS_WHITE_D65 */
+  int white_out;    /* gcs_whitepoint, GCS_WHITE_D65 */
+  int primary_in;   /* gcs_primaries, GCS_PRIM_SRGB */
+  int primary_out;  /* gcs_primaries, GCS_PRIM_SRGB */
+  int cat;          /* gcs_cat, GCS_CAT_CAT02 */
+  int ycbcr_matrix; /* gcs_ycbcr_matrix, GCS_YCC_REC709 */
+  int ycbcr_range;  /* gcs_ycbcr_range, GCS_YCC_RANGE_LEGAL */
+  int precision;    /* gcs_precision, GCS_PRECISION_EXACT */
+  float tolerance;  /* GCS_PRECISION_AUTO error bound, 1e-3 */
+  int bit_exact;    /* scalar reference curves, 0 */
+  const char* lut_file; /* .cube file or NULL, read at creation */
+  int lut_after;        /* apply lut_file after the out curve, 0 */
+} gcs_settings;
+
+GCS_API int gcs_api_version(void);
+
+/* Defaults for the first 'size' bytes of 's' */
+GCS_API void gcs_settings_init(gcs_settings* s, size_t size);
+
+/*
+ * Compiles 'settings' ('size' bytes of it, normally sizeof(gcs_settings)).
+ * LUT precisions bake here, so applying never waits. On failure a message
+ * goes to 'error' (may be NULL) and *transform is NULL.
+ */
+GCS_API gcs_status gcs_transform_create(const gcs_settings* settings,
+                                        size_t size, gcs_transform** transform,
+                                        char* error, size_t error_size);
+
+GCS_API void gcs_transform_destroy(gcs_transform* transform);
+
+/*
+ * In-place conversion of three planes of width x height pixels.
+ * 'row_stride' is the distance between rows in bytes (0: packed rows), the
+ * same for all planes. 'threads' caps the threads used, 0 for all of the
+ * library's threads (GCOLORSPACE_API_THREADS, all cores by default), 1 for
+ * the calling thread only.
+ */
+GCS_API gcs_status gcs_apply_planar(const gcs_transform* transform,
+                                    gcs_pixel_type type, void* r, void* g,
+                                    void* b, int width, int height,
+                                    ptrdiff_t row_stride, int threads);
+
+/*
+ * In-place conversion of interleaved RGB (channels 3) or RGBA (channels 4)
+ * pixels, alpha is left as is. Strides and threads as for
+ * gcs_apply_planar().
+ */
+GCS_API gcs_status gcs_apply_interleaved(const gcs_transform* transform,
+                                         gcs_pixel_type type, void* pixels,
+                                         int width, int height, int channels,
+                                         ptrdiff_t row_stride, int threads);
+
+/* Menu names as in the node, NULL past the end */
+GCS_API const char* gcs_colorspace_name(int colorspace);
+GCS_API const char* gcs_whitepoint_name(int whitepoint);
+GCS_API const char* gcs_primaries_name(int primaries);
+
+/* Enum value of a menu name, -1 when unknown */
+GCS_API int gcs_colorspace_find(const char* name);
+GCS_API int gcs_whitepoint_find(const char* name);
+GCS_API int gcs_primaries_find(const char* name);
+
+GCS_API const char* gcs_status_string(gcs_status status);
+
+/*
+ * Client of gcolorspace_daemon (Linux), for hosts that run many small
+ * conversions and should not pay for creating transforms and baking LUTs
+ * in every process. Frames live in shared memory (memfd): the daemon
+ * converts them in place, pixels never go through the socket.
+ *
+ *   gcs_frame frame;
+ *   gcs_frame_create(width * height * 4 * sizeof(float), &frame);
+ *   ... write RGBA floats to frame.data ...
+ *   gcs_client_apply_interleaved(client, &s, sizeof(s), &frame, 0,
+ *                                GCS_FLOAT32, width, height, 4, 0, 0,
+ *                                error, sizeof(error));
+ *
+ * A client sends one request at a time, concurrent calls on one client wait
+ * for each other: use a client per thread for parallel requests.
+ */
+typedef struct gcs_client gcs_client;
+
+typedef struct gcs_frame {
+  void* data;  /* mapped, read-write */
+  size_t size; /* bytes */
+  int fd;      /* memfd passed to the daemon */
+} gcs_frame;
+
+/* Shared memory for frames, one frame can hold several images */
+GCS_API gcs_status gcs_frame_create(size_t size, gcs_frame* frame);
+GCS_API void gcs_frame_destroy(gcs_frame* frame);
+
+/* 'socket_path' NULL for the daemon's default (GCOLORSPACE_DAEMON_SOCKET) */
+GCS_API gcs_status gcs_client_connect(const char* socket_path,
+                                      gcs_client** client, char* error,
+                                      size_t error_size);
+GCS_API void gcs_client_close(gcs_client* client);
+
+/*
+ * gcs_apply_interleaved() in the daemon, on the pixels 'offset' bytes into
+ * 'frame'. The daemon keeps the compiled transform for the next request
+ * with the same settings.
+ */
+GCS_API gcs_status gcs_client_apply_interleaved(
+    gcs_client* client, const gcs_settings* settings, size_t settings_size,
+    const gcs_frame* frame, size_t offset, gcs_pixel_type type, int width,
+    int height, int channels, ptrdiff_t row_stride, int threads, char* error,
+    size_t error_size);
+
+/* gcs_apply_planar() in the daemon, planes at 'offsets' bytes in 'frame' */
+GCS_API gcs_status gcs_client_apply_planar(
+    gcs_client* client, const gcs_settings* settings, size_t settings_size,
+    const gcs_frame* frame, const size_t offsets[3], gcs_pixel_type type,
+    int width, int height, ptrdiff_t row_stride, int threads, char* error,
+    size_t error_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GCOLORSPACE_C_H */
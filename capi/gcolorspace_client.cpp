@@ -0,0 +1,265 @@
+// Daemon client of the C interface, see gcolorspace.h and
+// include/DaemonProtocol.h. Needs none of the transform core.
+
+#define GCOLORSPACE_C_BUILD
+
+#include "capi/gcolorspace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "include/DaemonProtocol.h"
+#endif
+
+struct gcs_client
+{
+  int socket;
+  std::mutex mutex;
+};
+
+namespace
+{
+  void SetError(char* error, size_t size, const std::string& message)
+  {
+    if(error != nullptr && size > 0) {
+      std::snprintf(error, size, "%s", message.c_str());
+    }
+  }
+
+#if defined(__linux__)
+  gcs_status Send(gcs_client* client, const gcs_settings* settings,
+                  size_t settingsSize, const gcs_frame* frame,
+                  DaemonProtocol::Request& request, char* error,
+                  size_t errorSize)
+  {
+    if(client == nullptr || settings == nullptr || settingsSize == 0 ||
+       frame == nullptr || frame->fd < 0) {
+      SetError(error, errorSize, "invalid argument");
+      return GCS_ERROR_ARGUMENT;
+    }
+    // fields the caller does not know keep their defaults
+    gcs_settings s;
+    gcs_settings_init(&s, sizeof(s));
+    std::memcpy(&s, settings, std::min(settingsSize, sizeof(s)));
+    const size_t pathBytes = s.lut_file ? std::strlen(s.lut_file) : 0;
+    if(pathBytes > DaemonProtocol::kMaxPath) {
+      SetError(error, errorSize, "LUT file path too long");
+      return GCS_ERROR_ARGUMENT;
+    }
+
+    request.magic = DaemonProtocol::kMagic;
+    request.version = DaemonProtocol::kVersion;
+    DaemonProtocol::Spec& spec = request.spec;
+    spec.colorIn = s.color_in;
+    spec.colorOut = s.color_out;
+    spec.whiteIn = s.white_in;
+    spec.whiteOut = s.white_out;
+    spec.primaryIn = s.primary_in;
+    spec.primaryOut = s.primary_out;
+    spec.cat = s.cat;
+    spec.ycbcrMatrix = s.ycbcr_matrix;
+    spec.ycbcrRange = s.ycbcr_range;
+    spec.precision = s.precision;
+    spec.tolerance = s.tolerance;
+    spec.bitExact = s.bit_exact;
+    spec.lutAfter = s.lut_after;
+    spec.lutPathBytes = static_cast<uint32_t>(pathBytes);
+
+    std::lock_guard<std::mutex> lock(client->mutex);
+    DaemonProtocol::Reply reply;
+    if(!DaemonProtocol::SendWithFd(client->socket, &request, sizeof(request),
+                                   frame->fd) ||
+       !DaemonProtocol::SendAll(client->socket, s.lut_file, pathBytes) ||
+       !DaemonProtocol::RecvAll(client->socket, &reply, sizeof(reply)) ||
+       reply.magic != DaemonProtocol::kMagic ||
+       reply.messageBytes > DaemonProtocol::kMaxMessage) {
+      SetError(error, errorSize, "lost the connection to the daemon");
+      return GCS_ERROR_CONNECTION;
+    }
+    char message[DaemonProtocol::kMaxMessage + 1];
+    if(!DaemonProtocol::RecvAll(client->socket, message,
+                                reply.messageBytes)) {
+      SetError(error, errorSize, "lost the connection to the daemon");
+      return GCS_ERROR_CONNECTION;
+    }
+    message[reply.messageBytes] = 0;
+    const gcs_status status = static_cast<gcs_status>(reply.status);
+    if(status != GCS_OK) {
+      SetError(error, errorSize,
+               reply.messageBytes ? message : gcs_status_string(status));
+    }
+    return status;
+  }
+#endif
+}  // namespace
+
+extern "C" {
+
+#if defined(__linux__)
+
+gcs_status gcs_frame_create(size_t size, gcs_frame* frame)
+{
+  if(frame == nullptr || size == 0) return GCS_ERROR_ARGUMENT;
+  frame->data = nullptr;
+  frame->size = 0;
+  frame->fd =
+      memfd_create("gcolorspace-frame", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if(frame->fd < 0) return GCS_ERROR_INTERNAL;
+  // the daemon only maps frames that cannot shrink under it
+  if(ftruncate(frame->fd, static_cast<off_t>(size)) == 0 &&
+     fcntl(frame->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == 0) {
+    void* data =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, frame->fd, 0);
+    if(data != MAP_FAILED) {
+      frame->data = data;
+      frame->size = size;
+      return GCS_OK;
+    }
+  }
+  close(frame->fd);
+  frame->fd = -1;
+  return GCS_ERROR_INTERNAL;
+}
+
+void gcs_frame_destroy(gcs_frame* frame)
+{
+  if(frame == nullptr) return;
+  if(frame->data != nullptr) munmap(frame->data, frame->size);
+  if(frame->fd >= 0) close(frame->fd);
+  frame->data = nullptr;
+  frame->size = 0;
+  frame->fd = -1;
+}
+
+gcs_status gcs_client_connect(const char* socket_path, gcs_client** client,
+                              char* error, size_t error_size)
+{
+  if(client == nullptr) return GCS_ERROR_ARGUMENT;
+  *client = nullptr;
+  const std::string path =
+      socket_path ? socket_path : DaemonProtocol::DefaultSocketPath();
+  sockaddr_un address;
+  if(!DaemonProtocol::Address(path, address)) {
+    SetError(error, error_size, path + ": invalid socket path");
+    return GCS_ERROR_ARGUMENT;
+  }
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address),
+                       sizeof(address)) != 0) {
+    SetError(error, error_size,
+             path + ": " + std::strerror(errno) +
+                 " (is gcolorspace_daemon running?)");
+    if(fd >= 0) close(fd);
+    return GCS_ERROR_CONNECTION;
+  }
+  *client = new(std::nothrow) gcs_client;
+  if(*client == nullptr) {
+    close(fd);
+    return GCS_ERROR_INTERNAL;
+  }
+  (*client)->socket = fd;
+  return GCS_OK;
+}
+
+void gcs_client_close(gcs_client* client)
+{
+  if(client == nullptr) return;
+  close(client->socket);
+  delete client;
+}
+
+gcs_status gcs_client_apply_interleaved(
+    gcs_client* client, const gcs_settings* settings, size_t settings_size,
+    const gcs_frame* frame, size_t offset, gcs_pixel_type type, int width,
+    int height, int channels, ptrdiff_t row_stride, int threads, char* error,
+    size_t error_size)
+{
+  DaemonProtocol::Request request;
+  std::memset(&request, 0, sizeof(request));
+  request.type = type;
+  request.channels = channels;
+  request.width = width;
+  request.height = height;
+  request.rowStride = row_stride;
+  request.offset[0] = offset;
+  request.threads = threads;
+  if(channels != 3 && channels != 4) {
+    SetError(error, error_size, "channels must be 3 or 4");
+    return GCS_ERROR_ARGUMENT;
+  }
+  return Send(client, settings, settings_size, frame, request, error,
+              error_size);
+}
+
+gcs_status gcs_client_apply_planar(
+    gcs_client* client, const gcs_settings* settings, size_t settings_size,
+    const gcs_frame* frame, const size_t offsets[3], gcs_pixel_type type,
+    int width, int height, ptrdiff_t row_stride, int threads, char* error,
+    size_t error_size)
+{
+  if(offsets == nullptr) return GCS_ERROR_ARGUMENT;
+  DaemonProtocol::Request request;
+  std::memset(&request, 0, sizeof(request));
+  request.type = type;
+  request.channels = 0;
+  request.width = width;
+  request.height = height;
+  request.rowStride = row_stride;
+  for(int c = 0; c < 3; ++c) request.offset[c] = offsets[c];
+  request.threads = threads;
+  return Send(client, settings, settings_size, frame, request, error,
+              error_size);
+}
+
+#else
+
+// the daemon needs memfd, elsewhere every call reports no daemon
+
+gcs_status gcs_frame_create(size_t, gcs_frame*)
+{
+  return GCS_ERROR_CONNECTION;
+}
+
+void gcs_frame_destroy(gcs_frame*) {}
+
+gcs_status gcs_client_connect(const char*, gcs_client** client, char* error,
+                              size_t error_size)
+{
+  if(client != nullptr) *client = nullptr;
+  SetError(error, error_size, "the daemon is only available on Linux");
+  return GCS_ERROR_CONNECTION;
+}
+
+void gcs_client_close(gcs_client*) {}
+
+gcs_status gcs_client_apply_interleaved(gcs_client*, const gcs_settings*,
+                                        size_t, const gcs_frame*, size_t,
+                                        gcs_pixel_type, int, int, int,
+                                        ptrdiff_t, int, char*, size_t)
+{
+  return GCS_ERROR_CONNECTION;
+}
+
+gcs_status gcs_client_apply_planar(gcs_client*, const gcs_settings*, size_t,
+                                   const gcs_frame*, const size_t*,
+                                   gcs_pixel_type, int, int, ptrdiff_t, int,
+                                   char*, size_t)
+{
+  return GCS_ERROR_CONNECTION;
+}
+
+#endif
+
+}  // extern "C"
@@ -0,0 +1,182 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+// Decisions of the "auto" precision tier: which of exact / 1D LUT / 3D LUT
+// runs fastest within the error tolerance for one resolved transform on
+// this CPU. The measurement lives in TransformPlan.h, this only keeps the
+// results. They are persisted next to the disk LUT cache, in one text file
+// per CPU model and library version, so each farm node type tunes once:
+//
+//   autotune-<cpu model>-<library version>.txt
+//   <key as 24 hex words> <precision>
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include "include/Constants.h"
+#include "include/LutCache.h"
+#include "include/LutDiskCache.h"
+
+namespace AutotuneDetail
+{
+  // CPUID brand string reduced to [a-z0-9-], e.g.
+  // "intel-r-xeon-r-gold-6248-cpu-2-50ghz"
+  inline std::string CpuModel()
+  {
+    uint32_t regs[12] = {};
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0x80000000);
+    if(static_cast<uint32_t>(info[0]) >= 0x80000004u) {
+      for(int i = 0; i < 3; ++i) {
+        __cpuid(info, 0x80000002 + i);
+        std::memcpy(regs + 4 * i, info, sizeof(info));
+      }
+    }
+#else
+    if(__get_cpuid_max(0x80000000u, nullptr) >= 0x80000004u) {
+      for(unsigned i = 0; i < 3; ++i) {
+        __get_cpuid(0x80000002u + i, &regs[4 * i], &regs[4 * i + 1],
+                    &regs[4 * i + 2], &regs[4 * i + 3]);
+      }
+    }
+#endif
+    char brand[sizeof(regs) + 1] = {};
+    std::memcpy(brand, regs, sizeof(regs));
+
+    std::string model;
+    for(const char* c = brand; *c; ++c) {
+      const unsigned char u = static_cast<unsigned char>(*c);
+      if(std::isalnum(u)) {
+        model += static_cast<char>(std::tolower(u));
+      }
+      else if(!model.empty() && model.back() != '-') {
+        model += '-';
+      }
+    }
+    while(!model.empty() && model.back() == '-') model.pop_back();
+    return model.empty() ? "unknown-cpu" : model;
+  }
+
+  inline std::string KeyText(const LutKey& key)
+  {
+    std::string text;
+    char word[9];
+    for(uint32_t w : key.words) {
+      std::snprintf(word, sizeof(word), "%08x", w);
+      text += word;
+    }
+    return text;
+  }
+}  // namespace AutotuneDetail
+
+class Autotuner
+{
+ public:
+  static Autotuner& instance()
+  {
+    static Autotuner tuner;
+    return tuner;
+  }
+
+  // the recorded tier for 'key', -1 when it has not been tuned yet
+  int lookup(const LutKey& key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    load();
+    auto found = decisions.find(AutotuneDetail::KeyText(key));
+    return found == decisions.end() ? -1 : found->second;
+  }
+
+  void record(const LutKey& key, int precision)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    // merge what other processes on this machine recorded meanwhile
+    loaded = false;
+    load();
+    decisions[AutotuneDetail::KeyText(key)] = precision;
+    save();
+  }
+
+  // forgets the decisions in memory, the file is read again on next use
+  void reset()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    decisions.clear();
+    loaded = false;
+  }
+
+  std::string path() const
+  {
+    const std::string directory = LutDiskCache::instance().directoryPath();
+    if(directory.empty()) return std::string();
+    return directory + "/autotune-" + AutotuneDetail::CpuModel() + "-" +
+           Constants::LIBRARY_VERSION + ".txt";
+  }
+
+ private:
+  Autotuner() = default;
+
+  // unknown tiers (a file from a newer build) are skipped
+  void load()
+  {
+    if(loaded) return;
+    loaded = true;
+
+    const std::string file = path();
+    if(file.empty()) return;
+    std::ifstream in(file);
+    std::string line;
+    while(std::getline(in, line)) {
+      std::istringstream fields(line);
+      std::string key;
+      int precision = -1;
+      if(fields >> key >> precision && precision >= 0 &&
+         precision < Constants::PRECISION_AUTO) {
+        decisions[key] = precision;
+      }
+    }
+  }
+
+  // rewritten whole through a temporary file, the same way as the LUTs
+  void save()
+  {
+    const std::string file = path();
+    if(file.empty()) return;
+
+    const std::string temp =
+        file + "." + std::to_string(LutDiskDetail::ProcessId()) + ".tmp";
+    {
+      std::ofstream out(temp, std::ios::trunc);
+      for(const auto& decision : decisions) {
+        out << decision.first << ' ' << decision.second << '\n';
+      }
+      if(!out) {
+        std::remove(temp.c_str());
+        return;
+      }
+    }
+    if(std::rename(temp.c_str(), file.c_str()) != 0) {
+      std::remove(temp.c_str());
+    }
+  }
+
+  std::mutex mutex;
+  std::map<std::string, int> decisions;
+  bool loaded = false;
+};
+
+#endif  // AUTOTUNE_H
@@ -0,0 +1,350 @@
+#ifndef BAND_CACHE_H
+#define BAND_CACHE_H
+
+// Blocks of converted rows for the "bands" engine of the node.
+//
+// Nuke asks for one row at a time, from several threads. The bands engine
+// fetches rows() input rows at once instead, converts all their layers
+// with a single ApplyPlanar call and keeps the result here, so the other
+// rows of the band are plain copies. The first thread asking for a band
+// renders it, the others wait for it instead of rendering it again. The
+// next band is prefetched on the ThreadPool; a thread that needs it before
+// a worker picks it up renders it itself. Least recently used bands are
+// dropped once the cached bytes exceed the budget. No DDImage, channels are
+// plain ints.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "include/ThreadPool.h"
+
+// Rows [y, y + rows) and columns [x, x + width) of some channels, one
+// planar width * rows block per channel
+struct Band
+{
+  int y = 0;
+  int rows = 0;
+  int x = 0;
+  int width = 0;
+  std::vector<int> channels;
+  std::vector<float> pixels;
+
+  size_t planeSize() const { return static_cast<size_t>(width) * rows; }
+
+  size_t bytes() const { return sizeof(Band) + sizeof(float) * pixels.size(); }
+
+  // one uninitialized plane per channel, geometry must be set
+  void allocate(std::vector<int> ids)
+  {
+    channels = std::move(ids);
+    pixels.resize(planeSize() * channels.size());
+  }
+
+  // plane of 'channel', null when the band does not hold it
+  float* plane(int channel)
+  {
+    for(size_t i = 0; i < channels.size(); ++i) {
+      if(channels[i] == channel) return pixels.data() + i * planeSize();
+    }
+    return nullptr;
+  }
+
+  // row 'row' of 'channel' starting at column x, null when not held
+  const float* line(int channel, int row) const
+  {
+    if(row < y || row >= y + rows) return nullptr;
+    for(size_t i = 0; i < channels.size(); ++i) {
+      if(channels[i] == channel) {
+        return pixels.data() + i * planeSize() +
+               static_cast<size_t>(row - y) * width;
+      }
+    }
+    return nullptr;
+  }
+};
+
+class BandCache
+{
+ public:
+  using Entry = std::shared_ptr<const Band>;
+
+  static constexpr int kDefaultRows = 32;
+  static constexpr size_t kDefaultBudgetMB = 64;
+
+  struct Stats
+  {
+    uint64_t hits;
+    uint64_t misses;
+    size_t bytes;
+    size_t entries;
+  };
+
+  BandCache() = default;
+  ~BandCache() { drain(); }
+  BandCache(const BandCache&) = delete;
+  BandCache& operator=(const BandCache&) = delete;
+
+  // drops every band, for new settings or a new input
+  void reset(int rows = kDefaultRows,
+             size_t budgetBytes = kDefaultBudgetMB << 20)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++generation;
+    bandRows = rows > 0 ? rows : kDefaultRows;
+    budget = budgetBytes;
+    lru.clear();
+    index.clear();
+    pending.clear();
+    bytes = 0;
+    hits = 0;
+    misses = 0;
+  }
+
+  int rows() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bandRows;
+  }
+
+  // first row of the band holding row 'y'
+  int bandStart(int y) const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return Start(Index(y, bandRows), bandRows);
+  }
+
+  // Band holding row 'y'. On first use fill(Band&) -> bool renders it from
+  // the preset y and rows, and may shrink them to the image. A fill that
+  // returns false (aborted render) yields null and nothing is cached.
+  template <class Fill>
+  Entry acquire(int y, Fill fill)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    const int band = Index(y, bandRows);
+
+    auto found = index.find(band);
+    if(found != index.end()) {
+      ++hits;
+      lru.splice(lru.begin(), lru, found->second);
+      return found->second->entry;
+    }
+
+    auto rendering = pending.find(band);
+    if(rendering != pending.end()) {
+      // a prefetch no worker has started yet is rendered here, waiting for
+      // it could block on a pool whose workers wait on this thread
+      std::shared_ptr<Job> job = claimQueued(band);
+      if(job != nullptr) {
+        lock.unlock();
+        return finish(band, *job, fill);
+      }
+      ++hits;
+      std::shared_future<Entry> result = rendering->second;
+      lock.unlock();
+      return result.get();
+    }
+
+    std::shared_ptr<Job> job = start(band, Job::RUNNING);
+    lock.unlock();
+    return finish(band, *job, fill);
+  }
+
+  // Queues the band after the one holding row 'y' on the ThreadPool unless
+  // it is cached or another thread is on it already. Never waits; call
+  // drain() before anything 'fill' uses goes away.
+  template <class Fill>
+  void prefetch(int y, Fill fill)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    const int band = Index(y, bandRows) + 1;
+    if(index.count(band) != 0 || pending.count(band) != 0) return;
+
+    // forget the prefetches that are done
+    for(size_t i = 0; i < queued.size();) {
+      if(queued[i]->state == Job::DONE || queued[i]->state == Job::DROPPED) {
+        queued[i] = queued.back();
+        queued.pop_back();
+      }
+      else {
+        ++i;
+      }
+    }
+    std::shared_ptr<Job> job = start(band, Job::QUEUED);
+    queued.push_back(job);
+    lock.unlock();
+
+    // a dropped job never touches the cache, which may be gone by then
+    ThreadPool::instance().submit([this, band, job, fill]() mutable {
+      int expected = Job::QUEUED;
+      if(!job->state.compare_exchange_strong(expected, Job::RUNNING)) return;
+      try {
+        finish(band, *job, fill);
+      }
+      catch(...) {
+        // the exception went to the threads waiting for the band
+      }
+    });
+  }
+
+  // Drops the queued prefetches (their waiters get null) and waits for the
+  // running ones, so nothing renders into the owner after this returns
+  void drain()
+  {
+    std::vector<std::shared_ptr<Job>> jobs;
+    std::vector<std::shared_ptr<Job>> dropped;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.swap(queued);
+      for(const std::shared_ptr<Job>& job : jobs) {
+        int expected = Job::QUEUED;
+        if(!job->state.compare_exchange_strong(expected, Job::DROPPED)) {
+          continue;
+        }
+        if(generation == job->generation) pending.erase(job->index);
+        dropped.push_back(job);
+      }
+    }
+    for(const std::shared_ptr<Job>& job : dropped) {
+      job->promise.set_value(nullptr);
+    }
+    for(const std::shared_ptr<Job>& job : jobs) job->result.wait();
+  }
+
+  Stats stats() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return {hits, misses, bytes, index.size()};
+  }
+
+ private:
+  struct Node
+  {
+    int band;
+    Entry entry;
+    size_t bytes;
+  };
+
+  // rounds towards minus infinity, rows above the format are negative
+  static int Index(int y, int rows)
+  {
+    return y >= 0 ? y / rows : -((rows - 1 - y) / rows);
+  }
+
+  static int Start(int band, int rows) { return band * rows; }
+
+  // one band render, run by the thread asking for it or by a pool worker
+  struct Job
+  {
+    enum { QUEUED, RUNNING, DROPPED, DONE };
+    std::atomic<int> state{QUEUED};
+    int index = 0;
+    uint64_t generation = 0;
+    std::shared_ptr<Band> band;
+    std::promise<Entry> promise;
+    std::shared_future<Entry> result;
+  };
+
+  // called with the lock held and 'band' neither cached nor pending
+  std::shared_ptr<Job> start(int band, int state)
+  {
+    ++misses;
+    auto job = std::make_shared<Job>();
+    job->state = state;
+    job->index = band;
+    job->generation = generation;
+    job->band = std::make_shared<Band>();
+    job->band->y = Start(band, bandRows);
+    job->band->rows = bandRows;
+    job->result = job->promise.get_future().share();
+    pending.emplace(band, job->result);
+    return job;
+  }
+
+  // called with the lock held, the queued prefetch of 'band' taken over by
+  // the caller, null when there is none
+  std::shared_ptr<Job> claimQueued(int band)
+  {
+    for(const std::shared_ptr<Job>& job : queued) {
+      if(job->index != band || job->generation != generation) continue;
+      int expected = Job::QUEUED;
+      if(job->state.compare_exchange_strong(expected, Job::RUNNING)) {
+        return job;
+      }
+    }
+    return nullptr;
+  }
+
+  // Renders the band of 'job' without the lock and hands it to the threads
+  // waiting for it, rethrows what fill throws. Nothing of the cache is
+  // touched once the result is set.
+  template <class Fill>
+  Entry finish(int band, Job& job, Fill& fill)
+  {
+    bool ok = false;
+    try {
+      ok = fill(*job.band);
+    }
+    catch(...) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(generation == job.generation) pending.erase(band);
+      }
+      job.promise.set_exception(std::current_exception());
+      job.state = Job::DONE;
+      throw;
+    }
+
+    Entry entry = ok ? Entry(job.band) : nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      // a reset() meanwhile means the band was rendered for old settings
+      if(generation == job.generation) {
+        pending.erase(band);
+        if(entry != nullptr) insert(band, entry);
+      }
+    }
+    job.promise.set_value(entry);
+    job.state = Job::DONE;
+    return entry;
+  }
+
+  void insert(int band, const Entry& entry)
+  {
+    const size_t size = entry->bytes();
+    if(size > budget) return;
+
+    lru.push_front({band, entry, size});
+    index[band] = lru.begin();
+    bytes += size;
+    while(bytes > budget && !lru.empty()) {
+      bytes -= lru.back().bytes;
+      index.erase(lru.back().band);
+      lru.pop_back();
+    }
+  }
+
+  mutable std::mutex mutex;
+  std::list<Node> lru;
+  std::map<int, std::list<Node>::iterator> index;
+  std::map<int, std::shared_future<Entry>> pending;
+  // prefetches handed to the ThreadPool, until drain() or a later
+  // prefetch finds them done
+  std::vector<std::shared_ptr<Job>> queued;
+  int bandRows = kDefaultRows;
+  size_t budget = kDefaultBudgetMB << 20;
+  size_t bytes = 0;
+  uint64_t generation = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+};
+
+#endif  // BAND_CACHE_H
@@ -0,0 +1,620 @@
+#ifndef BATCH_JOB_H
+#define BATCH_JOB_H
+
+// Manifest driven batch conversion shared by any number of worker
+// processes, on one box or over a shared filesystem
+// (gcolorspace_convert --batch). POSIX only.
+//
+// Job file, one directive per line, '#' comments, "quoted" words:
+//   chunk 10        frames per claim (default 10)
+//   stale 600       seconds without a heartbeat before a claim is taken
+//                   over (default 600)
+//   state DIR       state directory (default: the job file + ".state")
+//   sequence IN OUT FIRST LAST [converter options]
+// IN and OUT are frame patterns with %0Nd, %d or a run of '#'. Ranges must
+// not change while the job runs, chunks are named after them.
+//
+// State directory, chunks are <sequence>-<first frame>:
+//   claims/<chunk>        O_EXCL, "host pid token", touched after each frame
+//   done/<chunk>          written once the chunk is journaled
+//   journal/<worker>.log  a line per finished chunk, written by its worker
+//                         only, so appends never interleave over NFS
+//   summary.txt           per worker throughput, rewritten by every worker
+//                         that exits
+// A finisher writes done before dropping its claim, so a worker that gets
+// the claim afterwards always sees the chunk done. Claims of workers that
+// died on this host, or without a heartbeat for 'stale' seconds, are taken
+// over: renamed aside (only one worker can), checked to still be the stale
+// claim, then claimed again. A worker only touches or drops a claim whose
+// token is still its own. Frames are written to a temporary name and
+// renamed, so the rare chunk converted twice only costs time.
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace BatchDetail
+{
+  inline bool Fail(std::string* error, const std::string& message)
+  {
+    if(error != nullptr) *error = message;
+    return false;
+  }
+
+  // whitespace separated words, "double quoted" words may hold spaces
+  inline bool Split(const std::string& line, std::vector<std::string>& words,
+                    std::string* error)
+  {
+    words.clear();
+    size_t i = 0;
+    while(i < line.size()) {
+      if(std::isspace(static_cast<unsigned char>(line[i]))) {
+        ++i;
+        continue;
+      }
+      if(line[i] == '#') break;
+      std::string word;
+      if(line[i] == '"') {
+        const size_t end = line.find('"', i + 1);
+        if(end == std::string::npos) return Fail(error, "unclosed quote");
+        word = line.substr(i + 1, end - i - 1);
+        i = end + 1;
+      }
+      else {
+        while(i < line.size() &&
+              !std::isspace(static_cast<unsigned char>(line[i]))) {
+          word += line[i++];
+        }
+      }
+      words.push_back(word);
+    }
+    return true;
+  }
+
+  inline bool ReadFile(const std::string& path, std::string& text)
+  {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if(f == nullptr) return false;
+    text.clear();
+    char buffer[4096];
+    size_t n;
+    while((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0) {
+      text.append(buffer, n);
+    }
+    std::fclose(f);
+    return true;
+  }
+
+  // temporary name and rename, readers see the old or the new file
+  inline bool WriteAtomic(const std::string& path, const std::string& text,
+                          const std::string& suffix)
+  {
+    const std::string temp = path + ".tmp-" + suffix;
+    FILE* f = std::fopen(temp.c_str(), "wb");
+    if(f == nullptr) return false;
+    const bool ok = std::fwrite(text.data(), 1, text.size(), f) ==
+                        text.size() &&
+                    std::fflush(f) == 0 && fsync(fileno(f)) == 0;
+    if(std::fclose(f) != 0 || !ok ||
+       std::rename(temp.c_str(), path.c_str()) != 0) {
+      std::remove(temp.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  inline bool MakeDirs(const std::string& path)
+  {
+    for(size_t slash = path.find('/', 1);; slash = path.find('/', slash + 1)) {
+      const std::string dir = path.substr(0, slash);
+      if(mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) return false;
+      if(slash == std::string::npos) return true;
+    }
+  }
+
+  inline std::string HostName()
+  {
+    char name[256] = {0};
+    if(gethostname(name, sizeof(name) - 1) != 0 || !name[0]) {
+      return "localhost";
+    }
+    return name;
+  }
+
+  // file names: no separators or spaces
+  inline std::string Safe(std::string name)
+  {
+    for(char& c : name) {
+      if(c == '/' || std::isspace(static_cast<unsigned char>(c))) c = '_';
+    }
+    return name;
+  }
+
+  inline double Now()
+  {
+    return std::chrono::duration<double>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+}  // namespace BatchDetail
+
+namespace Batch
+{
+  struct Sequence
+  {
+    std::string in;
+    std::string out;
+    int first;
+    int last;
+    // converter options of the line ("--in", "ARRILogC4", ...)
+    std::vector<std::string> options;
+    int line;
+  };
+
+  struct Job
+  {
+    std::string state;
+    int chunk = 10;
+    double stale = 600;
+    std::vector<Sequence> sequences;
+  };
+
+  // 'pattern' with its frame number placeholder replaced, empty without one
+  inline std::string FramePath(const std::string& pattern, int frame)
+  {
+    char digits[32];
+    const size_t hash = pattern.find('#');
+    size_t percent = pattern.find('%');
+    while(percent != std::string::npos) {
+      size_t end = percent + 1;
+      while(end < pattern.size() && std::isdigit(static_cast<unsigned char>(
+                                        pattern[end]))) {
+        ++end;
+      }
+      if(end < pattern.size() && pattern[end] == 'd') {
+        const int width =
+            std::atoi(pattern.substr(percent + 1, end - percent - 1).c_str());
+        std::snprintf(digits, sizeof(digits), "%0*d", width, frame);
+        return pattern.substr(0, percent) + digits + pattern.substr(end + 1);
+      }
+      percent = pattern.find('%', end);
+    }
+    if(hash != std::string::npos) {
+      size_t end = hash;
+      while(end < pattern.size() && pattern[end] == '#') ++end;
+      std::snprintf(digits, sizeof(digits), "%0*d",
+                    static_cast<int>(end - hash), frame);
+      return pattern.substr(0, hash) + digits + pattern.substr(end);
+    }
+    return std::string();
+  }
+
+  inline bool ReadJob(const std::string& path, Job& job, std::string* error)
+  {
+    using BatchDetail::Fail;
+    std::string text;
+    if(!BatchDetail::ReadFile(path, text)) {
+      return Fail(error, path + ": cannot open");
+    }
+    job = Job();
+    job.state = path + ".state";
+    std::vector<std::string> w;
+    int number = 0;
+    for(size_t start = 0; start < text.size();) {
+      size_t end = text.find('\n', start);
+      if(end == std::string::npos) end = text.size();
+      const std::string line = text.substr(start, end - start);
+      start = end + 1;
+      ++number;
+      const std::string where = path + ":" + std::to_string(number) + ": ";
+
+      std::string message;
+      if(!BatchDetail::Split(line, w, &message)) {
+        return Fail(error, where + message);
+      }
+      if(w.empty()) continue;
+      if(w[0] == "chunk" && w.size() == 2) {
+        job.chunk = std::atoi(w[1].c_str());
+        if(job.chunk < 1) return Fail(error, where + "chunk must be >= 1");
+      }
+      else if(w[0] == "stale" && w.size() == 2) {
+        char* end = nullptr;
+        job.stale = std::strtod(w[1].c_str(), &end);
+        if(*end != '\0' || !(job.stale > 0)) {
+          return Fail(error, where + "stale must be > 0 seconds");
+        }
+      }
+      else if(w[0] == "state" && w.size() == 2) {
+        job.state = w[1];
+      }
+      else if(w[0] == "sequence" && w.size() >= 5) {
+        Sequence s;
+        s.in = w[1];
+        s.out = w[2];
+        s.first = std::atoi(w[3].c_str());
+        s.last = std::atoi(w[4].c_str());
+        s.options.assign(w.begin() + 5, w.end());
+        s.line = number;
+        if(s.last < s.first) return Fail(error, where + "empty frame range");
+        if(FramePath(s.in, 0).empty() || FramePath(s.out, 0).empty()) {
+          return Fail(error, where + "patterns need a frame number "
+                                     "(%04d or ####)");
+        }
+        job.sequences.push_back(s);
+      }
+      else {
+        return Fail(error, where + "unknown directive \"" + w[0] + "\"");
+      }
+    }
+    if(job.sequences.empty()) return Fail(error, path + ": no sequences");
+    return true;
+  }
+
+  struct Chunk
+  {
+    int sequence;
+    int first;
+    int last;
+
+    std::string name() const
+    {
+      return std::to_string(sequence) + "-" + std::to_string(first);
+    }
+  };
+
+  inline std::vector<Chunk> Chunks(const Job& job)
+  {
+    std::vector<Chunk> chunks;
+    for(size_t s = 0; s < job.sequences.size(); ++s) {
+      const Sequence& seq = job.sequences[s];
+      for(int f = seq.first; f <= seq.last; f += job.chunk) {
+        chunks.push_back({static_cast<int>(s), f,
+                          std::min(seq.last, f + job.chunk - 1)});
+      }
+    }
+    return chunks;
+  }
+
+  struct Record
+  {
+    int frames = 0;
+    double seconds = 0;
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+  };
+
+  // One process's view of the shared state
+  class Worker
+  {
+   public:
+    Worker(const Job& job, const std::string& name)
+        : job(job),
+          name(BatchDetail::Safe(name)),
+          host(BatchDetail::HostName())
+    {
+    }
+
+    ~Worker()
+    {
+      if(journal >= 0) close(journal);
+    }
+
+    Worker(const Worker&) = delete;
+    Worker& operator=(const Worker&) = delete;
+
+    const std::string& id() const { return name; }
+
+    bool open(std::string* error)
+    {
+      for(const char* dir : {"/claims", "/done", "/journal"}) {
+        if(!BatchDetail::MakeDirs(job.state + dir)) {
+          return BatchDetail::Fail(error, job.state + dir + ": " +
+                                              std::strerror(errno));
+        }
+      }
+      const std::string path = job.state + "/journal/" + name + ".log";
+      journal = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0666);
+      if(journal < 0) {
+        return BatchDetail::Fail(error, path + ": " + std::strerror(errno));
+      }
+      // a line cut short by a crash must not swallow the next one
+      std::string text;
+      if(BatchDetail::ReadFile(path, text) && !text.empty() &&
+         text.back() != '\n' && write(journal, "\n", 1) != 1) {
+        return BatchDetail::Fail(error, path + ": cannot write");
+      }
+      return true;
+    }
+
+    bool done(const Chunk& chunk) const
+    {
+      struct stat info;
+      return stat(donePath(chunk).c_str(), &info) == 0;
+    }
+
+    // true when the chunk is ours to convert
+    bool claim(const Chunk& chunk)
+    {
+      const std::string path = claimPath(chunk);
+      for(int attempt = 0; attempt < 2; ++attempt) {
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if(fd >= 0) {
+          const std::string owner = host + " " + std::to_string(getpid()) +
+                                    " " + name + "-" +
+                                    std::to_string(++claims) + "\n";
+          const bool written =
+              write(fd, owner.data(), owner.size()) ==
+              static_cast<ssize_t>(owner.size());
+          close(fd);
+          if(!written || done(chunk)) {
+            unlink(path.c_str());
+            return false;
+          }
+          owned[chunk.name()] = owner;
+          return true;
+        }
+        if(errno != EEXIST || !takeOver(path)) return false;
+      }
+      return false;
+    }
+
+    // the claim stays fresh while frames finish, unless it was taken over
+    void heartbeat(const Chunk& chunk)
+    {
+      const std::string path = claimPath(chunk);
+      std::string owner;
+      if(BatchDetail::ReadFile(path, owner) && owner == token(chunk)) {
+        utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+      }
+    }
+
+    // journal, mark done, then drop the claim
+    bool finish(const Chunk& chunk, const Record& r)
+    {
+      char line[256];
+      const int n = std::snprintf(
+          line, sizeof(line), "chunk %s %d %.6f %llu %llu %.3f\n",
+          chunk.name().c_str(), r.frames, r.seconds,
+          static_cast<unsigned long long>(r.bytesIn),
+          static_cast<unsigned long long>(r.bytesOut), BatchDetail::Now());
+      const bool journaled = write(journal, line, n) == n &&
+                             fsync(journal) == 0 &&
+                             BatchDetail::WriteAtomic(donePath(chunk),
+                                                      name + "\n", name);
+      drop(chunk);
+      return journaled;
+    }
+
+    // give a failed chunk back for a later run
+    void release(const Chunk& chunk) { drop(chunk); }
+
+   private:
+    std::string claimPath(const Chunk& chunk) const
+    {
+      return job.state + "/claims/" + chunk.name();
+    }
+
+    std::string donePath(const Chunk& chunk) const
+    {
+      return job.state + "/done/" + chunk.name();
+    }
+
+    // the "host pid token" line written by claim(), empty when not ours
+    std::string token(const Chunk& chunk) const
+    {
+      const auto found = owned.find(chunk.name());
+      return found != owned.end() ? found->second : std::string();
+    }
+
+    // Removes the claim if it is still ours. A worker that took it over
+    // keeps it: the claim is renamed aside like in takeOver() and put back
+    // when the token differs.
+    void drop(const Chunk& chunk)
+    {
+      const std::string ours = token(chunk);
+      owned.erase(chunk.name());
+      if(ours.empty()) return;
+
+      const std::string path = claimPath(chunk);
+      const std::string aside = path + ".drop-" + name;
+      if(std::rename(path.c_str(), aside.c_str()) != 0) return;
+      std::string moved;
+      if(!BatchDetail::ReadFile(aside, moved) || moved != ours) {
+        link(aside.c_str(), path.c_str());
+      }
+      unlink(aside.c_str());
+    }
+
+    // a dead owner on this host, or no heartbeat for 'stale' seconds
+    bool stale(const std::string& owner, const struct stat& info) const
+    {
+      char ownerHost[256] = {0};
+      long pid = 0;
+      if(std::sscanf(owner.c_str(), "%255s %ld", ownerHost, &pid) == 2 &&
+         host == ownerHost && pid > 0 &&
+         kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH) {
+        return true;
+      }
+      return BatchDetail::Now() - static_cast<double>(info.st_mtime) >
+             job.stale;
+    }
+
+    bool takeOver(const std::string& path)
+    {
+      std::string owner;
+      struct stat info;
+      if(stat(path.c_str(), &info) != 0 ||
+         !BatchDetail::ReadFile(path, owner) || owner.empty() ||
+         !stale(owner, info)) {
+        return false;
+      }
+      // only one worker moves a given claim aside
+      const std::string aside = path + ".stale-" + name;
+      if(std::rename(path.c_str(), aside.c_str()) != 0) return false;
+      std::string moved;
+      const bool same = BatchDetail::ReadFile(aside, moved) && moved == owner;
+      if(!same) {
+        // someone reclaimed it in between: put theirs back
+        link(aside.c_str(), path.c_str());
+      }
+      unlink(aside.c_str());
+      return same;
+    }
+
+    const Job& job;
+    std::string name;
+    std::string host;
+    int journal = -1;
+    uint64_t claims = 0;
+    // claim file contents by chunk name, for the claims this worker holds
+    std::map<std::string, std::string> owned;
+  };
+
+  // Per worker totals from the journals, as text, also written to
+  // <state>/summary.txt. Chunks journaled twice count once.
+  inline bool WriteSummary(const Job& job, const std::string& writer,
+                           std::string& text, std::string* error)
+  {
+    struct Totals
+    {
+      int chunks = 0;
+      long frames = 0;
+      double seconds = 0;
+      uint64_t bytesIn = 0;
+      uint64_t bytesOut = 0;
+      double start = 1e300;
+      double end = 0;
+    };
+    std::map<std::string, std::pair<std::string, Record>> chunks;
+    std::map<std::string, double> ends;
+
+    const std::string dir = job.state + "/journal";
+    DIR* d = opendir(dir.c_str());
+    if(d == nullptr) return BatchDetail::Fail(error, dir + ": cannot open");
+    while(dirent* entry = readdir(d)) {
+      const std::string file = entry->d_name;
+      if(file.size() < 5 || file.compare(file.size() - 4, 4, ".log")) {
+        continue;
+      }
+      const std::string worker = file.substr(0, file.size() - 4);
+      std::string log;
+      if(!BatchDetail::ReadFile(dir + "/" + file, log)) continue;
+      for(size_t start = 0; start < log.size();) {
+        size_t end = log.find('\n', start);
+        if(end == std::string::npos) break;  // cut short, not journaled
+        const std::string line = log.substr(start, end - start);
+        start = end + 1;
+        char chunk[64];
+        Record r;
+        unsigned long long in, out;
+        double at;
+        if(std::sscanf(line.c_str(), "chunk %63s %d %lf %llu %llu %lf",
+                       chunk, &r.frames, &r.seconds, &in, &out, &at) == 6) {
+          r.bytesIn = in;
+          r.bytesOut = out;
+          chunks[chunk] = {worker, r};
+          ends[chunk] = at;
+        }
+      }
+    }
+    closedir(d);
+
+    std::map<std::string, Totals> workers;
+    Totals all;
+    for(const auto& c : chunks) {
+      const Record& r = c.second.second;
+      const double end = ends[c.first];
+      for(Totals* t : {&workers[c.second.first], &all}) {
+        ++t->chunks;
+        t->frames += r.frames;
+        t->seconds += r.seconds;
+        t->bytesIn += r.bytesIn;
+        t->bytesOut += r.bytesOut;
+        t->start = std::min(t->start, end - r.seconds);
+        t->end = std::max(t->end, end);
+      }
+    }
+
+    const size_t total = Chunks(job).size();
+    char line[256];
+    text = "# gcolorspace batch summary: " + std::to_string(all.chunks) +
+           " of " + std::to_string(total) + " chunks done\n";
+    std::snprintf(line, sizeof(line), "%-32s %7s %8s %9s %9s %9s %9s\n",
+                  "# worker", "chunks", "frames", "busy s", "frames/s",
+                  "MB/s in", "MB/s out");
+    text += line;
+    auto row = [&](const std::string& label, const Totals& t, double span) {
+      const double s = std::max(span, 1e-9);
+      std::snprintf(line, sizeof(line),
+                    "%-32s %7d %8ld %9.1f %9.2f %9.1f %9.1f\n", label.c_str(),
+                    t.chunks, t.frames, t.seconds, t.frames / s,
+                    t.bytesIn / s * 1e-6, t.bytesOut / s * 1e-6);
+      text += line;
+    };
+    // a worker's rate over its busy time, the job's over its wall time
+    for(const auto& w : workers) row(w.first, w.second, w.second.seconds);
+    if(all.chunks > 0) row("total (wall clock)", all, all.end - all.start);
+
+    if(!BatchDetail::WriteAtomic(job.state + "/summary.txt", text,
+                                 BatchDetail::Safe(writer))) {
+      return BatchDetail::Fail(error, job.state + "/summary.txt: cannot "
+                                                  "write");
+    }
+    return true;
+  }
+
+  // Claims and converts chunks until none is left, starting at a worker
+  // dependent chunk so workers spread out. convert(sequence index, frame,
+  // record, error) converts one frame and adds its bytes to the record.
+  // Returns the number of chunks that failed (released for another run).
+  inline int Run(const Job& job, Worker& worker,
+                 const std::function<bool(int, int, Record&, std::string*)>&
+                     convert)
+  {
+    const std::vector<Chunk> chunks = Chunks(job);
+    const size_t offset = std::hash<std::string>()(worker.id()) %
+                          std::max<size_t>(chunks.size(), 1);
+    int failed = 0;
+    for(size_t i = 0; i < chunks.size(); ++i) {
+      const Chunk& chunk = chunks[(offset + i) % chunks.size()];
+      if(worker.done(chunk) || !worker.claim(chunk)) continue;
+
+      Record r;
+      const auto start = std::chrono::steady_clock::now();
+      std::string error;
+      bool ok = true;
+      for(int f = chunk.first; f <= chunk.last && ok; ++f) {
+        ok = convert(chunk.sequence, f, r, &error);
+        if(ok) ++r.frames;
+        worker.heartbeat(chunk);
+      }
+      r.seconds = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+      if(ok && worker.finish(chunk, r)) continue;
+      if(ok) error = "cannot journal the chunk";
+      std::fprintf(stderr, "%s: chunk %s: %s\n", worker.id().c_str(),
+                   chunk.name().c_str(), error.c_str());
+      worker.release(chunk);
+      ++failed;
+    }
+    return failed;
+  }
+}  // namespace Batch
+
+#endif  // BATCH_JOB_H
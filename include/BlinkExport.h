@@ -0,0 +1,506 @@
+#ifndef BLINK_EXPORT_H
+#define BLINK_EXPORT_H
+
+// Generates one BlinkScript ImageComputationKernel for a TransformPlan, the
+// fused in curve -> white matrix -> out curve -> removeExp pipeline with
+// every constant inlined, so Blink's vectorized CPU backend runs the same
+// maths as the plugin.
+//
+// The curve code is emitted from the tables the plugin itself runs: log
+// cameras from their LogCurve coefficients, Y'CbCr from its YCbCrCoeffs and
+// the other curves from the ColorLut.h formulas. Matrices next to each
+// other (XYZ, Lab, Y'CbCr and the white adaptation) are folded into one.
+// The maths sits in a plain gcolorspace(float3) function ahead of the
+// kernel, which is what keeps it checkable as C++. LUT files have no Blink
+// form and are refused.
+
+#include <set>
+#include <string>
+
+#include "include/ClfExport.h"
+
+namespace BlinkDetail
+{
+  using ClfDetail::Matrix34;
+
+  // float literal that also reads back as a float in C++
+  inline std::string Literal(double v)
+  {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", v);
+    std::string s = text;
+    if(s.find_first_of(".e") == std::string::npos) s += ".0";
+    return s + "f";
+  }
+
+  // " + v", " - |v|" or nothing for 0
+  inline std::string Plus(double v)
+  {
+    if(v == 0.0) return std::string();
+    return (v < 0.0 ? " - " : " + ") + Literal(std::fabs(v));
+  }
+
+  // the kernel under construction, statements work on float r, g, b
+  class Writer
+  {
+   public:
+    // folded into the matrix waiting to be written
+    void matrix(const Matrix34& m)
+    {
+      pending = ClfDetail::Compose(m, pending);
+    }
+
+    // statements, after the matrix waiting before them
+    void code(const std::string& statements)
+    {
+      flush();
+      body += statements;
+    }
+
+    // 'name' from 'definition' once, then on each channel
+    void curve(const std::string& name, const std::string& definition)
+    {
+      define(name, definition);
+      code("  r = " + name + "(r);\n  g = " + name + "(g);\n  b = " + name +
+           "(b);\n");
+    }
+
+    // a helper function that is called from code()
+    void define(const std::string& name, const std::string& definition)
+    {
+      if(defined.insert(name).second) functions += definition + "\n";
+    }
+
+    std::string source(const std::string& header)
+    {
+      flush();
+      std::string s = header;
+      s += functions;
+      s += "inline float3 gcolorspace(const float3 rgb)\n{\n";
+      s += "  float r = rgb.x;\n  float g = rgb.y;\n  float b = rgb.z;\n\n";
+      s += body;
+      s += "\n  return float3(r, g, b);\n}\n";
+      return s;
+    }
+
+   private:
+    void flush()
+    {
+      // even the rounding of an equal white adaptation leaks between
+      // channels on large values, so only the exact identity is skipped
+      if(ClfDetail::IsIdentity(pending, 0.0)) return;
+      std::string s = "  {\n    const float x = r, y = g, z = b;\n";
+      const char* const out[3] = {"r", "g", "b"};
+      const char* const in[3] = {"x", "y", "z"};
+      for(int i = 0; i < 3; ++i) {
+        s += std::string("    ") + out[i] + " =";
+        bool first = true;
+        for(int j = 0; j < 4; ++j) {
+          const double v = pending[4 * i + j];
+          if(v == 0.0) continue;
+          s += first ? (v < 0.0 ? " -" : " ") : (v < 0.0 ? " - " : " + ");
+          s += Literal(std::fabs(v));
+          if(j < 3) s += std::string(" * ") + in[j];
+          first = false;
+        }
+        if(first) s += " 0.0f";
+        s += ";\n";
+      }
+      body += s + "  }\n";
+      pending = ClfDetail::Affine(matIdentity);
+    }
+
+    Matrix34 pending = ClfDetail::Affine(matIdentity);
+    std::set<std::string> defined;
+    std::string functions;
+    std::string body;
+  };
+
+  inline const char* SRGBInFunction()
+  {
+    return "inline float srgbIn(const float v)\n"
+           "{\n"
+           "  return v <= 0.04045f ? v / 12.92f\n"
+           "                       : pow((v + 0.055f) / 1.055f, 2.4f);\n"
+           "}\n";
+  }
+
+  inline const char* SRGBOutFunction()
+  {
+    return "inline float srgbOut(const float v)\n"
+           "{\n"
+           "  return v <= 0.0031308f ? 12.92f * v\n"
+           "                         : 1.055f * pow(v, 1.0f / 2.4f) - "
+           "0.055f;\n"
+           "}\n";
+  }
+
+  // LogCurveInScalar / LogCurveOutScalar with the coefficients inlined
+  inline std::string LogFunction(const std::string& name,
+                                 const LogCurveCoeffs& k, bool in)
+  {
+    const bool toe = (k.flags & LogCurve::LOG_TOE) != 0;
+    const bool mirror = (k.flags & LogCurve::LOG_MIRROR) != 0;
+    const bool range = (k.flags & LogCurve::LOG_RANGE) != 0;
+    std::string s = "inline float " + name + "(const float v)\n{\n";
+    if(in) {
+      if(range) {
+        s += "  if(v < " + Literal(k.logMin) + " || v > " +
+             Literal(k.logMax) + ") return 0.0f;\n";
+      }
+      if(toe) {
+        s += "  if(v < " + Literal(k.logBreak) + ") return (v" +
+             Plus(-k.toeOffset) + ") * " + Literal(k.toeSlopeInv) + ";\n";
+      }
+      s += "  const float d = v" + Plus(-k.logOffset) + ";\n";
+      s += std::string("  const float x = (exp(") +
+           (mirror ? "fabs(d)" : "d") + " * " + Literal(k.decodeGain) + ")" +
+           Plus(-k.linOffset) + ") * " + Literal(k.linSlopeInv) + ";\n";
+      s += mirror ? "  return d < 0.0f ? -x : x;\n" : "  return x;\n";
+    }
+    else {
+      if(range) {
+        s += "  if(v < " + Literal(k.linMin) + " || v > " +
+             Literal(k.linMax) + ") return 0.0f;\n";
+      }
+      if(toe) {
+        s += "  if(v < " + Literal(k.linBreak) + ") return " +
+             Literal(k.toeSlope) + " * v" + Plus(k.toeOffset) + ";\n";
+      }
+      s += std::string("  const float y = ") + Literal(k.encodeGain) +
+           " * log(" + Literal(k.linSlope) + " * " +
+           (mirror ? "fabs(v)" : "v") + Plus(k.linOffset) + ");\n";
+      s += std::string("  return ") + (mirror ? "(v < 0.0f ? -y : y)" : "y") +
+           Plus(k.logOffset) + ";\n";
+    }
+    return s + "}\n";
+  }
+
+  // per channel curves without coefficient tables, false when unknown
+  inline bool CurveFunction(int colorspace, bool in, const std::string& name,
+                            std::string& s)
+  {
+    const double gamma = ClfDetail::GammaOf(colorspace);
+    s = "inline float " + name + "(const float v)\n{\n";
+    if(gamma > 0.0) {
+      s += "  return pow(v, " + Literal(in ? gamma : 1.0 / gamma) + ");\n";
+      s += "}\n";
+      return true;
+    }
+
+    switch(colorspace) {
+      case Constants::COLOR_REC709:
+        s += in ? "  return v <= 0.081f ? v / 4.5f\n"
+                  "                     : pow((v + 0.099f) / 1.099f, "
+                  "1.0f / 0.45f);\n"
+                : "  return v <= 0.018f ? v * 4.5f\n"
+                  "                     : 1.099f * pow(v, 0.45f) - "
+                  "0.099f;\n";
+        break;
+      case Constants::COLOR_PLOGLIN:
+        s += in ? "  return 0.18f * pow(10.0f, (v * 1023.0f - 445.0f) * "
+                  "0.002f / 0.6f);\n"
+                : "  return (445.0f + log10(max(v, 1e-10f) / 0.18f) * "
+                  "0.6f / 0.002f) /\n         1023.0f;\n";
+        break;
+      case Constants::COLOR_HYBRID_LOG_GAMMA:
+        s += in ? "  if(v <= " + Literal(std::sqrt(3.0f * 0.0833f)) +
+                      ") return v * v / 3.0f;\n"
+                      "  return (exp((v - 0.55991073f) / 0.17883277f) + "
+                      "0.28466892f) / 12.0f;\n"
+                : "  if(v <= 0.0833f) return sqrt(3.0f * v);\n"
+                  "  return 0.17883277f * log(12.0f * v - 0.28466892f) + "
+                  "0.55991073f;\n";
+        break;
+      case Constants::COLOR_ST2084:
+        s += in ? "  const float p = pow(v, 1.0f / 78.84375f);\n"
+                  "  return 10000.0f * pow(max(p - 0.8359375f, 0.0f) /\n"
+                  "                            (18.8515625f - 18.6875f * p),\n"
+                  "                        1.0f / 0.1593017578125f);\n"
+                : "  const float p = pow(v / 10000.0f, 0.1593017578125f);\n"
+                  "  return pow((0.8359375f + 18.8515625f * p) / "
+                  "(1.0f + 18.6875f * p),\n             78.84375f);\n";
+        break;
+      default:
+        return false;
+    }
+    s += "}\n";
+    return true;
+  }
+
+  // hue sectors of LinToHSV / LinToHSL, c, x and m are set before
+  inline std::string HueSectors()
+  {
+    return "    float R = 0.0f, G = 0.0f, B = 0.0f;\n"
+           "    if(h >= 0.0f && h < 60.0f) { R = c + m; G = x + m; B = m; }\n"
+           "    else if(h >= 60.0f && h < 120.0f) { R = x + m; G = c + m; "
+           "B = m; }\n"
+           "    else if(h >= 120.0f && h < 180.0f) { R = m; G = c + m; "
+           "B = x + m; }\n"
+           "    else if(h >= 180.0f && h < 240.0f) { R = m; G = x + m; "
+           "B = c + m; }\n"
+           "    else if(h >= 240.0f && h < 300.0f) { R = x + m; G = m; "
+           "B = c + m; }\n"
+           "    else if(h >= 300.0f && h < 360.0f) { R = c + m; G = m; "
+           "B = x + m; }\n"
+           "    r = R;\n    g = G;\n    b = B;\n";
+  }
+
+  // cmax, cmin and delta of r, g, b, then the hue of HSVToLin / HSLToLin
+  inline std::string Hue(bool wrapAll)
+  {
+    const std::string wrap = wrapAll ? "fmod(" : "(";
+    const std::string end = wrapAll ? ", 360.0f)" : ")";
+    return "    const float cmax = max(max(r, g), b);\n"
+           "    const float cmin = min(min(r, g), b);\n"
+           "    const float delta = cmax - cmin;\n"
+           "    float h = 0.0f;\n"
+           "    if(delta == 0.0f) h = 0.0f;\n"
+           "    else if(cmax == r) h = fmod(60.0f * ((g - b) / delta) + "
+           "360.0f, 360.0f) / 360.0f;\n"
+           "    else if(cmax == g) h = " +
+           wrap + "60.0f * ((b - r) / delta) + 120.0f" + end +
+           " / 360.0f;\n"
+           "    else if(cmax == b) h = " +
+           wrap + "60.0f * ((r - g) / delta) + 240.0f" + end + " / 360.0f;\n";
+  }
+
+  inline void LabIn(Writer& w)
+  {
+    w.define("labIn",
+             "inline float labIn(const float v)\n"
+             "{\n"
+             "  return v > 0.206893f ? v * v * v : (v - 0.137931f) / "
+             "7.787f;\n"
+             "}\n");
+    w.code("  {\n"
+           "    const float fy = (r + 0.16f) / 1.16f;\n"
+           "    const float fx = fy + g / 5.0f;\n"
+           "    const float fz = fy - b / 2.0f;\n"
+           "    r = labIn(fx);\n    g = labIn(fy);\n    b = labIn(fz);\n"
+           "  }\n");
+    w.matrix(ClfDetail::Affine(matSRGBToXYZ_B));
+  }
+
+  inline void LabOut(Writer& w)
+  {
+    w.define("labOut",
+             "inline float labOut(const float v)\n"
+             "{\n"
+             "  return v > 0.008856f ? pow(v, 0.333333f) : 7.787f * v + "
+             "0.137931f;\n"
+             "}\n");
+    w.matrix(ClfDetail::Affine(matXYZToSRGB_B));
+    w.code("  {\n"
+           "    const float fx = labOut(r);\n"
+           "    const float fy = labOut(g);\n"
+           "    const float fz = labOut(b);\n"
+           "    r = 1.16f * fy - 0.16f;\n"
+           "    g = 5.0f * (fx - fy);\n"
+           "    b = 2.0f * (fy - fz);\n"
+           "  }\n");
+  }
+
+  // one curve stage, false with 'error' set when it has no Blink form
+  inline bool Stage(const TransformSettings& s, int colorspace, bool in,
+                    Writer& w, std::string* error)
+  {
+    const std::string name = in ? "inCurve" : "outCurve";
+    YCbCrCoeffs ycc;
+    switch(colorspace) {
+      case Constants::COLOR_LINEAR:
+        return true;
+      case Constants::COLOR_SRGB:
+        if(in) {
+          w.curve("srgbIn", SRGBInFunction());
+        }
+        else {
+          w.curve("srgbOut", SRGBOutFunction());
+        }
+        return true;
+      case Constants::COLOR_CIE_XYZ:
+        w.matrix(ClfDetail::Affine(in ? matSRGBToXYZ : matXYZToSRGB));
+        return true;
+      case Constants::COLOR_Y_CB_CR:
+      case Constants::COLOR_Y_PB_PR:
+        if(!TransformDetail::UseYCbCr(s, colorspace, ycc)) {
+          ycc = MakeYCbCrCoeffs(Constants::YCC_REC709,
+                                Constants::YCC_RANGE_LEGAL,
+                                colorspace == Constants::COLOR_Y_PB_PR);
+        }
+        if(in) {
+          w.matrix(ClfDetail::YCbCrMatrix(ycc, true));
+          w.curve("srgbIn", SRGBInFunction());
+        }
+        else {
+          w.curve("srgbOut", SRGBOutFunction());
+          w.matrix(ClfDetail::YCbCrMatrix(ycc, false));
+        }
+        return true;
+      case Constants::COLOR_CIE_YXY:
+        if(in) {
+          w.code("  {\n"
+                 "    const float d = b > 1e-6f ? r / b : 0.0f;\n"
+                 "    const float x = g * d;\n"
+                 "    const float z = (1.0f - g - b) * d;\n"
+                 "    g = r;\n    r = x;\n    b = z;\n"
+                 "  }\n");
+          w.matrix(ClfDetail::Affine(matSRGBToXYZ));
+        }
+        else {
+          w.matrix(ClfDetail::Affine(matXYZToSRGB));
+          w.code("  {\n"
+                 "    const float sum = r + g + b;\n"
+                 "    const float x = sum > 1e-6f ? r / sum : 0.0f;\n"
+                 "    const float y = sum > 1e-6f ? g / sum : 0.0f;\n"
+                 "    r = g;\n    g = x;\n    b = y;\n"
+                 "  }\n");
+        }
+        return true;
+      case Constants::COLOR_LAB:
+        if(in) {
+          LabIn(w);
+        }
+        else {
+          LabOut(w);
+        }
+        return true;
+      case Constants::COLOR_CIE_LCH:
+        if(in) {
+          w.code("  {\n"
+                 "    const float rad = b * 3.60f * " + Literal(_PI) +
+                 " / 1.80f;\n"
+                 "    b = g * sin(rad);\n"
+                 "    g = g * cos(rad);\n"
+                 "  }\n");
+          LabIn(w);
+        }
+        else {
+          LabOut(w);
+          w.code("  {\n"
+                 "    float h = atan2(b, g) * 1.80f / " + Literal(_PI) +
+                 ";\n"
+                 "    if(h < 0.0f) h += 3.60f;\n"
+                 "    g = sqrt(g * g + b * b);\n"
+                 "    b = h / 3.60f;\n"
+                 "  }\n");
+        }
+        return true;
+      case Constants::COLOR_HSV:
+      case Constants::COLOR_HSL: {
+        const bool hsv = colorspace == Constants::COLOR_HSV;
+        if(in) {
+          w.code(std::string("  {\n"
+                             "    const float h = r * 360.0f;\n") +
+                 (hsv ? "    const float c = b * g;\n"
+                      : "    const float c = (1.0f - fabs(2.0f * b - 1.0f)) "
+                        "* g;\n") +
+                 "    const float x = c * (1.0f - fabs(fmod(h / 60.0f, "
+                 "2.0f) - 1.0f));\n" +
+                 (hsv ? "    const float m = b - c;\n"
+                      : "    const float m = b - c / 2.0f;\n") +
+                 HueSectors() + "  }\n");
+          w.curve("srgbIn", SRGBInFunction());
+        }
+        else {
+          w.curve("srgbOut", SRGBOutFunction());
+          w.code("  {\n" + Hue(hsv) +
+                 (hsv ? "    g = cmax == 0.0f ? 0.0f : delta / cmax;\n"
+                        "    b = cmax;\n"
+                      : "    b = (cmax + cmin) / 2.0f;\n"
+                        "    g = delta == 0.0f ? 0.0f\n"
+                        "                      : delta / (1.0f - fabs(2.0f "
+                        "* b - 1.0f));\n") +
+                 "    r = h;\n  }\n");
+        }
+        return true;
+      }
+      default:
+        break;
+    }
+
+    const LogCurveCoeffs* k = LogCurveFor(colorspace);
+    if(k != nullptr) {
+      w.curve(name, LogFunction(name, *k, in));
+      return true;
+    }
+    std::string definition;
+    if(CurveFunction(colorspace, in, name, definition)) {
+      w.curve(name, definition);
+      return true;
+    }
+    if(error != nullptr) {
+      *error = std::string(Constants::COLOR_CURVE[colorspace]) +
+               " has no BlinkScript form";
+    }
+    return false;
+  }
+}  // namespace BlinkDetail
+
+// BlinkScript source of the plan's exact pipeline, empty with 'error' set
+// when part of it cannot be generated
+inline std::string BlinkKernelSource(const TransformPlan& plan,
+                                     std::string* error)
+{
+  using namespace BlinkDetail;
+  const TransformSettings& s = plan.settings;
+  if(s.lutFile != nullptr) {
+    if(error != nullptr) {
+      *error = "LUT files have no BlinkScript form, apply them in a separate "
+               "node";
+    }
+    return std::string();
+  }
+
+  Writer w;
+  if(!plan.curvesIdentity) {
+    if(!Stage(s, s.colorIn, true, w, error)) return std::string();
+    w.matrix(ClfDetail::Affine(plan.white.data()));
+    if(!Stage(s, s.colorOut, false, w, error)) return std::string();
+  }
+  w.code("  // removeExp\n"
+         "  if(fabs(r) < 1e-10f) r = 0.0f;\n"
+         "  if(fabs(g) < 1e-10f) g = 0.0f;\n"
+         "  if(fabs(b) < 1e-10f) b = 0.0f;\n");
+
+  const std::string in = ClfDetail::Side(s.colorIn, s.whiteIn, s.primaryIn);
+  const std::string out =
+      ClfDetail::Side(s.colorOut, s.whiteOut, s.primaryOut);
+  std::string source =
+      w.source("// GColorspace " + in + " to " + out + "\n// generated, " +
+               "edit the node and export again instead of this file\n\n");
+  source += "\n"
+            "kernel GColorspaceKernel : ImageComputationKernel<ePixelWise>\n"
+            "{\n"
+            "  Image<eRead, eAccessPoint, eEdgeClamped> src;\n"
+            "  Image<eWrite> dst;\n"
+            "\n"
+            "  void process()\n"
+            "  {\n"
+            "    SampleType(src) input = src();\n"
+            "    const float3 rgb = gcolorspace(float3(input.x, input.y, "
+            "input.z));\n"
+            "    dst() = float4(rgb.x, rgb.y, rgb.z, input.w);\n"
+            "  }\n"
+            "};\n";
+  return source;
+}
+
+// Writes the kernel of 'plan' to 'path'
+inline bool ExportBlink(const TransformPlan& plan, const std::string& path,
+                        std::string* error)
+{
+  const std::string source = BlinkKernelSource(plan, error);
+  if(source.empty()) return false;
+  FILE* f = std::fopen(path.c_str(), "wb");
+  const bool ok = f != nullptr &&
+                  std::fwrite(source.data(), 1, source.size(), f) ==
+                      source.size();
+  if((f != nullptr && std::fclose(f) != 0) || !ok) {
+    if(error != nullptr) *error = path + ": cannot write";
+    return false;
+  }
+  return true;
+}
+
+#endif  // BLINK_EXPORT_H
@@ -0,0 +1,259 @@
+#ifndef CHROMA_SUBSAMPLE_H
+#define CHROMA_SUBSAMPLE_H
+
+// Chroma subsampled Y'CbCr output (4:2:2 / 4:2:0) for video deliverables.
+//
+// Linear float RGB goes through the sRGB curve, the YCbCr matrix, the chroma
+// filter and the packer block by block, so every intermediate stays in L1
+// and each source row is read once. Rows are handed over one at a time for
+// 4:2:2 and in pairs for 4:2:0.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "include/Constants.h"
+#include "include/GammaCurve.h"
+#include "include/Simd.h"
+#include "include/YCbCr.h"
+
+enum ChromaFormats { CHROMA_422, CHROMA_420 };
+
+// Chroma sample position, same numbering as the H.264/HEVC
+// chroma_sample_loc_type
+enum ChromaSitings {
+  CHROMA_SITING_LEFT,     // co-sited horizontally, between rows (MPEG-2)
+  CHROMA_SITING_CENTER,   // between pixels and rows (JPEG, MPEG-1)
+  CHROMA_SITING_TOP_LEFT  // co-sited with the top left pixel (Rec.2020 UHD)
+};
+
+enum ChromaLayouts {
+  CHROMA_LAYOUT_PLANAR,  // Y, Cb and Cr planes, codes in the low bits
+  CHROMA_LAYOUT_P010,    // Y plane and interleaved CbCr plane, codes in the
+                         // high bits (P010 for 4:2:0, P210 for 4:2:2)
+  CHROMA_LAYOUT_V210     // 4:2:2 10 bit, 6 pixels in 4 little endian words
+};
+
+struct ChromaEncoder
+{
+  int format;
+  int siting;
+  int layout;
+  int bits;
+  // encode matrix in code units, rows are Y', Cb, Cr
+  float y[3], cb[3], cr[3];
+  float yLo, cMid;
+  float codeMax;
+};
+
+inline ChromaEncoder MakeChromaEncoder(int matrix, int range, int bits,
+                                       int format, int siting, int layout)
+{
+  // v210 only exists as 4:2:2 10 bit
+  if(layout == CHROMA_LAYOUT_V210) {
+    bits = 10;
+    format = CHROMA_422;
+  }
+
+  const YCbCrCodeRange codes = MakeYCbCrCodeRange(range, bits);
+  double rows[3][3];
+  YCbCrCodeMatrix(matrix, codes, rows);
+
+  ChromaEncoder e;
+  e.format = format;
+  e.siting = siting;
+  e.layout = layout;
+  e.bits = bits;
+  for(int i = 0; i < 3; ++i) {
+    e.y[i] = static_cast<float>(rows[0][i]);
+    e.cb[i] = static_cast<float>(rows[1][i]);
+    e.cr[i] = static_cast<float>(rows[2][i]);
+  }
+  e.yLo = static_cast<float>(codes.yLo);
+  e.cMid = static_cast<float>(codes.cMid);
+  e.codeMax = static_cast<float>((1 << bits) - 1);
+  return e;
+}
+
+// Destination of one call. Planar and P010 take 16 bit rows, the chroma row
+// holds width / 2 samples (interleaved pairs for P010). v210 takes one
+// packed row of V210RowBytes(width).
+struct ChromaRows
+{
+  uint16_t* y0;
+  uint16_t* y1;  // second luma row, 4:2:0 only
+  uint16_t* cb;  // P010: interleaved CbCr
+  uint16_t* cr;
+  uint32_t* v210;
+};
+
+// v210 rows are padded to groups of 48 pixels (128 bytes)
+inline int V210RowBytes(int width)
+{
+  return (width + 47) / 48 * 128;
+}
+
+inline int ChromaWidth(int width)
+{
+  return (width + 1) / 2;
+}
+
+namespace ChromaDetail
+{
+  // chroma samples per block, a multiple of 3 so v210 groups of 6 pixels
+  // never straddle two blocks
+  constexpr int kBlock = 48;
+  constexpr int kPixels = kBlock * 2;
+
+  // Gathers pixels [x0 - 1, x0 + count] with edge clamping and turns them
+  // into Y', Cb, Cr in code units, in place in the block buffers. Index 0 is
+  // the left neighbour used by the co-sited filter.
+  inline void Encode(const ChromaEncoder& e, const float* r, const float* g,
+                     const float* b, int width, int x0, int count, float* Y,
+                     float* Cb, float* Cr)
+  {
+    const int first = x0 - 1;
+    const int n = count + 2;
+    for(int i = 0; i < n; ++i) {
+      const int x = std::min(std::max(first + i, 0), width - 1);
+      Y[i] = r[x];
+      Cb[i] = g[x];
+      Cr[i] = b[x];
+    }
+
+    using namespace Simd;
+    const vfloat zero = set1(0.0f);
+    const vfloat one = set1(1.0f);
+    const vfloat hi = set1(e.codeMax);
+    Simd::forEach3(Y, Cb, Cr, n, [&](vfloat& x, vfloat& u, vfloat& v) {
+      // max() first so NaN lands on 0
+      const vfloat R = min(max(SRGBCurveOut(x), zero), one);
+      const vfloat G = min(max(SRGBCurveOut(u), zero), one);
+      const vfloat B = min(max(SRGBCurveOut(v), zero), one);
+
+      const vfloat y = madd(set1(e.y[0]), R,
+                            madd(set1(e.y[1]), G, mul(set1(e.y[2]), B)));
+      x = min(max(round(add(y, set1(e.yLo))), zero), hi);
+      u = madd(set1(e.cb[0]), R, madd(set1(e.cb[1]), G, mul(set1(e.cb[2]), B)));
+      v = madd(set1(e.cr[0]), R, madd(set1(e.cr[1]), G, mul(set1(e.cr[2]), B)));
+    });
+  }
+
+  // Horizontal decimation of one chroma plane. Co-sited samples use the
+  // [1 2 1] / 4 filter centred on the even pixel, centre siting averages
+  // each pixel pair. 'c' starts at the left neighbour (see Encode).
+  inline void Decimate(const ChromaEncoder& e, const float* c, int samples,
+                       uint16_t* dst)
+  {
+    const float mid = e.cMid + 0.5f;
+    if(e.siting == CHROMA_SITING_CENTER) {
+      for(int j = 0; j < samples; ++j) {
+        const float v = 0.5f * (c[2 * j + 1] + c[2 * j + 2]) + mid;
+        dst[j] = static_cast<uint16_t>(std::min(std::max(v, 0.0f), e.codeMax));
+      }
+    }
+    else {
+      for(int j = 0; j < samples; ++j) {
+        const float v =
+            0.25f * (c[2 * j] + 2.0f * c[2 * j + 1] + c[2 * j + 2]) + mid;
+        dst[j] = static_cast<uint16_t>(std::min(std::max(v, 0.0f), e.codeMax));
+      }
+    }
+  }
+
+  inline void StoreLuma(const float* Y, int count, uint16_t* dst, int shift)
+  {
+    for(int i = 0; i < count; ++i) {
+      dst[i] = static_cast<uint16_t>(static_cast<int>(Y[i + 1]) << shift);
+    }
+  }
+
+  // 6 pixels -> 4 words, Cb Y Cr / Y Cb Y / Cr Y Cb / Y Cr Y
+  inline void PackV210(const uint16_t* y, const uint16_t* cb,
+                       const uint16_t* cr, int pixels, uint32_t* dst)
+  {
+    for(int i = 0; i < pixels; i += 6) {
+      const uint16_t* Y = y + i;
+      const uint16_t* U = cb + i / 2;
+      const uint16_t* V = cr + i / 2;
+      dst[0] = U[0] | (Y[0] << 10) | (static_cast<uint32_t>(V[0]) << 20);
+      dst[1] = Y[1] | (U[1] << 10) | (static_cast<uint32_t>(Y[2]) << 20);
+      dst[2] = V[1] | (Y[3] << 10) | (static_cast<uint32_t>(U[2]) << 20);
+      dst[3] = Y[4] | (V[2] << 10) | (static_cast<uint32_t>(Y[5]) << 20);
+      dst += 4;
+    }
+  }
+}  // namespace ChromaDetail
+
+// Encodes one output row (4:2:2) or row pair (4:2:0) of linear float RGB.
+// r1/g1/b1 and rows.y1 are only read for 4:2:0.
+inline void ChromaEncodeRows(const ChromaEncoder& e, const float* r0,
+                             const float* g0, const float* b0, const float* r1,
+                             const float* g1, const float* b1, int width,
+                             const ChromaRows& rows)
+{
+  using namespace ChromaDetail;
+  constexpr int kBuffer = kPixels + 2;
+  float Y0[kBuffer], Cb0[kBuffer], Cr0[kBuffer];
+  float Y1[kBuffer], Cb1[kBuffer], Cr1[kBuffer];
+  uint16_t yCodes[kPixels], cbCodes[kBlock], crCodes[kBlock];
+
+  const bool pair = e.format == CHROMA_420;
+  const int lumaShift = e.layout == CHROMA_LAYOUT_P010 ? 16 - e.bits : 0;
+
+  for(int x0 = 0; x0 < width; x0 += kPixels) {
+    const int count = std::min(kPixels, width - x0);
+    const int samples = ChromaWidth(count);
+    const int c0 = x0 / 2;
+
+    Encode(e, r0, g0, b0, width, x0, count, Y0, Cb0, Cr0);
+    if(pair) {
+      Encode(e, r1, g1, b1, width, x0, count, Y1, Cb1, Cr1);
+      // vertical siting: between the rows, or on the top row
+      if(e.siting != CHROMA_SITING_TOP_LEFT) {
+        for(int i = 0; i < count + 2; ++i) {
+          Cb0[i] = 0.5f * (Cb0[i] + Cb1[i]);
+          Cr0[i] = 0.5f * (Cr0[i] + Cr1[i]);
+        }
+      }
+    }
+
+    Decimate(e, Cb0, samples, cbCodes);
+    Decimate(e, Cr0, samples, crCodes);
+
+    if(e.layout == CHROMA_LAYOUT_V210) {
+      // pad the last group by repeating the edge pixel
+      const int padded = (count + 5) / 6 * 6;
+      StoreLuma(Y0, count, yCodes, 0);
+      std::fill(yCodes + count, yCodes + padded, yCodes[count - 1]);
+      std::fill(cbCodes + samples, cbCodes + padded / 2, cbCodes[samples - 1]);
+      std::fill(crCodes + samples, crCodes + padded / 2, crCodes[samples - 1]);
+      PackV210(yCodes, cbCodes, crCodes, padded, rows.v210 + x0 / 6 * 4);
+      continue;
+    }
+
+    StoreLuma(Y0, count, rows.y0 + x0, lumaShift);
+    if(pair) StoreLuma(Y1, count, rows.y1 + x0, lumaShift);
+
+    if(e.layout == CHROMA_LAYOUT_P010) {
+      uint16_t* uv = rows.cb + c0 * 2;
+      for(int j = 0; j < samples; ++j) {
+        uv[2 * j] = static_cast<uint16_t>(cbCodes[j] << lumaShift);
+        uv[2 * j + 1] = static_cast<uint16_t>(crCodes[j] << lumaShift);
+      }
+    }
+    else {
+      std::memcpy(rows.cb + c0, cbCodes, sizeof(uint16_t) * samples);
+      std::memcpy(rows.cr + c0, crCodes, sizeof(uint16_t) * samples);
+    }
+  }
+
+  // zero the v210 row padding past the last group
+  if(e.layout == CHROMA_LAYOUT_V210) {
+    const int used = (width + 5) / 6 * 16;
+    std::memset(reinterpret_cast<uint8_t*>(rows.v210) + used, 0,
+                V210RowBytes(width) - used);
+  }
+}
+
+#endif  // CHROMA_SUBSAMPLE_H
@@ -0,0 +1,605 @@
+#ifndef CLF_EXPORT_H
+#define CLF_EXPORT_H
+
+// Exports a TransformPlan as an Academy/ASC Common LUT Format (CLF 3) file
+// and an OCIO v2 colorspace entry using it, so tools running OCIO evaluate
+// the same transform without baking it themselves.
+//
+// The exact pipeline (LUT file, in curve, white matrix, out curve) becomes
+// one process node list, analytic wherever the curve has a closed form:
+//   log cameras       Log, base e with the folded gains of LogCurve.h
+//   gamma, BT1886     Exponent basic (negative values clamp to 0)
+//   sRGB, rec709      Exponent monCurve (rec709 within 3e-4 at its break)
+//   XYZ, matrices     Matrix, neighbours folded into one
+//   YCbCr, YPbPr      Matrix with offsets and the sRGB monCurve
+// Other per channel curves (PLog, HLG, st2084, CLog) are baked into a half
+// domain LUT1D, which covers every half value including negatives and
+// highlights. Curves that mix channels (HSV, HSL, Yxy, Lab, LCH) are baked
+// into a 65^3 LUT3D over their usual value range, clamped outside it as
+// CLF does; hues are only approximate next to where they wrap. The final
+// removeExp flush of tiny values is not exported.
+
+#include <algorithm>
+#include <array>
+#include <cstdarg>
+#include <cfloat>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "include/ColorData.h"
+#include "include/Constants.h"
+#include "include/CubeLut.h"
+#include "include/Half.h"
+#include "include/LogCurve.h"
+#include "include/TransformPlan.h"
+#include "include/YCbCr.h"
+
+// One CLF process node
+struct ClfNode
+{
+  enum Kinds { MATRIX, LOG, EXPONENT, LUT_1D, LUT_3D };
+
+  int kind = MATRIX;
+  // Log / Exponent style and the attributes of their params element
+  std::string style;
+  std::vector<std::pair<const char*, double>> params;
+  // 3x4 row major, the last column is the offset
+  std::array<double, 12> matrix{};
+  // LUT_1D: size rows of 'channels' values. LUT_3D: size^3 rows of RGB,
+  // blue varying fastest as CLF orders them.
+  int size = 0;
+  int channels = 3;
+  bool halfDomain = false;
+  std::vector<float> table;
+};
+
+namespace ClfDetail
+{
+  using Matrix34 = std::array<double, 12>;
+
+  constexpr int kCubeSize = 65;
+  constexpr int kHalfEntries = 65536;
+
+  inline Matrix34 Affine(const float* m3, const float* offset = nullptr)
+  {
+    Matrix34 m{};
+    for(int i = 0; i < 3; ++i) {
+      for(int j = 0; j < 3; ++j) m[4 * i + j] = m3[3 * i + j];
+      m[4 * i + 3] = offset ? offset[i] : 0.0;
+    }
+    return m;
+  }
+
+  // per channel v * scale + bias
+  inline Matrix34 Scale(const float* scale, const float* bias)
+  {
+    Matrix34 m{};
+    for(int i = 0; i < 3; ++i) {
+      m[5 * i] = scale[i];
+      m[4 * i + 3] = bias[i];
+    }
+    return m;
+  }
+
+  // the default tolerance is below float resolution, for the adaptation
+  // between equal whites
+  inline bool IsIdentity(const Matrix34& m, double tolerance = 1e-7)
+  {
+    for(int i = 0; i < 3; ++i) {
+      for(int j = 0; j < 4; ++j) {
+        if(std::fabs(m[4 * i + j] - (i == j ? 1.0 : 0.0)) > tolerance) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // 'after' applied to the result of 'before'
+  inline Matrix34 Compose(const Matrix34& after, const Matrix34& before)
+  {
+    Matrix34 m{};
+    for(int i = 0; i < 3; ++i) {
+      for(int j = 0; j < 4; ++j) {
+        double v = j == 3 ? after[4 * i + 3] : 0.0;
+        for(int k = 0; k < 3; ++k) {
+          v += after[4 * i + k] * before[4 * k + j];
+        }
+        m[4 * i + j] = v;
+      }
+    }
+    return m;
+  }
+
+  // Node list under construction, consecutive matrices are folded
+  class Builder
+  {
+   public:
+    void matrix(const Matrix34& m)
+    {
+      if(!nodes.empty() && nodes.back().kind == ClfNode::MATRIX) {
+        nodes.back().matrix = Compose(m, nodes.back().matrix);
+        return;
+      }
+      ClfNode node;
+      node.kind = ClfNode::MATRIX;
+      node.matrix = m;
+      nodes.push_back(std::move(node));
+    }
+
+    void log(const char* style, const LogCurveCoeffs& k, bool toe)
+    {
+      ClfNode node;
+      node.kind = ClfNode::LOG;
+      node.style = style;
+      node.params = {{"base", std::exp(1.0)},
+                     {"logSideSlope", k.encodeGain},
+                     {"logSideOffset", k.logOffset},
+                     {"linSideSlope", k.linSlope},
+                     {"linSideOffset", k.linOffset}};
+      if(toe) {
+        node.params.push_back({"linSideBreak", k.linBreak});
+        node.params.push_back({"linearSlope", k.toeSlope});
+      }
+      nodes.push_back(std::move(node));
+    }
+
+    void exponent(const char* style, double exponent, double offset = -1.0)
+    {
+      ClfNode node;
+      node.kind = ClfNode::EXPONENT;
+      node.style = style;
+      node.params = {{"exponent", exponent}};
+      if(offset >= 0.0) node.params.push_back({"offset", offset});
+      nodes.push_back(std::move(node));
+    }
+
+    void lut(ClfNode node) { nodes.push_back(std::move(node)); }
+
+    // an empty list is one identity matrix, CLF needs a node
+    std::vector<ClfNode> finish()
+    {
+      std::vector<ClfNode> out;
+      for(ClfNode& node : nodes) {
+        if(node.kind == ClfNode::MATRIX && IsIdentity(node.matrix)) continue;
+        out.push_back(std::move(node));
+      }
+      if(out.empty()) {
+        ClfNode identity;
+        identity.matrix = Affine(matIdentity);
+        out.push_back(std::move(identity));
+      }
+      return out;
+    }
+
+   private:
+    std::vector<ClfNode> nodes;
+  };
+
+  // The camera form derives the toe from the break, so it only holds when
+  // the toe meets the log side there and decoding switches at the same point
+  inline bool ToeIsContinuous(const LogCurveCoeffs& k)
+  {
+    const double log = k.encodeGain * std::log(double(k.linSlope) * k.linBreak +
+                                               k.linOffset) +
+                       k.logOffset;
+    const double toe = double(k.toeSlope) * k.linBreak + k.toeOffset;
+    return std::fabs(log - toe) < 1e-4 && std::fabs(log - k.logBreak) < 1e-4;
+  }
+
+  inline double GammaOf(int colorspace)
+  {
+    switch(colorspace) {
+      case Constants::COLOR_GAMMA_1_80:
+        return 1.8;
+      case Constants::COLOR_GAMMA_2_20:
+        return 2.2;
+      case Constants::COLOR_GAMMA_2_40:
+      case Constants::COLOR_BT1886:
+        return 2.4;
+      case Constants::COLOR_GAMMA_2_60:
+        return 2.6;
+      default:
+        return 0.0;
+    }
+  }
+
+  // Y'CbCr decode (in) or encode (out) as a 3x4 matrix
+  inline Matrix34 YCbCrMatrix(const YCbCrCoeffs& k, bool in)
+  {
+    if(in) {
+      // normalize the codes, then the decode rows
+      const float scale[3] = {k.yScaleInv, k.cScaleInv, k.cScaleInv};
+      const float bias[3] = {-k.yOffset * k.yScaleInv,
+                             -k.cOffset * k.cScaleInv,
+                             -k.cOffset * k.cScaleInv};
+      const float decode[9] = {1.0f, 0.0f,  k.rCr, 1.0f, k.gCb,
+                               k.gCr, 1.0f, k.bCb, 0.0f};
+      return Compose(Affine(decode), Scale(scale, bias));
+    }
+    const float encode[9] = {k.yR,  k.yG,  k.yB,  k.cbR, k.cbG,
+                             k.cbB, k.crR, k.crG, k.crB};
+    const float scale[3] = {k.yScale, k.cScale, k.cScale};
+    const float bias[3] = {k.yOffset, k.cOffset, k.cOffset};
+    return Compose(Scale(scale, bias), Affine(encode));
+  }
+
+  // analytic nodes for one curve stage, false when it has no closed form
+  inline bool CurveNodes(const TransformSettings& s, const CurveStage& stage,
+                         int colorspace, bool in, Builder& b)
+  {
+    const double gamma = GammaOf(colorspace);
+    if(gamma > 0.0) {
+      b.exponent(in ? "basicFwd" : "basicRev", gamma);
+      return true;
+    }
+
+    YCbCrCoeffs ycc;
+    switch(colorspace) {
+      case Constants::COLOR_LINEAR:
+        return true;
+      case Constants::COLOR_SRGB:
+        b.exponent(in ? "monCurveFwd" : "monCurveRev", 2.4, 0.055);
+        return true;
+      case Constants::COLOR_REC709:
+        b.exponent(in ? "monCurveFwd" : "monCurveRev", 1.0 / 0.45, 0.099);
+        return true;
+      case Constants::COLOR_CIE_XYZ:
+        b.matrix(Affine(in ? matSRGBToXYZ : matXYZToSRGB));
+        return true;
+      case Constants::COLOR_Y_CB_CR:
+      case Constants::COLOR_Y_PB_PR:
+        // the engine's coefficients, or the scalar Rec.709 legal ones
+        if(!TransformDetail::UseYCbCr(s, colorspace, ycc)) {
+          ycc = MakeYCbCrCoeffs(Constants::YCC_REC709,
+                                Constants::YCC_RANGE_LEGAL,
+                                colorspace == Constants::COLOR_Y_PB_PR);
+        }
+        if(in) {
+          b.matrix(YCbCrMatrix(ycc, true));
+          b.exponent("monCurveFwd", 2.4, 0.055);
+        }
+        else {
+          b.exponent("monCurveRev", 2.4, 0.055);
+          b.matrix(YCbCrMatrix(ycc, false));
+        }
+        return true;
+      default:
+        break;
+    }
+
+    const LogCurveCoeffs* k = stage.log ? stage.log : LogCurveFor(colorspace);
+    if(k == nullptr || (k->flags & (LogCurve::LOG_MIRROR | LogCurve::LOG_RANGE))) {
+      return false;
+    }
+    const bool toe = (k->flags & LogCurve::LOG_TOE) != 0;
+    if(toe && !ToeIsContinuous(*k)) return false;
+    if(toe) {
+      b.log(in ? "cameraLogToLin" : "cameraLinToLog", *k, true);
+    }
+    else {
+      b.log(in ? "logToLin" : "linToLog", *k, false);
+    }
+    return true;
+  }
+
+  // the stage kernel on every half value, one column for all channels
+  inline ClfNode BakeHalfDomain(const CurveStage& stage)
+  {
+    ClfNode node;
+    node.kind = ClfNode::LUT_1D;
+    node.size = kHalfEntries;
+    node.channels = 1;
+    node.halfDomain = true;
+    node.table.resize(kHalfEntries);
+    std::vector<float> g(kHalfEntries), b(kHalfEntries);
+    for(int i = 0; i < kHalfEntries; ++i) {
+      node.table[i] = g[i] = b[i] = HalfToFloat(static_cast<uint16_t>(i));
+    }
+    Simd::forEach3(node.table.data(), g.data(), b.data(), kHalfEntries,
+                   [&stage](Simd::vfloat& x, Simd::vfloat& y,
+                            Simd::vfloat& z) { stage.kernel(stage, x, y, z); });
+    // NaN and infinite results are not numbers in the file
+    for(float& v : node.table) {
+      if(std::isnan(v)) v = 0.0f;
+      v = std::max(std::min(v, FLT_MAX), -FLT_MAX);
+    }
+    return node;
+  }
+
+  // value range a mixing stage is baked over, per channel
+  inline void CubeDomain(int colorspace, bool in, float* lo, float* hi)
+  {
+    for(int c = 0; c < 3; ++c) {
+      lo[c] = 0.0f;
+      hi[c] = 1.0f;
+    }
+    // a* and b* are signed
+    if(in && colorspace == Constants::COLOR_LAB) {
+      lo[1] = lo[2] = -1.0f;
+    }
+  }
+
+  // the stage kernel sampled on a kCubeSize^3 lattice over lo..hi
+  inline void BakeCube(const CurveStage& stage, int colorspace, bool in,
+                       Builder& b)
+  {
+    float lo[3], hi[3];
+    CubeDomain(colorspace, in, lo, hi);
+    float scale[3], bias[3];
+    for(int c = 0; c < 3; ++c) {
+      scale[c] = 1.0f / (hi[c] - lo[c]);
+      bias[c] = -lo[c] * scale[c];
+    }
+    b.matrix(Scale(scale, bias));
+
+    ClfNode node;
+    node.kind = ClfNode::LUT_3D;
+    node.size = kCubeSize;
+    const int n = kCubeSize;
+    std::vector<float> r(n), g(n), bl(n);
+    node.table.reserve(static_cast<size_t>(n) * n * n * 3);
+    for(int ri = 0; ri < n; ++ri) {
+      for(int gi = 0; gi < n; ++gi) {
+        for(int bi = 0; bi < n; ++bi) {
+          r[bi] = lo[0] + (hi[0] - lo[0]) * ri / (n - 1);
+          g[bi] = lo[1] + (hi[1] - lo[1]) * gi / (n - 1);
+          bl[bi] = lo[2] + (hi[2] - lo[2]) * bi / (n - 1);
+        }
+        Simd::forEach3(r.data(), g.data(), bl.data(), n,
+                       [&stage](Simd::vfloat& x, Simd::vfloat& y,
+                                Simd::vfloat& z) {
+                         stage.kernel(stage, x, y, z);
+                       });
+        for(int bi = 0; bi < n; ++bi) {
+          node.table.insert(node.table.end(), {r[bi], g[bi], bl[bi]});
+        }
+      }
+    }
+    b.lut(std::move(node));
+  }
+
+  inline void Stage(const TransformSettings& s, const CurveStage& stage,
+                    int colorspace, bool in, Builder& b)
+  {
+    if(CurveNodes(s, stage, colorspace, in, b)) return;
+    if(TransformDetail::IsSeparable(colorspace)) {
+      b.lut(BakeHalfDomain(stage));
+    }
+    else {
+      BakeCube(stage, colorspace, in, b);
+    }
+  }
+
+  // the .cube tables with their domains as matrices
+  inline void File(const CubeLut& lut, Builder& b)
+  {
+    if(lut.curves[0].size) {
+      b.matrix(Scale(lut.scale1D, lut.bias1D));
+      ClfNode node;
+      node.kind = ClfNode::LUT_1D;
+      node.size = lut.curves[0].size;
+      for(int i = 0; i < node.size; ++i) {
+        for(int c = 0; c < 3; ++c) node.table.push_back(lut.curves[c].table[i]);
+      }
+      b.lut(std::move(node));
+    }
+    if(lut.cube.size) {
+      b.matrix(Scale(lut.scale3D, lut.bias3D));
+      ClfNode node;
+      node.kind = ClfNode::LUT_3D;
+      node.size = lut.cube.size;
+      const int n = node.size;
+      node.table.reserve(static_cast<size_t>(n) * n * n * 3);
+      for(int r = 0; r < n; ++r) {
+        for(int g = 0; g < n; ++g) {
+          for(int bl = 0; bl < n; ++bl) {
+            const float* v = lut.cube.table + lut.cube.offset(r, g, bl);
+            node.table.insert(node.table.end(), v, v + 3);
+          }
+        }
+      }
+      b.lut(std::move(node));
+    }
+  }
+
+  inline void Append(std::string& out, const char* format, ...)
+  {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    const int n = std::vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    out.append(buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+  }
+
+  // menu names can hold '&' and friends in principle
+  inline std::string Escape(const std::string& text)
+  {
+    std::string out;
+    for(char c : text) {
+      switch(c) {
+        case '&':
+          out += "&amp;";
+          break;
+        case '<':
+          out += "&lt;";
+          break;
+        case '>':
+          out += "&gt;";
+          break;
+        case '"':
+          out += "&quot;";
+          break;
+        default:
+          out += c;
+      }
+    }
+    return out;
+  }
+
+  inline void WriteNode(const ClfNode& node, std::string& out)
+  {
+    static const char* const kTags[] = {"Matrix", "Log", "Exponent", "LUT1D",
+                                        "LUT3D"};
+    const char* tag = kTags[node.kind];
+    Append(out, "  <%s inBitDepth=\"32f\" outBitDepth=\"32f\"", tag);
+    if(!node.style.empty()) Append(out, " style=\"%s\"", node.style.c_str());
+    if(node.halfDomain) out += " halfDomain=\"true\"";
+    if(node.kind == ClfNode::LUT_3D) out += " interpolation=\"tetrahedral\"";
+    out += ">\n";
+
+    switch(node.kind) {
+      case ClfNode::MATRIX: {
+        bool offsets = false;
+        for(int i = 0; i < 3; ++i) offsets |= node.matrix[4 * i + 3] != 0.0;
+        const int columns = offsets ? 4 : 3;
+        Append(out, "    <Array dim=\"3 %d\">\n", columns);
+        for(int i = 0; i < 3; ++i) {
+          out += "     ";
+          for(int j = 0; j < columns; ++j) {
+            Append(out, " %.10g", node.matrix[4 * i + j]);
+          }
+          out += "\n";
+        }
+        out += "    </Array>\n";
+        break;
+      }
+      case ClfNode::LOG:
+      case ClfNode::EXPONENT:
+        Append(out, "    <%sParams", tag);
+        for(const auto& p : node.params) {
+          Append(out, " %s=\"%.10g\"", p.first, p.second);
+        }
+        out += "/>\n";
+        break;
+      default: {
+        if(node.kind == ClfNode::LUT_1D) {
+          Append(out, "    <Array dim=\"%d %d\">\n", node.size, node.channels);
+        }
+        else {
+          Append(out, "    <Array dim=\"%d %d %d 3\">\n", node.size, node.size,
+                 node.size);
+        }
+        const int columns = node.kind == ClfNode::LUT_1D ? node.channels : 3;
+        for(size_t i = 0; i < node.table.size(); i += columns) {
+          out += "     ";
+          for(int c = 0; c < columns; ++c) {
+            Append(out, " %.9g", node.table[i + c]);
+          }
+          out += "\n";
+        }
+        out += "    </Array>\n";
+        break;
+      }
+    }
+    Append(out, "  </%s>\n", tag);
+  }
+
+  // "Cineon D65 sRGB" style description of one side
+  inline std::string Side(int colorspace, int white, int primary)
+  {
+    return std::string(Constants::COLOR_CURVE[colorspace]) + ", " +
+           Constants::WHITEPOINT[white] + ", " +
+           Constants::PRIMARY_RGB[primary];
+  }
+}  // namespace ClfDetail
+
+// The exact pipeline of 'plan' as CLF process nodes
+inline std::vector<ClfNode> ClfNodes(const TransformPlan& plan)
+{
+  using namespace ClfDetail;
+  const TransformSettings& s = plan.settings;
+  Builder b;
+  const CubeLut* file = s.lutFile.get();
+  const bool after = s.lutFilePosition == Constants::LUT_FILE_AFTER;
+  if(file != nullptr && !after) File(*file, b);
+  if(!plan.curvesIdentity) {
+    Stage(s, plan.in, s.colorIn, true, b);
+    b.matrix(Affine(plan.white.data()));
+    Stage(s, plan.out, s.colorOut, false, b);
+  }
+  if(file != nullptr && after) File(*file, b);
+  return b.finish();
+}
+
+// CLF 3 document of the plan
+inline std::string ClfDocument(const TransformPlan& plan)
+{
+  using namespace ClfDetail;
+  const TransformSettings& s = plan.settings;
+  const std::string in = Side(s.colorIn, s.whiteIn, s.primaryIn);
+  const std::string out = Side(s.colorOut, s.whiteOut, s.primaryOut);
+
+  std::string doc = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+  Append(doc,
+         "<ProcessList compCLFversion=\"3.0\" id=\"gcolorspace-%016" PRIx64
+         "\">\n",
+         static_cast<uint64_t>(
+             LutKeyHash()(TransformDetail::MakeLutKey(plan))));
+  doc += "  <Description>GColorspace " + Escape(in) + " to " + Escape(out) +
+         "</Description>\n";
+  doc += "  <InputDescriptor>" + Escape(in) + "</InputDescriptor>\n";
+  doc += "  <OutputDescriptor>" + Escape(out) + "</OutputDescriptor>\n";
+  for(const ClfNode& node : ClfNodes(plan)) WriteNode(node, doc);
+  doc += "</ProcessList>\n";
+  return doc;
+}
+
+// OCIO v2 colorspace entry for the output side of the plan, converted from
+// the scene reference (expected to be the plan's input) by 'clfFile'
+inline std::string OcioColorspace(const TransformSettings& s,
+                                  const std::string& clfFile)
+{
+  using namespace ClfDetail;
+  const std::string in = Side(s.colorIn, s.whiteIn, s.primaryIn);
+  const std::string out = Side(s.colorOut, s.whiteOut, s.primaryOut);
+  std::string yaml;
+  yaml += "  - !<ColorSpace>\n";
+  yaml += "    name: \"GColorspace " + out + "\"\n";
+  yaml += "    family: GColorspace\n";
+  yaml += "    bitdepth: 32f\n";
+  yaml += "    description: \"" + out + " from " + in +
+          ", the scene reference is expected to be " + in + "\"\n";
+  yaml += "    isdata: false\n";
+  yaml += "    from_scene_reference: !<FileTransform> {src: \"" + clfFile +
+          "\", interpolation: tetrahedral}\n";
+  return yaml;
+}
+
+// Writes the CLF document to 'path' and the OCIO entry next to it, with
+// the extension replaced by .ocio.yaml
+inline bool ExportClf(const TransformPlan& plan, const std::string& path,
+                      std::string* error)
+{
+  const size_t slash = path.find_last_of("/\\");
+  const std::string name =
+      slash == std::string::npos ? path : path.substr(slash + 1);
+  const size_t dot = path.rfind('.');
+  const std::string stem =
+      dot == std::string::npos || (slash != std::string::npos && dot < slash)
+          ? path
+          : path.substr(0, dot);
+
+  const std::string files[2] = {path, stem + ".ocio.yaml"};
+  const std::string texts[2] = {ClfDocument(plan),
+                                OcioColorspace(plan.settings, name)};
+  for(int i = 0; i < 2; ++i) {
+    FILE* f = std::fopen(files[i].c_str(), "wb");
+    const bool ok =
+        f != nullptr &&
+        std::fwrite(texts[i].data(), 1, texts[i].size(), f) ==
+            texts[i].size();
+    if(f != nullptr && std::fclose(f) != 0) f = nullptr;
+    if(!ok || f == nullptr) {
+      if(error != nullptr) *error = files[i] + ": cannot write";
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif  // CLF_EXPORT_H
@@ -5,12 +5,12 @@
 #define COLORLUT_H
 
 #include <float.h>
+#include <math.h>
 
 #include <algorithm>
 #include <array>
 #include <cmath>
 
-#include "DDImage/DDMath.h"
 #include "include/ColorData.h"
 #include "include/aliases.h"
 
@@ -122,7 +122,7 @@ RGBcolor CIELabToLin(const RGBcolor& p)
   auto f = [](float v) {
     const float e = 0.008856f;
     const float k = 7.787f;
-    return (v > e) ? std::powf(v, 0.333333f) : ((k * v) + 0.137931f);
+    return (v > e) ? powf(v, 0.333333f) : ((k * v) + 0.137931f);
   };
 
   float fx = f(xyz[0]);
@@ -148,8 +148,8 @@ RGBcolor LinToCIELCh(const RGBcolor& p)
   float rad = (b * _PI) / 1.80f;
 
   lch[0] = r;
-  lch[1] = g * std::cosf(rad);
-  lch[2] = g * std::sinf(rad);
+  lch[1] = g * cosf(rad);
+  lch[2] = g * sinf(rad);
 
   return LinToCIELab(lch);
 }
@@ -164,8 +164,8 @@ RGBcolor CIELChToLin(const RGBcolor& p)
   float b = lab[2];
 
   rgb[0] = l;
-  rgb[1] = std::sqrtf(a * a + b * b);
-  rgb[2] = std::atan2f(b, a) * 1.80f / _PI;
+  rgb[1] = sqrtf(a * a + b * b);
+  rgb[2] = atan2f(b, a) * 1.80f / _PI;
 
   if(rgb[2] < 0.0f) rgb[2] += 3.60;
 
@@ -180,7 +180,7 @@ RGBcolor Gamma180ToLin(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::powf(p[i], 1.0f / 1.80f);
+    rgb[i] = powf(p[i], 1.0f / 1.80f);
   }
 
   return rgb;
@@ -191,7 +191,7 @@ RGBcolor LinToGamma180(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::powf(p[i], 1.80f);
+    rgb[i] = powf(p[i], 1.80f);
   }
 
   return rgb;
@@ -203,7 +203,7 @@ RGBcolor Gamma220ToLin(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::powf(p[i], 1.0f / 2.20f);
+    rgb[i] = powf(p[i], 1.0f / 2.20f);
   }
 
   return rgb;
@@ -214,7 +214,7 @@ RGBcolor LinToGamma220(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::powf(p[i], 2.20f);
+    rgb[i] = powf(p[i], 2.20f);
   }
 
   return rgb;
@@ -226,7 +226,7 @@ RGBcolor Gamma240ToLin(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::powf(p[i], 1.0f / 2.40f);
+    rgb[i] = powf(p[i], 1.0f / 2.40f);
   }
 
   return rgb;
@@ -237,7 +237,7 @@ RGBcolor LinToGamma240(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::powf(p[i], 2.40f);
+    rgb[i] = powf(p[i], 2.40f);
   }
 
   return rgb;
@@ -249,7 +249,7 @@ RGBcolor Gamma260ToLin(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::powf(p[i], 1.0f / 2.60f);
+    rgb[i] = powf(p[i], 1.0f / 2.60f);
   }
 
   return rgb;
@@ -260,7 +260,7 @@ RGBcolor LinToGamma260(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::powf(p[i], 2.60f);
+    rgb[i] = powf(p[i], 2.60f);
   }
 
   return rgb;
@@ -276,7 +276,7 @@ RGBcolor LinToRec709(const RGBcolor& p)
     if(v <= 0.081f)
       rgb[i] = v / 4.5f;
     else
-      rgb[i] = std::powf((v + 0.099f) / 1.099f, 1.0f / 0.45f);
+      rgb[i] = powf((v + 0.099f) / 1.099f, 1.0f / 0.45f);
   }
 
   return rgb;
@@ -291,7 +291,7 @@ RGBcolor Rec709ToLin(const RGBcolor& p)
     if(v <= 0.018f)
       rgb[i] = v * 4.5f;
     else
-      rgb[i] = 1.099f * std::powf(v, 0.45f) - 0.099f;
+      rgb[i] = 1.099f * powf(v, 0.45f) - 0.099f;
   }
 
   return rgb;
@@ -307,7 +307,7 @@ RGBcolor sRGBToLin(const RGBcolor& p)
     if(v <= 0.0031308f)
       rgb[i] = 12.92f * v;
     else
-      rgb[i] = 1.055f * std::powf(v, 1.0f / 2.4f) - 0.055f;
+      rgb[i] = 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
   }
 
   return rgb;
@@ -322,7 +322,7 @@ RGBcolor LinTosRGB(const RGBcolor& p)
     if(v <= 0.04045f)
       rgb[i] = v / 12.92f;
     else
-      rgb[i] = std::powf((v + 0.055f) / 1.055f, 2.4f);
+      rgb[i] = powf((v + 0.055f) / 1.055f, 2.4f);
   }
 
   return rgb;
@@ -333,7 +333,7 @@ RGBcolor LinToCineon(const RGBcolor& p)
 {
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
   float offset =
-      std::powf(10.f, (CIN_BLACKPOINT - CIN_WHITEPOINT) * 0.002f / CIN_GAMMA);
+      powf(10.f, (CIN_BLACKPOINT - CIN_WHITEPOINT) * 0.002f / CIN_GAMMA);
   float gain = 1.f / (1.f - offset);
 
   for(size_t i = 0; i < 3; ++i) {
@@ -341,7 +341,7 @@ RGBcolor LinToCineon(const RGBcolor& p)
 
     rgb[i] =
         gain *
-        (std::powf(10.f, (1023.f * v - CIN_WHITEPOINT) * 0.002f / CIN_GAMMA) -
+        (powf(10.f, (1023.f * v - CIN_WHITEPOINT) * 0.002f / CIN_GAMMA) -
          offset);
   }
 
@@ -352,13 +352,13 @@ RGBcolor CineonToLin(const RGBcolor& p)
 {
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
   float offset =
-      std::powf(10.f, (CIN_BLACKPOINT - CIN_WHITEPOINT) * 0.002f / CIN_GAMMA);
+      powf(10.f, (CIN_BLACKPOINT - CIN_WHITEPOINT) * 0.002f / CIN_GAMMA);
   float gain = 1.f / (1.f - offset);
 
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
 
-    rgb[i] = (std::log10f(v / gain + offset) / (0.002f / CIN_GAMMA) +
+    rgb[i] = (log10f(v / gain + offset) / (0.002f / CIN_GAMMA) +
               CIN_WHITEPOINT) /
              1023.f;
   }
@@ -622,7 +622,7 @@ RGBcolor PanalogToLin(const RGBcolor& p)  // to_func_Panalog
 
   for(size_t i = 0; i < 3; ++i) {
     rgb[i] =
-        (444.0f * std::log10f(0.0408f + (1.0f - 0.0408f) * p[i]) + 681.0f) /
+        (444.0f * log10f(0.0408f + (1.0f - 0.0408f) * p[i]) + 681.0f) /
         1023.0f;
   }
 
@@ -634,7 +634,7 @@ RGBcolor LinToPanalog(const RGBcolor& p)  // from_func_Panalog
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = (std::powf(10.0f, (1023.0f * p[i] - 681.0f) / 444.0f) - 0.0408f) /
+    rgb[i] = (powf(10.0f, (1023.0f * p[i] - 681.0f) / 444.0f) - 0.0408f) /
              (1.0f - 0.0408f);
   }
 
@@ -682,7 +682,7 @@ RGBcolor ViperLogToLin(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = (500.0f * std::log10f(p[i]) + 1023.0f) / 1023.0f;
+    rgb[i] = (500.0f * log10f(p[i]) + 1023.0f) / 1023.0f;
     ;
   }
 
@@ -694,7 +694,7 @@ RGBcolor LinToViperLog(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::powf(10.f, (1023.f * p[i] - 1023.f) / 500.f);
+    rgb[i] = powf(10.f, (1023.f * p[i] - 1023.f) / 500.f);
     ;
   }
 
@@ -710,7 +710,7 @@ RGBcolor AlexaV3LogCToLin(const RGBcolor& p)
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
     if(v > 0.010591f)
-      rgb[i] = 0.247190f * std::log10f(5.555556f * v + 0.052272f) + 0.385537f;
+      rgb[i] = 0.247190f * log10f(5.555556f * v + 0.052272f) + 0.385537f;
     else
       rgb[i] = v * 5.367655f + 0.092809f;
   }
@@ -725,7 +725,7 @@ RGBcolor LinToAlexaV3LogC(const RGBcolor& p)
     float v = p[i];
     if(v > 0.1496582f)
       rgb[i] =
-          std::powf(10.f, (v - 0.385537f) / 0.2471896f) * 0.18f - 0.00937677f;
+          powf(10.f, (v - 0.385537f) / 0.2471896f) * 0.18f - 0.00937677f;
     else
       rgb[i] = (v / 0.9661776f - 0.04378604f) * 0.18f - 0.00937677f;
   }
@@ -739,7 +739,7 @@ RGBcolor LinToPLog(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = 0.18f * std::powf(10.0f, (p[i] * 1023. - 445.0f) * 0.002f / 0.6f);
+    rgb[i] = 0.18f * powf(10.0f, (p[i] * 1023. - 445.0f) * 0.002f / 0.6f);
   }
 
   return rgb;
@@ -751,7 +751,7 @@ RGBcolor PLogToLin(const RGBcolor& p)
 
   for(size_t i = 0; i < 3; ++i) {
     rgb[i] =
-        (445.0f + std::log10f(std::max(p[i], 1e-10f) / 0.18f) * 0.6f / 0.002f) /
+        (445.0f + log10f(std::max(p[i], 1e-10f) / 0.18f) * 0.6f / 0.002f) /
         1023.0f;
   }
 
@@ -764,7 +764,7 @@ RGBcolor SlogToLin(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = (0.432699f * std::log10f(p[i] + 0.037584f) + 0.616596f) + 0.03f;
+    rgb[i] = (0.432699f * log10f(p[i] + 0.037584f) + 0.616596f) + 0.03f;
   }
 
   return rgb;
@@ -776,7 +776,7 @@ RGBcolor LinToSlog(const RGBcolor& p)
 
   for(size_t i = 0; i < 3; ++i) {
     rgb[i] =
-        std::powf(10.0f, ((p[i] - 0.616596f - 0.03f) / 0.432699f)) - 0.037584f;
+        powf(10.0f, ((p[i] - 0.616596f - 0.03f) / 0.432699f)) - 0.037584f;
   }
 
   return rgb;
@@ -790,7 +790,7 @@ RGBcolor Slog1ToLin(const RGBcolor& p)
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
     if(v >= -0.00008153227156f)
-      rgb[i] = ((std::log10f((v / 0.9f) + 0.037584f) * 0.432699f + 0.616596f +
+      rgb[i] = ((log10f((v / 0.9f) + 0.037584f) * 0.432699f + 0.616596f +
                  0.03f) *
                     (940.0f - 64.0f) +
                 64.0f) /
@@ -811,7 +811,7 @@ RGBcolor LinToSlog1(const RGBcolor& p)
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
     if(v >= 90.0f / 1023.0f)
-      rgb[i] = (std::powf(10., (((v * 1023.0f - 64.0f) / (940.0f - 64.0f) -
+      rgb[i] = (powf(10., (((v * 1023.0f - 64.0f) / (940.0f - 64.0f) -
                                  0.616596f - 0.03f) /
                                 0.432699f)) -
                 0.037584f) *
@@ -834,7 +834,7 @@ RGBcolor Slog2ToLin(const RGBcolor& p)
     float v = p[i];
     if(v >= -0.00008153227156f)
       rgb[i] =
-          ((std::log10f((v / 0.9f) * 155.0f / 219.0f + 0.037584f) * 0.432699f +
+          ((log10f((v / 0.9f) * 155.0f / 219.0f + 0.037584f) * 0.432699f +
             0.616596f + 0.03f) *
                (940.0f - 64.0f) +
            64.0f) /
@@ -857,7 +857,7 @@ RGBcolor LinToSlog2(const RGBcolor& p)
     float v = p[i];
     if(v >= 90.0f / 1023.0f)
       rgb[i] = 219.0 *
-               (std::powf(10.0f, (((v * 1023.0f - 64.0f) / (940.0f - 64.0f) -
+               (powf(10.0f, (((v * 1023.0f - 64.0f) / (940.0f - 64.0f) -
                                    0.616596f - 0.03f) /
                                   0.432699f)) -
                 0.037584f) /
@@ -879,7 +879,7 @@ RGBcolor Slog3ToLin(const RGBcolor& p)
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
     if(v >= 0.01125000f)
-      rgb[i] = (420.0f + std::log10f((v + 0.01f) / (0.18f + 0.01f)) * 261.5f) /
+      rgb[i] = (420.0f + log10f((v + 0.01f) / (0.18f + 0.01f)) * 261.5f) /
                1023.0f;
     else
       rgb[i] = (v * (171.2102946929f - 95.0f) / 0.01125000f + 95.0f) / 1023.0f;
@@ -895,7 +895,7 @@ RGBcolor LinToSlog3(const RGBcolor& p)
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
     if(v >= 171.2102946929f / 1023.0f)
-      rgb[i] = std::powf(10.0f, ((v * 1023.0f - 420.0f) / 261.5f)) *
+      rgb[i] = powf(10.0f, ((v * 1023.0f - 420.0f) / 261.5f)) *
                    (0.18f + 0.01f) -
                0.01f;
     else
@@ -917,10 +917,10 @@ RGBcolor ClogToLin(const RGBcolor& p)
       rgb[i] = 0.0f;
     }
     else if(v < 0.0f) {
-      rgb[i] = -0.529136f * std::log10f(1.0f - 10.1596f * v) + 0.0730597f;
+      rgb[i] = -0.529136f * log10f(1.0f - 10.1596f * v) + 0.0730597f;
     }
     else {
-      rgb[i] = 0.529136f * std::log10f(10.1596f * v + 1.0f) + 0.0730597f;
+      rgb[i] = 0.529136f * log10f(10.1596f * v + 1.0f) + 0.0730597f;
     }
   }
 
@@ -938,11 +938,11 @@ RGBcolor LinToClog(const RGBcolor& p)
     }
     else if(v < 0.0730597f) {
       rgb[i] =
-          (1.0f - std::powf(10.0f, (0.0730597f - v) / 0.529136f)) / 10.1596f;
+          (1.0f - powf(10.0f, (0.0730597f - v) / 0.529136f)) / 10.1596f;
     }
     else {
       rgb[i] =
-          (std::powf(10.0f, (v - 0.0730597f) / 0.529136f) - 1.0f) / 10.1596f;
+          (powf(10.0f, (v - 0.0730597f) / 0.529136f) - 1.0f) / 10.1596f;
     }
   }
 
@@ -963,7 +963,7 @@ RGBcolor LinToLog3G10(const RGBcolor& p)
     if(v < 0.0f)
       rgb[i] = (v / g) - c;
     else
-      rgb[i] = ((std::powf(10.f, (v / a)) - 1.0f) / b) - c;
+      rgb[i] = ((powf(10.f, (v / a)) - 1.0f) / b) - c;
   }
 
   return rgb;
@@ -982,7 +982,7 @@ RGBcolor Log3G10ToLin(const RGBcolor& p)
     if(v < 0.0f)
       rgb[i] = v * g;
     else
-      rgb[i] = a * std::log10f((v * b) + 1.0f);
+      rgb[i] = a * log10f((v * b) + 1.0f);
   }
 
   return rgb;
@@ -1002,7 +1002,7 @@ RGBcolor LinToLog3G12(const RGBcolor& p)
     if(v < 0.0f)
       rgb[i] = (v / g) - c;
     else
-      rgb[i] = ((std::powf(10.f, (v / a)) - 1.0f) / b) - c;
+      rgb[i] = ((powf(10.f, (v / a)) - 1.0f) / b) - c;
   }
 
   return rgb;
@@ -1021,7 +1021,7 @@ RGBcolor Log3G12ToLin(const RGBcolor& p)
     if(v < 0.0f)
       rgb[i] = v * g;
     else
-      rgb[i] = a * std::log10f((v * b) + 1.0f);
+      rgb[i] = a * log10f((v * b) + 1.0f);
   }
 
   return rgb;
@@ -1038,7 +1038,7 @@ RGBcolor LinToHybridLogGamma(const RGBcolor& p)
 
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
-    if(v <= std::sqrtf(3.0f * t)) {
+    if(v <= sqrtf(3.0f * t)) {
       rgb[i] = (v * v) / 3.0f;
     }
     else {
@@ -1060,9 +1060,9 @@ RGBcolor HybridLogGammaToLin(const RGBcolor& p)
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
     if(v <= t)
-      rgb[i] = std::sqrtf(3.0f * v);
+      rgb[i] = sqrtf(3.0f * v);
     else
-      rgb[i] = a * std::logf(12.0f * v - b) + c;
+      rgb[i] = a * logf(12.0f * v - b) + c;
   }
 
   return rgb;
@@ -1074,7 +1074,7 @@ RGBcolor LinToProtune(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = (std::powf(113.0f, p[i]) - 1.0f) / 112.0f;
+    rgb[i] = (powf(113.0f, p[i]) - 1.0f) / 112.0f;
   }
 
   return rgb;
@@ -1085,7 +1085,7 @@ RGBcolor ProtuneToLin(const RGBcolor& p)
   RGBcolor rgb = {0.0f, 0.0f, 0.0f};
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::logf(112.0f * p[i] + 1) / std::logf(113.0f);
+    rgb[i] = logf(112.0f * p[i] + 1) / logf(113.0f);
   }
 
   return rgb;
@@ -1100,7 +1100,7 @@ RGBcolor LinToBT1886(const RGBcolor& p)
   const float gamma = 2.4f;
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::powf((p[i] - black) / (white - black), gamma);
+    rgb[i] = powf((p[i] - black) / (white - black), gamma);
   }
 
   return rgb;
@@ -1114,7 +1114,7 @@ RGBcolor BT1886ToLin(const RGBcolor& p)
   const float gamma = 2.4f;
 
   for(size_t i = 0; i < 3; ++i) {
-    rgb[i] = std::powf(p[i], 1.0 / gamma) * (white - black) + black;
+    rgb[i] = powf(p[i], 1.0 / gamma) * (white - black) + black;
   }
 
   return rgb;
@@ -1133,7 +1133,7 @@ RGBcolor LinToSt2084(const RGBcolor& p)
 
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
-    rgb[i] = lum * std::powf(std::max(std::powf(v, 1.0f / m2) - c1, 0.0f) /
+    rgb[i] = lum * powf(std::max(powf(v, 1.0f / m2) - c1, 0.0f) /
                                  (c2 - c3 * pow(v, 1.0f / m2)),
                              1.0f / m1);
   }
@@ -1175,7 +1175,7 @@ RGBcolor LinToBFG5(const RGBcolor& p)
 
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
-    rgb[i] = v < cut ? (v - e) / d : std::expf((v - c) / a) - b;
+    rgb[i] = v < cut ? (v - e) / d : expf((v - c) / a) - b;
   }
   return rgb;
 }
@@ -1192,7 +1192,7 @@ RGBcolor BFG5ToLin(const RGBcolor& p)
 
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
-    rgb[i] = v < cut ? d * v + e : a * std::logf(v + b) + c;
+    rgb[i] = v < cut ? d * v + e : a * logf(v + b) + c;
   }
   return rgb;
 }
@@ -1213,7 +1213,7 @@ RGBcolor LinToARRILogC4(const RGBcolor& p)
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
     float vp = 14.0f * (v - c) / b + 6.0f;
-    rgb[i] = v < 0.0f ? v * s + t : (std::powf(2.0f, vp) - 64.0f) / a;
+    rgb[i] = v < 0.0f ? v * s + t : (powf(2.0f, vp) - 64.0f) / a;
   }
 
   return rgb;
@@ -1233,7 +1233,7 @@ RGBcolor ARRILogC4ToLin(const RGBcolor& p)
   for(size_t i = 0; i < 3; ++i) {
     float v = p[i];
     rgb[i] = v < t ? (v - t) / s
-                   : (std::log2f(a * v + 64.0f) - 6.0f) / 14.0f * b + c;
+                   : (log2f(a * v + 64.0f) - 6.0f) / 14.0f * b + c;
   }
 
   return rgb;
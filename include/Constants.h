@@ -2,6 +2,10 @@
 #define CONSTANTS_H
 namespace Constants
 {
+  // bumped whenever curve or matrix results change, it invalidates the
+  // on-disk LUT cache
+  static const char* const LIBRARY_VERSION = "1.1.0";
+
   enum CatMethods { CAT_CAT02, CAT_BRADFORD };
 
   enum Colorspaces {
@@ -87,6 +91,39 @@ namespace Constants
     PRIM_COLOR_COUNT
   };
 
+  enum YCbCrMatrices { YCC_REC601, YCC_REC709, YCC_REC2020, YCC_MATRIX_COUNT };
+
+  enum YCbCrRanges { YCC_RANGE_LEGAL, YCC_RANGE_FULL, YCC_RANGE_COUNT };
+
+  enum Precisions {
+    PRECISION_EXACT,
+    PRECISION_LUT_1D,
+    PRECISION_LUT_3D_33,
+    PRECISION_LUT_3D_65,
+    PRECISION_AUTO,
+    PRECISION_COUNT
+  };
+
+  enum LutStorages {
+    LUT_STORAGE_FLOAT,
+    LUT_STORAGE_HALF,
+    LUT_STORAGE_FLOAT_TILED,
+    LUT_STORAGE_HALF_TILED,
+    LUT_STORAGE_COUNT
+  };
+
+  enum LutFilePositions {
+    LUT_FILE_BEFORE,
+    LUT_FILE_AFTER,
+    LUT_FILE_POSITION_COUNT
+  };
+
+  enum Engines {
+    ENGINE_ROWS,
+    ENGINE_BANDS,
+    ENGINE_COUNT
+  };
+
   static const char* const COLOR_CURVE[] = {"gamma 1.80",
                                             "gamma 2.20",
                                             "gamma 2.40",
@@ -150,6 +187,22 @@ namespace Constants
                                             "Rec.2020",
                                             "ARRI Wide Gamut 4",
                                             0};
+
+  static const char* const YCBCR_MATRIX[] = {"Rec.601", "Rec.709", "Rec.2020",
+                                             0};
+
+  static const char* const YCBCR_RANGE[] = {"legal", "full", 0};
+
+  static const char* const PRECISION[] = {"exact",     "1D LUT", "3D LUT 33",
+                                          "3D LUT 65", "auto",   0};
+
+  static const char* const LUT_STORAGE[] = {"float", "half", "float tiled",
+                                            "half tiled", 0};
+
+  static const char* const LUT_FILE_POSITION[] = {"before curves",
+                                                  "after curves", 0};
+
+  static const char* const ENGINE[] = {"rows", "bands", 0};
 }  // namespace Constants
 
 #endif  // CONSTANTS_H
\ No newline at end of file
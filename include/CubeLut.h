@@ -0,0 +1,523 @@
+#ifndef CUBE_LUT_H
+#define CUBE_LUT_H
+
+// .cube LUT files (Adobe and Resolve flavours) as a transform stage.
+//
+// A file holds a 1D table, a 3D cube or both, in which case the 1D table is
+// a shaper applied first. Inputs are mapped from DOMAIN_MIN/MAX (or the
+// LUT_*_INPUT_RANGE of Resolve files) onto the table and clamped there, as
+// the format asks. The tables run through the same vector 1D and tetrahedral
+// lookups as the baked precision tiers.
+//
+// Files are mapped and parsed in place, numbers with a hand rolled parser,
+// and cached process wide by path. A cached file is used while its
+// modification time and size match, an edited file is parsed again.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "include/Lut.h"
+#include "include/Simd.h"
+
+struct CubeLut
+{
+  std::string title;
+  // per channel input domain as v * scale + bias, onto [0, 1]
+  float scale1D[3] = {1.0f, 1.0f, 1.0f};
+  float bias1D[3] = {};
+  float scale3D[3] = {1.0f, 1.0f, 1.0f};
+  float bias3D[3] = {};
+  // views into 'data': the 1D curves one after the other, then the cube
+  // row-major with r fastest, which is the file's own order
+  Lut1D curves[3];
+  Lut3D cube;
+  std::vector<float> data;
+  // of the tables and domains, identifies the content for LUT keys
+  uint64_t hash = 0;
+
+  CubeLut() = default;
+  CubeLut(const CubeLut&) = delete;
+  CubeLut& operator=(const CubeLut&) = delete;
+};
+
+inline void ApplyCubeLut(const CubeLut& lut, Simd::vfloat& r, Simd::vfloat& g,
+                         Simd::vfloat& b)
+{
+  using namespace Simd;
+  vfloat* channels[3] = {&r, &g, &b};
+  if(lut.curves[0].size) {
+    for(int c = 0; c < 3; ++c) {
+      const vfloat x =
+          madd(*channels[c], set1(lut.scale1D[c]), set1(lut.bias1D[c]));
+      *channels[c] = LookupLut1D(lut.curves[c], x);
+    }
+  }
+  if(lut.cube.size) {
+    for(int c = 0; c < 3; ++c) {
+      *channels[c] =
+          madd(*channels[c], set1(lut.scale3D[c]), set1(lut.bias3D[c]));
+    }
+    LookupLut3D(lut.cube, r, g, b);
+  }
+}
+
+namespace CubeDetail
+{
+  constexpr int kMaxSize1D = 65536;
+
+  inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+  inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+  inline void SkipSpace(const char*& p, const char* end)
+  {
+    while(p < end && IsSpace(*p)) ++p;
+  }
+
+  // Decimal or scientific notation. Short numbers are scaled exactly in
+  // float, longer ones keep their first 19 significant digits and are
+  // scaled in double, which rounds to the nearest float but for rare double
+  // rounding ties.
+  inline bool ParseFloat(const char*& p, const char* end, float& value)
+  {
+    static const double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                    1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                    1e18, 1e19, 1e20, 1e21, 1e22};
+    static const float kPow10f[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                    1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+    const char* s = p;
+    bool negative = false;
+    if(s < end && (*s == '-' || *s == '+')) negative = *s++ == '-';
+
+    const char* whole = s;
+    while(s < end && IsDigit(*s)) ++s;
+    const char* wholeEnd = s;
+    const char* fraction = s;
+    if(s < end && *s == '.') {
+      fraction = ++s;
+      while(s < end && IsDigit(*s)) ++s;
+    }
+    const char* fractionEnd = s;
+    const long wholeDigits = wholeEnd - whole;
+    const long fractionDigits = fractionEnd - fraction;
+    if(wholeDigits + fractionDigits == 0) return false;
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    if(wholeDigits + fractionDigits <= 19) {
+      for(const char* d = whole; d < wholeEnd; ++d) {
+        mantissa = mantissa * 10 + (*d - '0');
+      }
+      for(const char* d = fraction; d < fractionEnd; ++d) {
+        mantissa = mantissa * 10 + (*d - '0');
+      }
+      exponent = -static_cast<int>(fractionDigits);
+    }
+    else {
+      // only the first 19 significant digits fit
+      int digits = 0;
+      for(const char* d = whole; d < wholeEnd; ++d) {
+        if(digits < 19) {
+          mantissa = mantissa * 10 + (*d - '0');
+          digits += mantissa != 0;
+        }
+        else {
+          ++exponent;
+        }
+      }
+      for(const char* d = fraction; d < fractionEnd && digits < 19; ++d) {
+        mantissa = mantissa * 10 + (*d - '0');
+        digits += mantissa != 0;
+        --exponent;
+      }
+    }
+
+    if(s < end && (*s == 'e' || *s == 'E')) {
+      ++s;
+      bool minus = false;
+      if(s < end && (*s == '-' || *s == '+')) minus = *s++ == '-';
+      if(s == end || !IsDigit(*s)) return false;
+      int e = 0;
+      for(; s < end && IsDigit(*s); ++s) {
+        if(e < 10000) e = e * 10 + (*s - '0');
+      }
+      exponent += minus ? -e : e;
+    }
+
+    // both exact in float: one correctly rounded operation, which covers
+    // the "0.123456" style of every LUT writer
+    if(mantissa < (1u << 24) && exponent >= -10 && exponent <= 10) {
+      const float m = static_cast<float>(mantissa);
+      const float scaled = exponent < 0 ? m / kPow10f[-exponent]
+                                        : m * kPow10f[exponent];
+      value = negative ? -scaled : scaled;
+      p = s;
+      return true;
+    }
+
+    double v = static_cast<double>(mantissa);
+    if(mantissa == 0 || exponent < -80) {
+      v = 0.0;
+    }
+    else if(exponent > 60) {
+      v = HUGE_VAL;
+    }
+    else {
+      for(; exponent > 22; exponent -= 22) v *= kPow10[22];
+      for(; exponent < -22; exponent += 22) v /= kPow10[22];
+      v = exponent < 0 ? v / kPow10[-exponent] : v * kPow10[exponent];
+    }
+    value = static_cast<float>(negative ? -v : v);
+    p = s;
+    return true;
+  }
+
+  inline bool ParseInt(const char*& p, const char* end, int& value)
+  {
+    const char* s = p;
+    int v = 0;
+    for(; s < end && IsDigit(*s); ++s) {
+      if(v > 100000000) return false;
+      v = v * 10 + (*s - '0');
+    }
+    if(s == p) return false;
+    value = v;
+    p = s;
+    return true;
+  }
+
+  // 'count' floats separated by blanks, then the end of the line
+  inline bool ParseFloats(const char* p, const char* end, float* values,
+                          int count)
+  {
+    for(int i = 0; i < count; ++i) {
+      SkipSpace(p, end);
+      if(!ParseFloat(p, end, values[i])) return false;
+      if(p < end && !IsSpace(*p)) return false;
+    }
+    SkipSpace(p, end);
+    return p == end;
+  }
+
+  inline bool KeywordIs(const char* word, size_t length, const char* name)
+  {
+    return std::strlen(name) == length && !std::memcmp(word, name, length);
+  }
+
+  // v * scale + bias maps [lo, hi] onto [0, 1]
+  inline bool SetDomain(const float* lo, const float* hi, float* scale,
+                        float* bias)
+  {
+    for(int c = 0; c < 3; ++c) {
+      if(!(hi[c] > lo[c])) return false;
+      scale[c] = 1.0f / (hi[c] - lo[c]);
+      bias[c] = -lo[c] * scale[c];
+    }
+    return true;
+  }
+
+  inline uint64_t Hash(const CubeLut& lut)
+  {
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&h](const void* data, size_t bytes) {
+      const uint8_t* p = static_cast<const uint8_t*>(data);
+      for(size_t i = 0; i + 4 <= bytes; i += 4) {
+        uint32_t w;
+        std::memcpy(&w, p + i, sizeof(w));
+        h = (h ^ w) * 1099511628211ull;
+      }
+    };
+    const int sizes[2] = {lut.curves[0].size, lut.cube.size};
+    mix(sizes, sizeof(sizes));
+    mix(lut.scale1D, sizeof(lut.scale1D));
+    mix(lut.bias1D, sizeof(lut.bias1D));
+    mix(lut.scale3D, sizeof(lut.scale3D));
+    mix(lut.bias3D, sizeof(lut.bias3D));
+    mix(lut.data.data(), sizeof(float) * lut.data.size());
+    return h;
+  }
+
+  inline bool Fail(std::string* error, const std::string& name, int line,
+                   const char* message)
+  {
+    if(error != nullptr) {
+      *error = name + ":" + std::to_string(line) + ": " + message;
+    }
+    return false;
+  }
+
+  // 'text' of a whole .cube file into 'lut', 'name' only goes into errors
+  inline bool Parse(const char* text, size_t size, const std::string& name,
+                    CubeLut& lut, std::string* error)
+  {
+    int size1D = 0;
+    int size3D = 0;
+    float min1D[3] = {0.0f, 0.0f, 0.0f}, max1D[3] = {1.0f, 1.0f, 1.0f};
+    float min3D[3] = {0.0f, 0.0f, 0.0f}, max3D[3] = {1.0f, 1.0f, 1.0f};
+    size_t rows = 0;
+    size_t expected = 0;
+    float* cube = nullptr;
+
+    const char* end = text + size;
+    int line = 0;
+    for(const char* p = text; p < end;) {
+      const char* eol =
+          static_cast<const char*>(std::memchr(p, '\n', end - p));
+      if(eol == nullptr) eol = end;
+      const char* s = p;
+      p = eol + 1;
+      ++line;
+
+      SkipSpace(s, eol);
+      if(s == eol || *s == '#') continue;
+
+      const char c = *s;
+      if(IsDigit(c) || c == '-' || c == '+' || c == '.') {
+        if(rows == 0) {
+          if(size1D == 0 && size3D == 0) {
+            return Fail(error, name, line, "data before LUT_1D_SIZE or "
+                                           "LUT_3D_SIZE");
+          }
+          const size_t points = static_cast<size_t>(size3D) * size3D * size3D;
+          expected = size1D + points;
+          lut.data.assign(3 * static_cast<size_t>(size1D) + 3 * points, 0.0f);
+          cube = lut.data.data() + 3 * static_cast<size_t>(size1D);
+        }
+        if(rows == expected) {
+          return Fail(error, name, line, "more table rows than the size");
+        }
+        float v[3];
+        if(!ParseFloats(s, eol, v, 3)) {
+          return Fail(error, name, line, "expected three numbers");
+        }
+        if(rows < static_cast<size_t>(size1D)) {
+          for(int k = 0; k < 3; ++k) lut.data[k * size1D + rows] = v[k];
+        }
+        else {
+          std::memcpy(cube + 3 * (rows - size1D), v, sizeof(v));
+        }
+        ++rows;
+        continue;
+      }
+
+      const char* word = s;
+      while(s < eol && !IsSpace(*s)) ++s;
+      const size_t length = s - word;
+      if(rows != 0) {
+        return Fail(error, name, line, "keyword after the table");
+      }
+
+      if(KeywordIs(word, length, "TITLE")) {
+        SkipSpace(s, eol);
+        const char* q = s;
+        const char* last = eol;
+        while(last > q && IsSpace(last[-1])) --last;
+        if(q < last && *q == '"') ++q;
+        if(last > q && last[-1] == '"') --last;
+        lut.title.assign(q, last);
+      }
+      else if(KeywordIs(word, length, "LUT_1D_SIZE") ||
+              KeywordIs(word, length, "LUT_3D_SIZE")) {
+        const bool is1D = word[4] == '1';
+        int n;
+        SkipSpace(s, eol);
+        if(!ParseInt(s, eol, n) || n < 2) {
+          return Fail(error, name, line, "bad LUT size");
+        }
+        // the lookups address the cube with float offsets, exact up to 2^24
+        const bool tooLarge =
+            is1D ? n > kMaxSize1D
+                 : static_cast<double>(n) * n * n * 3 > double(1 << 24);
+        if(tooLarge) return Fail(error, name, line, "LUT size too large");
+        (is1D ? size1D : size3D) = n;
+      }
+      else if(KeywordIs(word, length, "DOMAIN_MIN") ||
+              KeywordIs(word, length, "DOMAIN_MAX")) {
+        float v[3];
+        if(!ParseFloats(s, eol, v, 3)) {
+          return Fail(error, name, line, "expected three numbers");
+        }
+        const bool lo = word[8] == 'I';
+        std::memcpy(lo ? min1D : max1D, v, sizeof(v));
+        std::memcpy(lo ? min3D : max3D, v, sizeof(v));
+      }
+      else if(KeywordIs(word, length, "LUT_1D_INPUT_RANGE") ||
+              KeywordIs(word, length, "LUT_3D_INPUT_RANGE")) {
+        float v[2];
+        if(!ParseFloats(s, eol, v, 2)) {
+          return Fail(error, name, line, "expected two numbers");
+        }
+        float* lo = word[4] == '1' ? min1D : min3D;
+        float* hi = word[4] == '1' ? max1D : max3D;
+        for(int k = 0; k < 3; ++k) {
+          lo[k] = v[0];
+          hi[k] = v[1];
+        }
+      }
+      // other keywords (LUT_IN_VIDEO_RANGE, ...) are vendor extensions
+    }
+
+    if(rows != expected || rows == 0) {
+      return Fail(error, name, line, "table shorter than the LUT size");
+    }
+    if(!SetDomain(min1D, max1D, lut.scale1D, lut.bias1D) ||
+       !SetDomain(min3D, max3D, lut.scale3D, lut.bias3D)) {
+      return Fail(error, name, line, "empty domain");
+    }
+
+    for(int k = 0; k < 3; ++k) {
+      lut.curves[k].size = size1D;
+      lut.curves[k].table =
+          size1D ? lut.data.data() + static_cast<size_t>(k) * size1D : nullptr;
+    }
+    lut.cube.size = size3D;
+    lut.cube.storage = Constants::LUT_STORAGE_FLOAT;
+    lut.cube.table = size3D ? cube : nullptr;
+    lut.hash = Hash(lut);
+    return true;
+  }
+}  // namespace CubeDetail
+
+// Parses the .cube file at 'path' without the cache
+inline std::shared_ptr<const CubeLut> ReadCubeLut(const std::string& path,
+                                                  std::string* error)
+{
+  auto lut = std::make_shared<CubeLut>();
+  bool ok;
+#if !defined(_WIN32)
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  struct stat info;
+  if(fd < 0 || ::fstat(fd, &info) != 0) {
+    if(fd >= 0) ::close(fd);
+    if(error != nullptr) *error = path + ": cannot open";
+    return nullptr;
+  }
+  const size_t bytes = static_cast<size_t>(info.st_size);
+  void* addr = bytes ? ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0)
+                     : nullptr;
+  ::close(fd);
+  if(addr == MAP_FAILED) {
+    if(error != nullptr) *error = path + ": cannot map";
+    return nullptr;
+  }
+  ok = CubeDetail::Parse(static_cast<const char*>(addr), bytes, path, *lut,
+                         error);
+  if(addr != nullptr) ::munmap(addr, bytes);
+#else
+  // no mapping on Windows, the file is read whole
+  FILE* f = std::fopen(path.c_str(), "rb");
+  if(f == nullptr) {
+    if(error != nullptr) *error = path + ": cannot open";
+    return nullptr;
+  }
+  std::vector<char> text;
+  char chunk[65536];
+  size_t n;
+  while((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0) {
+    text.insert(text.end(), chunk, chunk + n);
+  }
+  std::fclose(f);
+  ok = CubeDetail::Parse(text.data(), text.size(), path, *lut, error);
+#endif
+  return ok ? lut : nullptr;
+}
+
+// Process wide cache of parsed .cube files, shared by every node instance
+class CubeLutCache
+{
+ public:
+  using Entry = std::shared_ptr<const CubeLut>;
+
+  static CubeLutCache& instance()
+  {
+    static CubeLutCache cache;
+    return cache;
+  }
+
+  // The parsed file, null with 'error' set when it cannot be read
+  Entry load(const std::string& path, std::string* error)
+  {
+    Stamp stamp;
+    if(!Stat(path, stamp)) {
+      if(error != nullptr) *error = path + ": cannot open";
+      return nullptr;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto found = files.find(path);
+      if(found != files.end() && found->second.stamp == stamp) {
+        return found->second.lut;
+      }
+    }
+
+    // parsed outside the lock, a concurrent load of the same file at worst
+    // parses it twice
+    Entry lut = ReadCubeLut(path, error);
+    if(lut == nullptr) return nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    files[path] = {stamp, lut};
+    return lut;
+  }
+
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    files.clear();
+  }
+
+ private:
+  struct Stamp
+  {
+    int64_t seconds = 0;
+    int64_t nanoseconds = 0;
+    int64_t bytes = 0;
+
+    bool operator==(const Stamp& o) const
+    {
+      return seconds == o.seconds && nanoseconds == o.nanoseconds &&
+             bytes == o.bytes;
+    }
+  };
+
+  struct Slot
+  {
+    Stamp stamp;
+    Entry lut;
+  };
+
+  static bool Stat(const std::string& path, Stamp& stamp)
+  {
+    struct stat info;
+    if(::stat(path.c_str(), &info) != 0) return false;
+    stamp.seconds = static_cast<int64_t>(info.st_mtime);
+#if defined(__APPLE__)
+    stamp.nanoseconds = info.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+    stamp.nanoseconds = info.st_mtim.tv_nsec;
+#endif
+    stamp.bytes = static_cast<int64_t>(info.st_size);
+    return true;
+  }
+
+  CubeLutCache() = default;
+
+  std::mutex mutex;
+  std::unordered_map<std::string, Slot> files;
+};
+
+#endif  // CUBE_LUT_H
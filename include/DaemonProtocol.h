@@ -0,0 +1,184 @@
+#ifndef DAEMON_PROTOCOL_H
+#define DAEMON_PROTOCOL_H
+
+// Wire format between gcolorspace_daemon and the C API client
+// (gcs_client_*), over a Unix stream socket. Linux only (memfd frames).
+//
+// A connection carries any number of requests, one at a time:
+//   client: Request + the frame's memfd (SCM_RIGHTS), then lutPathBytes of
+//           .cube path
+//   daemon: Reply, then messageBytes of error text
+// The pixels never go through the socket: the daemon maps the memfd and
+// converts the frame in place before replying. Spec values are the C API
+// enums (gcs_colorspace, ...), which never change, so an older client keeps
+// talking to a newer daemon. Numbers are native, both ends share the host.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace DaemonProtocol
+{
+  constexpr uint32_t kMagic = 0x53434347;  // "GCCS"
+  constexpr uint32_t kVersion = 1;
+  constexpr uint32_t kMaxPath = 4096;
+  constexpr uint32_t kMaxMessage = 1024;
+
+  // gcs_settings without the pointer
+  struct Spec
+  {
+    int32_t colorIn;
+    int32_t colorOut;
+    int32_t whiteIn;
+    int32_t whiteOut;
+    int32_t primaryIn;
+    int32_t primaryOut;
+    int32_t cat;
+    int32_t ycbcrMatrix;
+    int32_t ycbcrRange;
+    int32_t precision;
+    float tolerance;
+    int32_t bitExact;
+    int32_t lutAfter;
+    uint32_t lutPathBytes;
+  };
+
+  struct Request
+  {
+    uint32_t magic;
+    uint32_t version;
+    Spec spec;
+    int32_t type;      // gcs_pixel_type
+    int32_t channels;  // 3 or 4 interleaved, 0 planar
+    int32_t width;
+    int32_t height;
+    int64_t rowStride;  // bytes, 0 for packed rows
+    // byte offsets into the memfd: the pixels, or the R, G and B planes
+    uint64_t offset[3];
+    int32_t threads;
+    uint32_t reserved;
+  };
+
+  struct Reply
+  {
+    uint32_t magic;
+    int32_t status;  // gcs_status
+    uint32_t messageBytes;
+    uint32_t reserved;
+  };
+
+  // GCOLORSPACE_DAEMON_SOCKET, else per user in XDG_RUNTIME_DIR or /tmp
+  inline std::string DefaultSocketPath()
+  {
+    if(const char* env = std::getenv("GCOLORSPACE_DAEMON_SOCKET")) {
+      if(*env) return env;
+    }
+    if(const char* dir = std::getenv("XDG_RUNTIME_DIR")) {
+      if(*dir) return std::string(dir) + "/gcolorspace.sock";
+    }
+    return "/tmp/gcolorspace-" + std::to_string(getuid()) + ".sock";
+  }
+
+  // false when 'path' does not fit sockaddr_un
+  inline bool Address(const std::string& path, sockaddr_un& address)
+  {
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.empty() || path.size() >= sizeof(address.sun_path)) return false;
+    std::memcpy(address.sun_path, path.data(), path.size());
+    return true;
+  }
+
+  inline bool SendAll(int socket, const void* data, size_t size)
+  {
+    const char* p = static_cast<const char*>(data);
+    while(size > 0) {
+      const ssize_t sent = send(socket, p, size, MSG_NOSIGNAL);
+      if(sent <= 0) return false;
+      p += sent;
+      size -= static_cast<size_t>(sent);
+    }
+    return true;
+  }
+
+  inline bool RecvAll(int socket, void* data, size_t size)
+  {
+    char* p = static_cast<char*>(data);
+    while(size > 0) {
+      const ssize_t got = recv(socket, p, size, 0);
+      if(got <= 0) return false;
+      p += got;
+      size -= static_cast<size_t>(got);
+    }
+    return true;
+  }
+
+  // 'data' with 'fd' attached to its first byte
+  inline bool SendWithFd(int socket, const void* data, size_t size, int fd)
+  {
+    iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    std::memset(control, 0, sizeof(control));
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+    const ssize_t sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    if(sent <= 0) return false;
+    return SendAll(socket, static_cast<const char*>(data) + sent,
+                   size - static_cast<size_t>(sent));
+  }
+
+  // 'size' bytes and the descriptor sent with them, -1 when there was none.
+  // False on end of stream or a short read.
+  inline bool RecvWithFd(int socket, void* data, size_t size, int& fd)
+  {
+    fd = -1;
+    iovec iov;
+    iov.iov_base = data;
+    iov.iov_len = size;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    const ssize_t got = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    if(got <= 0) return false;
+    for(cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr;
+        header = CMSG_NXTHDR(&message, header)) {
+      if(header->cmsg_level == SOL_SOCKET &&
+         header->cmsg_type == SCM_RIGHTS) {
+        std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+      }
+    }
+    if((message.msg_flags & MSG_CTRUNC) ||
+       !RecvAll(socket, static_cast<char*>(data) + got,
+                size - static_cast<size_t>(got))) {
+      if(fd >= 0) close(fd);
+      fd = -1;
+      return false;
+    }
+    return true;
+  }
+}  // namespace DaemonProtocol
+
+#endif  // DAEMON_PROTOCOL_H
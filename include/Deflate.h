@@ -0,0 +1,807 @@
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+// zlib streams (RFC 1950 around RFC 1951 deflate) without zlib, for the
+// ZIP and ZIPS compression of the built-in EXR I/O.
+//
+// Inflate handles stored, fixed and dynamic Huffman blocks and checks the
+// Adler-32 trailer. Deflate writes one dynamic Huffman block per run of
+// tokens from a hash chain LZ77 matcher, roughly zlib level 4-5: EXR data is
+// already delta coded by the time it gets here, so most of the gain is in the
+// entropy coding.
+//
+// Neither allocates: the decoder's tables are fixed size and the matcher's
+// come from the thread's ScratchArena, only 'out' of Deflate grows.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+#include "include/FramePool.h"
+
+namespace DeflateDetail
+{
+  constexpr uint16_t kLengthBase[29] = {3,  4,  5,  6,   7,   8,   9,   10,
+                                        11, 13, 15, 17,  19,  23,  27,  31,
+                                        35, 43, 51, 59,  67,  83,  99,  115,
+                                        131, 163, 195, 227, 258};
+  constexpr uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                        1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                        4, 4, 4, 4, 5, 5, 5, 5, 0};
+  constexpr uint16_t kDistBase[30] = {
+      1,   2,   3,   4,   5,   7,    9,    13,   17,   25,
+      33,  49,  65,  97,  129, 193,  257,  385,  513,  769,
+      1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+  constexpr uint8_t kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                      4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                      9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+  // order of the code length code lengths in a dynamic block header
+  constexpr uint8_t kCodeLengthOrder[19] = {16, 17, 18, 0, 8,  7, 9,
+                                            6,  10, 5,  11, 4, 12, 3,
+                                            13, 2,  14, 1,  15};
+
+  inline uint32_t Adler32(const uint8_t* p, size_t n)
+  {
+    uint32_t a = 1, b = 0;
+    while(n > 0) {
+      // largest block before b can overflow
+      const size_t block = std::min<size_t>(n, 5552);
+      for(size_t i = 0; i < block; ++i) {
+        a += p[i];
+        b += a;
+      }
+      a %= 65521;
+      b %= 65521;
+      p += block;
+      n -= block;
+    }
+    return (b << 16) | a;
+  }
+
+  inline uint32_t Reverse(uint32_t code, int bits)
+  {
+    uint32_t r = 0;
+    for(int i = 0; i < bits; ++i) {
+      r = (r << 1) | (code & 1);
+      code >>= 1;
+    }
+    return r;
+  }
+
+  // ---------------------------------------------------------------- inflate
+
+  class BitReader
+  {
+   public:
+    BitReader(const uint8_t* data, size_t size)
+        : p(data), end(data + size)
+    {
+    }
+
+    void refill()
+    {
+      if(end - p >= 8 && count <= 56) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        bits |= word << count;
+        const int take = (63 - count) >> 3;
+        p += take;
+        count += take << 3;
+        return;
+      }
+      while(count <= 56 && p < end) {
+        bits |= static_cast<uint64_t>(*p++) << count;
+        count += 8;
+      }
+    }
+
+    // up to 32 bits, refill() must have been called
+    uint32_t peek(int n) const
+    {
+      return static_cast<uint32_t>(bits & ((1ull << n) - 1));
+    }
+
+    void skip(int n)
+    {
+      bits >>= n;
+      count -= n;
+    }
+
+    uint32_t take(int n)
+    {
+      if(count < n) refill();
+      const uint32_t v = peek(n);
+      skip(n);
+      return v;
+    }
+
+    // bits read past the end of the input
+    bool overrun() const { return count < 0; }
+
+    // drops the bits up to the next byte boundary, for stored blocks
+    void align() { skip(count & 7); }
+
+    // whole bytes still buffered go back to the input
+    const uint8_t* bytePosition() const { return p - (count >> 3); }
+
+    void seek(const uint8_t* position)
+    {
+      p = position;
+      bits = 0;
+      count = 0;
+    }
+
+    const uint8_t* limit() const { return end; }
+
+   private:
+    const uint8_t* p;
+    const uint8_t* end;
+    uint64_t bits = 0;
+    int count = 0;
+  };
+
+  // Canonical Huffman decoder: codes up to kFastBits long resolve with one
+  // table lookup, longer ones walk the canonical ranges.
+  class Huffman
+  {
+   public:
+    static constexpr int kFastBits = 10;
+
+    // false for over-subscribed or (beyond a single code) incomplete sets
+    bool build(const uint8_t* lengths, int n)
+    {
+      std::fill(std::begin(counts), std::end(counts), 0);
+      for(int i = 0; i < n; ++i) ++counts[lengths[i]];
+      counts[0] = 0;
+
+      int left = 1;
+      for(int len = 1; len <= 15; ++len) {
+        left = (left << 1) - counts[len];
+        if(left < 0) return false;
+      }
+      int used = 0;
+      for(int len = 1; len <= 15; ++len) used += counts[len];
+      if(left > 0 && used > 1) return false;
+
+      int offsets[16];
+      offsets[1] = 0;
+      for(int len = 1; len < 15; ++len) {
+        offsets[len + 1] = offsets[len] + counts[len];
+      }
+      std::fill(symbols, symbols + n, 0);
+      for(int i = 0; i < n; ++i) {
+        if(lengths[i] != 0) {
+          symbols[offsets[lengths[i]]++] = static_cast<uint16_t>(i);
+        }
+      }
+
+      std::fill(std::begin(fast), std::end(fast), 0);
+      uint32_t code = 0;
+      int index = 0;
+      for(int len = 1; len <= kFastBits; ++len) {
+        for(int k = 0; k < counts[len]; ++k, ++code, ++index) {
+          const uint32_t reversed = Reverse(code, len);
+          const uint16_t entry =
+              static_cast<uint16_t>((symbols[index] << 4) | len);
+          for(uint32_t fill = reversed; fill < (1u << kFastBits);
+              fill += 1u << len) {
+            fast[fill] = entry;
+          }
+        }
+        code <<= 1;
+      }
+      return true;
+    }
+
+    // -1 on an invalid code
+    int decode(BitReader& in) const
+    {
+      const uint16_t entry = fast[in.peek(kFastBits)];
+      if(entry != 0) {
+        in.skip(entry & 15);
+        return entry >> 4;
+      }
+
+      // bit by bit past the table, as in zlib's puff
+      int code = 0, first = 0, index = 0;
+      for(int len = 1; len <= 15; ++len) {
+        code |= static_cast<int>(in.peek(len) >> (len - 1)) & 1;
+        const int count = counts[len];
+        if(code - count < first) {
+          in.skip(len);
+          return symbols[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+      }
+      return -1;
+    }
+
+   private:
+    uint16_t fast[1 << kFastBits];
+    int counts[16];
+    uint16_t symbols[288];
+  };
+
+  inline bool FixedTables(Huffman& lit, Huffman& dist)
+  {
+    uint8_t lengths[288];
+    std::fill(lengths, lengths + 144, 8);
+    std::fill(lengths + 144, lengths + 256, 9);
+    std::fill(lengths + 256, lengths + 280, 7);
+    std::fill(lengths + 280, lengths + 288, 8);
+    // 30 and 31 never occur but keep the code complete
+    uint8_t distLengths[32];
+    std::fill(distLengths, distLengths + 32, 5);
+    return lit.build(lengths, 288) && dist.build(distLengths, 32);
+  }
+
+  inline bool DynamicTables(BitReader& in, Huffman& lit, Huffman& dist)
+  {
+    const int nlit = static_cast<int>(in.take(5)) + 257;
+    const int ndist = static_cast<int>(in.take(5)) + 1;
+    const int ncode = static_cast<int>(in.take(4)) + 4;
+    if(nlit > 286 || ndist > 30) return false;
+
+    uint8_t codeLengths[19] = {};
+    for(int i = 0; i < ncode; ++i) {
+      codeLengths[kCodeLengthOrder[i]] = static_cast<uint8_t>(in.take(3));
+    }
+    Huffman lengthCode;
+    if(!lengthCode.build(codeLengths, 19)) return false;
+
+    uint8_t lengths[286 + 30] = {};
+    int i = 0;
+    while(i < nlit + ndist) {
+      in.refill();
+      const int symbol = lengthCode.decode(in);
+      if(symbol < 0) return false;
+      if(symbol < 16) {
+        lengths[i++] = static_cast<uint8_t>(symbol);
+        continue;
+      }
+      int repeat;
+      uint8_t value = 0;
+      if(symbol == 16) {
+        if(i == 0) return false;
+        value = lengths[i - 1];
+        repeat = 3 + static_cast<int>(in.take(2));
+      }
+      else if(symbol == 17) {
+        repeat = 3 + static_cast<int>(in.take(3));
+      }
+      else {
+        repeat = 11 + static_cast<int>(in.take(7));
+      }
+      if(i + repeat > nlit + ndist) return false;
+      std::fill(lengths + i, lengths + i + repeat, value);
+      i += repeat;
+    }
+    if(lengths[256] == 0) return false;
+    return lit.build(lengths, nlit) && dist.build(lengths + nlit, ndist);
+  }
+
+  inline bool InflateBlock(BitReader& in, const Huffman& lit,
+                           const Huffman& dist, uint8_t* out, size_t size,
+                           size_t& o)
+  {
+    for(;;) {
+      in.refill();
+      const int symbol = lit.decode(in);
+      if(symbol < 0) return false;
+      if(symbol < 256) {
+        if(o >= size) return false;
+        out[o++] = static_cast<uint8_t>(symbol);
+        continue;
+      }
+      if(symbol == 256) return !in.overrun();
+
+      const int l = symbol - 257;
+      if(l >= 29) return false;
+      const size_t length = kLengthBase[l] + in.take(kLengthExtra[l]);
+      in.refill();
+      const int d = dist.decode(in);
+      if(d < 0 || d >= 30) return false;
+      const size_t distance = kDistBase[d] + in.take(kDistExtra[d]);
+      if(distance > o || length > size - o || in.overrun()) return false;
+
+      uint8_t* to = out + o;
+      const uint8_t* from = to - distance;
+      if(distance >= length) {
+        std::memcpy(to, from, length);
+      }
+      else {
+        for(size_t k = 0; k < length; ++k) to[k] = from[k];
+      }
+      o += length;
+    }
+  }
+
+  // ---------------------------------------------------------------- deflate
+
+  template <typename Bytes>
+  class BitWriter
+  {
+   public:
+    explicit BitWriter(Bytes& out) : bytes(out) {}
+
+    // n <= 16, whole 32 bit words go out at once (little endian host)
+    void put(uint32_t value, int n)
+    {
+      bits |= static_cast<uint64_t>(value) << count;
+      count += n;
+      if(count >= 32) {
+        const uint32_t word = static_cast<uint32_t>(bits);
+        const size_t at = bytes.size();
+        bytes.resize(at + 4);
+        std::memcpy(bytes.data() + at, &word, sizeof(word));
+        bits >>= 32;
+        count -= 32;
+      }
+    }
+
+    void flush()
+    {
+      for(; count > 0; count -= 8) {
+        bytes.push_back(static_cast<uint8_t>(bits));
+        bits >>= 8;
+      }
+      bits = 0;
+      count = 0;
+    }
+
+   private:
+    Bytes& bytes;
+    uint64_t bits = 0;
+    int count = 0;
+  };
+
+  // Huffman code lengths of at most maxBits for 'freqs'. At least two
+  // symbols get a code so the set is always complete.
+  inline void BuildLengths(const uint32_t* counts, int n, int maxBits,
+                           uint8_t* lengths)
+  {
+    constexpr int kMaxSymbols = 286;
+    uint32_t freqs[kMaxSymbols];
+    std::copy(counts, counts + n, freqs);
+    std::fill(lengths, lengths + n, 0);
+    int used = 0;
+    for(int i = 0; i < n; ++i) used += freqs[i] != 0;
+    for(int i = 0; used < 2 && i < n; ++i) {
+      if(freqs[i] == 0) {
+        freqs[i] = 1;
+        ++used;
+      }
+    }
+
+    // plain Huffman tree over a min heap of (weight, node)
+    struct Node
+    {
+      uint64_t weight;
+      int parent;
+    };
+    Node nodes[2 * kMaxSymbols];
+    int count = 0;
+    using Item = std::pair<uint64_t, int>;
+    Item heap[kMaxSymbols];
+    int items = 0;
+    const std::greater<Item> order{};
+    auto push = [&](Item item) {
+      heap[items++] = item;
+      std::push_heap(heap, heap + items, order);
+    };
+    auto pop = [&]() {
+      std::pop_heap(heap, heap + items, order);
+      return heap[--items];
+    };
+    int leaf[kMaxSymbols];
+    std::fill(leaf, leaf + n, -1);
+    for(int i = 0; i < n; ++i) {
+      if(freqs[i] == 0) continue;
+      leaf[i] = count;
+      push({freqs[i], leaf[i]});
+      nodes[count++] = {freqs[i], -1};
+    }
+    while(items > 1) {
+      const Item a = pop();
+      const Item b = pop();
+      const int parent = count;
+      nodes[count++] = {a.first + b.first, -1};
+      nodes[a.second].parent = parent;
+      nodes[b.second].parent = parent;
+      push({a.first + b.first, parent});
+    }
+
+    int depth[2 * kMaxSymbols] = {};
+    for(int k = count - 1; k >= 0; --k) {
+      if(nodes[k].parent >= 0) depth[k] = depth[nodes[k].parent] + 1;
+    }
+    for(int i = 0; i < n; ++i) {
+      if(leaf[i] >= 0) {
+        lengths[i] = static_cast<uint8_t>(std::min(depth[leaf[i]], maxBits));
+      }
+    }
+
+    // Kraft sum in units of 2^-maxBits: lengthen the longest codes below the
+    // limit while it is over-subscribed, then shorten codes to fill it
+    const int64_t full = int64_t(1) << maxBits;
+    int64_t kraft = 0;
+    for(int i = 0; i < n; ++i) {
+      if(lengths[i]) kraft += int64_t(1) << (maxBits - lengths[i]);
+    }
+    while(kraft > full) {
+      int best = -1;
+      for(int i = 0; i < n; ++i) {
+        if(lengths[i] && lengths[i] < maxBits &&
+           (best < 0 || lengths[i] > lengths[best] ||
+            (lengths[i] == lengths[best] && freqs[i] < freqs[best]))) {
+          best = i;
+        }
+      }
+      kraft -= int64_t(1) << (maxBits - lengths[best] - 1);
+      ++lengths[best];
+    }
+    while(kraft < full) {
+      int best = -1;
+      for(int i = 0; i < n; ++i) {
+        if(lengths[i] > 1 &&
+           (int64_t(1) << (maxBits - lengths[i])) <= full - kraft &&
+           (best < 0 || freqs[i] > freqs[best])) {
+          best = i;
+        }
+      }
+      if(best < 0) break;
+      kraft += int64_t(1) << (maxBits - lengths[best]);
+      --lengths[best];
+    }
+  }
+
+  // canonical codes, bit reversed for the LSB first writer
+  inline void BuildCodes(const uint8_t* lengths, int n, uint16_t* codes)
+  {
+    int counts[16] = {};
+    for(int i = 0; i < n; ++i) ++counts[lengths[i]];
+    counts[0] = 0;
+    int next[16];
+    int code = 0;
+    for(int len = 1; len < 16; ++len) {
+      code = (code + counts[len - 1]) << 1;
+      next[len] = code;
+    }
+    for(int i = 0; i < n; ++i) {
+      codes[i] = lengths[i]
+                     ? static_cast<uint16_t>(
+                           Reverse(static_cast<uint32_t>(next[lengths[i]]++),
+                                   lengths[i]))
+                     : 0;
+    }
+  }
+
+  // length and distance symbols by lookup, distances past 256 through
+  // their top bits as in zlib's trees.c
+  struct SymbolTables
+  {
+    uint8_t length[259];
+    uint8_t dist[512];
+
+    SymbolTables()
+    {
+      for(int l = 0; l < 29; ++l) {
+        const int end = l == 28 ? 259 : kLengthBase[l + 1];
+        for(int n = kLengthBase[l]; n < end; ++n) length[n] = uint8_t(l);
+      }
+      for(int d = 0; d < 30; ++d) {
+        const int end = d == 29 ? 32769 : kDistBase[d + 1];
+        for(int n = kDistBase[d]; n < end; ++n) {
+          if(n <= 256) dist[n - 1] = uint8_t(d);
+          else dist[256 + ((n - 1) >> 7)] = uint8_t(d);
+        }
+      }
+    }
+
+    static const SymbolTables& instance()
+    {
+      static const SymbolTables tables;
+      return tables;
+    }
+  };
+
+  inline int LengthSymbol(int length)
+  {
+    return SymbolTables::instance().length[length];
+  }
+
+  inline int DistSymbol(int distance)
+  {
+    const SymbolTables& t = SymbolTables::instance();
+    return distance <= 256 ? t.dist[distance - 1]
+                           : t.dist[256 + ((distance - 1) >> 7)];
+  }
+
+  // equal leading bytes of a and b, up to 'limit'
+  inline int MatchLength(const uint8_t* a, const uint8_t* b, int limit)
+  {
+    int n = 0;
+    for(; n + 8 <= limit; n += 8) {
+      uint64_t x, y;
+      std::memcpy(&x, a + n, sizeof(x));
+      std::memcpy(&y, b + n, sizeof(y));
+      if(x != y) break;
+    }
+    while(n < limit && a[n] == b[n]) ++n;
+    return n;
+  }
+
+  // literal: value < 256; match: (length << 16) | distance with length >= 3
+  using Token = uint32_t;
+
+  template <typename Bytes>
+  inline void WriteBlock(BitWriter<Bytes>& out, const Token* tokens,
+                         size_t count, bool last)
+  {
+    uint32_t litFreq[286] = {}, distFreq[30] = {};
+    for(size_t k = 0; k < count; ++k) {
+      const Token t = tokens[k];
+      if(t < 256) {
+        ++litFreq[t];
+      }
+      else {
+        ++litFreq[257 + LengthSymbol(static_cast<int>(t >> 16))];
+        ++distFreq[DistSymbol(static_cast<int>(t & 0xffff))];
+      }
+    }
+    litFreq[256] = 1;
+
+    uint8_t lengths[286 + 30];
+    BuildLengths(litFreq, 286, 15, lengths);
+    BuildLengths(distFreq, 30, 15, lengths + 286);
+    int nlit = 286;
+    while(nlit > 257 && lengths[nlit - 1] == 0) --nlit;
+    int ndist = 30;
+    while(ndist > 1 && lengths[286 + ndist - 1] == 0) --ndist;
+
+    // run length code the lengths with 16, 17 and 18
+    uint8_t all[286 + 30];
+    std::memcpy(all, lengths, nlit);
+    std::memcpy(all + nlit, lengths + 286, ndist);
+    const int total = nlit + ndist;
+    uint16_t runs[286 + 30];  // symbol | extra << 5
+    int nruns = 0;
+    uint32_t codeFreq[19] = {};
+    for(int i = 0; i < total;) {
+      int run = 1;
+      while(i + run < total && all[i + run] == all[i]) ++run;
+      if(all[i] == 0 && run >= 3) {
+        const int r = std::min(run, 138);
+        const uint16_t symbol = r >= 11 ? 18 : 17;
+        runs[nruns++] = static_cast<uint16_t>(
+            symbol | (r - (symbol == 18 ? 11 : 3)) << 5);
+        ++codeFreq[symbol];
+        i += r;
+      }
+      else if(all[i] != 0 && run >= 4) {
+        runs[nruns++] = all[i];
+        ++codeFreq[all[i]];
+        const int r = std::min(run - 1, 6);
+        runs[nruns++] = static_cast<uint16_t>(16 | (r - 3) << 5);
+        ++codeFreq[16];
+        i += 1 + r;
+      }
+      else {
+        runs[nruns++] = all[i];
+        ++codeFreq[all[i]];
+        ++i;
+      }
+    }
+    uint8_t codeLengths[19];
+    BuildLengths(codeFreq, 19, 7, codeLengths);
+    int ncode = 19;
+    while(ncode > 4 && codeLengths[kCodeLengthOrder[ncode - 1]] == 0) --ncode;
+
+    uint16_t litCodes[286], distCodes[30], lengthCodes[19];
+    BuildCodes(lengths, 286, litCodes);
+    BuildCodes(lengths + 286, 30, distCodes);
+    BuildCodes(codeLengths, 19, lengthCodes);
+
+    out.put(last ? 1 : 0, 1);
+    out.put(2, 2);
+    out.put(static_cast<uint32_t>(nlit - 257), 5);
+    out.put(static_cast<uint32_t>(ndist - 1), 5);
+    out.put(static_cast<uint32_t>(ncode - 4), 4);
+    for(int i = 0; i < ncode; ++i) out.put(codeLengths[kCodeLengthOrder[i]], 3);
+    for(int k = 0; k < nruns; ++k) {
+      const uint16_t r = runs[k];
+      const int symbol = r & 31;
+      out.put(lengthCodes[symbol], codeLengths[symbol]);
+      if(symbol == 16) out.put(r >> 5, 2);
+      if(symbol == 17) out.put(r >> 5, 3);
+      if(symbol == 18) out.put(r >> 5, 7);
+    }
+
+    for(size_t k = 0; k < count; ++k) {
+      const Token t = tokens[k];
+      if(t < 256) {
+        out.put(litCodes[t], lengths[t]);
+        continue;
+      }
+      const int length = static_cast<int>(t >> 16);
+      const int distance = static_cast<int>(t & 0xffff);
+      const int l = LengthSymbol(length);
+      out.put(litCodes[257 + l], lengths[257 + l]);
+      out.put(static_cast<uint32_t>(length - kLengthBase[l]), kLengthExtra[l]);
+      const int d = DistSymbol(distance);
+      out.put(distCodes[d], lengths[286 + d]);
+      out.put(static_cast<uint32_t>(distance - kDistBase[d]), kDistExtra[d]);
+    }
+    out.put(litCodes[256], lengths[256]);
+  }
+}  // namespace DeflateDetail
+
+// zlib stream of 'size' bytes into exactly 'outSize' bytes of 'out'. False
+// on a corrupt stream, a checksum mismatch or a size other than 'outSize'.
+inline bool Inflate(const uint8_t* data, size_t size, uint8_t* out,
+                    size_t outSize)
+{
+  using namespace DeflateDetail;
+  if(size < 6) return false;
+  const int cmf = data[0], flg = data[1];
+  if((cmf & 15) != 8 || ((cmf << 8) | flg) % 31 != 0 || (flg & 0x20)) {
+    return false;
+  }
+
+  BitReader in(data + 2, size - 6);
+  Huffman lit, dist;
+  size_t o = 0;
+  bool last = false;
+  while(!last) {
+    last = in.take(1) != 0;
+    const uint32_t type = in.take(2);
+    if(type == 0) {
+      in.align();
+      const uint8_t* p = in.bytePosition();
+      if(in.limit() - p < 4) return false;
+      const size_t len = p[0] | p[1] << 8;
+      const size_t nlen = p[2] | p[3] << 8;
+      if((len ^ 0xffff) != nlen ||
+         static_cast<size_t>(in.limit() - p - 4) < len || len > outSize - o) {
+        return false;
+      }
+      std::memcpy(out + o, p + 4, len);
+      o += len;
+      in.seek(p + 4 + len);
+    }
+    else if(type == 1) {
+      if(!FixedTables(lit, dist) ||
+         !InflateBlock(in, lit, dist, out, outSize, o)) {
+        return false;
+      }
+    }
+    else if(type == 2) {
+      if(!DynamicTables(in, lit, dist) ||
+         !InflateBlock(in, lit, dist, out, outSize, o)) {
+        return false;
+      }
+    }
+    else {
+      return false;
+    }
+    if(in.overrun()) return false;
+  }
+  if(o != outSize) return false;
+
+  const uint8_t* t = data + size - 4;
+  const uint32_t adler = static_cast<uint32_t>(t[0]) << 24 | t[1] << 16 |
+                         t[2] << 8 | t[3];
+  return adler == Adler32(out, outSize);
+}
+
+// zlib stream of 'size' bytes appended to 'out', a byte vector
+template <typename Bytes>
+inline void Deflate(const uint8_t* data, size_t size, Bytes& out)
+{
+  using namespace DeflateDetail;
+  constexpr int kMaxHashBits = 15;
+  constexpr int kWindow = 32768;
+  constexpr int kMaxChain = 8;
+  constexpr int kMaxMatch = 258;
+  // stop searching at a match this long, as zlib's nice_length
+  constexpr int kNiceMatch = 32;
+  // positions inside longer matches are not indexed, as max_insert_length
+  constexpr int kMaxInsert = 16;
+  constexpr size_t kBlockTokens = 1 << 16;
+
+  out.reserve(out.size() + size + size / 8 + 64);
+  out.push_back(0x78);
+  out.push_back(0x5e);
+  BitWriter<Bytes> bits(out);
+
+  // tables sized to the input, EXR chunks are often far below the window
+  int hashBits = 8;
+  while(hashBits < kMaxHashBits && (size_t(1) << hashBits) < size) ++hashBits;
+  size_t window = 256;
+  while(window < static_cast<size_t>(kWindow) && window < size) window <<= 1;
+  ScratchArena::Scope scratch;
+  int32_t* head = scratch.take<int32_t>(size_t(1) << hashBits);
+  int32_t* prev = scratch.take<int32_t>(window);
+  std::fill(head, head + (size_t(1) << hashBits), -1);
+  std::fill(prev, prev + window, -1);
+  const size_t mask = window - 1;
+  auto hash = [data, hashBits](size_t i) {
+    uint32_t v;
+    std::memcpy(&v, data + i, 4);
+    return (v * 2654435761u) >> (32 - hashBits);
+  };
+  auto insert = [&](size_t i) {
+    const uint32_t h = hash(i);
+    prev[i & mask] = head[h];
+    head[h] = static_cast<int32_t>(i);
+  };
+
+  Token* tokens = scratch.take<Token>(kBlockTokens);
+  size_t count = 0;
+  size_t i = 0;
+  while(i < size) {
+    int bestLength = 0;
+    int bestDistance = 0;
+    if(i + 4 <= size) {
+      const uint32_t h = hash(i);
+      int32_t candidate = head[h];
+      const int limit = static_cast<int>(std::min<size_t>(kMaxMatch, size - i));
+      for(int chain = 0; chain < kMaxChain && candidate >= 0; ++chain) {
+        const size_t distance = i - static_cast<size_t>(candidate);
+        if(distance > static_cast<size_t>(kWindow - 1)) break;
+        const uint8_t* a = data + i;
+        const uint8_t* b = data + candidate;
+        // four bytes must match: far three byte matches rarely pay off and
+        // the check weeds out hash collisions cheaply
+        uint32_t x, y;
+        std::memcpy(&x, a, sizeof(x));
+        std::memcpy(&y, b, sizeof(y));
+        if(x == y && b[bestLength] == a[bestLength]) {
+          const int length = MatchLength(a, b, limit);
+          if(length > bestLength) {
+            bestLength = length;
+            bestDistance = static_cast<int>(distance);
+            if(length >= std::min(limit, kNiceMatch)) break;
+          }
+        }
+        candidate = prev[candidate & mask];
+      }
+      insert(i);
+    }
+
+    if(bestLength >= 3) {
+      tokens[count++] = static_cast<Token>(bestLength) << 16 |
+                        static_cast<Token>(bestDistance);
+      if(bestLength <= kMaxInsert) {
+        for(size_t k = i + 1; k < i + bestLength && k + 4 <= size; ++k) {
+          insert(k);
+        }
+      }
+      i += bestLength;
+    }
+    else {
+      tokens[count++] = data[i];
+      ++i;
+    }
+
+    if(count == kBlockTokens) {
+      WriteBlock(bits, tokens, count, false);
+      count = 0;
+    }
+  }
+  WriteBlock(bits, tokens, count, true);
+  bits.flush();
+
+  const uint32_t adler = Adler32(data, size);
+  out.push_back(static_cast<uint8_t>(adler >> 24));
+  out.push_back(static_cast<uint8_t>(adler >> 16));
+  out.push_back(static_cast<uint8_t>(adler >> 8));
+  out.push_back(static_cast<uint8_t>(adler));
+}
+
+#endif  // DEFLATE_H
@@ -4,8 +4,6 @@
 // in: LinToColor
 // out: ColorToLin
 
-#include <DDImage/Knobs.h>
-
 #include <array>
 
 #include "include/ColorData.h"
@@ -0,0 +1,672 @@
+#ifndef DPX_IO_H
+#define DPX_IO_H
+
+// 10 bit DPX reader and writer for the standalone tools: film scans, RGB or
+// RGBA, packed three components per 32 bit word (method A, padding in the
+// low two bits, or method B, padding in the high two), either byte order.
+//
+// Words unpack with SIMD shifts and masks straight into planar floats, and
+// the codes go through an optional 1024 entry table instead of / 1023. With
+// CurveTable() that is the exact scalar in-curve (Cineon and the other log
+// and gamma curves), so a scan is linear by the time it leaves the decoder.
+// Writing quantizes to codes, rounding to nearest, and packs the same way.
+//
+// Decoding runs on row bands in parallel with the same per-band callback as
+// the EXR reader. Headers of read files are kept and written back, so film
+// and TV metadata survive a DPX to DPX conversion; the transfer,
+// colorimetric and reference fields always describe the written codes. As
+// in the EXR I/O, planes and file bytes come from the FramePool and bands
+// run on the CoderTeam.
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/FramePool.h"
+#include "include/ThreadPool.h"
+#include "include/TransformPlan.h"
+
+namespace Dpx
+{
+  enum Packings { PACKING_PACKED, PACKING_A, PACKING_B };
+
+  // transfer characteristic and colorimetric codes of the image element
+  // that the tools set
+  enum Transfers {
+    TRANSFER_USER,
+    TRANSFER_PRINTING_DENSITY,
+    TRANSFER_LINEAR,
+    TRANSFER_LOG,
+    TRANSFER_REC709 = 6
+  };
+
+  struct Image
+  {
+    int width = 0;
+    int height = 0;
+    int channels = 3;  // RGB or RGBA
+    bool bigEndian = true;
+    int packing = PACKING_A;
+    int transfer = TRANSFER_PRINTING_DENSITY;
+    int colorimetric = TRANSFER_PRINTING_DENSITY;
+    // file header up to the image data, in the file's byte order; empty for
+    // a new file
+    std::vector<uint8_t> header;
+    FloatBuffer planes[4];
+
+    void allocate()
+    {
+      const size_t size = static_cast<size_t>(width) * height;
+      for(int c = 0; c < 4; ++c) planes[c].resize(c < channels ? size : 0);
+    }
+
+    float* line(int channel, int row)
+    {
+      return planes[channel].data() + static_cast<size_t>(row) * width;
+    }
+
+    const float* line(int channel, int row) const
+    {
+      return planes[channel].data() + static_cast<size_t>(row) * width;
+    }
+  };
+
+  // first row and row count of a decoded band, as Exr::ChunkCallback
+  using BandCallback = std::function<void(Image& image, int row, int rows)>;
+
+  constexpr int kCodes = 1024;
+  constexpr int kBandRows = 16;
+
+  // Exact code -> value table of the in-curve of 'colorspace' (code / 1023
+  // through the scalar LinTo* function), empty when the curve is not per
+  // channel and has to run on whole pixels
+  inline std::vector<float> CurveTable(int colorspace)
+  {
+    if(!TransformDetail::IsSeparable(colorspace)) return {};
+    const TransformDispatcher curve = TransformInDispatcher(colorspace);
+    std::vector<float> table(kCodes);
+    for(int code = 0; code < kCodes; ++code) {
+      const float v = static_cast<float>(code) / 1023.0f;
+      table[code] = curve({v, v, v})[0];
+    }
+    return table;
+  }
+}  // namespace Dpx
+
+namespace DpxDetail
+{
+  constexpr size_t kGenericHeader = 1664;
+  constexpr size_t kHeader = 2048;
+  constexpr uint8_t kDescriptorRGB = 50;
+  constexpr uint8_t kDescriptorRGBA = 51;
+
+  inline bool Fail(std::string* error, const std::string& message)
+  {
+    if(error) *error = message;
+    return false;
+  }
+
+  inline uint32_t Swap32(uint32_t v)
+  {
+    return (v >> 24) | ((v >> 8) & 0xff00u) | ((v << 8) & 0xff0000u) |
+           (v << 24);
+  }
+
+  inline uint16_t Swap16(uint16_t v)
+  {
+    return static_cast<uint16_t>((v >> 8) | (v << 8));
+  }
+
+  // header fields in the file's byte order
+  class Fields
+  {
+   public:
+    Fields(uint8_t* data, bool bigEndian) : p(data), swap(bigEndian) {}
+
+    uint32_t u32(size_t at) const
+    {
+      uint32_t v;
+      std::memcpy(&v, p + at, sizeof(v));
+      return swap ? Swap32(v) : v;
+    }
+
+    uint16_t u16(size_t at) const
+    {
+      uint16_t v;
+      std::memcpy(&v, p + at, sizeof(v));
+      return swap ? Swap16(v) : v;
+    }
+
+    void set32(size_t at, uint32_t v)
+    {
+      if(swap) v = Swap32(v);
+      std::memcpy(p + at, &v, sizeof(v));
+    }
+
+    void set16(size_t at, uint16_t v)
+    {
+      if(swap) v = Swap16(v);
+      std::memcpy(p + at, &v, sizeof(v));
+    }
+
+    void setFloat(size_t at, float f)
+    {
+      uint32_t v;
+      std::memcpy(&v, &f, sizeof(v));
+      set32(at, v);
+    }
+
+    void setString(size_t at, size_t size, const char* s)
+    {
+      std::memset(p + at, 0, size);
+      std::memcpy(p + at, s, std::min(size - 1, std::strlen(s)));
+    }
+
+   private:
+    uint8_t* p;
+    bool swap;
+  };
+
+  // field offsets, SMPTE 268M
+  enum Offsets : size_t {
+    MAGIC = 0,
+    IMAGE_OFFSET = 4,
+    VERSION = 8,
+    FILE_SIZE = 16,
+    DITTO_KEY = 20,
+    GENERIC_SIZE = 24,
+    INDUSTRY_SIZE = 28,
+    USER_SIZE = 32,
+    CREATOR = 160,
+    ORIENTATION = 768,
+    ELEMENTS = 770,
+    PIXELS = 772,
+    LINES = 776,
+    DATA_SIGN = 780,
+    REF_LOW = 784,
+    REF_LOW_QUANTITY = 788,
+    REF_HIGH = 792,
+    REF_HIGH_QUANTITY = 796,
+    DESCRIPTOR = 800,
+    TRANSFER = 801,
+    COLORIMETRIC = 802,
+    BIT_SIZE = 803,
+    PACKING = 804,
+    ENCODING = 806,
+    DATA_OFFSET = 808,
+    EOL_PADDING = 812,
+    EOP_PADDING = 816,
+    DESCRIPTION = 820
+  };
+
+  template <typename Bytes>
+  inline void NewHeader(bool bigEndian, Bytes& header)
+  {
+    // numeric fields left undefined are all ones, strings are empty
+    header.assign(kHeader, 0xff);
+    const size_t strings[][2] = {{8, 8},      {36, 724},   {820, 32},
+                                 {1432, 188}, {1664, 48},  {1732, 188},
+                                 {1356, 52}};
+    for(const auto& s : strings) std::memset(&header[s[0]], 0, s[1]);
+
+    Fields f(header.data(), bigEndian);
+    std::memcpy(&header[MAGIC], bigEndian ? "SDPX" : "XPDS", 4);
+    f.setString(VERSION, 8, "V2.0");
+    f.set32(DITTO_KEY, 1);
+    f.set32(GENERIC_SIZE, kGenericHeader);
+    f.set32(INDUSTRY_SIZE, kHeader - kGenericHeader);
+    f.set32(USER_SIZE, 0);
+    f.setString(CREATOR, 100, "GColorspace");
+    f.set16(ORIENTATION, 0);
+    f.set32(DATA_SIGN, 0);
+    f.set32(REF_LOW, 0);
+    f.set32(REF_HIGH, 1023);
+    f.setFloat(REF_LOW_QUANTITY, 0.0f);
+    f.setFloat(REF_HIGH_QUANTITY, 2.047f);
+  }
+
+  // The SIMD paths take 4 (SSSE3) or 8 (AVX2) RGB words per step: the
+  // byte swap is one shuffle, each component a shift and a mask, and the
+  // code -> float step a convert and scale or a table lookup.
+#if defined(__AVX2__)
+  inline __m256i Swap8(__m256i w)
+  {
+    const __m256i order = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7,
+        6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    return _mm256_shuffle_epi8(w, order);
+  }
+
+  inline __m256 Decode8(__m256i codes, const float* table)
+  {
+    if(table) return _mm256_i32gather_ps(table, codes, 4);
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(codes),
+                         _mm256_set1_ps(1.0f / 1023.0f));
+  }
+
+  inline __m256i Quantize8(const float* p)
+  {
+    // max() first so NaN lands on 0
+    const __m256 scaled =
+        _mm256_mul_ps(_mm256_loadu_ps(p), _mm256_set1_ps(1023.0f));
+    const __m256 v = _mm256_min_ps(_mm256_max_ps(scaled, _mm256_setzero_ps()),
+                                   _mm256_set1_ps(1023.0f));
+    return _mm256_cvtps_epi32(v);
+  }
+#elif defined(__SSSE3__)
+  inline __m128i Swap4(__m128i w)
+  {
+    const __m128i order =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    return _mm_shuffle_epi8(w, order);
+  }
+
+  inline __m128 Decode4(__m128i codes, const float* table)
+  {
+    if(table) {
+      alignas(16) int32_t c[4];
+      _mm_store_si128(reinterpret_cast<__m128i*>(c), codes);
+      return _mm_setr_ps(table[c[0]], table[c[1]], table[c[2]], table[c[3]]);
+    }
+    return _mm_mul_ps(_mm_cvtepi32_ps(codes), _mm_set1_ps(1.0f / 1023.0f));
+  }
+
+  inline __m128i Quantize4(const float* p)
+  {
+    // max() first so NaN lands on 0
+    const __m128 v = _mm_min_ps(
+        _mm_max_ps(_mm_mul_ps(_mm_loadu_ps(p), _mm_set1_ps(1023.0f)),
+                   _mm_setzero_ps()),
+        _mm_set1_ps(1023.0f));
+    return _mm_cvtps_epi32(v);
+  }
+#endif
+
+  inline float DecodeCode(uint32_t code, const float* table)
+  {
+    return table ? table[code] : static_cast<float>(code) * (1.0f / 1023.0f);
+  }
+
+  inline uint32_t QuantizeCode(float v)
+  {
+    // as the SIMD convert: round to nearest even, NaN to 0
+    v *= 1023.0f;
+    v = v > 0.0f ? std::min(v, 1023.0f) : 0.0f;
+    return static_cast<uint32_t>(std::nearbyint(v));
+  }
+
+  // One line of RGB words (one pixel each) into three planes. 'pad' is the
+  // position of the lowest component, 2 for method A and 0 for method B.
+  inline void UnpackRGB(const uint8_t* src, int width, bool swap, int pad,
+                        const float* table, float* r, float* g, float* b)
+  {
+    int x = 0;
+#if defined(__AVX2__)
+    const __m256i mask = _mm256_set1_epi32(0x3ff);
+    const __m128i shiftR = _mm_cvtsi32_si128(20 + pad);
+    const __m128i shiftG = _mm_cvtsi32_si128(10 + pad);
+    const __m128i shiftB = _mm_cvtsi32_si128(pad);
+    for(; x + 8 <= width; x += 8) {
+      __m256i w =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 4 * x));
+      if(swap) w = Swap8(w);
+      const __m256i R = _mm256_and_si256(_mm256_srl_epi32(w, shiftR), mask);
+      const __m256i G = _mm256_and_si256(_mm256_srl_epi32(w, shiftG), mask);
+      const __m256i B = _mm256_and_si256(_mm256_srl_epi32(w, shiftB), mask);
+      _mm256_storeu_ps(r + x, Decode8(R, table));
+      _mm256_storeu_ps(g + x, Decode8(G, table));
+      _mm256_storeu_ps(b + x, Decode8(B, table));
+    }
+#elif defined(__SSSE3__)
+    const __m128i mask = _mm_set1_epi32(0x3ff);
+    const __m128i shiftR = _mm_cvtsi32_si128(20 + pad);
+    const __m128i shiftG = _mm_cvtsi32_si128(10 + pad);
+    const __m128i shiftB = _mm_cvtsi32_si128(pad);
+    for(; x + 4 <= width; x += 4) {
+      __m128i w =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * x));
+      if(swap) w = Swap4(w);
+      const __m128i R = _mm_and_si128(_mm_srl_epi32(w, shiftR), mask);
+      const __m128i G = _mm_and_si128(_mm_srl_epi32(w, shiftG), mask);
+      const __m128i B = _mm_and_si128(_mm_srl_epi32(w, shiftB), mask);
+      _mm_storeu_ps(r + x, Decode4(R, table));
+      _mm_storeu_ps(g + x, Decode4(G, table));
+      _mm_storeu_ps(b + x, Decode4(B, table));
+    }
+#endif
+    for(; x < width; ++x) {
+      uint32_t w;
+      std::memcpy(&w, src + sizeof(w) * x, sizeof(w));
+      if(swap) w = Swap32(w);
+      r[x] = DecodeCode((w >> (20 + pad)) & 0x3ff, table);
+      g[x] = DecodeCode((w >> (10 + pad)) & 0x3ff, table);
+      b[x] = DecodeCode((w >> pad) & 0x3ff, table);
+    }
+  }
+
+  inline void PackRGB(const float* r, const float* g, const float* b,
+                      int width, bool swap, int pad, uint8_t* dst)
+  {
+    int x = 0;
+#if defined(__AVX2__)
+    const __m128i shiftR = _mm_cvtsi32_si128(20 + pad);
+    const __m128i shiftG = _mm_cvtsi32_si128(10 + pad);
+    const __m128i shiftB = _mm_cvtsi32_si128(pad);
+    for(; x + 8 <= width; x += 8) {
+      __m256i w = _mm256_or_si256(
+          _mm256_or_si256(_mm256_sll_epi32(Quantize8(r + x), shiftR),
+                          _mm256_sll_epi32(Quantize8(g + x), shiftG)),
+          _mm256_sll_epi32(Quantize8(b + x), shiftB));
+      if(swap) w = Swap8(w);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 4 * x), w);
+    }
+#elif defined(__SSSE3__)
+    const __m128i shiftR = _mm_cvtsi32_si128(20 + pad);
+    const __m128i shiftG = _mm_cvtsi32_si128(10 + pad);
+    const __m128i shiftB = _mm_cvtsi32_si128(pad);
+    for(; x + 4 <= width; x += 4) {
+      __m128i w = _mm_or_si128(
+          _mm_or_si128(_mm_sll_epi32(Quantize4(r + x), shiftR),
+                       _mm_sll_epi32(Quantize4(g + x), shiftG)),
+          _mm_sll_epi32(Quantize4(b + x), shiftB));
+      if(swap) w = Swap4(w);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * x), w);
+    }
+#endif
+    for(; x < width; ++x) {
+      uint32_t w = QuantizeCode(r[x]) << (20 + pad) |
+                   QuantizeCode(g[x]) << (10 + pad) | QuantizeCode(b[x]) << pad;
+      if(swap) w = Swap32(w);
+      std::memcpy(dst + sizeof(w) * x, &w, sizeof(w));
+    }
+  }
+
+  // Any other component count: components run on across words, three per
+  // word from the top, the line padded to a whole word. RGBA is rare for
+  // scans, so this stays scalar.
+  inline void UnpackComponents(const uint8_t* src, int width, int channels,
+                               bool swap, int pad, const float* table,
+                               float* const* planes)
+  {
+    const int count = width * channels;
+    for(int k = 0; k < count; k += 3) {
+      uint32_t w;
+      std::memcpy(&w, src + 4 * (k / 3), sizeof(w));
+      if(swap) w = Swap32(w);
+      for(int j = 0; j < 3 && k + j < count; ++j) {
+        const uint32_t code = (w >> (20 - 10 * j + pad)) & 0x3ff;
+        planes[(k + j) % channels][(k + j) / channels] =
+            DecodeCode(code, table);
+      }
+    }
+  }
+
+  inline void PackComponents(const float* const* planes, int width,
+                             int channels, bool swap, int pad, uint8_t* dst)
+  {
+    const int count = width * channels;
+    for(int k = 0; k < count; k += 3) {
+      uint32_t w = 0;
+      for(int j = 0; j < 3 && k + j < count; ++j) {
+        const float v = planes[(k + j) % channels][(k + j) / channels];
+        w |= QuantizeCode(v) << (20 - 10 * j + pad);
+      }
+      if(swap) w = Swap32(w);
+      std::memcpy(dst + 4 * (k / 3), &w, sizeof(w));
+    }
+  }
+
+  inline size_t LineBytes(int width, int channels)
+  {
+    return 4 * ((static_cast<size_t>(width) * channels + 2) / 3);
+  }
+}  // namespace DpxDetail
+
+namespace Dpx
+{
+  // Decodes an in-memory DPX file. 'table' maps codes to values (1024
+  // entries, see CurveTable), nullptr for code / 1023.
+  inline bool Decode(const uint8_t* data, size_t size, Image& image,
+                     std::string* error = nullptr,
+                     const float* table = nullptr,
+                     const BandCallback& onBand = nullptr, int threads = 0)
+  {
+    using namespace DpxDetail;
+    if(size < kGenericHeader) return Fail(error, "not a DPX file");
+    bool bigEndian;
+    if(!std::memcmp(data, "SDPX", 4)) {
+      bigEndian = true;
+    }
+    else if(!std::memcmp(data, "XPDS", 4)) {
+      bigEndian = false;
+    }
+    else {
+      return Fail(error, "not a DPX file");
+    }
+
+    Fields f(const_cast<uint8_t*>(data), bigEndian);
+    const uint32_t width = f.u32(PIXELS);
+    const uint32_t height = f.u32(LINES);
+    const uint8_t descriptor = data[DESCRIPTOR];
+    const uint16_t packing = f.u16(PACKING);
+    uint32_t offset = f.u32(DATA_OFFSET);
+    if(offset == 0xffffffffu || offset == 0) offset = f.u32(IMAGE_OFFSET);
+    uint32_t eol = f.u32(EOL_PADDING);
+    if(eol == 0xffffffffu) eol = 0;
+
+    if(f.u16(ELEMENTS) < 1 || data[BIT_SIZE] != 10 ||
+       f.u16(ENCODING) == 1) {
+      return Fail(error, "only uncompressed 10 bit DPX is supported");
+    }
+    if(descriptor != kDescriptorRGB && descriptor != kDescriptorRGBA) {
+      return Fail(error, "only RGB and RGBA DPX are supported");
+    }
+    if(packing != PACKING_A && packing != PACKING_B) {
+      return Fail(error, "only filled (method A or B) 10 bit packing is "
+                         "supported");
+    }
+    if(width == 0 || height == 0 || width > (1u << 16) ||
+       height > (1u << 16)) {
+      return Fail(error, "bad image size");
+    }
+
+    const int channels = descriptor == kDescriptorRGBA ? 4 : 3;
+    const size_t lineBytes = LineBytes(width, channels);
+    const size_t stride = lineBytes + eol;
+    if(offset > size || eol > size ||
+       size - offset < stride * (height - 1) + lineBytes) {
+      return Fail(error, "truncated DPX file");
+    }
+
+    image.width = static_cast<int>(width);
+    image.height = static_cast<int>(height);
+    image.channels = channels;
+    image.bigEndian = bigEndian;
+    image.packing = packing;
+    image.transfer = data[TRANSFER];
+    image.colorimetric = data[COLORIMETRIC];
+    image.header.assign(data, data + offset);
+    image.allocate();
+
+    const int pad = packing == PACKING_A ? 2 : 0;
+    const uint8_t* pixels = data + offset;
+    const int bands = (image.height + kBandRows - 1) / kBandRows;
+    auto decode = [&](int band) {
+      const int row = band * kBandRows;
+      const int rows = std::min(kBandRows, image.height - row);
+      for(int y = row; y < row + rows; ++y) {
+        const uint8_t* src = pixels + stride * y;
+        if(channels == 3) {
+          UnpackRGB(src, image.width, bigEndian, pad, table, image.line(0, y),
+                    image.line(1, y), image.line(2, y));
+        }
+        else {
+          float* planes[4] = {image.line(0, y), image.line(1, y),
+                              image.line(2, y), image.line(3, y)};
+          UnpackComponents(src, image.width, channels, bigEndian, pad, table,
+                           planes);
+        }
+      }
+      if(onBand) onBand(image, row, rows);
+    };
+    CoderTeam().run(bands, threads, decode);
+    return true;
+  }
+
+  // Encodes 'image' as 10 bit method A in its byte order, values in [0, 1]
+  // mapping to codes 0-1023. A kept header is reused with the image fields
+  // updated. 'file' is a byte vector.
+  template <typename Bytes>
+  inline bool Encode(const Image& image, Bytes& file,
+                     std::string* error = nullptr, int threads = 0)
+  {
+    using namespace DpxDetail;
+    if(image.width <= 0 || image.height <= 0 ||
+       (image.channels != 3 && image.channels != 4)) {
+      return Fail(error, "DPX needs an RGB or RGBA image");
+    }
+
+    const bool bigEndian = image.bigEndian;
+    bool keep = image.header.size() >= kHeader &&
+                !std::memcmp(image.header.data(), bigEndian ? "SDPX" : "XPDS",
+                             4);
+    if(keep) {
+      file.assign(image.header.begin(), image.header.end());
+    }
+    else {
+      NewHeader(bigEndian, file);
+    }
+    const size_t offset = file.size();
+    const size_t lineBytes = LineBytes(image.width, image.channels);
+    file.resize(offset + lineBytes * image.height);
+
+    Fields f(file.data(), bigEndian);
+    f.set32(IMAGE_OFFSET, static_cast<uint32_t>(offset));
+    f.set32(FILE_SIZE, static_cast<uint32_t>(file.size()));
+    f.set16(ELEMENTS, 1);
+    f.set32(PIXELS, static_cast<uint32_t>(image.width));
+    f.set32(LINES, static_cast<uint32_t>(image.height));
+    file[DESCRIPTOR] = image.channels == 4 ? kDescriptorRGBA : kDescriptorRGB;
+    // a kept header describes the input's codes, not these
+    file[TRANSFER] = static_cast<uint8_t>(image.transfer);
+    file[COLORIMETRIC] = static_cast<uint8_t>(image.colorimetric);
+    f.set32(REF_LOW, 0);
+    f.set32(REF_HIGH, 1023);
+    if(image.transfer == TRANSFER_PRINTING_DENSITY) {
+      f.setFloat(REF_LOW_QUANTITY, 0.0f);
+      f.setFloat(REF_HIGH_QUANTITY, 2.047f);
+    }
+    else {
+      // densities, undefined for anything but printing density
+      f.set32(REF_LOW_QUANTITY, 0xffffffffu);
+      f.set32(REF_HIGH_QUANTITY, 0xffffffffu);
+    }
+    file[BIT_SIZE] = 10;
+    f.set16(PACKING, PACKING_A);
+    f.set16(ENCODING, 0);
+    f.set32(DATA_OFFSET, static_cast<uint32_t>(offset));
+    f.set32(EOL_PADDING, 0);
+    f.set32(EOP_PADDING, 0);
+
+    uint8_t* pixels = file.data() + offset;
+    const int bands = (image.height + kBandRows - 1) / kBandRows;
+    auto encode = [&](int band) {
+      const int row = band * kBandRows;
+      const int end = std::min(row + kBandRows, image.height);
+      for(int y = row; y < end; ++y) {
+        uint8_t* dst = pixels + lineBytes * y;
+        if(image.channels == 3) {
+          PackRGB(image.line(0, y), image.line(1, y), image.line(2, y),
+                  image.width, bigEndian, 2, dst);
+        }
+        else {
+          const float* planes[4] = {image.line(0, y), image.line(1, y),
+                                    image.line(2, y), image.line(3, y)};
+          PackComponents(planes, image.width, image.channels, bigEndian, 2,
+                         dst);
+        }
+      }
+    };
+    CoderTeam().run(bands, threads, encode);
+    return true;
+  }
+
+  // Transfer and colorimetric codes of pixels in GColorspace 'colorspace'
+  // and 'primaries', user defined where SMPTE 268M has no code for them
+  inline void Describe(Image& image, int colorspace, int primaries)
+  {
+    if(colorspace == Constants::COLOR_CINEON) {
+      image.transfer = TRANSFER_PRINTING_DENSITY;
+      image.colorimetric = TRANSFER_PRINTING_DENSITY;
+      return;
+    }
+    switch(colorspace) {
+      case Constants::COLOR_LINEAR:
+        image.transfer = TRANSFER_LINEAR;
+        break;
+      case Constants::COLOR_REC709:
+        image.transfer = TRANSFER_REC709;
+        break;
+      default:
+        image.transfer = TRANSFER_USER;
+        break;
+    }
+    // sRGB primaries are the Rec.709 ones
+    image.colorimetric = primaries == Constants::PRIM_COLOR_SRGB
+                             ? TRANSFER_REC709
+                             : TRANSFER_USER;
+  }
+
+  inline bool Read(const std::string& path, Image& image,
+                   std::string* error = nullptr, const float* table = nullptr,
+                   const BandCallback& onBand = nullptr, int threads = 0)
+  {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if(!f) return DpxDetail::Fail(error, "cannot open " + path);
+    // read in one call, a stdio buffer would only be allocated
+    std::setvbuf(f, nullptr, _IONBF, 0);
+    ByteBuffer data;
+    if(std::fseek(f, 0, SEEK_END) == 0) {
+      const long size = std::ftell(f);
+      if(size > 0) {
+        data.resize(static_cast<size_t>(size));
+        std::fseek(f, 0, SEEK_SET);
+        data.resize(std::fread(data.data(), 1, data.size(), f));
+      }
+    }
+    std::fclose(f);
+    if(!Decode(data.data(), data.size(), image, error, table, onBand,
+               threads)) {
+      if(error) *error = path + ": " + *error;
+      return false;
+    }
+    return true;
+  }
+
+  inline bool Write(const std::string& path, const Image& image,
+                    std::string* error = nullptr, int threads = 0)
+  {
+    ByteBuffer file;
+    if(!Encode(image, file, error, threads)) return false;
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if(!f) return DpxDetail::Fail(error, "cannot write " + path);
+    std::setvbuf(f, nullptr, _IONBF, 0);
+    const bool written = std::fwrite(file.data(), 1, file.size(), f) ==
+                         file.size();
+    if(std::fclose(f) != 0 || !written) {
+      return DpxDetail::Fail(error, "cannot write " + path);
+    }
+    return true;
+  }
+}  // namespace Dpx
+
+#endif  // DPX_IO_H
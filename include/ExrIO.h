@@ -0,0 +1,788 @@
+#ifndef EXR_IO_H
+#define EXR_IO_H
+
+// Built-in single-part scanline OpenEXR reader and writer for the standalone
+// tools, so they run on hosts without the OpenEXR libraries.
+//
+// Covers HALF and FLOAT channels (no subsampling) with NONE, RLE, ZIPS and
+// ZIP compression, which is what renders and our farm write by default.
+// Tiled, deep and multi-part files and the other codecs are rejected with an
+// error rather than misread. The host is assumed little endian, as EXR is.
+//
+// Pixels live in planar float channels. Chunks are decoded on several
+// threads, and an optional callback sees each chunk's rows as soon as they
+// are in the planes, still in cache, so a transform can run inside the
+// decode pass instead of as a second sweep over the frame.
+//
+// Planes and file bytes come from the FramePool, chunk staging from the
+// coding thread's ScratchArena, and the threads are the persistent
+// CoderTeam: decoding into an image of the last frame's size and encoding
+// into a reused buffer allocate nothing.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/Deflate.h"
+#include "include/FramePool.h"
+#include "include/Half.h"
+#include "include/ThreadPool.h"
+
+namespace Exr
+{
+  enum PixelTypes { PIXEL_UINT, PIXEL_HALF, PIXEL_FLOAT };
+
+  enum Compressions {
+    COMPRESSION_NONE,
+    COMPRESSION_RLE,
+    COMPRESSION_ZIPS,
+    COMPRESSION_ZIP,
+    COMPRESSION_COUNT
+  };
+
+  static const char* const COMPRESSION[] = {"none", "rle", "zips", "zip", 0};
+
+  // inclusive pixel bounds, as in the file
+  struct Box
+  {
+    int xMin = 0;
+    int yMin = 0;
+    int xMax = -1;
+    int yMax = -1;
+
+    int width() const { return xMax - xMin + 1; }
+    int height() const { return yMax - yMin + 1; }
+  };
+
+  struct Channel
+  {
+    std::string name;
+    int type = PIXEL_HALF;
+  };
+
+  // Planar float image, one width * height plane per channel. Channels are
+  // kept sorted by name, the order of the file's channel list.
+  struct Image
+  {
+    Box dataWindow;
+    Box displayWindow;
+    int compression = COMPRESSION_ZIP;
+    std::vector<Channel> channels;
+    std::vector<FloatBuffer> planes;
+
+    int width() const { return dataWindow.width(); }
+    int height() const { return dataWindow.height(); }
+
+    // -1 when missing
+    int find(const std::string& name) const
+    {
+      for(size_t c = 0; c < channels.size(); ++c) {
+        if(channels[c].name == name) return static_cast<int>(c);
+      }
+      return -1;
+    }
+
+    // adds or retypes a channel, keeping the order
+    void addChannel(const std::string& name, int type)
+    {
+      const int existing = find(name);
+      if(existing >= 0) {
+        channels[existing].type = type;
+        return;
+      }
+      Channel channel;
+      channel.name = name;
+      channel.type = type;
+      const auto at = std::upper_bound(
+          channels.begin(), channels.end(), channel,
+          [](const Channel& a, const Channel& b) { return a.name < b.name; });
+      channels.insert(at, channel);
+    }
+
+    void allocate()
+    {
+      const size_t size = static_cast<size_t>(std::max(width(), 0)) *
+                          static_cast<size_t>(std::max(height(), 0));
+      planes.resize(channels.size());
+      for(FloatBuffer& plane : planes) plane.resize(size);
+    }
+
+    float* line(int channel, int row)
+    {
+      return planes[channel].data() + static_cast<size_t>(row) * width();
+    }
+
+    const float* line(int channel, int row) const
+    {
+      return planes[channel].data() + static_cast<size_t>(row) * width();
+    }
+  };
+
+  // Called with the first row (from the top of the data window) and the row
+  // count of a chunk once its pixels are in the planes, on the decoding
+  // thread. Chunks never overlap, so callbacks may write their rows.
+  using ChunkCallback = std::function<void(Image& image, int row, int rows)>;
+
+  inline int LinesPerChunk(int compression)
+  {
+    return compression == COMPRESSION_ZIP ? 16 : 1;
+  }
+
+  // threads for chunk coding, GCOLORSPACE_EXR_THREADS lowers it (the
+  // CoderTeam has a thread per core)
+  inline int DefaultThreads()
+  {
+    if(const char* env = std::getenv("GCOLORSPACE_EXR_THREADS")) {
+      return std::max(1, std::atoi(env));
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+}  // namespace Exr
+
+namespace ExrDetail
+{
+  constexpr uint32_t kMagic = 20000630;
+  constexpr uint32_t kVersion = 2;
+  constexpr uint32_t kTiledFlag = 0x200;
+  constexpr uint32_t kLongNamesFlag = 0x400;
+  constexpr uint32_t kNonImageFlag = 0x800;
+  constexpr uint32_t kMultiPartFlag = 0x1000;
+
+  inline bool Fail(std::string* error, const std::string& message)
+  {
+    if(error) *error = message;
+    return false;
+  }
+
+  inline int PixelSize(int type) { return type == Exr::PIXEL_HALF ? 2 : 4; }
+
+  template <typename T>
+  inline T Get(const uint8_t* p)
+  {
+    T v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  template <typename T, typename Bytes>
+  inline void Put(Bytes& out, T v)
+  {
+    const size_t at = out.size();
+    out.resize(at + sizeof(v));
+    std::memcpy(out.data() + at, &v, sizeof(v));
+  }
+
+  // ZIP and RLE first split the bytes into even and odd halves (the high
+  // and low bytes of halves end up apart) and delta code them
+
+  inline void Predict(const uint8_t* raw, size_t n, uint8_t* out)
+  {
+    uint8_t* t1 = out;
+    uint8_t* t2 = out + (n + 1) / 2;
+    size_t i = 0;
+    for(; i + 1 < n; i += 2) {
+      *t1++ = raw[i];
+      *t2++ = raw[i + 1];
+    }
+    if(i < n) *t1 = raw[i];
+
+    int p = n > 0 ? out[0] : 0;
+    for(size_t k = 1; k < n; ++k) {
+      const int d = int(out[k]) - p + (128 + 256);
+      p = out[k];
+      out[k] = static_cast<uint8_t>(d);
+    }
+  }
+
+  inline void Unpredict(uint8_t* tmp, size_t n, uint8_t* raw)
+  {
+    for(size_t k = 1; k < n; ++k) {
+      tmp[k] = static_cast<uint8_t>(int(tmp[k - 1]) + int(tmp[k]) - 128);
+    }
+    const uint8_t* t1 = tmp;
+    const uint8_t* t2 = tmp + (n + 1) / 2;
+    size_t i = 0;
+    for(; i + 1 < n; i += 2) {
+      raw[i] = *t1++;
+      raw[i + 1] = *t2++;
+    }
+    if(i < n) raw[i] = *t1;
+  }
+
+  // OpenEXR's byte run length coding: a count byte c >= 0 repeats the next
+  // byte c + 1 times, c < 0 copies the next -c bytes
+  template <typename Bytes>
+  inline void RleCompress(const uint8_t* in, size_t n, Bytes& out)
+  {
+    constexpr ptrdiff_t kMinRun = 3;
+    constexpr ptrdiff_t kMaxRun = 127;
+    const uint8_t* end = in + n;
+    const uint8_t* runStart = in;
+    const uint8_t* runEnd = in + 1;
+    while(runStart < end) {
+      while(runEnd < end && *runStart == *runEnd &&
+            runEnd - runStart - 1 < kMaxRun) {
+        ++runEnd;
+      }
+      if(runEnd - runStart >= kMinRun) {
+        out.push_back(static_cast<uint8_t>((runEnd - runStart) - 1));
+        out.push_back(*runStart);
+        runStart = runEnd;
+      }
+      else {
+        while(runEnd < end &&
+              ((runEnd + 1 >= end || *runEnd != *(runEnd + 1)) ||
+               (runEnd + 2 >= end || *(runEnd + 1) != *(runEnd + 2))) &&
+              runEnd - runStart < kMaxRun) {
+          ++runEnd;
+        }
+        out.push_back(static_cast<uint8_t>(runStart - runEnd));
+        out.insert(out.end(), runStart, runEnd);
+        runStart = runEnd;
+      }
+      ++runEnd;
+    }
+  }
+
+  inline bool RleUncompress(const uint8_t* in, size_t n, uint8_t* out,
+                            size_t outSize)
+  {
+    const uint8_t* end = in + n;
+    size_t o = 0;
+    while(in < end) {
+      const int count = static_cast<int8_t>(*in++);
+      if(count < 0) {
+        const size_t literal = static_cast<size_t>(-count);
+        if(static_cast<size_t>(end - in) < literal || outSize - o < literal) {
+          return false;
+        }
+        std::memcpy(out + o, in, literal);
+        in += literal;
+        o += literal;
+      }
+      else {
+        const size_t run = static_cast<size_t>(count) + 1;
+        if(in >= end || outSize - o < run) return false;
+        std::memset(out + o, *in++, run);
+        o += run;
+      }
+    }
+    return o == outSize;
+  }
+
+  // chunk bytes -> raw line-interleaved pixel data of 'size' bytes, staged
+  // in 'scratch'
+  inline bool DecodeChunk(int compression, const uint8_t* data, size_t size,
+                          size_t rawSize, ScratchArena::Scope& scratch,
+                          const uint8_t*& raw)
+  {
+    // a chunk that would not shrink is stored as is
+    if(compression == Exr::COMPRESSION_NONE || size == rawSize) {
+      raw = data;
+      return size == rawSize;
+    }
+    uint8_t* tmp = scratch.take<uint8_t>(rawSize);
+    uint8_t* out = scratch.take<uint8_t>(rawSize);
+    if(compression == Exr::COMPRESSION_RLE) {
+      if(!RleUncompress(data, size, tmp, rawSize)) return false;
+    }
+    else if(!Inflate(data, size, tmp, rawSize)) {
+      return false;
+    }
+    Unpredict(tmp, rawSize, out);
+    raw = out;
+    return true;
+  }
+
+  // raw chunk bytes -> file bytes in 'out', which has room for 'rawSize';
+  // returns how many were written
+  inline size_t EncodeChunk(int compression, const uint8_t* raw,
+                            size_t rawSize, uint8_t* out)
+  {
+    if(compression != Exr::COMPRESSION_NONE) {
+      ScratchArena::Scope scratch;
+      uint8_t* tmp = scratch.take<uint8_t>(rawSize);
+      Predict(raw, rawSize, tmp);
+      // the coded size is unknown up front, so the thread keeps a buffer
+      thread_local ByteBuffer packed;
+      packed.clear();
+      packed.reserve(rawSize + rawSize / 8 + 64);
+      if(compression == Exr::COMPRESSION_RLE) {
+        RleCompress(tmp, rawSize, packed);
+      }
+      else {
+        Deflate(tmp, rawSize, packed);
+      }
+      if(packed.size() < rawSize) {
+        std::memcpy(out, packed.data(), packed.size());
+        return packed.size();
+      }
+    }
+    std::memcpy(out, raw, rawSize);
+    return rawSize;
+  }
+
+#if !defined(__F16C__)
+  // without F16C halves decode through a 64K entry table, as OpenEXR's do
+  inline const float* HalfTable()
+  {
+    static const std::vector<float> table = []() {
+      std::vector<float> t(65536);
+      for(uint32_t h = 0; h < 65536; ++h) {
+        t[h] = HalfToFloat(static_cast<uint16_t>(h));
+      }
+      return t;
+    }();
+    return table.data();
+  }
+#endif
+
+  // one line of one channel from file bytes into floats
+  inline void UnpackLine(const uint8_t* src, int type, int width, float* dst)
+  {
+    if(type == Exr::PIXEL_FLOAT) {
+      std::memcpy(dst, src, sizeof(float) * width);
+      return;
+    }
+#if defined(__F16C__)
+    uint16_t halves[Simd::kWidth];
+    int x = 0;
+    for(; x + Simd::kWidth <= width; x += Simd::kWidth) {
+      std::memcpy(halves, src + 2 * x, sizeof(halves));
+      Simd::store(dst + x, Simd::loadHalf(halves));
+    }
+    for(; x < width; ++x) dst[x] = HalfToFloat(Get<uint16_t>(src + 2 * x));
+#else
+    const float* table = HalfTable();
+    for(int x = 0; x < width; ++x) dst[x] = table[Get<uint16_t>(src + 2 * x)];
+#endif
+  }
+
+  inline void PackLine(const float* src, int type, int width, uint8_t* dst)
+  {
+    if(type == Exr::PIXEL_FLOAT) {
+      std::memcpy(dst, src, sizeof(float) * width);
+      return;
+    }
+    uint16_t halves[Simd::kWidth];
+    int x = 0;
+    for(; x + Simd::kWidth <= width; x += Simd::kWidth) {
+      Simd::storeHalf(halves, Simd::load(src + x));
+      std::memcpy(dst + 2 * x, halves, sizeof(halves));
+    }
+    for(; x < width; ++x) {
+      const uint16_t h = FloatToHalf(src[x]);
+      std::memcpy(dst + sizeof(h) * x, &h, sizeof(h));
+    }
+  }
+
+  // bytes of one line over all channels
+  inline size_t LineBytes(const Exr::Image& image)
+  {
+    size_t bytes = 0;
+    for(const Exr::Channel& c : image.channels) {
+      bytes += static_cast<size_t>(PixelSize(c.type)) * image.width();
+    }
+    return bytes;
+  }
+
+  class HeaderReader
+  {
+   public:
+    HeaderReader(const uint8_t* data, size_t size) : p(data), end(data + size)
+    {
+    }
+
+    bool string(std::string& s)
+    {
+      const char* view;
+      if(!string(view)) return false;
+      s = view;
+      return true;
+    }
+
+    // in place, up to the file's terminating zero
+    bool string(const char*& s)
+    {
+      const uint8_t* zero =
+          static_cast<const uint8_t*>(std::memchr(p, 0, end - p));
+      if(!zero) return false;
+      s = reinterpret_cast<const char*>(p);
+      p = zero + 1;
+      return true;
+    }
+
+    template <typename T>
+    bool value(T& v)
+    {
+      if(static_cast<size_t>(end - p) < sizeof(T)) return false;
+      std::memcpy(&v, p, sizeof(T));
+      p += sizeof(T);
+      return true;
+    }
+
+    const uint8_t* position() const { return p; }
+    size_t left() const { return static_cast<size_t>(end - p); }
+    void skip(size_t n) { p += n; }
+
+   private:
+    const uint8_t* p;
+    const uint8_t* end;
+  };
+
+  inline bool ReadChannels(const uint8_t* p, size_t size, Exr::Image& image,
+                           std::string* error)
+  {
+    HeaderReader in(p, size);
+    for(;;) {
+      Exr::Channel channel;
+      if(!in.string(channel.name)) return Fail(error, "bad channel list");
+      if(channel.name.empty()) return true;
+      int32_t type, xSampling, ySampling;
+      uint32_t linear;  // pLinear and three reserved bytes
+      if(!in.value(type) || !in.value(linear) || !in.value(xSampling) ||
+         !in.value(ySampling)) {
+        return Fail(error, "bad channel list");
+      }
+      if(type != Exr::PIXEL_HALF && type != Exr::PIXEL_FLOAT) {
+        return Fail(error, "channel " + channel.name +
+                               ": only half and float are supported");
+      }
+      if(xSampling != 1 || ySampling != 1) {
+        return Fail(error, "channel " + channel.name + " is subsampled");
+      }
+      channel.type = type;
+      image.channels.push_back(channel);
+    }
+  }
+
+  // name, type and size of an attribute, its 'size' bytes follow
+  template <typename Bytes>
+  inline void WriteAttribute(Bytes& out, const char* name, const char* type,
+                             size_t size)
+  {
+    out.insert(out.end(), name, name + std::strlen(name) + 1);
+    out.insert(out.end(), type, type + std::strlen(type) + 1);
+    Put<int32_t>(out, static_cast<int32_t>(size));
+  }
+
+  template <typename Bytes, typename T>
+  inline void WriteAttribute(Bytes& out, const char* name, const char* type,
+                             std::initializer_list<T> values)
+  {
+    WriteAttribute(out, name, type, sizeof(T) * values.size());
+    for(T v : values) Put<T>(out, v);
+  }
+
+  template <typename Bytes>
+  inline void WriteBox(Bytes& out, const char* name, const Exr::Box& box)
+  {
+    WriteAttribute<Bytes, int32_t>(out, name, "box2i",
+                                   {box.xMin, box.yMin, box.xMax, box.yMax});
+  }
+}  // namespace ExrDetail
+
+namespace Exr
+{
+  // Decodes an in-memory EXR file into 'image' (channels, windows,
+  // compression and planes are all replaced)
+  inline bool Decode(const uint8_t* data, size_t size, Image& image,
+                     std::string* error = nullptr,
+                     const ChunkCallback& onChunk = nullptr, int threads = 0)
+  {
+    using namespace ExrDetail;
+    // planes of a previous frame of the same size are reused as they are,
+    // and so is the channel list's storage
+    std::vector<FloatBuffer> planes = std::move(image.planes);
+    std::vector<Channel> channels = std::move(image.channels);
+    channels.clear();
+    image = Image();
+    image.planes = std::move(planes);
+    image.channels = std::move(channels);
+    if(size < 8 || Get<uint32_t>(data) != kMagic) {
+      return Fail(error, "not an OpenEXR file");
+    }
+    const uint32_t version = Get<uint32_t>(data + 4);
+    if((version & 0xff) != kVersion) {
+      return Fail(error, "unsupported OpenEXR version");
+    }
+    if(version & (kTiledFlag | kNonImageFlag | kMultiPartFlag)) {
+      return Fail(error, "only single-part scanline files are supported");
+    }
+    (void)kLongNamesFlag;  // 255 character names need nothing extra here
+
+    HeaderReader in(data + 8, size - 8);
+    bool haveChannels = false, haveWindow = false;
+    int lineOrder = 0;
+    for(;;) {
+      const char* name;
+      const char* type;
+      if(!in.string(name)) return Fail(error, "truncated header");
+      if(!*name) break;
+      int32_t attributeSize;
+      if(!in.string(type) || !in.value(attributeSize) || attributeSize < 0 ||
+         in.left() < static_cast<size_t>(attributeSize)) {
+        return Fail(error, "truncated header");
+      }
+      const uint8_t* v = in.position();
+      const size_t vsize = static_cast<size_t>(attributeSize);
+      auto is = [](const char* a, const char* b) { return !std::strcmp(a, b); };
+      if(is(name, "channels") && is(type, "chlist")) {
+        if(!ReadChannels(v, vsize, image, error)) return false;
+        haveChannels = true;
+      }
+      else if(is(name, "compression") && vsize == 1) {
+        image.compression = v[0];
+        if(image.compression >= COMPRESSION_COUNT) {
+          return Fail(error, "unsupported compression, only none, rle, zips "
+                             "and zip are built in");
+        }
+      }
+      else if((is(name, "dataWindow") || is(name, "displayWindow")) &&
+              vsize == 16) {
+        Box& box = is(name, "dataWindow") ? image.dataWindow
+                                          : image.displayWindow;
+        box.xMin = Get<int32_t>(v);
+        box.yMin = Get<int32_t>(v + 4);
+        box.xMax = Get<int32_t>(v + 8);
+        box.yMax = Get<int32_t>(v + 12);
+        haveWindow |= is(name, "dataWindow");
+      }
+      else if(is(name, "lineOrder") && vsize == 1) {
+        lineOrder = v[0];
+      }
+      in.skip(vsize);
+    }
+    if(!haveChannels || !haveWindow || image.width() <= 0 ||
+       image.height() <= 0) {
+      return Fail(error, "missing channels or dataWindow");
+    }
+    (void)lineOrder;  // chunks are addressed through the offset table
+
+    const int width = image.width();
+    const int height = image.height();
+    const int lines = LinesPerChunk(image.compression);
+    const int chunks = (height + lines - 1) / lines;
+    const uint8_t* table = in.position();
+    if(in.left() < sizeof(uint64_t) * chunks) {
+      return Fail(error, "truncated offset table");
+    }
+    image.allocate();
+
+    // the chunk each table entry decoded, -1 when it did not
+    ScratchArena::Scope scratch;
+    int* decoded = scratch.take<int>(chunks);
+
+    const size_t lineBytes = LineBytes(image);
+    std::atomic<bool> ok(true);
+    std::string failure;
+    std::atomic_flag failureLock = ATOMIC_FLAG_INIT;
+    auto fail = [&](const std::string& message) {
+      if(!failureLock.test_and_set()) failure = message;
+      ok = false;
+    };
+
+    auto decode = [&](int k) {
+      decoded[k] = -1;
+      if(!ok) return;
+      const uint64_t offset = Get<uint64_t>(table + sizeof(uint64_t) * k);
+      if(offset > size || size - offset < 8) {
+        return fail("bad chunk offset");
+      }
+      const int32_t y = Get<int32_t>(data + offset);
+      const int32_t packedSize = Get<int32_t>(data + offset + 4);
+      const int row = y - image.dataWindow.yMin;
+      if(packedSize < 0 ||
+         size - offset - 8 < static_cast<size_t>(packedSize) || row < 0 ||
+         row >= height || row % lines != 0) {
+        return fail("bad chunk header");
+      }
+      const int rows = std::min(lines, height - row);
+      const size_t rawSize = lineBytes * rows;
+
+      ScratchArena::Scope scratch;
+      const uint8_t* raw;
+      if(!DecodeChunk(image.compression, data + offset + 8,
+                      static_cast<size_t>(packedSize), rawSize, scratch,
+                      raw)) {
+        return fail("corrupt chunk at line " + std::to_string(y));
+      }
+      for(int r = 0; r < rows; ++r) {
+        for(size_t c = 0; c < image.channels.size(); ++c) {
+          const int type = image.channels[c].type;
+          UnpackLine(raw, type, width,
+                     image.line(static_cast<int>(c), row + r));
+          raw += static_cast<size_t>(PixelSize(type)) * width;
+        }
+      }
+      decoded[k] = row / lines;
+      if(onChunk) onChunk(image, row, rows);
+    };
+    CoderTeam().run(chunks, threads > 0 ? threads : DefaultThreads(), decode);
+    if(!ok) return Fail(error, failure);
+
+    // entries naming the same lines twice leave others as the reused planes
+    // had them, from the last frame
+    uint8_t* covered = scratch.take<uint8_t>(chunks);
+    std::memset(covered, 0, chunks);
+    for(int k = 0; k < chunks; ++k) covered[decoded[k]] = 1;
+    for(int k = 0; k < chunks; ++k) {
+      if(!covered[k]) {
+        return Fail(error, "missing chunk at line " +
+                               std::to_string(image.dataWindow.yMin +
+                                              k * lines));
+      }
+    }
+    return true;
+  }
+
+  // Encodes 'image' with its own compression and channel types into 'file',
+  // a byte vector
+  template <typename Bytes>
+  inline bool Encode(const Image& image, Bytes& file,
+                     std::string* error = nullptr, int threads = 0)
+  {
+    using namespace ExrDetail;
+    if(image.width() <= 0 || image.height() <= 0 || image.channels.empty() ||
+       image.planes.size() != image.channels.size()) {
+      return Fail(error, "empty image");
+    }
+    if(image.compression < 0 || image.compression >= COMPRESSION_COUNT) {
+      return Fail(error, "unsupported compression");
+    }
+
+    file.clear();
+    Put<uint32_t>(file, kMagic);
+    Put<uint32_t>(file, kVersion);
+
+    size_t listSize = 1;
+    for(const Channel& c : image.channels) {
+      if(c.type != PIXEL_HALF && c.type != PIXEL_FLOAT) {
+        return Fail(error, "channel " + c.name + " is not half or float");
+      }
+      listSize += c.name.size() + 1 + 16;
+    }
+    WriteAttribute(file, "channels", "chlist", listSize);
+    for(const Channel& c : image.channels) {
+      file.insert(file.end(), c.name.c_str(),
+                  c.name.c_str() + c.name.size() + 1);
+      Put<int32_t>(file, c.type);
+      Put<uint32_t>(file, 0);  // pLinear and reserved
+      Put<int32_t>(file, 1);
+      Put<int32_t>(file, 1);
+    }
+    file.push_back(0);
+    WriteAttribute<Bytes, uint8_t>(
+        file, "compression", "compression",
+        {static_cast<uint8_t>(image.compression)});
+    WriteBox(file, "dataWindow", image.dataWindow);
+    const Box& display = image.displayWindow.width() > 0
+                             ? image.displayWindow
+                             : image.dataWindow;
+    WriteBox(file, "displayWindow", display);
+    WriteAttribute<Bytes, uint8_t>(file, "lineOrder", "lineOrder", {0});
+    WriteAttribute<Bytes, float>(file, "pixelAspectRatio", "float", {1.0f});
+    WriteAttribute<Bytes, float>(file, "screenWindowCenter", "v2f",
+                                 {0.0f, 0.0f});
+    WriteAttribute<Bytes, float>(file, "screenWindowWidth", "float", {1.0f});
+    file.push_back(0);
+
+    const int width = image.width();
+    const int height = image.height();
+    const int lines = LinesPerChunk(image.compression);
+    const int chunks = (height + lines - 1) / lines;
+    const size_t lineBytes = LineBytes(image);
+
+    // every chunk is coded in place, into a slot of its raw size (coded
+    // chunks are never larger), then the slots are closed up in order
+    const size_t tableAt = file.size();
+    const size_t dataAt = tableAt + sizeof(uint64_t) * chunks;
+    const size_t slot = 8 + lineBytes * lines;
+    file.resize(dataAt + slot * chunks);
+    ScratchArena::Scope scratch;
+    size_t* sizes = scratch.take<size_t>(chunks);
+    auto encode = [&](int k) {
+      ScratchArena::Scope rawScratch;
+      const int row = k * lines;
+      const int rows = std::min(lines, height - row);
+      uint8_t* raw = rawScratch.take<uint8_t>(lineBytes * rows);
+      uint8_t* to = raw;
+      for(int r = 0; r < rows; ++r) {
+        for(size_t c = 0; c < image.channels.size(); ++c) {
+          const int type = image.channels[c].type;
+          PackLine(image.line(static_cast<int>(c), row + r), type, width, to);
+          to += static_cast<size_t>(PixelSize(type)) * width;
+        }
+      }
+      sizes[k] = EncodeChunk(image.compression, raw, lineBytes * rows,
+                             file.data() + dataAt + slot * k + 8);
+    };
+    CoderTeam().run(chunks, threads > 0 ? threads : DefaultThreads(), encode);
+
+    size_t at = dataAt;
+    for(int k = 0; k < chunks; ++k) {
+      const uint64_t offset = at;
+      std::memcpy(file.data() + tableAt + sizeof(uint64_t) * k, &offset,
+                  sizeof(offset));
+      const int32_t header[2] = {image.dataWindow.yMin + k * lines,
+                                 static_cast<int32_t>(sizes[k])};
+      std::memmove(file.data() + at + 8, file.data() + dataAt + slot * k + 8,
+                   sizes[k]);
+      std::memcpy(file.data() + at, header, sizeof(header));
+      at += 8 + sizes[k];
+    }
+    file.resize(at);
+    return true;
+  }
+
+  inline bool Read(const std::string& path, Image& image,
+                   std::string* error = nullptr,
+                   const ChunkCallback& onChunk = nullptr, int threads = 0)
+  {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if(!f) return ExrDetail::Fail(error, "cannot open " + path);
+    // read in one call, a stdio buffer would only be allocated
+    std::setvbuf(f, nullptr, _IONBF, 0);
+    ByteBuffer data;
+    if(std::fseek(f, 0, SEEK_END) == 0) {
+      const long size = std::ftell(f);
+      if(size > 0) {
+        data.resize(static_cast<size_t>(size));
+        std::fseek(f, 0, SEEK_SET);
+        data.resize(std::fread(data.data(), 1, data.size(), f));
+      }
+    }
+    std::fclose(f);
+    if(!Decode(data.data(), data.size(), image, error, onChunk, threads)) {
+      if(error) *error = path + ": " + *error;
+      return false;
+    }
+    return true;
+  }
+
+  inline bool Write(const std::string& path, const Image& image,
+                    std::string* error = nullptr, int threads = 0)
+  {
+    ByteBuffer file;
+    if(!Encode(image, file, error, threads)) return false;
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if(!f) return ExrDetail::Fail(error, "cannot write " + path);
+    std::setvbuf(f, nullptr, _IONBF, 0);
+    const bool written = std::fwrite(file.data(), 1, file.size(), f) ==
+                         file.size();
+    if(std::fclose(f) != 0 || !written) {
+      return ExrDetail::Fail(error, "cannot write " + path);
+    }
+    return true;
+  }
+}  // namespace Exr
+
+#endif  // EXR_IO_H
@@ -0,0 +1,511 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+// Recycled memory for the frame pipeline of the standalone tools.
+//
+// FramePool hands out page aligned blocks for frame planes, file bytes and
+// row buffers, and keeps released ones mapped for the next frame of the
+// same size, so a sequence stops faulting in fresh pages and going through
+// the allocator's lock once per frame. Blocks of 2 MB and more are backed by
+// transparent huge pages (madvise) by default, or by MAP_HUGETLB pages when
+// the system has them reserved; GCOLORSPACE_HUGE_PAGES picks "off", "thp"
+// or "hugetlb". The pool keeps at most as many spare bytes as it ever had
+// in use at once, GCOLORSPACE_FRAME_POOL_MB caps that further (0 turns
+// recycling off).
+//
+// ScratchArena is the per-thread bump allocator for kernel temporaries:
+// chunk bytes while they are (de)compressed, AoS <-> SoA and half <-> float
+// staging, deflate's match tables. A Scope rewinds it. Its blocks come from
+// the pool and go back to it when the thread ends.
+//
+// PoolAllocator leaves resized elements uninitialized: every buffer it backs
+// is written in full before it is read, and a frame is not cleared first.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+class FramePool
+{
+ public:
+  enum HugePages { HUGE_PAGES_OFF, HUGE_PAGES_THP, HUGE_PAGES_HUGETLB };
+
+  // smaller blocks come from operator new
+  static constexpr size_t kMinBytes = 4096;
+  static constexpr size_t kHugePage = size_t(2) << 20;
+
+  struct Stats
+  {
+    size_t committed;      // mapped, in use or spare
+    size_t peakCommitted;
+    size_t inUse;
+    size_t peakInUse;
+    size_t hugeTlb;        // of committed, in MAP_HUGETLB pages
+    uint64_t maps;
+    uint64_t reuses;
+    uint64_t unmaps;
+    int hugePages;
+  };
+
+  // never destroyed: arenas of threads that outlive static destruction
+  // still give their blocks back
+  static FramePool& instance()
+  {
+    static FramePool* pool = new FramePool;
+    return *pool;
+  }
+
+  void* acquire(size_t bytes)
+  {
+    if(bytes < kMinBytes) return ::operator new(bytes);
+    bytes = Round(bytes);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for(Bucket& b : buckets) {
+        if(b.bytes == bytes && b.head != nullptr) {
+          Free* block = b.head;
+          b.head = block->next;
+          spare -= bytes;
+          ++reuses;
+          taken(bytes);
+          return block;
+        }
+      }
+    }
+    bool huge = false;
+    void* p = Map(bytes, huge);
+    if(p == nullptr) throw std::bad_alloc();
+    std::lock_guard<std::mutex> lock(mutex);
+    ++maps;
+    committed += bytes;
+    peakCommitted = std::max(peakCommitted, committed);
+    if(huge) {
+      hugeTlb += bytes;
+      hugeBlocks.push_back(p);
+    }
+    taken(bytes);
+    return p;
+  }
+
+  void release(void* p, size_t bytes)
+  {
+    if(p == nullptr) return;
+    if(bytes < kMinBytes) {
+      ::operator delete(p);
+      return;
+    }
+    bytes = Round(bytes);
+    std::unique_lock<std::mutex> lock(mutex);
+    inUse -= bytes;
+    if(spare + bytes <= std::min(limit, peakInUse)) {
+      Bucket* bucket = nullptr;
+      for(Bucket& b : buckets) {
+        if(b.bytes == bytes || (bucket == nullptr && b.head == nullptr)) {
+          bucket = &b;
+          if(b.bytes == bytes) break;
+        }
+      }
+      if(bucket != nullptr) {
+        bucket->bytes = bytes;
+        Free* block = static_cast<Free*>(p);
+        block->next = bucket->head;
+        bucket->head = block;
+        spare += bytes;
+        return;
+      }
+    }
+    unmapped(p, bytes);
+    lock.unlock();
+    Unmap(p, bytes);
+  }
+
+  // unmaps every spare block
+  void trim()
+  {
+    std::vector<std::pair<void*, size_t>> blocks;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for(Bucket& b : buckets) {
+        for(Free* block = b.head; block != nullptr;) {
+          Free* next = block->next;
+          blocks.emplace_back(block, b.bytes);
+          unmapped(block, b.bytes);
+          block = next;
+        }
+        b.head = nullptr;
+      }
+      spare = 0;
+    }
+    for(const auto& block : blocks) Unmap(block.first, block.second);
+  }
+
+  // spare bytes kept at most (on top of the peak in use)
+  void setLimit(size_t bytes)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      limit = bytes;
+    }
+    trim();
+  }
+
+  // for blocks mapped from now on
+  void setHugePages(int mode)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    hugePages = mode;
+  }
+
+  Stats stats() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return {committed, peakCommitted, inUse, peakInUse, hugeTlb,
+            maps,      reuses,        unmaps, hugePages};
+  }
+
+ private:
+  struct Free
+  {
+    Free* next;
+  };
+
+  // spare blocks of one size
+  struct Bucket
+  {
+    size_t bytes = 0;
+    Free* head = nullptr;
+  };
+
+  static constexpr int kBuckets = 32;
+
+  FramePool()
+  {
+    if(const char* env = std::getenv("GCOLORSPACE_HUGE_PAGES")) {
+      const std::string mode = env;
+      if(mode == "off" || mode == "0") hugePages = HUGE_PAGES_OFF;
+      if(mode == "hugetlb" || mode == "1") hugePages = HUGE_PAGES_HUGETLB;
+    }
+    if(const char* env = std::getenv("GCOLORSPACE_FRAME_POOL_MB")) {
+      limit = static_cast<size_t>(std::strtoull(env, nullptr, 10)) << 20;
+    }
+  }
+
+  // whole pages, whole huge pages from 2 MB on
+  static size_t Round(size_t bytes)
+  {
+    const size_t unit =
+        bytes >= kHugePage ? size_t(kHugePage) : size_t(kMinBytes);
+    return (bytes + unit - 1) / unit * unit;
+  }
+
+  void taken(size_t bytes)
+  {
+    inUse += bytes;
+    peakInUse = std::max(peakInUse, inUse);
+  }
+
+  void unmapped(void* p, size_t bytes)
+  {
+    ++unmaps;
+    committed -= bytes;
+    const auto huge = std::find(hugeBlocks.begin(), hugeBlocks.end(), p);
+    if(huge != hugeBlocks.end()) {
+      hugeTlb -= bytes;
+      hugeBlocks.erase(huge);
+    }
+  }
+
+  void* Map(size_t bytes, bool& huge)
+  {
+    int mode;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      mode = hugePages;
+    }
+#if defined(_WIN32)
+    (void)mode;
+    return _aligned_malloc(bytes, kMinBytes);
+#else
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    const bool large = bytes >= kHugePage;
+#if defined(MAP_HUGETLB)
+    if(large && mode == HUGE_PAGES_HUGETLB) {
+      void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                     flags | MAP_HUGETLB, -1, 0);
+      if(p != MAP_FAILED) {
+        huge = true;
+        return p;
+      }
+      // none reserved (vm.nr_hugepages), transparent ones instead
+      mode = HUGE_PAGES_THP;
+    }
+#endif
+    if(!large || mode == HUGE_PAGES_OFF) {
+      void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+      return p != MAP_FAILED ? p : nullptr;
+    }
+    // 2 MB aligned, so every huge page of the block can be a real one
+    void* mapped = mmap(nullptr, bytes + kHugePage, PROT_READ | PROT_WRITE,
+                        flags, -1, 0);
+    if(mapped == MAP_FAILED) return nullptr;
+    const uintptr_t start = reinterpret_cast<uintptr_t>(mapped);
+    const uintptr_t aligned = (start + kHugePage - 1) & ~(kHugePage - 1);
+    if(aligned > start) munmap(mapped, aligned - start);
+    const size_t tail = kHugePage - (aligned - start);
+    if(tail > 0) munmap(reinterpret_cast<void*>(aligned + bytes), tail);
+    void* p = reinterpret_cast<void*>(aligned);
+#if defined(MADV_HUGEPAGE)
+    madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    return p;
+#endif
+  }
+
+  static void Unmap(void* p, size_t bytes)
+  {
+#if defined(_WIN32)
+    (void)bytes;
+    _aligned_free(p);
+#else
+    munmap(p, bytes);
+#endif
+  }
+
+  mutable std::mutex mutex;
+  Bucket buckets[kBuckets];
+  std::vector<void*> hugeBlocks;
+  size_t committed = 0;
+  size_t peakCommitted = 0;
+  size_t inUse = 0;
+  size_t peakInUse = 0;
+  size_t spare = 0;
+  size_t hugeTlb = 0;
+  size_t limit = ~size_t(0);
+  uint64_t maps = 0;
+  uint64_t reuses = 0;
+  uint64_t unmaps = 0;
+  int hugePages = HUGE_PAGES_THP;
+};
+
+template <typename T>
+class PoolAllocator
+{
+ public:
+  using value_type = T;
+
+  PoolAllocator() = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&)
+  {
+  }
+
+  T* allocate(size_t n)
+  {
+    return static_cast<T*>(FramePool::instance().acquire(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n)
+  {
+    FramePool::instance().release(p, n * sizeof(T));
+  }
+
+  template <typename U>
+  void construct(U* p)
+  {
+    ::new(static_cast<void*>(p)) U;
+  }
+
+  template <typename U, typename... Args>
+  void construct(U* p, Args&&... args)
+  {
+    ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U>&) const
+  {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const PoolAllocator<U>&) const
+  {
+    return false;
+  }
+};
+
+using FloatBuffer = std::vector<float, PoolAllocator<float>>;
+using ByteBuffer = std::vector<uint8_t, PoolAllocator<uint8_t>>;
+
+class ScratchArena
+{
+ public:
+  static constexpr size_t kAlign = 64;
+  static constexpr size_t kFirstBlock = size_t(1) << 20;
+
+  // the calling thread's arena
+  static ScratchArena& local()
+  {
+    thread_local ScratchArena arena;
+    return arena;
+  }
+
+  ~ScratchArena()
+  {
+    for(int b = 0; b < count; ++b) {
+      FramePool::instance().release(blocks[b].data, blocks[b].size);
+    }
+  }
+
+  // 'n' uninitialized T, 64 byte aligned, valid until the enclosing Scope
+  // ends
+  template <typename T>
+  T* take(size_t n)
+  {
+    const size_t bytes = (n * sizeof(T) + kAlign - 1) & ~(kAlign - 1);
+    for(; current < count; ++current, used = 0) {
+      if(blocks[current].size - used >= bytes) {
+        uint8_t* p = blocks[current].data + used;
+        used += bytes;
+        return reinterpret_cast<T*>(p);
+      }
+    }
+    if(count == kMaxBlocks) throw std::bad_alloc();
+    // each block at least doubles, a handful cover any frame
+    const size_t size = std::max(
+        {bytes, size_t(kFirstBlock),
+         count ? 2 * blocks[count - 1].size : 0});
+    blocks[count].data =
+        static_cast<uint8_t*>(FramePool::instance().acquire(size));
+    blocks[count].size = size;
+    current = count++;
+    used = bytes;
+    return reinterpret_cast<T*>(blocks[current].data);
+  }
+
+  // bytes held, in use or not
+  size_t committed() const
+  {
+    size_t bytes = 0;
+    for(int b = 0; b < count; ++b) bytes += blocks[b].size;
+    return bytes;
+  }
+
+  // Everything taken from the thread's arena while a Scope lives is
+  // given back when it ends. Scopes nest.
+  class Scope
+  {
+   public:
+    Scope() : arena(local()), block(arena.current), used(arena.used) {}
+
+    ~Scope()
+    {
+      arena.current = block;
+      arena.used = used;
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    template <typename T>
+    T* take(size_t n)
+    {
+      return arena.take<T>(n);
+    }
+
+   private:
+    ScratchArena& arena;
+    int block;
+    size_t used;
+  };
+
+ private:
+  static constexpr int kMaxBlocks = 24;
+
+  struct Block
+  {
+    uint8_t* data;
+    size_t size;
+  };
+
+  ScratchArena() = default;
+
+  Block blocks[kMaxBlocks];
+  int count = 0;
+  int current = 0;
+  size_t used = 0;
+};
+
+namespace FramePoolDetail
+{
+  // kB value of a /proc/self/status line, 0 when missing
+  inline size_t StatusBytes(const char* field)
+  {
+#if defined(__linux__)
+    FILE* f = std::fopen("/proc/self/status", "r");
+    if(f == nullptr) return 0;
+    char line[256];
+    size_t kb = 0;
+    const size_t length = std::strlen(field);
+    while(std::fgets(line, sizeof(line), f)) {
+      if(!std::strncmp(line, field, length) && line[length] == ':') {
+        kb = std::strtoull(line + length + 1, nullptr, 10);
+        break;
+      }
+    }
+    std::fclose(f);
+    return kb << 10;
+#else
+    (void)field;
+    return 0;
+#endif
+  }
+}  // namespace FramePoolDetail
+
+// One line on the process and the pool: peak and current resident memory,
+// what the pool has mapped now and at most, how often it had to map.
+inline std::string MemoryReport()
+{
+  size_t peak = FramePoolDetail::StatusBytes("VmHWM");
+  const size_t resident = FramePoolDetail::StatusBytes("VmRSS");
+#if !defined(_WIN32)
+  if(peak == 0) {
+    rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0) {
+      peak = static_cast<size_t>(usage.ru_maxrss) << 10;
+    }
+  }
+#endif
+  const FramePool::Stats s = FramePool::instance().stats();
+  static const char* const kModes[] = {"off", "thp", "hugetlb"};
+  const double mb = 1.0 / (1 << 20);
+  char text[320];
+  std::snprintf(text, sizeof(text),
+                "memory: %.1f MB peak resident (%.1f MB now), pool %.1f MB "
+                "committed (peak %.1f MB, %.1f MB in use), %llu maps, %llu "
+                "reuses, huge pages %s%s",
+                peak * mb, resident * mb, s.committed * mb,
+                s.peakCommitted * mb, s.inUse * mb,
+                static_cast<unsigned long long>(s.maps),
+                static_cast<unsigned long long>(s.reuses),
+                kModes[s.hugePages],
+                s.hugeTlb ? " (hugetlb in use)" : "");
+  return text;
+}
+
+#endif  // FRAME_POOL_H
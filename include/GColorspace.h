@@ -29,17 +29,26 @@
 
 #include <DDImage/Channel.h>
 #include <DDImage/Convolve.h>
+#include <DDImage/Iop.h>
 #include <DDImage/Knobs.h>
-#include <DDImage/Matrix3.h>
 #include <DDImage/NukeWrapper.h>
-#include <DDImage/PixelIop.h>
 #include <DDImage/Row.h>
 
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "include/BandCache.h"
+#include "include/RowCache.h"
+#include "include/TransformPlan.h"
 #include "include/aliases.h"
 
 using namespace DD::Image;
 
-class GColorspaceIop : public PixelIop
+// A plain Iop rather than a PixelIop so the "bands" engine can fetch blocks
+// of input rows itself, the "rows" engine behaves like a PixelIop.
+class GColorspaceIop : public Iop
 {
   int colorIn_index;
   int colorOut_index;
@@ -47,8 +56,39 @@ class GColorspaceIop : public PixelIop
   int whiteOut_index;
   int primaryIn_index;
   int primaryOut_index;
+  int ycbcrMatrix_index;
+  int ycbcrRange_index;
   bool use_bradford_matrix;
-  Matrix3 currentMatrix;
+  bool bit_exact_curves;
+  int precision_index;
+  float auto_tolerance;
+  int lutStorage_index;
+  std::string lut_file;
+  int lutFilePosition_index;
+  std::string clf_file;
+  std::string blink_file;
+  int engine_index;
+  bool temporal_cache;
+  std::string rowCacheInfo;
+  TransformPlan plan;
+  BandCache bands;
+  // channels asked for since _validate, the ones the bands hold
+  ChannelSet bandChannels;
+  mutable std::mutex bandChannelsLock;
+  // RowCache salt of the resolved transform and this node's lookups
+  uint64_t rowSalt;
+  std::atomic<uint64_t> rowHits;
+  std::atomic<uint64_t> rowLookups;
+
+  // layers converted per ApplyPlanar call
+  static constexpr int kMaxLayers = 16;
+
+  void rowEngine(const Row& in, int rowY, int rowX, int rowXBound,
+                 ChannelMask outputChannels, Row& out);
+  bool bandEngine(int rowY, int rowX, int rowXBound,
+                  ChannelMask outputChannels, Row& out);
+  bool renderBand(Band& band);
+  void convertLayers(PlanarLayer* layers, int count, int n);
 
  protected:
   ConvolveArray colormatrix;
@@ -72,16 +112,25 @@ class GColorspaceIop : public PixelIop
 
   int knob_changed(Knob* k) override;
 
-  void in_channels(int n, ChannelSet& mask) const override;
+  void in_channels(int n, ChannelSet& mask) const;
 
-  void pixel_engine(const Row& in, int rowY, int rowX, int rowXBound,
-                    ChannelMask outputChannels, Row& out) override;
+  void engine(int rowY, int rowX, int rowXBound, ChannelMask outputChannels,
+              Row& out) override;
 
   void _validate(bool for_real) override;
 
+  bool updateUI(const OutputContext& context) override;
+
+  void _request(int x, int y, int r, int t, ChannelMask channels,
+                int count) override;
+
   void setColorMatrix();
-  RGBcolor ToInColorspace(const RGBcolor& p);
-  RGBcolor ToOutColorspace(const RGBcolor& p);
+  TransformSettings settings() const;
+  // writes the resolved transform to 'path', reports failures as dialogs
+  using Exporter = bool (*)(const TransformPlan&, const std::string&,
+                            std::string*);
+  void exportTransform(const std::string& path, const char* format,
+                       Exporter exporter);
 };
 
 static DD::Image::Op* build(Node* node);
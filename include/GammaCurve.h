@@ -0,0 +1,116 @@
+#ifndef GAMMA_CURVE_H
+#define GAMMA_CURVE_H
+
+// Vectorized pow for the pure power curves (gamma 1.8 - 2.6, BT1886).
+// x^g is evaluated as exp(log(x) * g) with the exponent baked in at compile
+// time. Special values follow powf for the positive exponents used here:
+// x < 0 gives NaN, 0 gives 0, +-inf gives inf and NaN propagates.
+
+#include "include/Constants.h"
+#include "include/Simd.h"
+
+using GammaKernel = void (*)(const float* src, float* dst, int n);
+
+template <int Num, int Den>
+inline Simd::vfloat GammaPowVector(Simd::vfloat x)
+{
+  constexpr float kExponent =
+      static_cast<float>(Num) / static_cast<float>(Den);
+
+  const Simd::vfloat y =
+      Simd::exp(Simd::mul(Simd::log(x), Simd::set1(kExponent)));
+  return Simd::select(Simd::eq(x, Simd::set1(-INFINITY)), Simd::abs(x), y);
+}
+
+template <int Num, int Den>
+inline void GammaPow(const float* src, float* dst, int n)
+{
+  Simd::forEach(src, dst, n, &GammaPowVector<Num, Den>);
+}
+
+// sRGB piecewise curve on one vector, decode (LinTosRGB) and encode
+// (sRGBToLin) directions
+inline Simd::vfloat SRGBCurveIn(Simd::vfloat v)
+{
+  using namespace Simd;
+  const vfloat lin = div(v, set1(12.92f));
+  const vfloat t = div(add(v, set1(0.055f)), set1(1.055f));
+  const vfloat p = exp(mul(log(t), set1(2.4f)));
+  return select(le(v, set1(0.04045f)), lin, p);
+}
+
+inline Simd::vfloat SRGBCurveOut(Simd::vfloat v)
+{
+  using namespace Simd;
+  const vfloat lin = mul(v, set1(12.92f));
+  const vfloat p = exp(mul(log(v), set1(1.0f / 2.4f)));
+  return select(le(v, set1(0.0031308f)), lin,
+                madd(p, set1(1.055f), set1(-0.055f)));
+}
+
+namespace GammaDetail
+{
+  // Op<Num, Den>::run per curve, nullptr when not a pure power curve
+  template <template <int, int> class Op,
+            class Fn = decltype(&Op<1, 1>::run)>
+  inline Fn SelectIn(int colorspace)
+  {
+    switch(colorspace) {
+      case Constants::COLOR_GAMMA_1_80:
+        return &Op<180, 100>::run;
+      case Constants::COLOR_GAMMA_2_20:
+        return &Op<220, 100>::run;
+      case Constants::COLOR_GAMMA_2_40:
+        return &Op<240, 100>::run;
+      case Constants::COLOR_GAMMA_2_60:
+        return &Op<260, 100>::run;
+      case Constants::COLOR_BT1886:
+        return &Op<240, 100>::run;
+      default:
+        return nullptr;
+    }
+  }
+
+  template <template <int, int> class Op,
+            class Fn = decltype(&Op<1, 1>::run)>
+  inline Fn SelectOut(int colorspace)
+  {
+    switch(colorspace) {
+      case Constants::COLOR_GAMMA_1_80:
+        return &Op<100, 180>::run;
+      case Constants::COLOR_GAMMA_2_20:
+        return &Op<100, 220>::run;
+      case Constants::COLOR_GAMMA_2_40:
+        return &Op<100, 240>::run;
+      case Constants::COLOR_GAMMA_2_60:
+        return &Op<100, 260>::run;
+      case Constants::COLOR_BT1886:
+        return &Op<100, 240>::run;
+      default:
+        return nullptr;
+    }
+  }
+
+  template <int Num, int Den>
+  struct ArrayOp
+  {
+    static void run(const float* src, float* dst, int n)
+    {
+      GammaPow<Num, Den>(src, dst, n);
+    }
+  };
+}  // namespace GammaDetail
+
+// LinToGamma (TransformInDispatcher), nullptr when not a pure power curve
+inline GammaKernel GammaCurveIn(int colorspace)
+{
+  return GammaDetail::SelectIn<GammaDetail::ArrayOp>(colorspace);
+}
+
+// GammaToLin (TransformOutDispatcher)
+inline GammaKernel GammaCurveOut(int colorspace)
+{
+  return GammaDetail::SelectOut<GammaDetail::ArrayOp>(colorspace);
+}
+
+#endif  // GAMMA_CURVE_H
@@ -0,0 +1,138 @@
+#ifndef HALF_H
+#define HALF_H
+
+// IEEE 754 binary16 <-> float. F16C is used when the build enables it
+// (GCOLORSPACE_AVX2), the portable path rounds to nearest even the same way.
+
+#include <immintrin.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "include/Simd.h"
+
+inline float HalfToFloat(uint16_t h)
+{
+  const uint32_t shiftedExp = 0x7c00u << 13;
+  uint32_t o = (h & 0x7fffu) << 13;
+  const uint32_t exp = shiftedExp & o;
+  o += (127 - 15) << 23;
+
+  float f;
+  if(exp == shiftedExp) {
+    // inf / NaN
+    o += (128 - 16) << 23;
+    std::memcpy(&f, &o, sizeof(f));
+  }
+  else if(exp == 0) {
+    // zero / denormal, renormalized through a float subtract
+    o += 1 << 23;
+    const uint32_t magicBits = 113u << 23;
+    float magic;
+    std::memcpy(&f, &o, sizeof(f));
+    std::memcpy(&magic, &magicBits, sizeof(magic));
+    f -= magic;
+  }
+  else {
+    std::memcpy(&f, &o, sizeof(f));
+  }
+
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  bits |= static_cast<uint32_t>(h & 0x8000u) << 16;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+inline uint16_t FloatToHalf(float value)
+{
+  const uint32_t f32Inf = 255u << 23;
+  const uint32_t f16Max = (127u + 16u) << 23;
+  const uint32_t denormMagicBits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+  uint32_t f;
+  std::memcpy(&f, &value, sizeof(f));
+  const uint32_t sign = f & 0x80000000u;
+  f ^= sign;
+
+  uint32_t o;
+  if(f >= f16Max) {
+    // overflow goes to inf, NaN stays a quiet NaN
+    o = f > f32Inf ? 0x7e00u : 0x7c00u;
+  }
+  else if(f < (113u << 23)) {
+    // the float add lines the mantissa up and rounds to nearest even
+    float denormMagic, v;
+    std::memcpy(&denormMagic, &denormMagicBits, sizeof(denormMagic));
+    std::memcpy(&v, &f, sizeof(v));
+    v += denormMagic;
+    std::memcpy(&o, &v, sizeof(o));
+    o -= denormMagicBits;
+  }
+  else {
+    const uint32_t mantOdd = (f >> 13) & 1u;
+    f += (static_cast<uint32_t>(15 - 127) << 23) + 0xfffu;
+    f += mantOdd;
+    o = f >> 13;
+  }
+
+  return static_cast<uint16_t>(o | (sign >> 16));
+}
+
+namespace Simd
+{
+  // kWidth halves <-> one vector
+  inline vfloat loadHalf(const uint16_t* p)
+  {
+#if defined(__F16C__) && defined(__AVX__)
+    return _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+#elif defined(__F16C__)
+    return _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+#else
+    float lanes[kWidth];
+    for(int i = 0; i < kWidth; ++i) lanes[i] = HalfToFloat(p[i]);
+    return load(lanes);
+#endif
+  }
+
+  inline void storeHalf(uint16_t* p, vfloat v)
+  {
+#if defined(__F16C__) && defined(__AVX__)
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p),
+                     _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+#elif defined(__F16C__)
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(p),
+                     _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+#else
+    float lanes[kWidth];
+    store(lanes, v);
+    for(int i = 0; i < kWidth; ++i) p[i] = FloatToHalf(lanes[i]);
+#endif
+  }
+
+  // table[idx] per lane as float, idx holds non-negative integral floats.
+  // The AVX2 path loads 32 bits per lane, so the table needs one readable
+  // half past the last index.
+  inline vfloat gatherHalf(const uint16_t* table, vfloat idx)
+  {
+#if defined(__AVX2__) && defined(__F16C__)
+    __m256i bits = _mm256_i32gather_epi32(reinterpret_cast<const int*>(table),
+                                          _mm256_cvttps_epi32(idx), 2);
+    bits = _mm256_and_si256(bits, _mm256_set1_epi32(0xffff));
+    // 16 bit values of both 128 bit halves into the low quadwords
+    bits = _mm256_packus_epi32(bits, bits);
+    bits = _mm256_permute4x64_epi64(bits, 0x08);
+    return _mm256_cvtph_ps(_mm256_castsi256_si128(bits));
+#else
+    float lanes[kWidth];
+    store(lanes, idx);
+    for(int i = 0; i < kWidth; ++i) {
+      lanes[i] = HalfToFloat(table[static_cast<int>(lanes[i])]);
+    }
+    return load(lanes);
+#endif
+  }
+}  // namespace Simd
+
+#endif  // HALF_H
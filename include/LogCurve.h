@@ -0,0 +1,381 @@
+#ifndef LOG_CURVE_H
+#define LOG_CURVE_H
+
+// Parametric description of the log style camera curves in ColorLut.h.
+//
+// log side: y = logSlope * log_base(linSlope * x + linOffset) + logOffset
+// toe:      y = toeSlope * x + toeOffset          (x < linBreak / y < logBreak)
+//
+// "In" is the log -> linear direction (LinToColor, TransformInDispatcher),
+// "Out" is linear -> log (ColorToLin, TransformOutDispatcher).
+// Adding a camera is a new entry in LogCurveFor().
+
+#include <array>
+#include <cmath>
+
+#include "include/Constants.h"
+#include "include/Simd.h"
+
+struct LogCurve
+{
+  enum Flags {
+    LOG_TOE = 1 << 0,     // linear segment below the breaks
+    LOG_MIRROR = 1 << 1,  // odd symmetric around x = 0 / y = logOffset (CLog)
+    LOG_RANGE = 1 << 2    // values outside [min, max] map to 0 (CLog)
+  };
+
+  float base;
+  float logSlope;
+  float logOffset;
+  float linSlope;
+  float linOffset;
+
+  int flags;
+  float linBreak;
+  float logBreak;
+  float toeSlope;
+  float toeOffset;
+  float linMin, linMax;
+  float logMin, logMax;
+};
+
+// Coefficients folded for the kernels, built once per curve
+struct LogCurveCoeffs
+{
+  int flags;
+  float encodeGain;  // logSlope / ln(base)
+  float decodeGain;  // ln(base) / logSlope
+  float logOffset;
+  float linSlope;
+  float linSlopeInv;
+  float linOffset;
+  float linBreak;
+  float logBreak;
+  float toeSlope;
+  float toeSlopeInv;
+  float toeOffset;
+  float linMin, linMax;
+  float logMin, logMax;
+};
+
+inline LogCurveCoeffs MakeLogCurveCoeffs(const LogCurve& c)
+{
+  const float lnBase = std::log(c.base);
+
+  LogCurveCoeffs k;
+  k.flags = c.flags;
+  k.encodeGain = c.logSlope / lnBase;
+  k.decodeGain = lnBase / c.logSlope;
+  k.logOffset = c.logOffset;
+  k.linSlope = c.linSlope;
+  k.linSlopeInv = 1.0f / c.linSlope;
+  k.linOffset = c.linOffset;
+  k.linBreak = c.linBreak;
+  k.logBreak = c.logBreak;
+  k.toeSlope = c.toeSlope;
+  k.toeSlopeInv = c.toeSlope != 0.0f ? 1.0f / c.toeSlope : 0.0f;
+  k.toeOffset = c.toeOffset;
+  k.linMin = c.linMin;
+  k.linMax = c.linMax;
+  k.logMin = c.logMin;
+  k.logMax = c.logMax;
+  return k;
+}
+
+inline LogCurve MakeLogCurve(float base, float logSlope, float logOffset,
+                             float linSlope, float linOffset)
+{
+  LogCurve c = {};
+  c.base = base;
+  c.logSlope = logSlope;
+  c.logOffset = logOffset;
+  c.linSlope = linSlope;
+  c.linOffset = linOffset;
+  return c;
+}
+
+inline LogCurve WithToe(LogCurve c, float linBreak, float logBreak,
+                        float toeSlope, float toeOffset)
+{
+  c.flags |= LogCurve::LOG_TOE;
+  c.linBreak = linBreak;
+  c.logBreak = logBreak;
+  c.toeSlope = toeSlope;
+  c.toeOffset = toeOffset;
+  return c;
+}
+
+inline LogCurve WithMirrorRange(LogCurve c, float linMin, float linMax,
+                                float logMin, float logMax)
+{
+  c.flags |= LogCurve::LOG_MIRROR | LogCurve::LOG_RANGE;
+  c.linMin = linMin;
+  c.linMax = linMax;
+  c.logMin = logMin;
+  c.logMax = logMax;
+  return c;
+}
+
+// Returns the folded coefficients for a colorspace, nullptr when the curve is
+// not a log curve and has to go through its scalar function.
+inline const LogCurveCoeffs* LogCurveFor(int colorspace)
+{
+  static const std::array<LogCurveCoeffs, Constants::COLORSPACE_COUNT> table =
+      [] {
+        std::array<LogCurveCoeffs, Constants::COLORSPACE_COUNT> t = {};
+        for(auto& k : t) k.flags = -1;
+
+        auto set = [&t](int i, const LogCurve& c) {
+          t[i] = MakeLogCurveCoeffs(c);
+        };
+
+        // Cineon
+        const float cinOffset =
+            std::pow(10.0f, (95.0f - 685.0f) * 0.002f / 0.6f);
+        set(Constants::COLOR_CINEON,
+            MakeLogCurve(10.0f, 300.0f / 1023.0f, 685.0f / 1023.0f,
+                         1.0f - cinOffset, cinOffset));
+
+        // Panalog
+        set(Constants::COLOR_PANALOG,
+            MakeLogCurve(10.0f, 444.0f / 1023.0f, 681.0f / 1023.0f,
+                         1.0f - 0.0408f, 0.0408f));
+
+        // REDLog
+        const float redOffset = std::pow(10.0f, (0.0f - 1023.0f) / 511.0f);
+        set(Constants::COLOR_REDLOG,
+            MakeLogCurve(10.0f, 511.0f / 1023.0f, 1.0f, 1.0f - redOffset,
+                         redOffset));
+
+        // ViperLog
+        set(Constants::COLOR_VIPERLOG,
+            MakeLogCurve(10.0f, 500.0f / 1023.0f, 1.0f, 1.0f, 0.0f));
+
+        // AlexaV3LogC (EI 800)
+        set(Constants::COLOR_ALEXAV3LOGC,
+            WithToe(MakeLogCurve(10.0f, 0.247190f, 0.385537f, 5.555556f,
+                                 0.052272f),
+                    0.010591f, 0.1496582f, 5.367655f, 0.092809f));
+
+        // SLog
+        set(Constants::COLOR_SLOG,
+            MakeLogCurve(10.0f, 0.432699f, 0.616596f + 0.03f, 1.0f,
+                         0.037584f));
+
+        // SLog1 / SLog2, 10 bit legal range
+        const float slogScale = (940.0f - 64.0f) / 1023.0f;
+        const float slogLogOffset = (0.646596f * 876.0f + 64.0f) / 1023.0f;
+        const float slogToeOffset =
+            (0.030001222851889303f * 876.0f + 64.0f) / 1023.0f;
+        set(Constants::COLOR_SLOG1,
+            WithToe(MakeLogCurve(10.0f, 0.432699f * slogScale, slogLogOffset,
+                                 1.0f / 0.9f, 0.037584f),
+                    -0.00008153227156f, 90.0f / 1023.0f,
+                    5.0f / 0.9f * slogScale, slogToeOffset));
+        set(Constants::COLOR_SLOG2,
+            WithToe(MakeLogCurve(10.0f, 0.432699f * slogScale, slogLogOffset,
+                                 155.0f / (219.0f * 0.9f), 0.037584f),
+                    -0.00008153227156f, 90.0f / 1023.0f,
+                    3.53881278538813f / 0.9f * slogScale, slogToeOffset));
+
+        // SLog3
+        set(Constants::COLOR_SLOG3,
+            WithToe(MakeLogCurve(10.0f, 261.5f / 1023.0f, 420.0f / 1023.0f,
+                                 1.0f / 0.19f, 0.01f / 0.19f),
+                    0.01125000f, 171.2102946929f / 1023.0f,
+                    (171.2102946929f - 95.0f) / 0.01125000f / 1023.0f,
+                    95.0f / 1023.0f));
+
+        // CLog
+        set(Constants::COLOR_CLOG,
+            WithMirrorRange(
+                MakeLogCurve(10.0f, 0.529136f, 0.0730597f, 10.1596f, 1.0f),
+                -0.0452664f, 8.00903f, -0.0684932f, 1.08676f));
+
+        // Log3G10 / Log3G12
+        set(Constants::COLOR_LOG3G10,
+            WithToe(MakeLogCurve(10.0f, 0.224282f, 0.0f, 155.975327f,
+                                 155.975327f * 0.01f + 1.0f),
+                    -0.01f, 0.0f, 15.1927f, 15.1927f * 0.01f));
+        set(Constants::COLOR_LOG3G12,
+            WithToe(MakeLogCurve(10.0f, 0.184904f, 0.0f, 347.189667f, 1.0f),
+                    0.0f, 0.0f, 15.1927f, 0.0f));
+
+        // Protune
+        set(Constants::COLOR_PROTUNE,
+            MakeLogCurve(113.0f, 1.0f, 0.0f, 112.0f, 1.0f));
+
+        // Blackmagic Film Generation 5
+        set(Constants::COLOR_BLACKMAGIC_GEN5,
+            WithToe(MakeLogCurve(2.718281828459045f, 0.08692876065491224f,
+                                 0.5300133392291939f, 1.0f,
+                                 0.005494072432257808f),
+                    0.005f, 0.005f, 8.283605932402494f,
+                    0.09246575342465753f));
+
+        // ARRILogC4
+        const float c4a = 2231.8263090676883f;
+        const float c4b = 0.9071358748778103f;
+        const float c4c = 0.09286412512218964f;
+        const float c4s = 0.1135972086105891f;
+        const float c4t = -0.01805699611991131f;
+        set(Constants::COLOR_ARRI_LOG_C4,
+            WithToe(MakeLogCurve(2.0f, c4b / 14.0f, c4c - 6.0f * c4b / 14.0f,
+                                 c4a, 64.0f),
+                    c4t, 0.0f, 1.0f / c4s, -c4t / c4s));
+
+        return t;
+      }();
+
+  if(colorspace < 0 || colorspace >= Constants::COLORSPACE_COUNT) {
+    return nullptr;
+  }
+
+  const LogCurveCoeffs& k = table[colorspace];
+  return k.flags < 0 ? nullptr : &k;
+}
+
+// Scalar reference of the parametric form, used to cross-check the kernels
+inline float LogCurveOutScalar(const LogCurveCoeffs& k, float x)
+{
+  if((k.flags & LogCurve::LOG_RANGE) && (x < k.linMin || x > k.linMax)) {
+    return 0.0f;
+  }
+  if((k.flags & LogCurve::LOG_TOE) && x < k.linBreak) {
+    return k.toeSlope * x + k.toeOffset;
+  }
+
+  const bool mirror = (k.flags & LogCurve::LOG_MIRROR) && x < 0.0f;
+  const float v = mirror ? -x : x;
+  const float y = k.encodeGain * std::log(k.linSlope * v + k.linOffset);
+  return (mirror ? -y : y) + k.logOffset;
+}
+
+inline float LogCurveInScalar(const LogCurveCoeffs& k, float y)
+{
+  if((k.flags & LogCurve::LOG_RANGE) && (y < k.logMin || y > k.logMax)) {
+    return 0.0f;
+  }
+  if((k.flags & LogCurve::LOG_TOE) && y < k.logBreak) {
+    return (y - k.toeOffset) * k.toeSlopeInv;
+  }
+
+  const float d = y - k.logOffset;
+  const bool mirror = (k.flags & LogCurve::LOG_MIRROR) && d < 0.0f;
+  const float v = mirror ? -d : d;
+  const float x = (std::exp(v * k.decodeGain) - k.linOffset) * k.linSlopeInv;
+  return mirror ? -x : x;
+}
+
+namespace LogCurveDetail
+{
+  // one vector through the curve, shared by the array kernels below and the
+  // fused transform pipeline
+  template <bool Toe, bool Mirror, bool Range>
+  inline Simd::vfloat OutVector(const LogCurveCoeffs& k, Simd::vfloat x)
+  {
+    using namespace Simd;
+    const vfloat v = Mirror ? abs(x) : x;
+    vfloat y = mul(set1(k.encodeGain),
+                   log(madd(set1(k.linSlope), v, set1(k.linOffset))));
+    if(Mirror) y = copySign(y, x);
+    y = add(y, set1(k.logOffset));
+    if(Toe) {
+      y = select(lt(x, set1(k.linBreak)),
+                 madd(set1(k.toeSlope), x, set1(k.toeOffset)), y);
+    }
+    if(Range) {
+      y = andNot(bitOr(lt(x, set1(k.linMin)), gt(x, set1(k.linMax))), y);
+    }
+    return y;
+  }
+
+  template <bool Toe, bool Mirror, bool Range>
+  inline Simd::vfloat InVector(const LogCurveCoeffs& k, Simd::vfloat y)
+  {
+    using namespace Simd;
+    const vfloat d = sub(y, set1(k.logOffset));
+    const vfloat v = Mirror ? abs(d) : d;
+    vfloat x = mul(sub(exp(mul(v, set1(k.decodeGain))), set1(k.linOffset)),
+                   set1(k.linSlopeInv));
+    if(Mirror) x = copySign(x, d);
+    if(Toe) {
+      x = select(lt(y, set1(k.logBreak)),
+                 mul(sub(y, set1(k.toeOffset)), set1(k.toeSlopeInv)), x);
+    }
+    if(Range) {
+      x = andNot(bitOr(lt(y, set1(k.logMin)), gt(y, set1(k.logMax))), x);
+    }
+    return x;
+  }
+
+  template <bool Toe, bool Mirror, bool Range>
+  inline void Out(const LogCurveCoeffs& k, const float* src, float* dst, int n)
+  {
+    Simd::forEach(src, dst, n, [&k](Simd::vfloat x) {
+      return OutVector<Toe, Mirror, Range>(k, x);
+    });
+  }
+
+  template <bool Toe, bool Mirror, bool Range>
+  inline void In(const LogCurveCoeffs& k, const float* src, float* dst, int n)
+  {
+    Simd::forEach(src, dst, n, [&k](Simd::vfloat y) {
+      return InVector<Toe, Mirror, Range>(k, y);
+    });
+  }
+}  // namespace LogCurveDetail
+
+namespace LogCurveDetail
+{
+  using Kernel = void (*)(const LogCurveCoeffs&, const float*, float*, int);
+
+  // one instantiation per flag combination, indexed by LogCurve::Flags
+  template <template <bool, bool, bool> class Op,
+            class Fn = decltype(&Op<false, false, false>::run)>
+  inline Fn Select(int flags)
+  {
+    static const Fn kernels[] = {
+        &Op<false, false, false>::run, &Op<true, false, false>::run,
+        &Op<false, true, false>::run,  &Op<true, true, false>::run,
+        &Op<false, false, true>::run,  &Op<true, false, true>::run,
+        &Op<false, true, true>::run,   &Op<true, true, true>::run};
+    return kernels[flags & 7];
+  }
+
+  template <bool Toe, bool Mirror, bool Range>
+  struct OutOp
+  {
+    static void run(const LogCurveCoeffs& k, const float* src, float* dst,
+                    int n)
+    {
+      Out<Toe, Mirror, Range>(k, src, dst, n);
+    }
+  };
+
+  template <bool Toe, bool Mirror, bool Range>
+  struct InOp
+  {
+    static void run(const LogCurveCoeffs& k, const float* src, float* dst,
+                    int n)
+    {
+      In<Toe, Mirror, Range>(k, src, dst, n);
+    }
+  };
+}  // namespace LogCurveDetail
+
+// linear -> log over n floats, src and dst may alias
+inline void LogCurveOut(const LogCurveCoeffs& k, const float* src, float* dst,
+                        int n)
+{
+  LogCurveDetail::Select<LogCurveDetail::OutOp>(k.flags)(k, src, dst, n);
+}
+
+// log -> linear over n floats, src and dst may alias
+inline void LogCurveIn(const LogCurveCoeffs& k, const float* src, float* dst,
+                       int n)
+{
+  LogCurveDetail::Select<LogCurveDetail::InOp>(k.flags)(k, src, dst, n);
+}
+
+#endif  // LOG_CURVE_H
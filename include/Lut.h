@@ -0,0 +1,326 @@
+#ifndef LUT_H
+#define LUT_H
+
+// Baked lookup tables for the LUT precision tiers.
+//
+// Both table kinds cover the [0, 1] domain of their input. Lanes outside it
+// (and NaN) are flagged so the caller can run the exact path for them, the
+// tables never extrapolate.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "include/Constants.h"
+#include "include/Half.h"
+#include "include/Simd.h"
+
+// Single curve sampled at 'size' points, linear interpolation
+struct Lut1D
+{
+  int size = 0;
+  const float* table = nullptr;
+};
+
+// RGB -> RGB cube of size^3 points, interleaved RGB, tetrahedral
+// interpolation. Entries are float or half (Constants::LutStorages) and
+// either row-major with r varying fastest, or tiled in kBrick^3 bricks so
+// the corners of a cell mostly share cache lines.
+struct Lut3D
+{
+  static constexpr int kBrick = 4;
+
+  int size = 0;
+  int storage = Constants::LUT_STORAGE_FLOAT;
+  const float* table = nullptr;  // uint16_t entries for half storage
+
+  bool half() const
+  {
+    return storage == Constants::LUT_STORAGE_HALF ||
+           storage == Constants::LUT_STORAGE_HALF_TILED;
+  }
+
+  bool tiled() const
+  {
+    return storage == Constants::LUT_STORAGE_FLOAT_TILED ||
+           storage == Constants::LUT_STORAGE_HALF_TILED;
+  }
+
+  // lattice points per axis including the brick padding
+  int paddedSize() const
+  {
+    return tiled() ? (size + kBrick - 1) / kBrick * kBrick : size;
+  }
+
+  size_t entries() const
+  {
+    const size_t n = static_cast<size_t>(paddedSize());
+    return n * n * n * 3;
+  }
+
+  // payload words, half tables get one spare word for the 32 bit gathers
+  size_t words() const
+  {
+    if(size == 0) return 0;
+    return half() ? entries() / 2 + 1 : entries();
+  }
+
+  // float offset of lattice point (x, y, z)
+  size_t offset(int x, int y, int z) const
+  {
+    if(!tiled()) {
+      return ((static_cast<size_t>(z) * size + y) * size + x) * 3;
+    }
+    const int bricks = paddedSize() / kBrick;
+    const size_t brick =
+        (static_cast<size_t>(z / kBrick) * bricks + y / kBrick) * bricks +
+        x / kBrick;
+    const int local =
+        ((z % kBrick) * kBrick + y % kBrick) * kBrick + x % kBrick;
+    return (brick * kBrick * kBrick * kBrick + local) * 3;
+  }
+};
+
+// Everything a TransformPlan bakes for a precision tier. Stages that cannot
+// be baked keep size 0 and run exact.
+//
+// The tables are views into one payload of 32 bit words laid out in, out,
+// cube. The payload is either owned ('storage', after a bake) or a mapped
+// cache file kept alive by 'mapping'.
+struct BakedLut
+{
+  Lut1D in;
+  Lut1D out;
+  Lut3D cube;
+  std::vector<float> storage;
+  std::shared_ptr<const void> mapping;
+
+  BakedLut() = default;
+  BakedLut(const BakedLut&) = delete;
+  BakedLut& operator=(const BakedLut&) = delete;
+
+  size_t words() const
+  {
+    return static_cast<size_t>(in.size) + out.size + cube.words();
+  }
+
+  size_t bytes() const { return sizeof(BakedLut) + sizeof(float) * words(); }
+
+  // start of the contiguous payload, null when nothing is baked
+  const float* payload() const
+  {
+    return in.size ? in.table : out.size ? out.table : cube.table;
+  }
+
+  // points the tables into 'payload', sizes and storage must be set
+  void attach(const float* payload)
+  {
+    in.table = in.size ? payload : nullptr;
+    payload += in.size;
+    out.table = out.size ? payload : nullptr;
+    payload += out.size;
+    cube.table = cube.size ? payload : nullptr;
+  }
+
+  // owned payload for a bake, returns it for writing
+  float* allocate(int inSize, int outSize, int cubeSize, int cubeStorage)
+  {
+    in.size = inSize;
+    out.size = outSize;
+    cube.size = cubeSize;
+    cube.storage = cubeStorage;
+    storage.assign(words(), 0.0f);
+    attach(storage.data());
+    return storage.data();
+  }
+};
+
+// Row-major float cube 'src' of lut.size^3 into the storage of 'lut'
+inline void StoreCube(const Lut3D& lut, const float* src, float* dst)
+{
+  const int n = lut.size;
+  uint16_t* half = reinterpret_cast<uint16_t*>(dst);
+  for(int z = 0; z < n; ++z) {
+    for(int y = 0; y < n; ++y) {
+      for(int x = 0; x < n; ++x) {
+        const size_t from = ((static_cast<size_t>(z) * n + y) * n + x) * 3;
+        const size_t to = lut.offset(x, y, z);
+        for(int c = 0; c < 3; ++c) {
+          if(lut.half()) {
+            half[to + c] = FloatToHalf(src[from + c]);
+          }
+          else {
+            dst[to + c] = src[from + c];
+          }
+        }
+      }
+    }
+  }
+}
+
+namespace LutDetail
+{
+  // all-ones in the lanes where 0 <= x <= 1, NaN fails both compares
+  inline Simd::vfloat InDomain(Simd::vfloat x)
+  {
+    using namespace Simd;
+    return bitAnd(ge(x, set1(0.0f)), le(x, set1(1.0f)));
+  }
+
+  // max() first so NaN lands on 0
+  inline Simd::vfloat Clamp01(Simd::vfloat x)
+  {
+    using namespace Simd;
+    return min(max(x, set1(0.0f)), set1(1.0f));
+  }
+}  // namespace LutDetail
+
+inline Simd::vfloat LookupLut1D(const Lut1D& lut, Simd::vfloat x)
+{
+  using namespace Simd;
+  const float last = static_cast<float>(lut.size - 1);
+  const vfloat pos = mul(LutDetail::Clamp01(x), set1(last));
+  const vfloat index = min(truncate(pos), set1(last - 1.0f));
+  const vfloat frac = sub(pos, index);
+
+  const float* t = lut.table;
+  const vfloat lo = gather(t, index);
+  const vfloat hi = gather(t, add(index, set1(1.0f)));
+  return madd(frac, sub(hi, lo), lo);
+}
+
+namespace LutDetail
+{
+  // channel c of the entries at 'index'
+  template <bool Half>
+  inline Simd::vfloat Fetch(const float* table, int c, Simd::vfloat index)
+  {
+    if(Half) {
+      const uint16_t* half = reinterpret_cast<const uint16_t*>(table);
+      return Simd::gatherHalf(half + c, index);
+    }
+    return Simd::gather(table + c, index);
+  }
+
+  // float offset of lattice points in the bricked layout, same as
+  // Lut3D::offset
+  inline Simd::vfloat TiledOffset(Simd::vfloat x, Simd::vfloat y,
+                                  Simd::vfloat z, float bricks)
+  {
+    using namespace Simd;
+    const float k = static_cast<float>(Lut3D::kBrick);
+    const vfloat inv = set1(1.0f / k);
+    const vfloat xb = truncate(mul(x, inv));
+    const vfloat yb = truncate(mul(y, inv));
+    const vfloat zb = truncate(mul(z, inv));
+    const vfloat xl = sub(x, mul(xb, set1(k)));
+    const vfloat yl = sub(y, mul(yb, set1(k)));
+    const vfloat zl = sub(z, mul(zb, set1(k)));
+    const vfloat brick = madd(madd(zb, set1(bricks), yb), set1(bricks), xb);
+    const vfloat local = madd(madd(zl, set1(k), yl), set1(k), xl);
+    return mul(madd(brick, set1(k * k * k), local), set1(3.0f));
+  }
+
+  // Tetrahedral interpolation without branches: the cell is split along its
+  // main diagonal into six tetrahedra, picked per lane by sorting the three
+  // fractions. c0 and c3 are the diagonal corners, c1 steps along the axis
+  // with the largest fraction, c2 along the two largest.
+  template <bool Half, bool Tiled>
+  inline void Lookup3D(const Lut3D& lut, Simd::vfloat& r, Simd::vfloat& g,
+                       Simd::vfloat& b)
+  {
+    using namespace Simd;
+    const int n = lut.size;
+    const float last = static_cast<float>(n - 1);
+    const vfloat scale = set1(last);
+    const vfloat top = set1(last - 1.0f);
+
+    const vfloat pr = mul(Clamp01(r), scale);
+    const vfloat pg = mul(Clamp01(g), scale);
+    const vfloat pb = mul(Clamp01(b), scale);
+    const vfloat ir = min(truncate(pr), top);
+    const vfloat ig = min(truncate(pg), top);
+    const vfloat ib = min(truncate(pb), top);
+    const vfloat fr = sub(pr, ir);
+    const vfloat fg = sub(pg, ig);
+    const vfloat fb = sub(pb, ib);
+
+    // largest fraction, ties prefer r then g
+    const vfloat rHi = bitAnd(ge(fr, fg), ge(fr, fb));
+    const vfloat gHi = andNot(rHi, ge(fg, fb));
+    const vfloat bHi = andNot(bitOr(rHi, gHi), constBits(0xffffffffu));
+    // smallest fraction, ties prefer b then g
+    const vfloat bLo = bitAnd(le(fb, fr), le(fb, fg));
+    const vfloat gLo = andNot(bLo, le(fg, fr));
+    const vfloat rLo = andNot(bitOr(bLo, gLo), constBits(0xffffffffu));
+
+    // float offsets stay exact, 68^3 * 3 is far below 2^24
+    vfloat c0, c1, c2, c3;
+    if(Tiled) {
+      const float bricks = static_cast<float>(lut.paddedSize() / Lut3D::kBrick);
+      const vfloat one = set1(1.0f);
+      c0 = TiledOffset(ir, ig, ib, bricks);
+      c1 = TiledOffset(add(ir, bitAnd(rHi, one)), add(ig, bitAnd(gHi, one)),
+                       add(ib, bitAnd(bHi, one)), bricks);
+      c2 = TiledOffset(sub(add(ir, one), bitAnd(rLo, one)),
+                       sub(add(ig, one), bitAnd(gLo, one)),
+                       sub(add(ib, one), bitAnd(bLo, one)), bricks);
+      c3 = TiledOffset(add(ir, one), add(ig, one), add(ib, one), bricks);
+    }
+    else {
+      const float strideR = 3.0f;
+      const float strideG = 3.0f * n;
+      const float strideB = 3.0f * n * n;
+      const vfloat diagonal = set1(strideR + strideG + strideB);
+      c0 = madd(ib, set1(strideB),
+                madd(ig, set1(strideG), mul(ir, set1(strideR))));
+      c1 = add(c0, select(rHi, set1(strideR),
+                          select(gHi, set1(strideG), set1(strideB))));
+      c2 = add(c0, sub(diagonal,
+                       select(bLo, set1(strideB),
+                              select(gLo, set1(strideG), set1(strideR)))));
+      c3 = add(c0, diagonal);
+    }
+
+    const vfloat hi = max(max(fr, fg), fb);
+    const vfloat lo = min(min(fr, fg), fb);
+    const vfloat mid = sub(add(add(fr, fg), fb), add(hi, lo));
+
+    const vfloat w0 = sub(set1(1.0f), hi);
+    const vfloat w1 = sub(hi, mid);
+    const vfloat w2 = sub(mid, lo);
+    const vfloat w3 = lo;
+
+    vfloat* channels[3] = {&r, &g, &b};
+    for(int c = 0; c < 3; ++c) {
+      vfloat v = mul(w0, Fetch<Half>(lut.table, c, c0));
+      v = madd(w1, Fetch<Half>(lut.table, c, c1), v);
+      v = madd(w2, Fetch<Half>(lut.table, c, c2), v);
+      v = madd(w3, Fetch<Half>(lut.table, c, c3), v);
+      *channels[c] = v;
+    }
+  }
+}  // namespace LutDetail
+
+inline void LookupLut3D(const Lut3D& lut, Simd::vfloat& r, Simd::vfloat& g,
+                        Simd::vfloat& b)
+{
+  switch(lut.storage) {
+    case Constants::LUT_STORAGE_HALF:
+      LutDetail::Lookup3D<true, false>(lut, r, g, b);
+      break;
+    case Constants::LUT_STORAGE_FLOAT_TILED:
+      LutDetail::Lookup3D<false, true>(lut, r, g, b);
+      break;
+    case Constants::LUT_STORAGE_HALF_TILED:
+      LutDetail::Lookup3D<true, true>(lut, r, g, b);
+      break;
+    default:
+      LutDetail::Lookup3D<false, false>(lut, r, g, b);
+      break;
+  }
+}
+
+#endif  // LUT_H
@@ -0,0 +1,320 @@
+#ifndef LUT_CACHE_H
+#define LUT_CACHE_H
+
+// Process wide cache of baked LUTs, shared by every node instance.
+//
+// Entries are immutable and reference counted: a plan keeps its LUT alive
+// after eviction, the cache only stops handing it out. Lookups take a mutex,
+// a bake runs outside of it and concurrent requests for the same key wait
+// for the first one instead of baking again. Least recently used entries are
+// evicted once the cached bytes exceed the budget, which defaults to
+// kDefaultBudgetMB or GCOLORSPACE_LUT_CACHE_MB from the environment.
+//
+// acquireAsync() never blocks: the bake runs on the ThreadPool and the
+// result is published into every LutHandle that asked for it. A bake is
+// cancelled once all of those handles are gone, i.e. every plan that wanted
+// the table has been replaced by a newer one.
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "include/Lut.h"
+#include "include/ThreadPool.h"
+
+// Resolved transform identity, filled by whoever bakes. Unused words stay 0.
+struct LutKey
+{
+  std::array<uint32_t, 24> words{};
+
+  bool operator==(const LutKey& other) const { return words == other.words; }
+};
+
+struct LutKeyHash
+{
+  // FNV-1a over the key words
+  size_t operator()(const LutKey& key) const
+  {
+    uint64_t h = 14695981039346656037ull;
+    for(uint32_t w : key.words) {
+      for(int i = 0; i < 4; ++i) {
+        h ^= (w >> (8 * i)) & 0xffu;
+        h *= 1099511628211ull;
+      }
+    }
+    return static_cast<size_t>(h);
+  }
+};
+
+// A plan's table. It starts empty when baked in the background and is set
+// exactly once; readers pick it up on their next row.
+class LutHandle
+{
+ public:
+  LutHandle() = default;
+  explicit LutHandle(std::shared_ptr<const BakedLut> lut) { publish(lut); }
+
+  LutHandle(const LutHandle&) = delete;
+  LutHandle& operator=(const LutHandle&) = delete;
+
+  const BakedLut* get() const { return ready.load(std::memory_order_acquire); }
+
+  // owning pointer once published, null before
+  std::shared_ptr<const BakedLut> share() const
+  {
+    return get() != nullptr ? owner : nullptr;
+  }
+
+  void publish(std::shared_ptr<const BakedLut> lut)
+  {
+    owner = std::move(lut);
+    ready.store(owner.get(), std::memory_order_release);
+  }
+
+ private:
+  std::atomic<const BakedLut*> ready{nullptr};
+  std::shared_ptr<const BakedLut> owner;
+};
+
+class LutCache
+{
+ public:
+  using Entry = std::shared_ptr<const BakedLut>;
+
+  static constexpr size_t kDefaultBudgetMB = 256;
+
+  struct Stats
+  {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t cancelled;
+    size_t bytes;
+    size_t budget;
+    size_t entries;
+  };
+
+  static LutCache& instance()
+  {
+    static LutCache cache;
+    return cache;
+  }
+
+  // Cached entry for 'key', baked with bake() -> Entry on a miss
+  template <class Bake>
+  Entry acquire(const LutKey& key, Bake bake)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    auto found = index.find(key);
+    if(found != index.end()) {
+      ++hits;
+      lru.splice(lru.begin(), lru, found->second);
+      return found->second->lut;
+    }
+
+    auto baking = pending.find(key);
+    if(baking != pending.end()) {
+      ++hits;
+      std::shared_future<Entry> result = baking->second;
+      lock.unlock();
+      return result.get();
+    }
+
+    ++misses;
+    std::promise<Entry> promise;
+    pending.emplace(key, promise.get_future().share());
+    lock.unlock();
+
+    Entry lut;
+    try {
+      lut = bake();
+    }
+    catch(...) {
+      lock.lock();
+      pending.erase(key);
+      promise.set_exception(std::current_exception());
+      throw;
+    }
+
+    lock.lock();
+    pending.erase(key);
+    insert(key, lut);
+    lock.unlock();
+
+    promise.set_value(lut);
+    return lut;
+  }
+
+  // Publishes the entry for 'key' into 'handle', now when cached, else when
+  // a background bake(cancelled) -> Entry finishes. bake() should poll
+  // cancelled() and return null once it is true.
+  template <class Bake>
+  void acquireAsync(const LutKey& key, const std::shared_ptr<LutHandle>& handle,
+                    Bake bake)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    auto found = index.find(key);
+    if(found != index.end()) {
+      ++hits;
+      lru.splice(lru.begin(), lru, found->second);
+      Entry lut = found->second->lut;
+      lock.unlock();
+      handle->publish(lut);
+      return;
+    }
+
+    auto running = jobs.find(key);
+    if(running != jobs.end()) {
+      ++hits;
+      running->second->waiters.push_back(handle);
+      return;
+    }
+
+    ++misses;
+    auto job = std::make_shared<Job>();
+    job->waiters.push_back(handle);
+    jobs.emplace(key, job);
+    lock.unlock();
+
+    ThreadPool::instance().submit([this, key, job, bake]() {
+      auto cancelled = [this, &key, &job]() { return obsolete(key, job); };
+      Entry lut;
+      try {
+        lut = bake(cancelled);
+      }
+      catch(...) {
+        // the plans keep running exact
+      }
+      finish(key, job, lut);
+    });
+  }
+
+  void setBudget(size_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = bytes;
+    evict();
+  }
+
+  Stats stats() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return {hits, misses, evictions, cancelled, bytes, budget, index.size()};
+  }
+
+  // drops every entry, plans holding one keep it
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    lru.clear();
+    index.clear();
+    bytes = 0;
+  }
+
+ private:
+  struct Job
+  {
+    std::vector<std::weak_ptr<LutHandle>> waiters;
+  };
+
+  struct Node
+  {
+    LutKey key;
+    Entry lut;
+    size_t bytes;
+  };
+
+  LutCache()
+  {
+    size_t mb = kDefaultBudgetMB;
+    if(const char* env = std::getenv("GCOLORSPACE_LUT_CACHE_MB")) {
+      mb = static_cast<size_t>(std::strtoull(env, nullptr, 10));
+    }
+    budget = mb << 20;
+  }
+
+  // True when no handle wants the result anymore. The job is dropped under
+  // the same lock, so a later request starts a fresh bake instead of
+  // joining a cancelled one.
+  bool obsolete(const LutKey& key, const std::shared_ptr<Job>& job)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(const std::weak_ptr<LutHandle>& w : job->waiters) {
+      if(!w.expired()) return false;
+    }
+    auto running = jobs.find(key);
+    if(running != jobs.end() && running->second == job) {
+      jobs.erase(running);
+      ++cancelled;
+    }
+    return true;
+  }
+
+  void finish(const LutKey& key, const std::shared_ptr<Job>& job,
+              const Entry& lut)
+  {
+    std::vector<std::shared_ptr<LutHandle>> live;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto running = jobs.find(key);
+      if(running == jobs.end() || running->second != job) return;
+      jobs.erase(running);
+      if(lut == nullptr) return;
+
+      insert(key, lut);
+      for(const std::weak_ptr<LutHandle>& w : job->waiters) {
+        if(auto handle = w.lock()) live.push_back(handle);
+      }
+    }
+    for(const std::shared_ptr<LutHandle>& handle : live) {
+      handle->publish(lut);
+    }
+  }
+
+  // an entry larger than the whole budget is handed out uncached, a key
+  // baked twice (sync and async) keeps the first entry
+  void insert(const LutKey& key, const Entry& lut)
+  {
+    const size_t size = lut->bytes();
+    if(size > budget || index.count(key) != 0) return;
+
+    lru.push_front({key, lut, size});
+    index[key] = lru.begin();
+    bytes += size;
+    evict();
+  }
+
+  void evict()
+  {
+    while(bytes > budget && !lru.empty()) {
+      bytes -= lru.back().bytes;
+      index.erase(lru.back().key);
+      lru.pop_back();
+      ++evictions;
+    }
+  }
+
+  mutable std::mutex mutex;
+  std::list<Node> lru;
+  std::unordered_map<LutKey, std::list<Node>::iterator, LutKeyHash> index;
+  std::unordered_map<LutKey, std::shared_future<Entry>, LutKeyHash> pending;
+  std::unordered_map<LutKey, std::shared_ptr<Job>, LutKeyHash> jobs;
+  size_t bytes = 0;
+  size_t budget = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  uint64_t cancelled = 0;
+};
+
+#endif  // LUT_CACHE_H
@@ -0,0 +1,347 @@
+#ifndef LUT_DISK_CACHE_H
+#define LUT_DISK_CACHE_H
+
+// Optional on-disk cache of baked LUTs, so cold farm renders map the tables
+// instead of baking them. Enabled by GCOLORSPACE_LUT_CACHE_DIR or
+// setDirectory(), disabled when the directory is empty.
+//
+// One file per transform, <key hash>-<library version>.gclut:
+//   LutFileHeader, then the BakedLut payload (in, out, cube words).
+// Numbers are native little endian. A load only checks the header and the
+// file size, so mapping a table costs page faults as it is used and not a
+// read of every page. The payload checksum is written at store time and
+// checked on load only with GCOLORSPACE_LUT_CACHE_VERIFY=1 or setVerify().
+// A rejected file is baked again and replaced by the store that follows,
+// never removed: a key mismatch is another transform whose hash collides.
+// Files are written to a temporary name and renamed, so readers never see
+// a partial table.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "include/Constants.h"
+#include "include/Lut.h"
+#include "include/LutCache.h"
+
+struct LutFileHeader
+{
+  char magic[8];
+  uint32_t format;
+  uint32_t headerBytes;
+  char version[16];
+  uint32_t key[24];
+  int32_t inSize;
+  int32_t outSize;
+  int32_t cubeSize;
+  int32_t cubeStorage;
+  uint64_t payloadBytes;
+  uint64_t checksum;
+};
+
+namespace LutDiskDetail
+{
+  // temporary file names only need to differ between processes
+  inline unsigned long ProcessId()
+  {
+#if defined(_WIN32)
+    return static_cast<unsigned long>(_getpid());
+#else
+    return static_cast<unsigned long>(getpid());
+#endif
+  }
+
+  constexpr char kMagic[8] = {'G', 'C', 'S', 'L', 'U', 'T', '\r', '\n'};
+  constexpr uint32_t kFormat = 2;
+
+  // FNV-1a over 32 bit words
+  inline uint64_t Checksum(const float* payload, size_t words)
+  {
+    uint64_t h = 14695981039346656037ull;
+    for(size_t i = 0; i < words; ++i) {
+      uint32_t w;
+      std::memcpy(&w, payload + i, sizeof(w));
+      h ^= w;
+      h *= 1099511628211ull;
+    }
+    return h;
+  }
+
+  inline LutFileHeader MakeHeader(const LutKey& key, const BakedLut& lut)
+  {
+    LutFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.format = kFormat;
+    header.headerBytes = sizeof(LutFileHeader);
+    std::strncpy(header.version, Constants::LIBRARY_VERSION,
+                 sizeof(header.version) - 1);
+    std::memcpy(header.key, key.words.data(), sizeof(header.key));
+    header.inSize = lut.in.size;
+    header.outSize = lut.out.size;
+    header.cubeSize = lut.cube.size;
+    header.cubeStorage = lut.cube.storage;
+    header.payloadBytes = sizeof(float) * lut.words();
+    return header;
+  }
+
+  // header fields that do not depend on the payload
+  inline bool HeaderMatches(const LutFileHeader& header, const LutKey& key,
+                            size_t fileBytes)
+  {
+    LutFileHeader expected;
+    std::memset(&expected, 0, sizeof(expected));
+    std::strncpy(expected.version, Constants::LIBRARY_VERSION,
+                 sizeof(expected.version) - 1);
+
+    if(std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+       header.format != kFormat ||
+       header.headerBytes != sizeof(LutFileHeader) ||
+       std::memcmp(header.version, expected.version, sizeof(expected.version)) !=
+           0 ||
+       std::memcmp(header.key, key.words.data(), sizeof(header.key)) != 0) {
+      return false;
+    }
+    if(header.inSize < 0 || header.outSize < 0 || header.cubeSize < 0 ||
+       header.cubeSize > 256 || header.cubeStorage < 0 ||
+       header.cubeStorage >= Constants::LUT_STORAGE_COUNT) {
+      return false;
+    }
+
+    Lut3D cube;
+    cube.size = header.cubeSize;
+    cube.storage = header.cubeStorage;
+    const uint64_t words = static_cast<uint64_t>(header.inSize) +
+                           header.outSize + cube.words();
+    return header.payloadBytes == sizeof(float) * words &&
+           fileBytes == sizeof(LutFileHeader) + header.payloadBytes;
+  }
+}  // namespace LutDiskDetail
+
+class LutDiskCache
+{
+ public:
+  struct Stats
+  {
+    uint64_t loads;
+    uint64_t stores;
+    uint64_t rejected;
+  };
+
+  static LutDiskCache& instance()
+  {
+    static LutDiskCache cache;
+    return cache;
+  }
+
+  void setDirectory(const std::string& path)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    directory = path;
+  }
+
+  // checksum the payload on every load, reading all of it
+  void setVerify(bool enabled)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    verifyPayload = enabled;
+  }
+
+  // empty when disabled
+  std::string directoryPath() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return directory;
+  }
+
+  std::string path(const LutKey& key) const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if(directory.empty()) return std::string();
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016llx-%s.gclut",
+                  static_cast<unsigned long long>(LutKeyHash()(key)),
+                  Constants::LIBRARY_VERSION);
+    return directory + "/" + name;
+  }
+
+  // Mapped table for 'key', null when disabled, missing or rejected
+  LutCache::Entry load(const LutKey& key)
+  {
+    const std::string file = path(key);
+    if(file.empty()) return nullptr;
+
+    LutCache::Entry lut = read(file, key);
+    if(lut != nullptr) {
+      count(&Stats::loads);
+    }
+    return lut;
+  }
+
+  // Best effort, a failed write only costs the next process a bake
+  void store(const LutKey& key, const BakedLut& lut)
+  {
+    const std::string file = path(key);
+    if(file.empty()) return;
+
+    const float* payload = lut.payload();
+    LutFileHeader stamped = LutDiskDetail::MakeHeader(key, lut);
+    stamped.checksum = LutDiskDetail::Checksum(payload, lut.words());
+
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), ".%lu.tmp",
+                  LutDiskDetail::ProcessId());
+    const std::string temp = file + suffix;
+
+    FILE* f = std::fopen(temp.c_str(), "wb");
+    if(f == nullptr) return;
+    bool ok = std::fwrite(&stamped, sizeof(stamped), 1, f) == 1;
+    if(lut.words() > 0) {
+      ok = ok && std::fwrite(payload, sizeof(float), lut.words(), f) ==
+                     lut.words();
+    }
+    ok = std::fclose(f) == 0 && ok;
+
+    if(!ok || std::rename(temp.c_str(), file.c_str()) != 0) {
+      std::remove(temp.c_str());
+      return;
+    }
+    count(&Stats::stores);
+  }
+
+  Stats stats() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+  }
+
+ private:
+  LutDiskCache()
+  {
+    if(const char* env = std::getenv("GCOLORSPACE_LUT_CACHE_DIR")) {
+      directory = env;
+    }
+    if(const char* env = std::getenv("GCOLORSPACE_LUT_CACHE_VERIFY")) {
+      verifyPayload = std::atoi(env) != 0;
+    }
+  }
+
+  void count(uint64_t Stats::*field)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++(counters.*field);
+  }
+
+  // kept on disk, the store after the bake replaces it
+  LutCache::Entry reject()
+  {
+    count(&Stats::rejected);
+    return nullptr;
+  }
+
+  bool verifying() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return verifyPayload;
+  }
+
+  LutCache::Entry verify(const LutFileHeader& header,
+                         std::shared_ptr<const void> mapping,
+                         const float* payload, std::vector<float> storage)
+  {
+    auto lut = std::make_shared<BakedLut>();
+    lut->in.size = header.inSize;
+    lut->out.size = header.outSize;
+    lut->cube.size = header.cubeSize;
+    lut->cube.storage = header.cubeStorage;
+    if(verifying() &&
+       LutDiskDetail::Checksum(payload, lut->words()) != header.checksum) {
+      return reject();
+    }
+    lut->storage = std::move(storage);
+    lut->mapping = std::move(mapping);
+    lut->attach(lut->storage.empty() ? payload : lut->storage.data());
+    return lut;
+  }
+
+#if !defined(_WIN32)
+  LutCache::Entry read(const std::string& file, const LutKey& key)
+  {
+    const int fd = ::open(file.c_str(), O_RDONLY);
+    if(fd < 0) return nullptr;
+
+    struct stat info;
+    if(::fstat(fd, &info) != 0 ||
+       static_cast<size_t>(info.st_size) < sizeof(LutFileHeader)) {
+      ::close(fd);
+      return reject();
+    }
+
+    const size_t bytes = static_cast<size_t>(info.st_size);
+    void* addr = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(addr == MAP_FAILED) return nullptr;
+
+    std::shared_ptr<const void> mapping(
+        addr, [bytes](const void* p) { ::munmap(const_cast<void*>(p), bytes); });
+
+    LutFileHeader header;
+    std::memcpy(&header, addr, sizeof(header));
+    if(!LutDiskDetail::HeaderMatches(header, key, bytes)) {
+      return reject();
+    }
+
+    const float* payload = reinterpret_cast<const float*>(
+        static_cast<const char*>(addr) + sizeof(LutFileHeader));
+    return verify(header, std::move(mapping), payload, {});
+  }
+#else
+  // no mapping on Windows, the payload is read into the entry
+  LutCache::Entry read(const std::string& file, const LutKey& key)
+  {
+    FILE* f = std::fopen(file.c_str(), "rb");
+    if(f == nullptr) return nullptr;
+
+    LutFileHeader header;
+    std::fseek(f, 0, SEEK_END);
+    const size_t bytes = static_cast<size_t>(std::ftell(f));
+    std::fseek(f, 0, SEEK_SET);
+    if(bytes < sizeof(header) || std::fread(&header, sizeof(header), 1, f) != 1 ||
+       !LutDiskDetail::HeaderMatches(header, key, bytes)) {
+      std::fclose(f);
+      return reject();
+    }
+
+    std::vector<float> storage(header.payloadBytes / sizeof(float));
+    const bool ok = std::fread(storage.data(), sizeof(float), storage.size(),
+                               f) == storage.size();
+    std::fclose(f);
+    if(!ok) return reject();
+
+    const float* payload = storage.data();
+    return verify(header, nullptr, payload, std::move(storage));
+  }
+#endif
+
+  mutable std::mutex mutex;
+  std::string directory;
+  bool verifyPayload = false;
+  Stats counters = {0, 0, 0};
+};
+
+#endif  // LUT_DISK_CACHE_H
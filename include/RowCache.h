@@ -0,0 +1,211 @@
+#ifndef ROW_CACHE_H
+#define ROW_CACHE_H
+
+// Temporal cache of converted rows, for locked-off shots and hold frames
+// where most rows of a frame are the same bits as in the previous one.
+//
+// An entry is one RGB layer of one row span: the input it was converted
+// from and the output. Lookups hash the input span and then compare it
+// with the stored one, so a hash collision costs a conversion, never a
+// wrong row. The key also carries a salt for the resolved transform, so
+// nodes with other settings never see each other's rows.
+//
+// Process wide, split into kShards independently locked shards so render
+// threads rarely wait on each other. Each shard drops its least recently
+// used entries beyond its share of the budget, kDefaultBudgetMB or
+// GCOLORSPACE_ROW_CACHE_MB from the environment.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "include/TransformPlan.h"
+
+class RowCache
+{
+ public:
+  static constexpr size_t kDefaultBudgetMB = 512;
+  static constexpr int kShards = 16;
+
+  struct Stats
+  {
+    uint64_t hits;
+    uint64_t misses;
+    size_t bytes;
+    size_t budget;
+    size_t entries;
+  };
+
+  static RowCache& instance()
+  {
+    static RowCache cache;
+    return cache;
+  }
+
+  // 64 bit multiply-xorshift hash of the n RGB input pixels of 'layer'
+  static uint64_t Hash(uint64_t salt, const PlanarLayer& layer, int n)
+  {
+    uint64_t h = salt ^ (static_cast<uint64_t>(n) * 0x9e3779b97f4a7c15ull);
+    const float* channels[3] = {layer.r, layer.g, layer.b};
+    for(const float* c : channels) {
+      int i = 0;
+      for(; i + 2 <= n; i += 2) {
+        uint64_t w;
+        std::memcpy(&w, c + i, sizeof(w));
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+      }
+      if(i < n) {
+        uint32_t w;
+        std::memcpy(&w, c + i, sizeof(w));
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+      }
+    }
+    return h;
+  }
+
+  // Copies the cached output of 'layer' into its output arrays, false when
+  // the input span was not seen with this salt
+  bool lookup(uint64_t hash, uint64_t salt, const PlanarLayer& layer, int n)
+  {
+    Shard& shard = shards[hash % kShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto found = shard.index.find(hash);
+    if(found == shard.index.end() ||
+       !found->second->matches(salt, layer, n)) {
+      ++shard.misses;
+      return false;
+    }
+    ++shard.hits;
+    shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+
+    const size_t bytes = sizeof(float) * n;
+    const float* out = found->second->pixels.data() + 3 * n;
+    std::memcpy(layer.rOut, out, bytes);
+    std::memcpy(layer.gOut, out + n, bytes);
+    std::memcpy(layer.bOut, out + 2 * n, bytes);
+    return true;
+  }
+
+  // Keeps input and output of a converted layer. Layers converted in place
+  // have lost their input and are skipped.
+  void store(uint64_t hash, uint64_t salt, const PlanarLayer& layer, int n)
+  {
+    if(layer.rOut == layer.r || layer.gOut == layer.g ||
+       layer.bOut == layer.b) {
+      return;
+    }
+
+    Entry entry;
+    entry.hash = hash;
+    entry.salt = salt;
+    entry.n = n;
+    entry.pixels.resize(6 * static_cast<size_t>(n));
+    const float* from[6] = {layer.r,    layer.g,    layer.b,
+                            layer.rOut, layer.gOut, layer.bOut};
+    for(int c = 0; c < 6; ++c) {
+      std::memcpy(entry.pixels.data() + c * static_cast<size_t>(n), from[c],
+                  sizeof(float) * n);
+    }
+
+    Shard& shard = shards[hash % kShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const size_t size = entry.bytes();
+    const size_t share = budget / kShards;
+    if(size > share || shard.index.count(hash) != 0) return;
+
+    shard.lru.push_front(std::move(entry));
+    shard.index[hash] = shard.lru.begin();
+    shard.bytes += size;
+    while(shard.bytes > share && !shard.lru.empty()) {
+      shard.bytes -= shard.lru.back().bytes();
+      shard.index.erase(shard.lru.back().hash);
+      shard.lru.pop_back();
+    }
+  }
+
+  void setBudget(size_t bytes)
+  {
+    budget = bytes;
+    clear();
+  }
+
+  Stats stats() const
+  {
+    Stats s = {0, 0, 0, budget, 0};
+    for(const Shard& shard : shards) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      s.hits += shard.hits;
+      s.misses += shard.misses;
+      s.bytes += shard.bytes;
+      s.entries += shard.index.size();
+    }
+    return s;
+  }
+
+  void clear()
+  {
+    for(Shard& shard : shards) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.lru.clear();
+      shard.index.clear();
+      shard.bytes = 0;
+    }
+  }
+
+ private:
+  // input r, g, b then output r, g, b, n floats each
+  struct Entry
+  {
+    uint64_t hash;
+    uint64_t salt;
+    int n;
+    std::vector<float> pixels;
+
+    size_t bytes() const
+    {
+      return sizeof(Entry) + sizeof(float) * pixels.size();
+    }
+
+    bool matches(uint64_t s, const PlanarLayer& layer, int count) const
+    {
+      if(salt != s || n != count) return false;
+      const size_t bytes = sizeof(float) * n;
+      return std::memcmp(pixels.data(), layer.r, bytes) == 0 &&
+             std::memcmp(pixels.data() + n, layer.g, bytes) == 0 &&
+             std::memcmp(pixels.data() + 2 * n, layer.b, bytes) == 0;
+    }
+  };
+
+  struct Shard
+  {
+    mutable std::mutex mutex;
+    std::list<Entry> lru;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    size_t bytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+
+  RowCache()
+  {
+    size_t mb = kDefaultBudgetMB;
+    if(const char* env = std::getenv("GCOLORSPACE_ROW_CACHE_MB")) {
+      mb = static_cast<size_t>(std::strtoull(env, nullptr, 10));
+    }
+    budget = mb << 20;
+  }
+
+  Shard shards[kShards];
+  std::atomic<size_t> budget{0};
+};
+
+#endif  // ROW_CACHE_H
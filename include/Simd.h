@@ -0,0 +1,377 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Thin SIMD layer shared by the row kernels.
+// AVX builds (the default on UNIX, see CMakeLists.txt) run 8 lanes, anything
+// else falls back to 4 SSE lanes. Only AVX1/SSE2 instructions are used so the
+// plugin keeps the same CPU baseline.
+
+#include <immintrin.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace Simd
+{
+
+#if defined(__AVX__)
+  using vfloat = __m256;
+  constexpr int kWidth = 8;
+
+  inline vfloat set1(float v) { return _mm256_set1_ps(v); }
+  inline vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+  inline void store(float* p, vfloat v) { _mm256_storeu_ps(p, v); }
+  inline vfloat add(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+  inline vfloat sub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+  inline vfloat mul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+  inline vfloat div(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+  inline vfloat min(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+  inline vfloat max(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+  inline vfloat bitAnd(vfloat a, vfloat b) { return _mm256_and_ps(a, b); }
+  inline vfloat bitOr(vfloat a, vfloat b) { return _mm256_or_ps(a, b); }
+  inline vfloat bitXor(vfloat a, vfloat b) { return _mm256_xor_ps(a, b); }
+  inline vfloat andNot(vfloat a, vfloat b) { return _mm256_andnot_ps(a, b); }
+  inline vfloat lt(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  inline vfloat le(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+  inline vfloat gt(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  inline vfloat ge(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+  inline vfloat eq(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+  inline vfloat isNan(vfloat a) { return _mm256_cmp_ps(a, a, _CMP_UNORD_Q); }
+  // plain bitwise select: GCC scalarizes blendv on AVX1-only targets
+  inline vfloat select(vfloat mask, vfloat a, vfloat b)
+  {
+    return _mm256_or_ps(_mm256_and_ps(mask, a), _mm256_andnot_ps(mask, b));
+  }
+  inline bool any(vfloat mask) { return _mm256_movemask_ps(mask) != 0; }
+  // round to nearest integer, result stays a float
+  inline vfloat round(vfloat a)
+  {
+    return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  }
+  inline vfloat fromBits(vfloat a)
+  {
+    return _mm256_cvtepi32_ps(_mm256_castps_si256(a));
+  }
+  inline vfloat toBits(vfloat a)
+  {
+    return _mm256_castsi256_ps(_mm256_cvtps_epi32(a));
+  }
+  inline vfloat constBits(uint32_t v)
+  {
+    return _mm256_castsi256_ps(_mm256_set1_epi32(static_cast<int>(v)));
+  }
+
+  // 8 interleaved RGBA pixels (v0..v3) <-> one register per channel. The
+  // 128 bit halves are paired first (px 0|4, 1|5, 2|6, 3|7) so the in-lane
+  // unpacks and shuffles finish the 4x4 transposes.
+  inline void deinterleave4(vfloat v0, vfloat v1, vfloat v2, vfloat v3,
+                            vfloat& r, vfloat& g, vfloat& b, vfloat& a)
+  {
+    const vfloat p04 = _mm256_permute2f128_ps(v0, v2, 0x20);
+    const vfloat p15 = _mm256_permute2f128_ps(v0, v2, 0x31);
+    const vfloat p26 = _mm256_permute2f128_ps(v1, v3, 0x20);
+    const vfloat p37 = _mm256_permute2f128_ps(v1, v3, 0x31);
+    const vfloat rg01 = _mm256_unpacklo_ps(p04, p15);
+    const vfloat ba01 = _mm256_unpackhi_ps(p04, p15);
+    const vfloat rg23 = _mm256_unpacklo_ps(p26, p37);
+    const vfloat ba23 = _mm256_unpackhi_ps(p26, p37);
+    r = _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(1, 0, 1, 0));
+    g = _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(3, 2, 3, 2));
+    b = _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(1, 0, 1, 0));
+    a = _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(3, 2, 3, 2));
+  }
+
+  inline void interleave4(vfloat r, vfloat g, vfloat b, vfloat a, vfloat& v0,
+                          vfloat& v1, vfloat& v2, vfloat& v3)
+  {
+    const vfloat rg01 = _mm256_unpacklo_ps(r, g);
+    const vfloat rg23 = _mm256_unpackhi_ps(r, g);
+    const vfloat ba01 = _mm256_unpacklo_ps(b, a);
+    const vfloat ba23 = _mm256_unpackhi_ps(b, a);
+    const vfloat p04 = _mm256_shuffle_ps(rg01, ba01, _MM_SHUFFLE(1, 0, 1, 0));
+    const vfloat p15 = _mm256_shuffle_ps(rg01, ba01, _MM_SHUFFLE(3, 2, 3, 2));
+    const vfloat p26 = _mm256_shuffle_ps(rg23, ba23, _MM_SHUFFLE(1, 0, 1, 0));
+    const vfloat p37 = _mm256_shuffle_ps(rg23, ba23, _MM_SHUFFLE(3, 2, 3, 2));
+    v0 = _mm256_permute2f128_ps(p04, p15, 0x20);
+    v1 = _mm256_permute2f128_ps(p26, p37, 0x20);
+    v2 = _mm256_permute2f128_ps(p04, p15, 0x31);
+    v3 = _mm256_permute2f128_ps(p26, p37, 0x31);
+  }
+#else
+  using vfloat = __m128;
+  constexpr int kWidth = 4;
+
+  inline vfloat set1(float v) { return _mm_set1_ps(v); }
+  inline vfloat load(const float* p) { return _mm_loadu_ps(p); }
+  inline void store(float* p, vfloat v) { _mm_storeu_ps(p, v); }
+  inline vfloat add(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+  inline vfloat sub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+  inline vfloat mul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+  inline vfloat div(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+  inline vfloat min(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+  inline vfloat max(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+  inline vfloat bitAnd(vfloat a, vfloat b) { return _mm_and_ps(a, b); }
+  inline vfloat bitOr(vfloat a, vfloat b) { return _mm_or_ps(a, b); }
+  inline vfloat bitXor(vfloat a, vfloat b) { return _mm_xor_ps(a, b); }
+  inline vfloat andNot(vfloat a, vfloat b) { return _mm_andnot_ps(a, b); }
+  inline vfloat lt(vfloat a, vfloat b) { return _mm_cmplt_ps(a, b); }
+  inline vfloat le(vfloat a, vfloat b) { return _mm_cmple_ps(a, b); }
+  inline vfloat gt(vfloat a, vfloat b) { return _mm_cmpgt_ps(a, b); }
+  inline vfloat ge(vfloat a, vfloat b) { return _mm_cmpge_ps(a, b); }
+  inline vfloat eq(vfloat a, vfloat b) { return _mm_cmpeq_ps(a, b); }
+  inline vfloat isNan(vfloat a) { return _mm_cmpunord_ps(a, a); }
+  inline vfloat select(vfloat mask, vfloat a, vfloat b)
+  {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+  }
+  inline bool any(vfloat mask) { return _mm_movemask_ps(mask) != 0; }
+  inline vfloat round(vfloat a)
+  {
+    return _mm_cvtepi32_ps(_mm_cvtps_epi32(a));
+  }
+  inline vfloat fromBits(vfloat a)
+  {
+    return _mm_cvtepi32_ps(_mm_castps_si128(a));
+  }
+  inline vfloat toBits(vfloat a)
+  {
+    return _mm_castsi128_ps(_mm_cvtps_epi32(a));
+  }
+  inline vfloat constBits(uint32_t v)
+  {
+    return _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(v)));
+  }
+
+  inline void deinterleave4(vfloat v0, vfloat v1, vfloat v2, vfloat v3,
+                            vfloat& r, vfloat& g, vfloat& b, vfloat& a)
+  {
+    _MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+    r = v0;
+    g = v1;
+    b = v2;
+    a = v3;
+  }
+
+  inline void interleave4(vfloat r, vfloat g, vfloat b, vfloat a, vfloat& v0,
+                          vfloat& v1, vfloat& v2, vfloat& v3)
+  {
+    _MM_TRANSPOSE4_PS(r, g, b, a);
+    v0 = r;
+    v1 = g;
+    v2 = b;
+    v3 = a;
+  }
+#endif
+
+  inline vfloat madd(vfloat a, vfloat b, vfloat c)
+  {
+#if defined(__FMA__) && defined(__AVX__)
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return add(mul(a, b), c);
+#endif
+  }
+
+  inline vfloat abs(vfloat a) { return andNot(set1(-0.0f), a); }
+
+  // copy the sign bit of 's' onto 'a'
+  inline vfloat copySign(vfloat a, vfloat s)
+  {
+    const vfloat signMask = set1(-0.0f);
+    return bitOr(andNot(signMask, a), bitAnd(signMask, s));
+  }
+
+  // Natural logarithm, cephes logf polynomial (~1 ulp on normal inputs).
+  // Matches libm on the special values: log(0) = -inf, log(x < 0) = NaN,
+  // log(inf) = inf, NaN propagates.
+  inline vfloat log(vfloat x)
+  {
+    const vfloat one = set1(1.0f);
+    const vfloat zero = set1(0.0f);
+
+    // rescale denormals so the exponent extraction below stays valid
+    const vfloat denormal = lt(x, set1(1.17549435e-38f));
+    vfloat v = select(denormal, mul(x, set1(8388608.0f)), x);
+    vfloat bias = select(denormal, set1(-23.0f), zero);
+
+    // exponent as float: the masked bits are an exact multiple of 2^23
+    vfloat e = fromBits(bitAnd(v, constBits(0x7F800000u)));
+    e = madd(e, set1(1.0f / 8388608.0f), set1(-126.0f));
+    e = add(e, bias);
+
+    // mantissa in [0.5, 1)
+    vfloat m = bitOr(bitAnd(v, constBits(0x007FFFFFu)), set1(0.5f));
+
+    const vfloat small = lt(m, set1(0.707106781186547524f));
+    e = sub(e, bitAnd(small, one));
+    m = add(sub(m, one), bitAnd(small, m));
+
+    const vfloat z = mul(m, m);
+    vfloat y = set1(7.0376836292E-2f);
+    y = madd(y, m, set1(-1.1514610310E-1f));
+    y = madd(y, m, set1(1.1676998740E-1f));
+    y = madd(y, m, set1(-1.2420140846E-1f));
+    y = madd(y, m, set1(1.4249322787E-1f));
+    y = madd(y, m, set1(-1.6668057665E-1f));
+    y = madd(y, m, set1(2.0000714765E-1f));
+    y = madd(y, m, set1(-2.4999993993E-1f));
+    y = madd(y, m, set1(3.3333331174E-1f));
+    y = mul(mul(y, m), z);
+
+    y = madd(e, set1(-2.12194440e-4f), y);
+    y = madd(z, set1(-0.5f), y);
+    vfloat r = add(m, y);
+    r = madd(e, set1(0.693359375f), r);
+
+    const vfloat inf = set1(INFINITY);
+    r = select(eq(x, zero), set1(-INFINITY), r);
+    r = select(eq(x, inf), inf, r);
+    r = select(bitOr(lt(x, zero), isNan(x)), set1(NAN), r);
+    return r;
+  }
+
+  // Natural exponential, cephes expf polynomial (~1 ulp).
+  // Overflow gives inf, results below FLT_MIN flush to zero, NaN propagates.
+  inline vfloat exp(vfloat x)
+  {
+    const vfloat hi = set1(88.7228390f);
+    const vfloat lo = set1(-87.3365448f);
+    const vfloat xc = min(max(x, lo), hi);
+
+    vfloat n = round(mul(xc, set1(1.44269504088896341f)));
+    vfloat r = madd(n, set1(-0.693359375f), xc);
+    r = madd(n, set1(2.12194440e-4f), r);
+
+    const vfloat z = mul(r, r);
+    vfloat y = set1(1.9875691500E-4f);
+    y = madd(y, r, set1(1.3981999507E-3f));
+    y = madd(y, r, set1(8.3334519073E-3f));
+    y = madd(y, r, set1(4.1665795894E-2f));
+    y = madd(y, r, set1(1.6666665459E-1f));
+    y = madd(y, r, set1(5.0000001201E-1f));
+    y = madd(y, z, add(r, set1(1.0f)));
+
+    // 2^n built from the exponent bits, n = 128 is folded into the mantissa
+    const vfloat big = gt(n, set1(127.0f));
+    y = select(big, add(y, y), y);
+    n = select(big, set1(127.0f), n);
+    const vfloat pow2n = toBits(mul(add(n, set1(127.0f)), set1(8388608.0f)));
+    y = mul(y, pow2n);
+
+    y = select(gt(x, hi), set1(INFINITY), y);
+    y = select(lt(x, lo), set1(0.0f), y);
+    y = select(isNan(x), x, y);
+    return y;
+  }
+
+  // round toward zero, result stays a float
+  inline vfloat truncate(vfloat a)
+  {
+#if defined(__AVX__)
+    return _mm256_round_ps(a, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+#else
+    return _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+#endif
+  }
+
+  // table[idx] per lane, idx holds non-negative integral floats
+  inline vfloat gather(const float* table, vfloat idx)
+  {
+#if defined(__AVX2__)
+    return _mm256_i32gather_ps(table, _mm256_cvttps_epi32(idx), 4);
+#else
+    float lanes[kWidth];
+    store(lanes, idx);
+    for(int i = 0; i < kWidth; ++i) {
+      lanes[i] = table[static_cast<int>(lanes[i])];
+    }
+    return load(lanes);
+#endif
+  }
+
+  // kWidth interleaved RGBA pixels <-> one vector per channel
+  inline void loadRGBA(const float* p, vfloat& r, vfloat& g, vfloat& b,
+                       vfloat& a)
+  {
+    deinterleave4(load(p), load(p + kWidth), load(p + 2 * kWidth),
+                  load(p + 3 * kWidth), r, g, b, a);
+  }
+
+  inline void storeRGBA(float* p, vfloat r, vfloat g, vfloat b, vfloat a)
+  {
+    vfloat v0, v1, v2, v3;
+    interleave4(r, g, b, a, v0, v1, v2, v3);
+    store(p, v0);
+    store(p + kWidth, v1);
+    store(p + 2 * kWidth, v2);
+    store(p + 3 * kWidth, v3);
+  }
+
+  // Runs 'kernel' over n floats, the tail goes through a padded block so
+  // every element takes the exact same vector path.
+  template <typename Kernel>
+  inline void forEach(const float* src, float* dst, int n, Kernel kernel)
+  {
+    int i = 0;
+    for(; i + kWidth <= n; i += kWidth) {
+      store(dst + i, kernel(load(src + i)));
+    }
+
+    if(i < n) {
+      float tail[kWidth] = {};
+      std::memcpy(tail, src + i, sizeof(float) * (n - i));
+      store(tail, kernel(load(tail)));
+      std::memcpy(dst + i, tail, sizeof(float) * (n - i));
+    }
+  }
+
+  // Same as forEach for three planar channels converted together, from
+  // (sa, sb, sc) into (a, b, c). The kernel receives the three lanes by
+  // reference. Each block is loaded whole before it is stored, so an output
+  // may be the very array of an input; partially overlapping arrays are not
+  // supported.
+  template <typename Kernel>
+  inline void forEach3(const float* sa, const float* sb, const float* sc,
+                       float* a, float* b, float* c, int n, Kernel kernel)
+  {
+    int i = 0;
+    for(; i + kWidth <= n; i += kWidth) {
+      vfloat x = load(sa + i);
+      vfloat y = load(sb + i);
+      vfloat z = load(sc + i);
+      kernel(x, y, z);
+      store(a + i, x);
+      store(b + i, y);
+      store(c + i, z);
+    }
+
+    if(i < n) {
+      const size_t bytes = sizeof(float) * (n - i);
+      float ta[kWidth] = {}, tb[kWidth] = {}, tc[kWidth] = {};
+      std::memcpy(ta, sa + i, bytes);
+      std::memcpy(tb, sb + i, bytes);
+      std::memcpy(tc, sc + i, bytes);
+      vfloat x = load(ta);
+      vfloat y = load(tb);
+      vfloat z = load(tc);
+      kernel(x, y, z);
+      store(ta, x);
+      store(tb, y);
+      store(tc, z);
+      std::memcpy(a + i, ta, bytes);
+      std::memcpy(b + i, tb, bytes);
+      std::memcpy(c + i, tc, bytes);
+    }
+  }
+
+  // three planar channels converted in place
+  template <typename Kernel>
+  inline void forEach3(float* a, float* b, float* c, int n, Kernel kernel)
+  {
+    forEach3(a, b, c, a, b, c, n, kernel);
+  }
+
+}  // namespace Simd
+
+#endif  // SIMD_H
@@ -0,0 +1,245 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Background worker threads for work that must not block the render
+// threads (LUT bakes). Half the hardware threads by default, or
+// GCOLORSPACE_BAKE_THREADS.
+//
+// ParallelFor is the blocking counterpart for the standalone tools, which
+// split a frame over short-lived threads and wait for all of them.
+// WorkerTeam does the same on long-lived threads without allocating per
+// call, for hosts that convert many small images (the C API) and for the
+// tools' file coders (CoderTeam), which go through a sequence frame after
+// frame.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+ public:
+  static ThreadPool& instance()
+  {
+    static ThreadPool pool(DefaultThreads());
+    return pool;
+  }
+
+  explicit ThreadPool(unsigned threads)
+  {
+    for(unsigned i = 0; i < std::max(threads, 1u); ++i) {
+      workers.emplace_back([this]() { work(); });
+    }
+  }
+
+  // queued tasks still run before the workers exit
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& t : workers) t.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(std::function<void()> task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+  }
+
+  size_t size() const { return workers.size(); }
+
+ private:
+  static unsigned DefaultThreads()
+  {
+    if(const char* env = std::getenv("GCOLORSPACE_BAKE_THREADS")) {
+      return static_cast<unsigned>(std::strtoul(env, nullptr, 10));
+    }
+    return std::thread::hardware_concurrency() / 2;
+  }
+
+  void work()
+  {
+    for(;;) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+        if(tasks.empty()) return;
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<std::function<void()>> tasks;
+  std::vector<std::thread> workers;
+  bool stopping = false;
+};
+
+// Runs fn(index, worker) for index in [0, count) on 'threads' threads (all
+// hardware threads when 0), the calling one included. 'worker' is in
+// [0, threads), for per-thread scratch.
+template <typename Fn>
+inline void ParallelFor(int count, int threads, Fn fn)
+{
+  if(threads <= 0) {
+    threads = static_cast<int>(std::thread::hardware_concurrency());
+  }
+  threads = std::max(1, std::min(threads, count));
+  std::atomic<int> next(0);
+  auto work = [&](int worker) {
+    for(int i = next++; i < count; i = next++) fn(i, worker);
+  };
+  std::vector<std::thread> pool;
+  for(int t = 1; t < threads; ++t) pool.emplace_back(work, t);
+  work(0);
+  for(std::thread& t : pool) t.join();
+}
+
+// Persistent threads that help whoever calls run(). Jobs live on the
+// caller's stack and are linked into a list, so a call allocates nothing;
+// concurrent calls share the threads. Each job takes at most 'threads' - 1
+// helpers, the caller always works on its own job too.
+class WorkerTeam
+{
+ public:
+  explicit WorkerTeam(unsigned threads)
+  {
+    for(unsigned i = 0; i < threads; ++i) {
+      workers.emplace_back([this]() { work(); });
+    }
+  }
+
+  ~WorkerTeam()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& t : workers) t.join();
+  }
+
+  WorkerTeam(const WorkerTeam&) = delete;
+  WorkerTeam& operator=(const WorkerTeam&) = delete;
+
+  size_t size() const { return workers.size(); }
+
+  // fn(index) for index in [0, count) on up to 'threads' threads (all of the
+  // team and the caller when 0), returns when all are done
+  template <typename Fn>
+  void run(int count, int threads, Fn& fn)
+  {
+    const int limit = static_cast<int>(workers.size()) + 1;
+    threads = threads <= 0 ? limit : std::min(threads, limit);
+    threads = std::min(threads, count);
+    if(threads <= 1) {
+      for(int i = 0; i < count; ++i) fn(i);
+      return;
+    }
+
+    Job job;
+    job.call = [](void* context, int i) { (*static_cast<Fn*>(context))(i); };
+    job.context = &fn;
+    job.count = count;
+    job.helpers = threads - 1;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job.next = jobs;
+      jobs = &job;
+    }
+    wake.notify_all();
+
+    work(job);
+
+    // nobody joins once unlinked, then wait for the helpers inside
+    std::unique_lock<std::mutex> lock(mutex);
+    for(Job** p = &jobs; *p != nullptr; p = &(*p)->next) {
+      if(*p == &job) {
+        *p = job.next;
+        break;
+      }
+    }
+    idle.wait(lock, [&job]() { return job.active == 0; });
+  }
+
+ private:
+  struct Job
+  {
+    void (*call)(void* context, int i);
+    void* context;
+    int count;
+    std::atomic<int> index{0};
+    // guarded by the team mutex
+    int helpers;
+    int active = 0;
+    Job* next = nullptr;
+  };
+
+  static void work(Job& job)
+  {
+    for(int i = job.index++; i < job.count; i = job.index++) {
+      job.call(job.context, i);
+    }
+  }
+
+  // a listed job that still has work and room for a helper
+  Job* open() const
+  {
+    for(Job* job = jobs; job != nullptr; job = job->next) {
+      if(job->helpers > 0 && job->index < job->count) return job;
+    }
+    return nullptr;
+  }
+
+  void work()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    for(;;) {
+      Job* job = nullptr;
+      wake.wait(lock, [&]() { return stopping || (job = open()) != nullptr; });
+      if(job == nullptr) return;
+      --job->helpers;
+      ++job->active;
+      lock.unlock();
+      work(*job);
+      lock.lock();
+      if(--job->active == 0) idle.notify_all();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable idle;
+  Job* jobs = nullptr;
+  std::vector<std::thread> workers;
+  bool stopping = false;
+};
+
+// Team of the EXR and DPX coders: a thread per core with the caller
+inline WorkerTeam& CoderTeam()
+{
+  static WorkerTeam team(std::max(1u, std::thread::hardware_concurrency()) -
+                         1);
+  return team;
+}
+
+#endif  // THREAD_POOL_H
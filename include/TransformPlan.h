@@ -0,0 +1,1040 @@
+#ifndef TRANSFORM_PLAN_H
+#define TRANSFORM_PLAN_H
+
+// Host independent transform core, no DDImage.
+//
+// A TransformPlan resolves the node settings once: the in and out curve
+// stages and the white adaptation matrix. Each vector of pixels then goes
+// through in curve -> white matrix -> out curve -> removeExp in registers.
+// The same pipeline runs on planar rows (Nuke) and on interleaved RGBA
+// float/half buffers (review player, image servers), where channels are
+// split and merged with shuffles and alpha is carried through untouched.
+// A .cube file (CubeLut) can run as an extra stage before the in curve or
+// after the out curve.
+//
+// The LUT precision tiers bake the exact pipeline once into 1D curve tables
+// or a 3D cube, taken from the process wide LutCache so nodes with the same
+// resolved transform share one table, and from LutDiskCache across renders.
+// Pixels outside the table domain still run exact. With backgroundBake the
+// plan is usable right away: rows run exact until the ThreadPool publishes
+// the table, then switch to it. PRECISION_AUTO times the tiers once per
+// transform and CPU model (Autotuner) and keeps the fastest accurate one.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "include/Autotune.h"
+#include "include/ColorData.h"
+#include "include/Constants.h"
+#include "include/CubeLut.h"
+#include "include/Dispatcher.h"
+#include "include/GammaCurve.h"
+#include "include/Half.h"
+#include "include/LogCurve.h"
+#include "include/Lut.h"
+#include "include/LutCache.h"
+#include "include/LutDiskCache.h"
+#include "include/Simd.h"
+#include "include/ThreadPool.h"
+#include "include/Whitepoint.h"
+#include "include/YCbCr.h"
+#include "include/aliases.h"
+
+// Node settings, defaults match a fresh GColorspace node
+struct TransformSettings
+{
+  int colorIn = Constants::COLOR_LINEAR;
+  int colorOut = Constants::COLOR_LINEAR;
+  int whiteIn = Constants::WHITE_D65;
+  int whiteOut = Constants::WHITE_D65;
+  int primaryIn = Constants::PRIM_COLOR_SRGB;
+  int primaryOut = Constants::PRIM_COLOR_SRGB;
+  int ycbcrMatrix = Constants::YCC_REC709;
+  int ycbcrRange = Constants::YCC_RANGE_LEGAL;
+  bool bradford = false;
+  bool bitExact = false;
+  int precision = Constants::PRECISION_EXACT;
+  // bake LUT tiers on the ThreadPool and run exact until the table is ready
+  bool backgroundBake = false;
+  // PRECISION_AUTO: largest accepted error against the bit-exact pipeline,
+  // absolute below 1 and relative above
+  float tolerance = 1e-3f;
+  // entry type and ordering of 3D LUTs
+  int lutStorage = Constants::LUT_STORAGE_FLOAT;
+  // .cube file run before the in curve or after the out curve, null for
+  // none. The 3D precision tiers bake it into their cube.
+  std::shared_ptr<const CubeLut> lutFile;
+  int lutFilePosition = Constants::LUT_FILE_BEFORE;
+};
+
+struct CurveStage;
+using StageKernel = void (*)(const CurveStage& stage, Simd::vfloat& r,
+                             Simd::vfloat& g, Simd::vfloat& b);
+
+// One curve direction. 'kernel' always runs, it falls back to calling
+// 'scalar' per lane when the curve has no vector form.
+struct CurveStage
+{
+  StageKernel kernel;
+  TransformDispatcher scalar;
+  const LogCurveCoeffs* log;
+  YCbCrCoeffs ycbcr;
+};
+
+struct TransformPlan
+{
+  TransformSettings settings;
+  bool identity;
+  // the curves and matrix pass pixels through, only a LUT file runs
+  bool curvesIdentity;
+  CurveStage in;
+  CurveStage out;
+  XYZMat white;
+  std::shared_ptr<LutHandle> lut;  // null or not ready yet runs exact
+};
+
+namespace TransformDetail
+{
+  inline void Linear(const CurveStage&, Simd::vfloat&, Simd::vfloat&,
+                     Simd::vfloat&)
+  {
+  }
+
+  inline void Scalar(const CurveStage& stage, Simd::vfloat& r,
+                     Simd::vfloat& g, Simd::vfloat& b)
+  {
+    using namespace Simd;
+    float lr[kWidth], lg[kWidth], lb[kWidth];
+    store(lr, r);
+    store(lg, g);
+    store(lb, b);
+    for(int i = 0; i < kWidth; ++i) {
+      const RGBcolor rgb = stage.scalar({lr[i], lg[i], lb[i]});
+      lr[i] = rgb[0];
+      lg[i] = rgb[1];
+      lb[i] = rgb[2];
+    }
+    r = load(lr);
+    g = load(lg);
+    b = load(lb);
+  }
+
+  template <bool Toe, bool Mirror, bool Range>
+  struct LogIn
+  {
+    static void run(const CurveStage& stage, Simd::vfloat& r, Simd::vfloat& g,
+                    Simd::vfloat& b)
+    {
+      const LogCurveCoeffs& k = *stage.log;
+      r = LogCurveDetail::InVector<Toe, Mirror, Range>(k, r);
+      g = LogCurveDetail::InVector<Toe, Mirror, Range>(k, g);
+      b = LogCurveDetail::InVector<Toe, Mirror, Range>(k, b);
+    }
+  };
+
+  template <bool Toe, bool Mirror, bool Range>
+  struct LogOut
+  {
+    static void run(const CurveStage& stage, Simd::vfloat& r, Simd::vfloat& g,
+                    Simd::vfloat& b)
+    {
+      const LogCurveCoeffs& k = *stage.log;
+      r = LogCurveDetail::OutVector<Toe, Mirror, Range>(k, r);
+      g = LogCurveDetail::OutVector<Toe, Mirror, Range>(k, g);
+      b = LogCurveDetail::OutVector<Toe, Mirror, Range>(k, b);
+    }
+  };
+
+  template <int Num, int Den>
+  struct Gamma
+  {
+    static void run(const CurveStage&, Simd::vfloat& r, Simd::vfloat& g,
+                    Simd::vfloat& b)
+    {
+      r = GammaPowVector<Num, Den>(r);
+      g = GammaPowVector<Num, Den>(g);
+      b = GammaPowVector<Num, Den>(b);
+    }
+  };
+
+  inline void YCbCrInStage(const CurveStage& stage, Simd::vfloat& r,
+                           Simd::vfloat& g, Simd::vfloat& b)
+  {
+    YCbCrInVector(stage.ycbcr, r, g, b);
+  }
+
+  inline void YCbCrOutStage(const CurveStage& stage, Simd::vfloat& r,
+                            Simd::vfloat& g, Simd::vfloat& b)
+  {
+    YCbCrOutVector(stage.ycbcr, r, g, b);
+  }
+
+  // The scalar YCbCr/YPbPr functions are Rec.709 legal, anything else needs
+  // the engine even in bit-exact mode
+  inline bool UseYCbCr(const TransformSettings& s, int colorspace,
+                       YCbCrCoeffs& coeffs)
+  {
+    const bool analog = colorspace == Constants::COLOR_Y_PB_PR;
+    if(colorspace != Constants::COLOR_Y_CB_CR && !analog) {
+      return false;
+    }
+
+    const bool scalarMatch =
+        s.ycbcrMatrix == Constants::YCC_REC709 &&
+        (analog || s.ycbcrRange == Constants::YCC_RANGE_LEGAL);
+    if(s.bitExact && scalarMatch) {
+      return false;
+    }
+
+    coeffs = MakeYCbCrCoeffs(s.ycbcrMatrix, s.ycbcrRange, analog);
+    return true;
+  }
+
+  inline CurveStage MakeStage(const TransformSettings& s, int colorspace,
+                              bool in)
+  {
+    CurveStage stage;
+    stage.scalar = in ? TransformInDispatcher(colorspace)
+                      : TransformOutDispatcher(colorspace);
+    stage.log = nullptr;
+    stage.ycbcr = YCbCrCoeffs();
+    stage.kernel = &Scalar;
+
+    if(colorspace == Constants::COLOR_LINEAR) {
+      stage.kernel = &Linear;
+      return stage;
+    }
+
+    if(UseYCbCr(s, colorspace, stage.ycbcr)) {
+      stage.kernel = in ? &YCbCrInStage : &YCbCrOutStage;
+      return stage;
+    }
+
+    // log and power curves have vector kernels, bit-exact keeps the
+    // scalar functions
+    if(s.bitExact) {
+      return stage;
+    }
+
+    stage.log = LogCurveFor(colorspace);
+    if(stage.log != nullptr) {
+      stage.kernel = in ? LogCurveDetail::Select<LogIn>(stage.log->flags)
+                        : LogCurveDetail::Select<LogOut>(stage.log->flags);
+      return stage;
+    }
+
+    const StageKernel gamma = in ? GammaDetail::SelectIn<Gamma>(colorspace)
+                                 : GammaDetail::SelectOut<Gamma>(colorspace);
+    if(gamma != nullptr) {
+      stage.kernel = gamma;
+    }
+    return stage;
+  }
+
+  constexpr int kLut1DSize = 4096;
+
+  // Curves that mix the channels cannot be baked per channel
+  inline bool IsSeparable(int colorspace)
+  {
+    switch(colorspace) {
+      case Constants::COLOR_LINEAR:
+      case Constants::COLOR_HSV:
+      case Constants::COLOR_HSL:
+      case Constants::COLOR_Y_PB_PR:
+      case Constants::COLOR_Y_CB_CR:
+      case Constants::COLOR_CIE_XYZ:
+      case Constants::COLOR_CIE_YXY:
+      case Constants::COLOR_LAB:
+      case Constants::COLOR_CIE_LCH:
+        return false;
+      default:
+        return true;
+    }
+  }
+
+  inline void RemoveExp(Simd::vfloat& r, Simd::vfloat& g, Simd::vfloat& b)
+  {
+    using namespace Simd;
+    const vfloat tiny = set1(1e-10f);
+    r = andNot(lt(abs(r), tiny), r);
+    g = andNot(lt(abs(g), tiny), g);
+    b = andNot(lt(abs(b), tiny), b);
+  }
+
+  // One curve stage, from its 1D table when baked. Out of domain lanes run
+  // the stage kernel.
+  inline void RunStage(const CurveStage& stage, const Lut1D* lut,
+                       Simd::vfloat& r, Simd::vfloat& g, Simd::vfloat& b)
+  {
+    using namespace Simd;
+    if(lut == nullptr || lut->size == 0) {
+      stage.kernel(stage, r, g, b);
+      return;
+    }
+
+    const vfloat rIn = LutDetail::InDomain(r);
+    const vfloat gIn = LutDetail::InDomain(g);
+    const vfloat bIn = LutDetail::InDomain(b);
+    const vfloat inside = bitAnd(bitAnd(rIn, gIn), bIn);
+
+    vfloat lr = LookupLut1D(*lut, r);
+    vfloat lg = LookupLut1D(*lut, g);
+    vfloat lb = LookupLut1D(*lut, b);
+    if(any(andNot(inside, constBits(0xffffffffu)))) {
+      stage.kernel(stage, r, g, b);
+      lr = select(rIn, lr, r);
+      lg = select(gIn, lg, g);
+      lb = select(bIn, lb, b);
+    }
+    r = lr;
+    g = lg;
+    b = lb;
+  }
+
+  // in curve -> white matrix -> out curve -> removeExp on one vector
+  inline void RunCurves(const TransformPlan& plan, const BakedLut* lut,
+                        Simd::vfloat& r, Simd::vfloat& g, Simd::vfloat& b)
+  {
+    using namespace Simd;
+    RunStage(plan.in, lut ? &lut->in : nullptr, r, g, b);
+
+    // same operation order as toXYZMat
+    const XYZMat& m = plan.white;
+    vfloat x = add(add(mul(set1(m[0]), r), mul(set1(m[1]), g)),
+                   mul(set1(m[2]), b));
+    vfloat y = add(add(mul(set1(m[3]), r), mul(set1(m[4]), g)),
+                   mul(set1(m[5]), b));
+    vfloat z = add(add(mul(set1(m[6]), r), mul(set1(m[7]), g)),
+                   mul(set1(m[8]), b));
+
+    RunStage(plan.out, lut ? &lut->out : nullptr, x, y, z);
+
+    RemoveExp(x, y, z);
+    r = x;
+    g = y;
+    b = z;
+  }
+
+  // the curves with the plan's LUT file before or after them
+  inline void RunExact(const TransformPlan& plan, const BakedLut* lut,
+                       Simd::vfloat& r, Simd::vfloat& g, Simd::vfloat& b)
+  {
+    const CubeLut* file = plan.settings.lutFile.get();
+    const bool after =
+        plan.settings.lutFilePosition == Constants::LUT_FILE_AFTER;
+    if(file != nullptr && !after) ApplyCubeLut(*file, r, g, b);
+    if(!plan.curvesIdentity) RunCurves(plan, lut, r, g, b);
+    if(file != nullptr && after) ApplyCubeLut(*file, r, g, b);
+  }
+
+  // 'lut' is the plan's table as read once per row, null runs exact
+  inline void Run(const TransformPlan& plan, const BakedLut* lut,
+                  Simd::vfloat& r, Simd::vfloat& g, Simd::vfloat& b)
+  {
+    using namespace Simd;
+    if(lut == nullptr || lut->cube.size == 0) {
+      RunExact(plan, lut, r, g, b);
+      return;
+    }
+
+    const vfloat inside =
+        bitAnd(bitAnd(LutDetail::InDomain(r), LutDetail::InDomain(g)),
+               LutDetail::InDomain(b));
+    vfloat lr = r, lg = g, lb = b;
+    LookupLut3D(lut->cube, lr, lg, lb);
+    RemoveExp(lr, lg, lb);
+
+    if(any(andNot(inside, constBits(0xffffffffu)))) {
+      RunExact(plan, lut, r, g, b);
+      lr = select(inside, lr, r);
+      lg = select(inside, lg, g);
+      lb = select(inside, lb, b);
+    }
+    r = lr;
+    g = lg;
+    b = lb;
+  }
+
+  // 'exact' sampled over [0, 1] into kLut1DSize floats, the ramp goes
+  // through all three channels
+  inline void BakeStage(const CurveStage& exact, float* table)
+  {
+    std::vector<float> g(kLut1DSize), b(kLut1DSize);
+    for(int i = 0; i < kLut1DSize; ++i) {
+      table[i] = g[i] = b[i] = static_cast<float>(i) / (kLut1DSize - 1);
+    }
+    Simd::forEach3(table, g.data(), b.data(), kLut1DSize,
+                   [&exact](Simd::vfloat& x, Simd::vfloat& y, Simd::vfloat& z) {
+                     exact.kernel(exact, x, y, z);
+                   });
+  }
+
+  // The whole exact pipeline sampled on a size^3 lattice, one r row at a
+  // time. Gives up between b slices once cancelled() is true.
+  template <class Cancelled>
+  bool BakeCube(const TransformPlan& exact, int size, float* table,
+                const Cancelled& cancelled)
+  {
+    std::vector<float> r(size), g(size), b(size);
+    const float step = 1.0f / (size - 1);
+    for(int bi = 0; bi < size; ++bi) {
+      if(cancelled()) return false;
+      for(int gi = 0; gi < size; ++gi) {
+        for(int ri = 0; ri < size; ++ri) {
+          r[ri] = ri * step;
+          g[ri] = gi * step;
+          b[ri] = bi * step;
+        }
+        Simd::forEach3(r.data(), g.data(), b.data(), size,
+                       [&exact](Simd::vfloat& x, Simd::vfloat& y,
+                                Simd::vfloat& z) {
+                         Run(exact, nullptr, x, y, z);
+                       });
+        for(int ri = 0; ri < size; ++ri) {
+          *table++ = r[ri];
+          *table++ = g[ri];
+          *table++ = b[ri];
+        }
+      }
+    }
+    return true;
+  }
+
+  // Everything the baked tables depend on. Primaries and the out whitepoint
+  // only matter through 'identity'.
+  inline LutKey MakeLutKey(const TransformPlan& plan)
+  {
+    const TransformSettings& s = plan.settings;
+    LutKey key;
+    int w = 0;
+    key.words[w++] = static_cast<uint32_t>(s.precision);
+    key.words[w++] = static_cast<uint32_t>(s.colorIn);
+    key.words[w++] = static_cast<uint32_t>(s.colorOut);
+    key.words[w++] = static_cast<uint32_t>(s.ycbcrMatrix);
+    key.words[w++] = static_cast<uint32_t>(s.ycbcrRange);
+    key.words[w++] = s.bitExact;
+    key.words[w++] = plan.identity;
+    for(float m : plan.white) {
+      std::memcpy(&key.words[w++], &m, sizeof(float));
+    }
+    key.words[w++] = static_cast<uint32_t>(s.lutStorage);
+    // word 17 is the auto tolerance
+    w = 18;
+    if(s.lutFile != nullptr) {
+      key.words[w++] = static_cast<uint32_t>(s.lutFile->hash);
+      key.words[w++] = static_cast<uint32_t>(s.lutFile->hash >> 32);
+      key.words[w++] = static_cast<uint32_t>(s.lutFilePosition) + 1;
+    }
+    return key;
+  }
+
+  // null when cancelled
+  template <class Cancelled>
+  std::shared_ptr<const BakedLut> Bake(const TransformPlan& exact,
+                                       const Cancelled& cancelled)
+  {
+    const TransformSettings& s = exact.settings;
+    int inSize = 0;
+    int outSize = 0;
+    int cubeSize = 0;
+    if(s.precision == Constants::PRECISION_LUT_1D) {
+      inSize = IsSeparable(s.colorIn) ? kLut1DSize : 0;
+      outSize = IsSeparable(s.colorOut) ? kLut1DSize : 0;
+    }
+    else if(s.precision == Constants::PRECISION_LUT_3D_33) {
+      cubeSize = 33;
+    }
+    else if(s.precision == Constants::PRECISION_LUT_3D_65) {
+      cubeSize = 65;
+    }
+
+    auto lut = std::make_shared<BakedLut>();
+    float* payload = lut->allocate(inSize, outSize, cubeSize, s.lutStorage);
+    if(inSize) BakeStage(exact.in, payload);
+    if(outSize) BakeStage(exact.out, payload + inSize);
+    if(cubeSize == 0) return lut;
+
+    // other storages are converted from a row-major float bake
+    float* cube = payload + inSize + outSize;
+    if(s.lutStorage == Constants::LUT_STORAGE_FLOAT) {
+      return BakeCube(exact, cubeSize, cube, cancelled) ? lut : nullptr;
+    }
+    std::vector<float> rowMajor(static_cast<size_t>(cubeSize) * cubeSize *
+                                cubeSize * 3);
+    if(!BakeCube(exact, cubeSize, rowMajor.data(), cancelled)) {
+      return nullptr;
+    }
+    StoreCube(lut->cube, rowMajor.data(), cube);
+    return lut;
+  }
+
+  // mapped from the disk cache when a valid file exists, else baked and
+  // written back
+  template <class Cancelled>
+  LutCache::Entry LoadOrBake(const TransformPlan& exact, const LutKey& key,
+                             const Cancelled& cancelled)
+  {
+    LutDiskCache& disk = LutDiskCache::instance();
+    LutCache::Entry lut = disk.load(key);
+    if(lut == nullptr) {
+      lut = Bake(exact, cancelled);
+      if(lut != nullptr) disk.store(key, *lut);
+    }
+    return lut;
+  }
+
+  inline const BakedLut* CurrentLut(const TransformPlan& plan)
+  {
+    return plan.lut ? plan.lut->get() : nullptr;
+  }
+}  // namespace TransformDetail
+
+namespace TransformDetail
+{
+  inline TransformPlan ResolveAuto(const TransformPlan& plan);
+}
+
+inline TransformPlan MakeTransformPlan(const TransformSettings& s)
+{
+  TransformPlan plan;
+  plan.settings = s;
+
+  // if the colorspace matches the output the pixels pass through
+  plan.curvesIdentity = s.colorIn == s.colorOut && s.whiteIn == s.whiteOut &&
+                        s.primaryIn == s.primaryOut;
+  plan.identity = plan.curvesIdentity && s.lutFile == nullptr;
+
+  plan.in = TransformDetail::MakeStage(s, s.colorIn, true);
+  plan.out = TransformDetail::MakeStage(s, s.colorOut, false);
+
+  const float* srcWhite = WhitepointDispatcher(Constants::WHITE_D65);
+  const float* dstWhite = WhitepointDispatcher(s.whiteIn);
+  const float* catMat = CatDispatcher(s.bradford);
+  plan.white = calcWhite(srcWhite, dstWhite, catMat);
+
+  // only the tiers with something to bake go through the cache
+  const bool curveTier =
+      s.precision == Constants::PRECISION_LUT_1D &&
+      (TransformDetail::IsSeparable(s.colorIn) ||
+       TransformDetail::IsSeparable(s.colorOut));
+  const bool cubeTier = s.precision == Constants::PRECISION_LUT_3D_33 ||
+                        s.precision == Constants::PRECISION_LUT_3D_65;
+  // a LUT file alone is a table already
+  if(plan.curvesIdentity) {
+    return plan;
+  }
+  if(s.precision == Constants::PRECISION_AUTO) {
+    return TransformDetail::ResolveAuto(plan);
+  }
+  if(!(curveTier || cubeTier)) {
+    return plan;
+  }
+
+  const LutKey key = TransformDetail::MakeLutKey(plan);
+  if(s.backgroundBake) {
+    // the bake works on its own copy of the still exact plan
+    const TransformPlan exact = plan;
+    plan.lut = std::make_shared<LutHandle>();
+    LutCache::instance().acquireAsync(
+        key, plan.lut, [exact, key](const std::function<bool()>& cancelled) {
+          return TransformDetail::LoadOrBake(exact, key, cancelled);
+        });
+  }
+  else {
+    auto never = []() { return false; };
+    plan.lut = std::make_shared<LutHandle>(LutCache::instance().acquire(
+        key, [&plan, &key, &never]() {
+          return TransformDetail::LoadOrBake(plan, key, never);
+        }));
+  }
+
+  return plan;
+}
+
+// Planar rows converted from (r, g, b) into (rOut, gOut, bOut) in one
+// streaming pass. An output may be the same array as its input (in place),
+// partially overlapping rows are not supported.
+inline void ApplyPlanar(const TransformPlan& plan, const float* r,
+                        const float* g, const float* b, float* rOut,
+                        float* gOut, float* bOut, int n)
+{
+  if(plan.identity) {
+    const size_t bytes = sizeof(float) * n;
+    if(rOut != r) std::memcpy(rOut, r, bytes);
+    if(gOut != g) std::memcpy(gOut, g, bytes);
+    if(bOut != b) std::memcpy(bOut, b, bytes);
+    return;
+  }
+
+  const BakedLut* lut = TransformDetail::CurrentLut(plan);
+  Simd::forEach3(r, g, b, rOut, gOut, bOut, n,
+                 [&plan, lut](Simd::vfloat& x, Simd::vfloat& y,
+                              Simd::vfloat& z) {
+                   TransformDetail::Run(plan, lut, x, y, z);
+                 });
+}
+
+// Planar rows converted in place
+inline void ApplyPlanar(const TransformPlan& plan, float* r, float* g,
+                        float* b, int n)
+{
+  ApplyPlanar(plan, r, g, b, r, g, b, n);
+}
+
+namespace TransformDetail
+{
+  // Pixel reuse for flat and posterized content. Every pixel's result only
+  // depends on its own RGB, so computing a colour once and broadcasting it
+  // gives the same bits as running the kernel on each pixel.
+  enum ReuseModes { REUSE_NONE, REUSE_RUNS, REUSE_MEMO };
+
+  constexpr int kReuseProbes = 32;
+  // a run this long is cheaper broadcast than run through the kernel
+  constexpr int kMinRun = 16;
+  constexpr int kMemoBits = 8;
+
+  inline uint32_t Bits(float v)
+  {
+    uint32_t u;
+    std::memcpy(&u, &v, sizeof(u));
+    return u;
+  }
+
+  // bitwise, so runs of NaN or -0 are found too
+  inline bool SameColor(const float* r, const float* g, const float* b,
+                        int i, int j)
+  {
+    return Bits(r[i]) == Bits(r[j]) && Bits(g[i]) == Bits(g[j]) &&
+           Bits(b[i]) == Bits(b[j]);
+  }
+
+  inline uint32_t MemoSlot(const uint32_t* key)
+  {
+    return (key[0] * 0x9e3779b1u ^ key[1] * 0x85ebca77u ^
+            key[2] * 0xc2b2ae3du) >>
+           (32 - kMemoBits);
+  }
+
+  // Samples a few pixel pairs of the row: many equal neighbours mean runs,
+  // few distinct colours mean posterized content, anything else is treated
+  // as a noisy plate and runs the plain kernel.
+  inline int ProbeReuse(const float* r, const float* g, const float* b, int n)
+  {
+    if(n < 4 * kReuseProbes) return REUSE_NONE;
+
+    const int step = n / kReuseProbes;
+    int equal = 0;
+    int distinct[9];
+    int distinctCount = 0;
+    for(int k = 0; k < kReuseProbes; ++k) {
+      const int i = k * step;
+      if(SameColor(r, g, b, i, i + 1)) ++equal;
+      bool seen = false;
+      for(int d = 0; d < distinctCount && !seen; ++d) {
+        seen = SameColor(r, g, b, i, distinct[d]);
+      }
+      if(!seen && distinctCount < 9) distinct[distinctCount++] = i;
+    }
+    if(equal >= kReuseProbes / 4) return REUSE_RUNS;
+    if(distinctCount <= 8) return REUSE_MEMO;
+    return REUSE_NONE;
+  }
+
+  // one colour through the kernel
+  template <typename Kernel>
+  inline void RunColor(float r, float g, float b, float* out, Kernel& kernel)
+  {
+    using namespace Simd;
+    vfloat x = set1(r), y = set1(g), z = set1(b);
+    kernel(x, y, z);
+    float lanes[kWidth];
+    store(lanes, x);
+    out[0] = lanes[0];
+    store(lanes, y);
+    out[1] = lanes[0];
+    store(lanes, z);
+    out[2] = lanes[0];
+  }
+
+  // Runs of at least kMinRun identical pixels are converted once and
+  // filled, the pixels between them go through the kernel as usual
+  template <typename Kernel>
+  inline void ApplyRuns(const float* r, const float* g, const float* b,
+                        float* rOut, float* gOut, float* bOut, int n,
+                        Kernel& kernel)
+  {
+    int start = 0;
+    int i = 0;
+    while(i < n) {
+      int j = i + 1;
+      while(j < n && SameColor(r, g, b, i, j)) ++j;
+      if(j - i >= kMinRun) {
+        Simd::forEach3(r + start, g + start, b + start, rOut + start,
+                       gOut + start, bOut + start, i - start, kernel);
+        float color[3];
+        RunColor(r[i], g[i], b[i], color, kernel);
+        std::fill(rOut + i, rOut + j, color[0]);
+        std::fill(gOut + i, gOut + j, color[1]);
+        std::fill(bOut + i, bOut + j, color[2]);
+        start = j;
+      }
+      i = j;
+    }
+    Simd::forEach3(r + start, g + start, b + start, rOut + start,
+                   gOut + start, bOut + start, n - start, kernel);
+  }
+
+  // Direct mapped memo of the colours seen in this row. Misses are
+  // collected into one vector and converted together.
+  template <typename Kernel>
+  inline void ApplyMemo(const float* r, const float* g, const float* b,
+                        float* rOut, float* gOut, float* bOut, int n,
+                        Kernel& kernel)
+  {
+    using namespace Simd;
+    constexpr int kSlots = 1 << kMemoBits;
+    uint32_t keys[kSlots][3];
+    float values[kSlots][3];
+    bool used[kSlots] = {};
+
+    float pr[kWidth], pg[kWidth], pb[kWidth];
+    int pixel[kWidth];
+    int pending = 0;
+
+    auto flush = [&]() {
+      vfloat x = load(pr), y = load(pg), z = load(pb);
+      kernel(x, y, z);
+      float xr[kWidth], yr[kWidth], zr[kWidth];
+      store(xr, x);
+      store(yr, y);
+      store(zr, z);
+      for(int k = 0; k < pending; ++k) {
+        const int i = pixel[k];
+        rOut[i] = xr[k];
+        gOut[i] = yr[k];
+        bOut[i] = zr[k];
+
+        const uint32_t key[3] = {Bits(pr[k]), Bits(pg[k]), Bits(pb[k])};
+        const uint32_t slot = MemoSlot(key);
+        std::memcpy(keys[slot], key, sizeof(key));
+        values[slot][0] = xr[k];
+        values[slot][1] = yr[k];
+        values[slot][2] = zr[k];
+        used[slot] = true;
+      }
+      pending = 0;
+    };
+
+    for(int i = 0; i < n; ++i) {
+      const uint32_t key[3] = {Bits(r[i]), Bits(g[i]), Bits(b[i])};
+      const uint32_t slot = MemoSlot(key);
+      if(used[slot] && std::memcmp(keys[slot], key, sizeof(key)) == 0) {
+        rOut[i] = values[slot][0];
+        gOut[i] = values[slot][1];
+        bOut[i] = values[slot][2];
+        continue;
+      }
+      // read now, in place the output may overwrite it before the flush
+      pr[pending] = r[i];
+      pg[pending] = g[i];
+      pb[pending] = b[i];
+      pixel[pending] = i;
+      if(++pending == kWidth) flush();
+    }
+    if(pending > 0) {
+      for(int k = pending; k < kWidth; ++k) {
+        pr[k] = pg[k] = pb[k] = 0.0f;
+      }
+      flush();
+    }
+  }
+}  // namespace TransformDetail
+
+// One RGB triplet of a batch, source and destination as for ApplyPlanar
+struct PlanarLayer
+{
+  const float* r;
+  const float* g;
+  const float* b;
+  float* rOut;
+  float* gOut;
+  float* bOut;
+};
+
+// Several layers of n pixels each (beauty and AOVs of a row) in one call.
+// The plan is looked up once, so every layer sees the same LUT even when a
+// background bake lands halfway through the batch. Runs of identical pixels
+// and rows of few colours are converted once per colour, a probe of each
+// layer keeps noisy plates on the plain kernel.
+inline void ApplyPlanar(const TransformPlan& plan, const PlanarLayer* layers,
+                        int count, int n)
+{
+  if(plan.identity) {
+    for(int i = 0; i < count; ++i) {
+      const PlanarLayer& l = layers[i];
+      ApplyPlanar(plan, l.r, l.g, l.b, l.rOut, l.gOut, l.bOut, n);
+    }
+    return;
+  }
+
+  const BakedLut* lut = TransformDetail::CurrentLut(plan);
+  auto kernel = [&plan, lut](Simd::vfloat& x, Simd::vfloat& y,
+                             Simd::vfloat& z) {
+    TransformDetail::Run(plan, lut, x, y, z);
+  };
+  for(int i = 0; i < count; ++i) {
+    const PlanarLayer& l = layers[i];
+    switch(TransformDetail::ProbeReuse(l.r, l.g, l.b, n)) {
+      case TransformDetail::REUSE_RUNS:
+        TransformDetail::ApplyRuns(l.r, l.g, l.b, l.rOut, l.gOut, l.bOut, n,
+                                   kernel);
+        break;
+      case TransformDetail::REUSE_MEMO:
+        TransformDetail::ApplyMemo(l.r, l.g, l.b, l.rOut, l.gOut, l.bOut, n,
+                                   kernel);
+        break;
+      default:
+        Simd::forEach3(l.r, l.g, l.b, l.rOut, l.gOut, l.bOut, n, kernel);
+        break;
+    }
+  }
+}
+
+// Interleaved RGBA float pixels converted in place, alpha is not modified
+inline void ApplyRGBA(const TransformPlan& plan, float* rgba, int n)
+{
+  using namespace Simd;
+  if(plan.identity) return;
+
+  const BakedLut* lut = TransformDetail::CurrentLut(plan);
+  int i = 0;
+  for(; i + kWidth <= n; i += kWidth) {
+    float* p = rgba + 4 * i;
+    vfloat r, g, b, a;
+    loadRGBA(p, r, g, b, a);
+    TransformDetail::Run(plan, lut, r, g, b);
+    storeRGBA(p, r, g, b, a);
+  }
+
+  if(i < n) {
+    const size_t bytes = sizeof(float) * 4 * (n - i);
+    float tail[4 * kWidth] = {};
+    std::memcpy(tail, rgba + 4 * i, bytes);
+    vfloat r, g, b, a;
+    loadRGBA(tail, r, g, b, a);
+    TransformDetail::Run(plan, lut, r, g, b);
+    storeRGBA(tail, r, g, b, a);
+    std::memcpy(rgba + 4 * i, tail, bytes);
+  }
+}
+
+// Interleaved RGBA half pixels converted in place. Alpha is restored from
+// the source bits so NaN payloads survive the float round trip too.
+inline void ApplyRGBA(const TransformPlan& plan, uint16_t* rgba, int n)
+{
+  using namespace Simd;
+  if(plan.identity) return;
+
+  const BakedLut* lut = TransformDetail::CurrentLut(plan);
+  auto block = [&plan, lut](uint16_t* p) {
+    uint16_t alpha[kWidth];
+    for(int j = 0; j < kWidth; ++j) alpha[j] = p[4 * j + 3];
+
+    vfloat r, g, b, a;
+    deinterleave4(loadHalf(p), loadHalf(p + kWidth), loadHalf(p + 2 * kWidth),
+                  loadHalf(p + 3 * kWidth), r, g, b, a);
+    TransformDetail::Run(plan, lut, r, g, b);
+
+    vfloat v0, v1, v2, v3;
+    interleave4(r, g, b, a, v0, v1, v2, v3);
+    storeHalf(p, v0);
+    storeHalf(p + kWidth, v1);
+    storeHalf(p + 2 * kWidth, v2);
+    storeHalf(p + 3 * kWidth, v3);
+
+    for(int j = 0; j < kWidth; ++j) p[4 * j + 3] = alpha[j];
+  };
+
+  int i = 0;
+  for(; i + kWidth <= n; i += kWidth) {
+    block(rgba + 4 * i);
+  }
+
+  if(i < n) {
+    const size_t bytes = sizeof(uint16_t) * 4 * (n - i);
+    uint16_t tail[4 * kWidth] = {};
+    std::memcpy(tail, rgba + 4 * i, bytes);
+    block(tail);
+    std::memcpy(rgba + 4 * i, tail, bytes);
+  }
+}
+
+namespace TransformDetail
+{
+  // Deterministic probe pixels: mostly inside the LUT domain, the rest
+  // spread over negatives and highlights that run exact
+  inline void MakeProbe(std::vector<float>& r, std::vector<float>& g,
+                        std::vector<float>& b)
+  {
+    const int n = 16384;
+    r.resize(n);
+    g.resize(n);
+    b.resize(n);
+    uint32_t state = 0x2545f491u;
+    auto next = [&state]() {
+      state = state * 1664525u + 1013904223u;
+      return static_cast<float>(state >> 8) / 16777216.0f;
+    };
+    for(int i = 0; i < n; ++i) {
+      const bool wide = (i & 7) == 7;
+      const float lo = wide ? -0.25f : 0.0f;
+      const float range = wide ? 2.25f : 1.0f;
+      r[i] = lo + range * next();
+      g[i] = lo + range * next();
+      b[i] = lo + range * next();
+    }
+  }
+
+  // NaN on one side only counts as an infinite error
+  inline double ProbeError(const std::vector<float>& ref,
+                           const std::vector<float>& test)
+  {
+    double worst = 0.0;
+    for(size_t i = 0; i < ref.size(); ++i) {
+      if(std::isnan(ref[i]) || std::isnan(test[i])) {
+        if(std::isnan(ref[i]) != std::isnan(test[i])) {
+          return std::numeric_limits<double>::infinity();
+        }
+        continue;
+      }
+      const double scale = std::max(1.0, std::fabs(double(ref[i])));
+      worst = std::max(worst, std::fabs(double(test[i]) - ref[i]) / scale);
+    }
+    return worst;
+  }
+
+  // Times every tier on the probe and returns the fastest one within
+  // s.tolerance. Exact always qualifies, it is what the user gets without
+  // a LUT anyway.
+  inline int Tune(const TransformSettings& s)
+  {
+    using Clock = std::chrono::steady_clock;
+    std::vector<float> r, g, b;
+    MakeProbe(r, g, b);
+    const int n = static_cast<int>(r.size());
+
+    TransformSettings ref = s;
+    ref.precision = Constants::PRECISION_EXACT;
+    ref.bitExact = true;
+    ref.backgroundBake = false;
+    std::vector<float> refR = r, refG = g, refB = b;
+    ApplyPlanar(MakeTransformPlan(ref), refR.data(), refG.data(),
+                refB.data(), n);
+
+    const int candidates[] = {
+        Constants::PRECISION_EXACT, Constants::PRECISION_LUT_1D,
+        Constants::PRECISION_LUT_3D_33, Constants::PRECISION_LUT_3D_65};
+    int best = Constants::PRECISION_EXACT;
+    double bestTime = std::numeric_limits<double>::infinity();
+
+    for(int precision : candidates) {
+      if(precision == Constants::PRECISION_LUT_1D &&
+         !IsSeparable(s.colorIn) && !IsSeparable(s.colorOut)) {
+        continue;
+      }
+
+      TransformSettings t = s;
+      t.precision = precision;
+      t.backgroundBake = false;
+      const TransformPlan plan = MakeTransformPlan(t);
+
+      std::vector<float> outR = r, outG = g, outB = b;
+      ApplyPlanar(plan, outR.data(), outG.data(), outB.data(), n);
+      const double error = std::max({ProbeError(refR, outR),
+                                     ProbeError(refG, outG),
+                                     ProbeError(refB, outB)});
+      if(precision != Constants::PRECISION_EXACT && !(error <= s.tolerance)) {
+        continue;
+      }
+
+      // best of a few runs, the first one also warms the table
+      double seconds = std::numeric_limits<double>::infinity();
+      for(int run = 0; run < 5; ++run) {
+        const Clock::time_point start = Clock::now();
+        ApplyPlanar(plan, r.data(), g.data(), b.data(), outR.data(),
+                    outG.data(), outB.data(), n);
+        seconds = std::min(
+            seconds, std::chrono::duration<double>(Clock::now() - start).count());
+      }
+      if(seconds < bestTime) {
+        bestTime = seconds;
+        best = precision;
+      }
+    }
+    return best;
+  }
+
+  // the LUT key of the auto plan plus the tolerance
+  inline LutKey AutoKey(const TransformPlan& plan)
+  {
+    LutKey key = MakeLutKey(plan);
+    std::memcpy(&key.words[17], &plan.settings.tolerance, sizeof(float));
+    return key;
+  }
+
+  inline int TuneAndRecord(const TransformSettings& s, const LutKey& key)
+  {
+    int best = Autotuner::instance().lookup(key);
+    if(best < 0) {
+      best = Tune(s);
+      Autotuner::instance().record(key, best);
+    }
+    return best;
+  }
+
+  // A known decision resolves right away. Otherwise tuning runs in place,
+  // or with backgroundBake on the ThreadPool while the plan runs exact, and
+  // the winning table is published into the plan's handle.
+  inline TransformPlan ResolveAuto(const TransformPlan& plan)
+  {
+    const TransformSettings& s = plan.settings;
+    const LutKey key = AutoKey(plan);
+
+    int precision = Autotuner::instance().lookup(key);
+    if(precision < 0 && !s.backgroundBake) {
+      precision = TuneAndRecord(s, key);
+    }
+    if(precision >= 0) {
+      TransformSettings t = s;
+      t.precision = precision;
+      return MakeTransformPlan(t);
+    }
+
+    TransformPlan exact = plan;
+    exact.lut = std::make_shared<LutHandle>();
+    std::weak_ptr<LutHandle> handle = exact.lut;
+    ThreadPool::instance().submit([s, key, handle]() {
+      // the knob moved on before tuning started
+      if(handle.expired()) return;
+
+      TransformSettings t = s;
+      t.precision = TuneAndRecord(s, key);
+      t.backgroundBake = false;
+      const TransformPlan tuned = MakeTransformPlan(t);
+      std::shared_ptr<LutHandle> target = handle.lock();
+      if(target != nullptr && tuned.lut != nullptr) {
+        target->publish(tuned.lut->share());
+      }
+    });
+    return exact;
+  }
+}  // namespace TransformDetail
+
+#endif  // TRANSFORM_PLAN_H
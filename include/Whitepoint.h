@@ -1,9 +1,8 @@
 #ifndef WHITEPOINT_H
 #define WHITEPOINT_H
 
-#include <DDImage/DDMath.h>
-#include <DDImage/Matrix3.h>
-#include <DDImage/Vector3.h>
+// Chromatic adaptation on plain row-major 3x3 matrices (XYZMat), so the
+// transform core builds without DDImage. Results are laid out for toXYZMat.
 
 #include <algorithm>
 #include <array>
@@ -12,74 +11,81 @@
 #include "include/ColorData.h"
 #include "include/aliases.h"
 
-Matrix3 transpose(Matrix3 m)
+inline XYZMat setMatrix(const float* m)
 {
-  return Matrix3(m.array()[0], m.array()[1], m.array()[2], m.array()[3],
-                 m.array()[4], m.array()[5], m.array()[6], m.array()[7],
-                 m.array()[8]);
+  return {m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], m[8]};
 }
 
-Matrix3 setMatrix(const float* m)
+inline XYZMat diag(const RGBcolor& v)
 {
-  return Matrix3(m[0], m[3], m[6], m[1], m[4], m[7], m[2], m[5], m[8]);
+  return {v[0], 0.0f, 0.0f, 0.0f, v[1], 0.0f, 0.0f, 0.0f, v[2]};
 }
 
-Matrix3 diag(Vector3 v)
+inline XYZMat multiply(const XYZMat& a, const XYZMat& b)
 {
-  return Matrix3(v[0], 0.0f, 0.0f, 0.0f, v[1], 0.0f, 0.0f, 0.0f, v[2]);
+  XYZMat m;
+  for(int row = 0; row < 3; ++row) {
+    for(int col = 0; col < 3; ++col) {
+      m[row * 3 + col] = a[row * 3] * b[col] + a[row * 3 + 1] * b[3 + col] +
+                         a[row * 3 + 2] * b[6 + col];
+    }
+  }
+  return m;
 }
 
-Vector3 xyY_to_XYZ(const float* xyY)
+inline RGBcolor multiply(const XYZMat& a, const RGBcolor& v)
 {
-  Vector3 XYZ;
-  float x = xyY[0];
-  float y = xyY[1];
-  float Y = 0.0f;
-  size_t xyYSize = sizeof(xyY) / sizeof(xyY[0]);
-
-  if(xyYSize == 2) {
-    Y = 1.0f;
-  }
-  else {
-    Y = xyY[2];
-  }
-
-  XYZ.set(x * Y / MAX(y, 1e-10f), Y, (1.0f - x - y) * Y / MAX(y, 1e-10f));
+  return {a[0] * v[0] + a[1] * v[1] + a[2] * v[2],
+          a[3] * v[0] + a[4] * v[1] + a[5] * v[2],
+          a[6] * v[0] + a[7] * v[1] + a[8] * v[2]};
+}
 
-  return XYZ;
+inline XYZMat inverse(const XYZMat& m)
+{
+  const float c00 = m[4] * m[8] - m[5] * m[7];
+  const float c01 = m[5] * m[6] - m[3] * m[8];
+  const float c02 = m[3] * m[7] - m[4] * m[6];
+  const float det = m[0] * c00 + m[1] * c01 + m[2] * c02;
+  const float inv = 1.0f / det;
+
+  return {c00 * inv,
+          (m[2] * m[7] - m[1] * m[8]) * inv,
+          (m[1] * m[5] - m[2] * m[4]) * inv,
+          c01 * inv,
+          (m[0] * m[8] - m[2] * m[6]) * inv,
+          (m[2] * m[3] - m[0] * m[5]) * inv,
+          c02 * inv,
+          (m[1] * m[6] - m[0] * m[7]) * inv,
+          (m[0] * m[4] - m[1] * m[3]) * inv};
 }
 
-Matrix3 calcWhite(const float* srcWhite, const float* dstWhite,
-                  const float* catMat)
+// whitepoints are stored as xy, Y is 1
+inline RGBcolor xyY_to_XYZ(const float* xyY)
 {
-  Matrix3 crmtx;
-  Vector3 srcXYZ;
-  Vector3 dstXYZ;
-  Vector3 srcCrmtx;
-  Vector3 dstCrmtx;
-  Matrix3 vonKriesMatrix;
-  Matrix3 catMatrix;
+  const float x = xyY[0];
+  const float y = std::max(xyY[1], 1e-10f);
+  return {x / y, 1.0f, (1.0f - x - xyY[1]) / y};
+}
 
+// Von Kries adaptation from srcWhite to dstWhite in the cone space of catMat
+inline XYZMat calcWhite(const float* srcWhite, const float* dstWhite,
+                        const float* catMat)
+{
   if(catMat == nullptr) {
-    catMatrix.makeIdentity();
-    return catMatrix;
+    return setMatrix(matIdentity);
   }
 
-  crmtx = setMatrix(catMat);
-
-  // Get XYZ values from xy chromaticity coords
-  srcXYZ = xyY_to_XYZ(srcWhite);
-  dstXYZ = xyY_to_XYZ(dstWhite);
-
-  // Calculate source and destination cone response matrices
-  srcCrmtx = transpose(crmtx) * srcXYZ;
-  dstCrmtx = transpose(crmtx) * dstXYZ;
+  const XYZMat crmtx = setMatrix(catMat);
 
-  vonKriesMatrix = diag(dstCrmtx / srcCrmtx);
+  // Calculate source and destination cone responses
+  const RGBcolor srcCone = multiply(crmtx, xyY_to_XYZ(srcWhite));
+  const RGBcolor dstCone = multiply(crmtx, xyY_to_XYZ(dstWhite));
 
-  catMatrix = crmtx * (vonKriesMatrix * crmtx.inverse());
+  const XYZMat vonKriesMatrix =
+      diag({dstCone[0] / srcCone[0], dstCone[1] / srcCone[1],
+            dstCone[2] / srcCone[2]});
 
-  return catMatrix;
+  return multiply(inverse(crmtx), multiply(vonKriesMatrix, crmtx));
 }
 
-#endif  // WHITEPOINT_H
\ No newline at end of file
+#endif  // WHITEPOINT_H
@@ -0,0 +1,370 @@
+#ifndef YCBCR_H
+#define YCBCR_H
+
+// Y'CbCr / Y'PbPr engine with selectable matrix (Rec.601/709/2020) and range.
+//
+// The float kernels back the YCbCr and YPbPr curves of the node. The
+// fixed-point encoder goes from linear float straight to integer code values
+// (8 to 12 bits) for video deliverables. Like YCbCrToLin, both encode the
+// sRGB curve before the matrix.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "include/Constants.h"
+#include "include/GammaCurve.h"
+#include "include/Simd.h"
+
+struct YCbCrCoeffs
+{
+  // encode
+  float yR, yG, yB;
+  float cbR, cbG, cbB;
+  float crR, crG, crB;
+  // decode
+  float rCr, gCb, gCr, bCb;
+  // normalized code = value * scale + offset
+  float yScale, yOffset;
+  float cScale, cOffset;
+  float yScaleInv, cScaleInv;
+};
+
+inline void YCbCrWeights(int matrix, float& kr, float& kb)
+{
+  switch(matrix) {
+    case Constants::YCC_REC601:
+      kr = 0.299f;
+      kb = 0.114f;
+      return;
+    case Constants::YCC_REC2020:
+      kr = 0.2627f;
+      kb = 0.0593f;
+      return;
+    default:
+      kr = 0.2126f;
+      kb = 0.0722f;
+      return;
+  }
+}
+
+// 'analog' selects Y'PbPr: no offsets and no range scaling
+inline YCbCrCoeffs MakeYCbCrCoeffs(int matrix, int range, bool analog)
+{
+  float kr, kb;
+  YCbCrWeights(matrix, kr, kb);
+  const float kg = 1.0f - kr - kb;
+
+  YCbCrCoeffs k;
+  k.yR = kr;
+  k.yG = kg;
+  k.yB = kb;
+  k.cbR = -0.5f * kr / (1.0f - kb);
+  k.cbG = -0.5f * kg / (1.0f - kb);
+  k.cbB = 0.5f;
+  k.crR = 0.5f;
+  k.crG = -0.5f * kg / (1.0f - kr);
+  k.crB = -0.5f * kb / (1.0f - kr);
+
+  k.rCr = 2.0f - 2.0f * kr;
+  k.gCb = -2.0f * kb * (1.0f - kb) / kg;
+  k.gCr = -2.0f * kr * (1.0f - kr) / kg;
+  k.bCb = 2.0f - 2.0f * kb;
+
+  // the default Y'PbPr keeps the rounded coefficients of LinToYPbPr /
+  // YPbPrToLin, so existing scripts render the same pixels
+  if(analog && matrix == Constants::YCC_REC709) {
+    k.cbR = -0.1146f;
+    k.cbG = -0.3854f;
+    k.crG = -0.4542f;
+    k.crB = -0.0458f;
+    k.gCb = -0.1873f;
+    k.gCr = -0.4681f;
+  }
+
+  if(analog) {
+    k.yScale = 1.0f;
+    k.yOffset = 0.0f;
+    k.cScale = 1.0f;
+    k.cOffset = 0.0f;
+  }
+  else if(range == Constants::YCC_RANGE_FULL) {
+    k.yScale = 1.0f;
+    k.yOffset = 0.0f;
+    k.cScale = 1.0f;
+    k.cOffset = 128.0f / 255.0f;
+  }
+  else {
+    k.yScale = (235.0f - 16.0f) / 255.0f;
+    k.yOffset = 16.0f / 255.0f;
+    k.cScale = (240.0f - 16.0f) / 255.0f;
+    k.cOffset = 128.0f / 255.0f;
+  }
+
+  k.yScaleInv = 1.0f / k.yScale;
+  k.cScaleInv = 1.0f / k.cScale;
+  return k;
+}
+
+// linear RGB -> Y'CbCr on one vector per channel (YCbCrToLin / YPbPrToLin
+// direction)
+inline void YCbCrOutVector(const YCbCrCoeffs& k, Simd::vfloat& x,
+                           Simd::vfloat& y, Simd::vfloat& z)
+{
+  using namespace Simd;
+  const vfloat R = SRGBCurveOut(x);
+  const vfloat G = SRGBCurveOut(y);
+  const vfloat B = SRGBCurveOut(z);
+
+  const vfloat Y =
+      madd(set1(k.yR), R, madd(set1(k.yG), G, mul(set1(k.yB), B)));
+  const vfloat Cb =
+      madd(set1(k.cbR), R, madd(set1(k.cbG), G, mul(set1(k.cbB), B)));
+  const vfloat Cr =
+      madd(set1(k.crR), R, madd(set1(k.crG), G, mul(set1(k.crB), B)));
+
+  x = madd(Y, set1(k.yScale), set1(k.yOffset));
+  y = madd(Cb, set1(k.cScale), set1(k.cOffset));
+  z = madd(Cr, set1(k.cScale), set1(k.cOffset));
+}
+
+// Y'CbCr -> linear RGB on one vector per channel (LinToYCbCr / LinToYPbPr
+// direction)
+inline void YCbCrInVector(const YCbCrCoeffs& k, Simd::vfloat& x,
+                          Simd::vfloat& u, Simd::vfloat& v)
+{
+  using namespace Simd;
+  const vfloat Y = mul(sub(x, set1(k.yOffset)), set1(k.yScaleInv));
+  const vfloat Cb = mul(sub(u, set1(k.cOffset)), set1(k.cScaleInv));
+  const vfloat Cr = mul(sub(v, set1(k.cOffset)), set1(k.cScaleInv));
+
+  const vfloat R = madd(set1(k.rCr), Cr, Y);
+  const vfloat G = madd(set1(k.gCb), Cb, madd(set1(k.gCr), Cr, Y));
+  const vfloat B = madd(set1(k.bCb), Cb, Y);
+
+  x = SRGBCurveIn(R);
+  u = SRGBCurveIn(G);
+  v = SRGBCurveIn(B);
+}
+
+// linear RGB -> Y'CbCr in place
+inline void YCbCrOut(const YCbCrCoeffs& k, float* r, float* g, float* b,
+                     int n)
+{
+  Simd::forEach3(r, g, b, n,
+                 [&k](Simd::vfloat& x, Simd::vfloat& y, Simd::vfloat& z) {
+                   YCbCrOutVector(k, x, y, z);
+                 });
+}
+
+// Y'CbCr -> linear RGB in place
+inline void YCbCrIn(const YCbCrCoeffs& k, float* y, float* cb, float* cr,
+                    int n)
+{
+  Simd::forEach3(y, cb, cr, n,
+                 [&k](Simd::vfloat& x, Simd::vfloat& u, Simd::vfloat& v) {
+                   YCbCrInVector(k, x, u, v);
+                 });
+}
+
+// Fixed-point encoder state. R'G'B' are quantized to 15 bits, the matrix
+// rows carry the range scaling and are stored as Q'shift' integers so one
+// 16x16 multiply-add per pair of channels produces the final code.
+struct YCbCrFixed
+{
+  int bits;
+  int shift;
+  int32_t y[3];
+  int32_t cb[3];
+  int32_t cr[3];
+  int32_t yBias;  // footroom + rounding, in Q'shift'
+  int32_t cBias;  // chroma midpoint + rounding, in Q'shift'
+  int32_t codeMax;
+};
+
+constexpr float kYCbCrInputOne = 32767.0f;
+
+// Integer code range for 'bits' deep video, legal codes scale with depth
+// (16-235 at 8 bits becomes 64-940 at 10 bits)
+struct YCbCrCodeRange
+{
+  double yLo, yRange;
+  double cMid, cRange;
+};
+
+inline YCbCrCodeRange MakeYCbCrCodeRange(int range, int bits)
+{
+  const int up = bits - 8;
+  YCbCrCodeRange c;
+  if(range == Constants::YCC_RANGE_FULL) {
+    c.yLo = 0.0;
+    c.yRange = (1 << bits) - 1;
+    c.cMid = 1 << (bits - 1);
+    c.cRange = (1 << bits) - 1;
+  }
+  else {
+    c.yLo = 16 << up;
+    c.yRange = 219 << up;
+    c.cMid = 128 << up;
+    c.cRange = 224 << up;
+  }
+  return c;
+}
+
+// Encode matrix scaled to code units, rows are Y', Cb, Cr
+inline void YCbCrCodeMatrix(int matrix, const YCbCrCodeRange& c,
+                            double rows[3][3])
+{
+  float kr, kb;
+  YCbCrWeights(matrix, kr, kb);
+  const float kg = 1.0f - kr - kb;
+
+  rows[0][0] = kr * c.yRange;
+  rows[0][1] = kg * c.yRange;
+  rows[0][2] = kb * c.yRange;
+  rows[1][0] = -0.5 * kr / (1.0 - kb) * c.cRange;
+  rows[1][1] = -0.5 * kg / (1.0 - kb) * c.cRange;
+  rows[1][2] = 0.5 * c.cRange;
+  rows[2][0] = 0.5 * c.cRange;
+  rows[2][1] = -0.5 * kg / (1.0 - kr) * c.cRange;
+  rows[2][2] = -0.5 * kb / (1.0 - kr) * c.cRange;
+}
+
+inline YCbCrFixed MakeYCbCrFixed(int matrix, int range, int bits)
+{
+  const YCbCrCodeRange codes = MakeYCbCrCodeRange(range, bits);
+  double rows[3][3];
+  YCbCrCodeMatrix(matrix, codes, rows);
+
+  double largest = 0.0;
+  for(const auto& row : rows) {
+    for(double c : row) largest = std::max(largest, std::abs(c));
+  }
+
+  // widest shift that keeps every coefficient inside int16
+  YCbCrFixed f;
+  f.bits = bits;
+  f.shift = 0;
+  while(largest / kYCbCrInputOne * std::ldexp(1.0, f.shift + 1) < 32767.0) {
+    ++f.shift;
+  }
+
+  const double scale = std::ldexp(1.0, f.shift) / kYCbCrInputOne;
+  for(int i = 0; i < 3; ++i) {
+    f.y[i] = static_cast<int32_t>(std::lround(rows[0][i] * scale));
+    f.cb[i] = static_cast<int32_t>(std::lround(rows[1][i] * scale));
+    f.cr[i] = static_cast<int32_t>(std::lround(rows[2][i] * scale));
+  }
+
+  const double half = std::ldexp(1.0, f.shift - 1);
+  f.yBias = static_cast<int32_t>(std::ldexp(codes.yLo, f.shift) + half);
+  f.cBias = static_cast<int32_t>(std::ldexp(codes.cMid, f.shift) + half);
+  f.codeMax = (1 << bits) - 1;
+  return f;
+}
+
+namespace YCbCrDetail
+{
+  constexpr int kBlock = 64;
+
+  inline int32_t Clamp(int32_t v, int32_t hi)
+  {
+    return v < 0 ? 0 : (v > hi ? hi : v);
+  }
+
+#if defined(__AVX2__)
+  inline __m256i Pair(int32_t lo, int32_t hi)
+  {
+    const uint32_t v = (static_cast<uint32_t>(lo) & 0xFFFFu) |
+                       (static_cast<uint32_t>(hi) << 16);
+    return _mm256_set1_epi32(static_cast<int>(v));
+  }
+
+  inline __m256i MatrixRow(__m256i rg, __m256i b, __m256i cRG, __m256i cB,
+                           __m256i bias, int shift, __m256i hi)
+  {
+    __m256i v = _mm256_add_epi32(_mm256_madd_epi16(rg, cRG),
+                                 _mm256_madd_epi16(b, cB));
+    v = _mm256_srai_epi32(_mm256_add_epi32(v, bias), shift);
+    return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()), hi);
+  }
+
+  inline void Store(uint16_t* dst, __m256i v)
+  {
+    const __m256i packed = _mm256_permute4x64_epi64(
+        _mm256_packus_epi32(v, v), _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst),
+                     _mm256_castsi256_si128(packed));
+  }
+#endif
+
+  // integer matrix over quantized R'G'B', identical results on both paths
+  inline void Matrix(const YCbCrFixed& f, const float* r, const float* g,
+                     const float* b, uint16_t* y, uint16_t* cb, uint16_t* cr,
+                     int n)
+  {
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i cY = Pair(f.y[0], f.y[1]), cY2 = Pair(f.y[2], 0);
+    const __m256i cCb = Pair(f.cb[0], f.cb[1]), cCb2 = Pair(f.cb[2], 0);
+    const __m256i cCr = Pair(f.cr[0], f.cr[1]), cCr2 = Pair(f.cr[2], 0);
+    const __m256i yBias = _mm256_set1_epi32(f.yBias);
+    const __m256i cBias = _mm256_set1_epi32(f.cBias);
+    const __m256i hi = _mm256_set1_epi32(f.codeMax);
+
+    for(; i + 8 <= n; i += 8) {
+      const __m256i R = _mm256_cvttps_epi32(_mm256_loadu_ps(r + i));
+      const __m256i G = _mm256_cvttps_epi32(_mm256_loadu_ps(g + i));
+      const __m256i B = _mm256_cvttps_epi32(_mm256_loadu_ps(b + i));
+      const __m256i RG = _mm256_or_si256(R, _mm256_slli_epi32(G, 16));
+
+      Store(y + i, MatrixRow(RG, B, cY, cY2, yBias, f.shift, hi));
+      Store(cb + i, MatrixRow(RG, B, cCb, cCb2, cBias, f.shift, hi));
+      Store(cr + i, MatrixRow(RG, B, cCr, cCr2, cBias, f.shift, hi));
+    }
+#endif
+    for(; i < n; ++i) {
+      const int32_t R = static_cast<int32_t>(r[i]);
+      const int32_t G = static_cast<int32_t>(g[i]);
+      const int32_t B = static_cast<int32_t>(b[i]);
+
+      const int32_t Y = R * f.y[0] + G * f.y[1] + B * f.y[2] + f.yBias;
+      const int32_t Cb = R * f.cb[0] + G * f.cb[1] + B * f.cb[2] + f.cBias;
+      const int32_t Cr = R * f.cr[0] + G * f.cr[1] + B * f.cr[2] + f.cBias;
+
+      y[i] = static_cast<uint16_t>(Clamp(Y >> f.shift, f.codeMax));
+      cb[i] = static_cast<uint16_t>(Clamp(Cb >> f.shift, f.codeMax));
+      cr[i] = static_cast<uint16_t>(Clamp(Cr >> f.shift, f.codeMax));
+    }
+  }
+}  // namespace YCbCrDetail
+
+// Linear float RGB -> planar integer Y'CbCr codes. Cache sized blocks go
+// through the float curve and straight into the integer matrix.
+inline void YCbCrEncodeCodes(const YCbCrFixed& f, const float* r,
+                             const float* g, const float* b, uint16_t* y,
+                             uint16_t* cb, uint16_t* cr, int n)
+{
+  using namespace Simd;
+  constexpr int kBlock = YCbCrDetail::kBlock;
+  float qr[kBlock], qg[kBlock], qb[kBlock];
+
+  const vfloat zero = set1(0.0f);
+  const vfloat one = set1(1.0f);
+  const vfloat scale = set1(kYCbCrInputOne);
+  auto quantize = [&](vfloat v) {
+    // max() first so NaN lands on 0
+    v = min(max(SRGBCurveOut(v), zero), one);
+    return round(mul(v, scale));
+  };
+
+  for(int i = 0; i < n; i += kBlock) {
+    const int count = n - i < kBlock ? n - i : kBlock;
+    Simd::forEach(r + i, qr, count, quantize);
+    Simd::forEach(g + i, qg, count, quantize);
+    Simd::forEach(b + i, qb, count, quantize);
+    YCbCrDetail::Matrix(f, qr, qg, qb, y + i, cb + i, cr + i, count);
+  }
+}
+
+#endif  // YCBCR_H
@@ -0,0 +1,248 @@
+#ifndef YUV_IO_H
+#define YUV_IO_H
+
+// Raw Y'CbCr code files for video deliverables, written by the standalone
+// tools from linear float RGB planes.
+//
+// 4:4:4 goes through the fixed-point encoder of YCbCr.h (sRGB curve, then
+// the integer matrix of the selected matrix and range), 4:2:2 and 4:2:0
+// through the fused chroma encoder of ChromaSubsample.h with its siting.
+// Layouts:
+//   planar  Y', Cb, Cr planes one after the other, 8 bit codes as bytes and
+//           deeper ones as 16 bit little endian words with the code in the
+//           low bits (yuv444p, yuv422p10le, yuv420p and so on)
+//   p010    Y' plane and an interleaved CbCr plane, 16 bit little endian
+//           words with the code in the high bits (P010 / P210 at 10 bits)
+//   v210    4:2:2 10 bit, rows of V210RowBytes() bytes
+// Row bands run on the CoderTeam, file bytes come from the FramePool.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "include/Constants.h"
+#include "include/FramePool.h"
+#include "include/ChromaSubsample.h"
+#include "include/ThreadPool.h"
+#include "include/YCbCr.h"
+
+namespace Yuv
+{
+  enum Formats { FORMAT_444, FORMAT_422, FORMAT_420 };
+
+  static const char* const FORMAT[] = {"444", "422", "420", 0};
+  // ChromaSitings and ChromaLayouts order
+  static const char* const SITING[] = {"left", "center", "top-left", 0};
+  static const char* const LAYOUT[] = {"planar", "p010", "v210", 0};
+
+  struct Settings
+  {
+    int format = FORMAT_444;
+    int matrix = Constants::YCC_REC709;
+    int range = Constants::YCC_RANGE_LEGAL;
+    int bits = 10;
+    int siting = CHROMA_SITING_LEFT;
+    int layout = CHROMA_LAYOUT_PLANAR;
+  };
+
+  namespace YuvDetail
+  {
+    // even, so 4:2:0 row pairs never straddle two bands
+    constexpr int kBandRows = 16;
+
+    inline bool Fail(std::string* error, const std::string& message)
+    {
+      if(error) *error = message;
+      return false;
+    }
+
+    inline void Store(const uint16_t* codes, int n, int bytes, uint8_t* dst)
+    {
+      if(bytes == 1) {
+        for(int i = 0; i < n; ++i) dst[i] = static_cast<uint8_t>(codes[i]);
+        return;
+      }
+      for(int i = 0; i < n; ++i) {
+        dst[2 * i] = static_cast<uint8_t>(codes[i]);
+        dst[2 * i + 1] = static_cast<uint8_t>(codes[i] >> 8);
+      }
+    }
+
+    inline void Store(const uint32_t* words, int n, uint8_t* dst)
+    {
+      for(int i = 0; i < n; ++i) {
+        for(int b = 0; b < 4; ++b) {
+          dst[4 * i + b] = static_cast<uint8_t>(words[i] >> (8 * b));
+        }
+      }
+    }
+
+    // bytes per code, 1 only for 8 bit planar
+    inline int SampleBytes(const Settings& s)
+    {
+      return s.bits > 8 || s.layout != CHROMA_LAYOUT_PLANAR ? 2 : 1;
+    }
+
+    inline int ChromaHeight(const Settings& s, int height)
+    {
+      return s.format == FORMAT_420 ? (height + 1) / 2 : height;
+    }
+
+    inline bool Check(const Settings& s, std::string* error)
+    {
+      if(s.bits < 8 || s.bits > 12) {
+        return Fail(error, "Y'CbCr codes are 8 to 12 bits");
+      }
+      if(s.format == FORMAT_444 && s.layout != CHROMA_LAYOUT_PLANAR) {
+        return Fail(error, "4:4:4 codes are only written planar");
+      }
+      if(s.layout == CHROMA_LAYOUT_V210 &&
+         (s.format != FORMAT_422 || s.bits != 10)) {
+        return Fail(error, "v210 is 4:2:2 10 bit");
+      }
+      if(s.layout == CHROMA_LAYOUT_P010 && s.bits == 8) {
+        return Fail(error, "p010 codes are 9 to 12 bits");
+      }
+      return true;
+    }
+
+    // the codes of 'rows' rows from 'row', encoded by 4:2:2 rows or 4:2:0
+    // row pairs
+    inline void EncodeChroma(const ChromaEncoder& e, const Settings& s,
+                             const float* r, const float* g, const float* b,
+                             int width, int height, int row, int rows,
+                             uint8_t* file)
+    {
+      const int bytes = SampleBytes(s);
+      const size_t cw = ChromaWidth(width);
+      const size_t lumaBytes = static_cast<size_t>(width) * height * bytes;
+      const size_t chromaBytes = cw * ChromaHeight(s, height) * bytes;
+      const size_t v210Bytes = V210RowBytes(width);
+
+      ScratchArena::Scope scratch;
+      uint16_t* luma =
+          scratch.take<uint16_t>(2 * static_cast<size_t>(width));
+      uint16_t* cb = scratch.take<uint16_t>(2 * cw);
+      uint16_t* cr = scratch.take<uint16_t>(cw);
+      uint32_t* v210 = scratch.take<uint32_t>(v210Bytes / 4);
+      const ChromaRows dst = {luma, luma + width, cb, cr, v210};
+
+      const int step = s.format == FORMAT_420 ? 2 : 1;
+      for(int y = row; y < row + rows; y += step) {
+        const size_t y0 = static_cast<size_t>(width) * y;
+        // an odd last row pairs with itself
+        const size_t y1 = y + 1 < height ? y0 + width : y0;
+        ChromaEncodeRows(e, r + y0, g + y0, b + y0, r + y1, g + y1, b + y1,
+                         width, dst);
+
+        if(s.layout == CHROMA_LAYOUT_V210) {
+          Store(v210, static_cast<int>(v210Bytes / 4), file + v210Bytes * y);
+          continue;
+        }
+        Store(luma, width, bytes, file + y0 * bytes);
+        if(step == 2 && y + 1 < height) {
+          Store(luma + width, width, bytes, file + (y0 + width) * bytes);
+        }
+        const size_t cy = y / step;
+        uint8_t* chroma = file + lumaBytes;
+        if(s.layout == CHROMA_LAYOUT_P010) {
+          Store(cb, static_cast<int>(2 * cw), 2, chroma + cy * cw * 4);
+        }
+        else {
+          Store(cb, static_cast<int>(cw), bytes, chroma + cy * cw * bytes);
+          Store(cr, static_cast<int>(cw), bytes,
+                chroma + chromaBytes + cy * cw * bytes);
+        }
+      }
+    }
+  }  // namespace YuvDetail
+
+  // Bytes of a width x height file
+  inline size_t FileBytes(const Settings& s, int width, int height)
+  {
+    using namespace YuvDetail;
+    if(s.layout == CHROMA_LAYOUT_V210) {
+      return static_cast<size_t>(V210RowBytes(width)) * height;
+    }
+    const size_t luma = static_cast<size_t>(width) * height;
+    const size_t chroma = s.format == FORMAT_444
+                              ? luma
+                              : static_cast<size_t>(ChromaWidth(width)) *
+                                    ChromaHeight(s, height);
+    return (luma + 2 * chroma) * SampleBytes(s);
+  }
+
+  // Encodes the width x height planes r, g, b (rows packed one after the
+  // other) into 'file', a byte vector
+  template <typename Bytes>
+  inline bool Encode(const float* r, const float* g, const float* b,
+                     int width, int height, const Settings& s, Bytes& file,
+                     std::string* error = nullptr, int threads = 0)
+  {
+    using namespace YuvDetail;
+    if(width <= 0 || height <= 0) return Fail(error, "empty image");
+    if(!Check(s, error)) return false;
+    file.resize(FileBytes(s, width, height));
+    const int bands = (height + kBandRows - 1) / kBandRows;
+
+    if(s.format != FORMAT_444) {
+      const ChromaEncoder e = MakeChromaEncoder(
+          s.matrix, s.range, s.bits,
+          s.format == FORMAT_420 ? CHROMA_420 : CHROMA_422, s.siting,
+          s.layout);
+      auto encode = [&](int band) {
+        const int row = band * kBandRows;
+        EncodeChroma(e, s, r, g, b, width, height, row,
+                     std::min(kBandRows, height - row), file.data());
+      };
+      CoderTeam().run(bands, threads, encode);
+      return true;
+    }
+
+    const YCbCrFixed fixed = MakeYCbCrFixed(s.matrix, s.range, s.bits);
+    const int bytes = s.bits > 8 ? 2 : 1;
+    const size_t planeBytes = static_cast<size_t>(width) * height * bytes;
+    uint8_t* planes[3] = {file.data(), file.data() + planeBytes,
+                          file.data() + 2 * planeBytes};
+    auto encode = [&](int band) {
+      ScratchArena::Scope scratch;
+      uint16_t* codes =
+          scratch.take<uint16_t>(3 * static_cast<size_t>(width));
+      const int row = band * kBandRows;
+      const int end = std::min(row + kBandRows, height);
+      for(int y = row; y < end; ++y) {
+        const size_t offset = static_cast<size_t>(width) * y;
+        YCbCrEncodeCodes(fixed, r + offset, g + offset, b + offset, codes,
+                         codes + width, codes + 2 * width, width);
+        for(int c = 0; c < 3; ++c) {
+          Store(codes + c * width, width, bytes, planes[c] + offset * bytes);
+        }
+      }
+    };
+    CoderTeam().run(bands, threads, encode);
+    return true;
+  }
+
+  inline bool Write(const std::string& path, const float* r, const float* g,
+                    const float* b, int width, int height, const Settings& s,
+                    std::string* error = nullptr, int threads = 0)
+  {
+    ByteBuffer file;
+    if(!Encode(r, g, b, width, height, s, file, error, threads)) {
+      if(error) *error = path + ": " + *error;
+      return false;
+    }
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if(!f) return YuvDetail::Fail(error, "cannot write " + path);
+    std::setvbuf(f, nullptr, _IONBF, 0);
+    const bool written = std::fwrite(file.data(), 1, file.size(), f) ==
+                         file.size();
+    if(std::fclose(f) != 0 || !written) {
+      return YuvDetail::Fail(error, "cannot write " + path);
+    }
+    return true;
+  }
+}  // namespace Yuv
+
+#endif  // YUV_IO_H
@@ -0,0 +1,382 @@
+/*
+ * Python bindings on the C API (capi/gcolorspace.h), no NumPy or pybind11
+ * needed to build: images come in through the buffer protocol and are
+ * converted in place, with the GIL released, on the library's threads.
+ *
+ *   import numpy as np, gcolorspace
+ *   t = gcolorspace.Transform(color_in="ARRILogC4",
+ *                             primary_in="ARRI Wide Gamut 4",
+ *                             color_out="sRGB (~2.20)")
+ *   t.apply(img)  # (H, W, 3|4) float32 or float16, alpha is kept
+ *
+ * Colorspaces, whitepoints and primaries take the node's menu names (see
+ * colorspaces() and friends) or their index. Rows may be strided, so crops
+ * such as img[:, 100:200] convert in place too; pixels within a row must be
+ * packed.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <limits.h>
+#include <string.h>
+
+#include "capi/gcolorspace.h"
+
+typedef struct
+{
+  PyObject_HEAD
+  gcs_transform* transform;
+} TransformObject;
+
+typedef const char* (*NameFn)(int);
+typedef int (*FindFn)(const char*);
+
+/* an enum knob: None keeps 'value', ints pass, names go through 'find' */
+static int EnumArg(PyObject* arg, const char* knob, FindFn find, int* value)
+{
+  if(arg == NULL || arg == Py_None) return 1;
+  if(PyLong_Check(arg)) {
+    const long v = PyLong_AsLong(arg);
+    if(v == -1 && PyErr_Occurred()) return 0;
+    if(v < INT_MIN || v > INT_MAX) {
+      PyErr_Format(PyExc_ValueError, "%s: %ld out of range", knob, v);
+      return 0;
+    }
+    *value = (int)v;
+    return 1;
+  }
+  if(find != NULL && PyUnicode_Check(arg)) {
+    const char* name = PyUnicode_AsUTF8(arg);
+    if(name == NULL) return 0;
+    *value = find(name);
+    if(*value < 0) {
+      PyErr_Format(PyExc_ValueError, "%s: unknown name '%s'", knob, name);
+      return 0;
+    }
+    return 1;
+  }
+  PyErr_Format(PyExc_TypeError, "%s: expected %s, got %s", knob,
+               find != NULL ? "an int or a name" : "an int",
+               Py_TYPE(arg)->tp_name);
+  return 0;
+}
+
+static int Transform_init(TransformObject* self, PyObject* args,
+                          PyObject* kwargs)
+{
+  static char* keywords[] = {"color_in",     "color_out",   "white_in",
+                             "white_out",    "primary_in",  "primary_out",
+                             "cat",          "ycbcr_matrix", "ycbcr_range",
+                             "precision",    "tolerance",   "bit_exact",
+                             "lut_file",     "lut_after",   NULL};
+  PyObject* colorIn = NULL;
+  PyObject* colorOut = NULL;
+  PyObject* whiteIn = NULL;
+  PyObject* whiteOut = NULL;
+  PyObject* primaryIn = NULL;
+  PyObject* primaryOut = NULL;
+  PyObject* cat = NULL;
+  PyObject* ycbcrMatrix = NULL;
+  PyObject* ycbcrRange = NULL;
+  PyObject* precision = NULL;
+  PyObject* lutFile = NULL;
+  int bitExact = 0;
+  int lutAfter = 0;
+  gcs_settings s;
+  gcs_transform* transform = NULL;
+  gcs_status status;
+  char error[512];
+
+  if(self->transform != NULL) {
+    PyErr_SetString(PyExc_RuntimeError, "Transform is already initialized");
+    return -1;
+  }
+  gcs_settings_init(&s, sizeof(s));
+  if(!PyArg_ParseTupleAndKeywords(
+         args, kwargs, "|OOOOOOOOOOfpOp:Transform", keywords, &colorIn,
+         &colorOut, &whiteIn, &whiteOut, &primaryIn, &primaryOut, &cat,
+         &ycbcrMatrix, &ycbcrRange, &precision, &s.tolerance, &bitExact,
+         &lutFile, &lutAfter)) {
+    return -1;
+  }
+  if(!EnumArg(colorIn, "color_in", gcs_colorspace_find, &s.color_in) ||
+     !EnumArg(colorOut, "color_out", gcs_colorspace_find, &s.color_out) ||
+     !EnumArg(whiteIn, "white_in", gcs_whitepoint_find, &s.white_in) ||
+     !EnumArg(whiteOut, "white_out", gcs_whitepoint_find, &s.white_out) ||
+     !EnumArg(primaryIn, "primary_in", gcs_primaries_find, &s.primary_in) ||
+     !EnumArg(primaryOut, "primary_out", gcs_primaries_find,
+              &s.primary_out) ||
+     !EnumArg(cat, "cat", NULL, &s.cat) ||
+     !EnumArg(ycbcrMatrix, "ycbcr_matrix", NULL, &s.ycbcr_matrix) ||
+     !EnumArg(ycbcrRange, "ycbcr_range", NULL, &s.ycbcr_range) ||
+     !EnumArg(precision, "precision", NULL, &s.precision)) {
+    return -1;
+  }
+  s.bit_exact = bitExact;
+  s.lut_after = lutAfter;
+  if(lutFile != NULL && lutFile != Py_None) {
+    if(!PyUnicode_Check(lutFile)) {
+      PyErr_SetString(PyExc_TypeError, "lut_file: expected a path");
+      return -1;
+    }
+    s.lut_file = PyUnicode_AsUTF8(lutFile);
+    if(s.lut_file == NULL) return -1;
+  }
+
+  /* LUT tiers bake here, other threads may run meanwhile */
+  error[0] = '\0';
+  Py_BEGIN_ALLOW_THREADS
+  status = gcs_transform_create(&s, sizeof(s), &transform, error,
+                                sizeof(error));
+  Py_END_ALLOW_THREADS
+  if(status != GCS_OK) {
+    PyErr_SetString(status == GCS_ERROR_LUT_FILE ? PyExc_OSError
+                                                 : PyExc_ValueError,
+                    error[0] ? error : gcs_status_string(status));
+    return -1;
+  }
+  /* apply() may be running on the transform with the GIL released, so a
+   * live object keeps the one it has */
+  if(self->transform != NULL) {
+    gcs_transform_destroy(transform);
+    PyErr_SetString(PyExc_RuntimeError, "Transform is already initialized");
+    return -1;
+  }
+  self->transform = transform;
+  return 0;
+}
+
+static void Transform_dealloc(TransformObject* self)
+{
+  gcs_transform_destroy(self->transform);
+  Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+/* 'f' or 'e' with an optional native prefix */
+static int PixelType(const char* format, gcs_pixel_type* type)
+{
+  if(format == NULL) format = "B";
+  if(*format == '@' || *format == '=') ++format;
+#if PY_LITTLE_ENDIAN
+  else if(*format == '<') ++format;
+#else
+  else if(*format == '>' || *format == '!') ++format;
+#endif
+  if(!strcmp(format, "f")) {
+    *type = GCS_FLOAT32;
+    return 1;
+  }
+  if(!strcmp(format, "e")) {
+    *type = GCS_FLOAT16;
+    return 1;
+  }
+  return 0;
+}
+
+static PyObject* Transform_apply(TransformObject* self, PyObject* args,
+                                 PyObject* kwargs)
+{
+  static char* keywords[] = {"image", "threads", NULL};
+  PyObject* image;
+  int threads = 0;
+  gcs_transform* transform = self->transform;
+  Py_buffer view;
+  gcs_pixel_type type;
+  gcs_status status;
+  Py_ssize_t height, width, channels;
+
+  if(!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i:apply", keywords,
+                                  &image, &threads)) {
+    return NULL;
+  }
+  if(transform == NULL) {
+    PyErr_SetString(PyExc_RuntimeError, "Transform is not initialized");
+    return NULL;
+  }
+  if(PyObject_GetBuffer(image, &view, PyBUF_RECORDS) < 0) return NULL;
+
+  if(!PixelType(view.format, &type) || view.ndim != 3) {
+    PyErr_Format(PyExc_TypeError,
+                 "apply: expected a (H, W, 3|4) float32 or float16 image, "
+                 "got format '%s' with %d dimensions",
+                 view.format != NULL ? view.format : "B", view.ndim);
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+  height = view.shape[0];
+  width = view.shape[1];
+  channels = view.shape[2];
+  if(channels != 3 && channels != 4) {
+    PyErr_Format(PyExc_ValueError, "apply: %zd channels, expected 3 or 4",
+                 channels);
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+  if(height > INT_MAX || width > INT_MAX) {
+    PyErr_SetString(PyExc_ValueError, "apply: image too large");
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+  /* packed pixels, any forward row stride */
+  if(height > 0 && width > 0 &&
+     (view.strides[2] != view.itemsize ||
+      view.strides[1] != channels * view.itemsize ||
+      (height > 1 && view.strides[0] < width * view.strides[1]))) {
+    PyErr_SetString(PyExc_ValueError,
+                    "apply: pixels must be contiguous within a row "
+                    "(use numpy.ascontiguousarray)");
+    PyBuffer_Release(&view);
+    return NULL;
+  }
+
+  Py_BEGIN_ALLOW_THREADS
+  status = gcs_apply_interleaved(transform, type, view.buf, (int)width,
+                                 (int)height, (int)channels,
+                                 height > 1 ? view.strides[0] : 0, threads);
+  Py_END_ALLOW_THREADS
+  PyBuffer_Release(&view);
+  if(status != GCS_OK) {
+    PyErr_SetString(PyExc_RuntimeError, gcs_status_string(status));
+    return NULL;
+  }
+  Py_INCREF(image);
+  return image;
+}
+
+static PyMethodDef Transform_methods[] = {
+    {"apply", (PyCFunction)(void (*)(void))Transform_apply,
+     METH_VARARGS | METH_KEYWORDS,
+     "apply(image, threads=0)\n--\n\n"
+     "Converts a writable (H, W, 3|4) float32 or float16 buffer in place and\n"
+     "returns it. 'threads' caps the threads used, 0 for all, 1 for the\n"
+     "calling thread only. The GIL is released meanwhile."},
+    {NULL, NULL, 0, NULL}};
+
+static PyTypeObject TransformType = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "gcolorspace.Transform",
+    .tp_basicsize = sizeof(TransformObject),
+    .tp_dealloc = (destructor)Transform_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc =
+        "Transform(color_in=None, color_out=None, white_in=None,\n"
+        "          white_out=None, primary_in=None, primary_out=None,\n"
+        "          cat=CAT_CAT02, ycbcr_matrix=YCC_REC709,\n"
+        "          ycbcr_range=YCC_RANGE_LEGAL, precision=PRECISION_EXACT,\n"
+        "          tolerance=1e-3, bit_exact=False, lut_file=None,\n"
+        "          lut_after=False)\n--\n\n"
+        "A compiled conversion, as set up on the node. Unset knobs keep the\n"
+        "node's defaults (linear, D65, sRGB primaries). Safe to apply from\n"
+        "several threads at once, and not re-initializable for that reason.",
+    .tp_methods = Transform_methods,
+    .tp_init = (initproc)Transform_init,
+    .tp_new = PyType_GenericNew,
+};
+
+static PyObject* Names(NameFn name)
+{
+  PyObject* list = PyList_New(0);
+  const char* n;
+  int i;
+  if(list == NULL) return NULL;
+  for(i = 0; (n = name(i)) != NULL; ++i) {
+    PyObject* item = PyUnicode_FromString(n);
+    if(item == NULL || PyList_Append(list, item) < 0) {
+      Py_XDECREF(item);
+      Py_DECREF(list);
+      return NULL;
+    }
+    Py_DECREF(item);
+  }
+  return list;
+}
+
+static PyObject* Colorspaces(PyObject* module, PyObject* unused)
+{
+  (void)module;
+  (void)unused;
+  return Names(gcs_colorspace_name);
+}
+
+static PyObject* Whitepoints(PyObject* module, PyObject* unused)
+{
+  (void)module;
+  (void)unused;
+  return Names(gcs_whitepoint_name);
+}
+
+static PyObject* Primaries(PyObject* module, PyObject* unused)
+{
+  (void)module;
+  (void)unused;
+  return Names(gcs_primaries_name);
+}
+
+static PyMethodDef module_methods[] = {
+    {"colorspaces", Colorspaces, METH_NOARGS,
+     "Colorspace menu names, in index order"},
+    {"whitepoints", Whitepoints, METH_NOARGS,
+     "Whitepoint menu names, in index order"},
+    {"primaries", Primaries, METH_NOARGS,
+     "Primaries menu names, in index order"},
+    {NULL, NULL, 0, NULL}};
+
+static struct PyModuleDef module_def = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "gcolorspace",
+    .m_doc =
+        "GColorspace conversions for buffer protocol images (NumPy arrays)",
+    .m_size = -1,
+    .m_methods = module_methods,
+    .m_slots = NULL,
+    .m_traverse = NULL,
+    .m_clear = NULL,
+    .m_free = NULL,
+};
+
+PyMODINIT_FUNC PyInit_gcolorspace(void)
+{
+  static const struct
+  {
+    const char* name;
+    int value;
+  } constants[] = {{"CAT_CAT02", GCS_CAT_CAT02},
+                   {"CAT_BRADFORD", GCS_CAT_BRADFORD},
+                   {"YCC_REC601", GCS_YCC_REC601},
+                   {"YCC_REC709", GCS_YCC_REC709},
+                   {"YCC_REC2020", GCS_YCC_REC2020},
+                   {"YCC_RANGE_LEGAL", GCS_YCC_RANGE_LEGAL},
+                   {"YCC_RANGE_FULL", GCS_YCC_RANGE_FULL},
+                   {"PRECISION_EXACT", GCS_PRECISION_EXACT},
+                   {"PRECISION_LUT_1D", GCS_PRECISION_LUT_1D},
+                   {"PRECISION_LUT_3D_33", GCS_PRECISION_LUT_3D_33},
+                   {"PRECISION_LUT_3D_65", GCS_PRECISION_LUT_3D_65},
+                   {"PRECISION_AUTO", GCS_PRECISION_AUTO}};
+  PyObject* module;
+  size_t i;
+
+  if(gcs_api_version() != GCS_API_VERSION) {
+    PyErr_Format(PyExc_ImportError,
+                 "gcolorspace: built for C API %d, library has %d",
+                 GCS_API_VERSION, gcs_api_version());
+    return NULL;
+  }
+  if(PyType_Ready(&TransformType) < 0) return NULL;
+  module = PyModule_Create(&module_def);
+  if(module == NULL) return NULL;
+  Py_INCREF(&TransformType);
+  if(PyModule_AddObject(module, "Transform", (PyObject*)&TransformType) <
+     0) {
+    Py_DECREF(&TransformType);
+    Py_DECREF(module);
+    return NULL;
+  }
+  for(i = 0; i < sizeof(constants) / sizeof(constants[0]); ++i) {
+    if(PyModule_AddIntConstant(module, constants[i].name,
+                               constants[i].value) < 0) {
+      Py_DECREF(module);
+      return NULL;
+    }
+  }
+  return module;
+}
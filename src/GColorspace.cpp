@@ -30,18 +30,28 @@
 #include <DDImage/ArrayKnobI.h>
 #include <DDImage/Channel.h>
 #include <DDImage/Enumeration_KnobI.h>
+#include <DDImage/Iop.h>
 #include <DDImage/Knobs.h>
-#include <DDImage/Matrix3.h>
 #include <DDImage/NukeWrapper.h>
-#include <DDImage/PixelIop.h>
 #include <DDImage/Row.h>
+#include <DDImage/Tile.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
+#include "include/BlinkExport.h"
+#include "include/ClfExport.h"
 #include "include/ColorData.h"
 #include "include/Constants.h"
+#include "include/CubeLut.h"
 #include "include/DebugTools.h"
 #include "include/Dispatcher.h"
+#include "include/RowCache.h"
+#include "include/TransformPlan.h"
 #include "include/Utils.h"
 #include "include/Whitepoint.h"
 #include "include/aliases.h"
@@ -49,7 +59,7 @@
 static float _defaultMatValues[] = {1.0f, 0.0f, 0.0f, 0.0f, 1.0f,
                                     0.0f, 0.0f, 0.0f, 1.0f};
 
-GColorspaceIop::GColorspaceIop(Node* n) : PixelIop(n)
+GColorspaceIop::GColorspaceIop(Node* n) : Iop(n)
 {
   colorIn_index = Constants::COLOR_LINEAR;
   colorOut_index = Constants::COLOR_LINEAR;
@@ -57,13 +67,27 @@ GColorspaceIop::GColorspaceIop(Node* n) : PixelIop(n)
   whiteOut_index = Constants::WHITE_D65;
   primaryIn_index = Constants::PRIM_COLOR_SRGB;
   primaryOut_index = Constants::PRIM_COLOR_SRGB;
+  ycbcrMatrix_index = Constants::YCC_REC709;
+  ycbcrRange_index = Constants::YCC_RANGE_LEGAL;
   use_bradford_matrix = 0;
-  currentMatrix.makeIdentity();
+  bit_exact_curves = false;
+  precision_index = Constants::PRECISION_EXACT;
+  auto_tolerance = 1e-3f;
+  lutStorage_index = Constants::LUT_STORAGE_FLOAT;
+  lutFilePosition_index = Constants::LUT_FILE_BEFORE;
+  engine_index = Constants::ENGINE_ROWS;
+  temporal_cache = false;
+  rowSalt = 0;
+  rowHits = 0;
+  rowLookups = 0;
+  plan = MakeTransformPlan(TransformSettings());
   colormatrix.set(3, 3, _defaultMatValues);
 }
 
 GColorspaceIop::~GColorspaceIop()
 {
+  // prefetched bands render through this op
+  bands.drain();
 }
 
 void GColorspaceIop::knobs(Knob_Callback f)
@@ -86,9 +110,86 @@ void GColorspaceIop::knobs(Knob_Callback f)
                    "");
   ClearFlags(f, Knob::STARTLINE);
 
+  Enumeration_knob(f, &ycbcrMatrix_index, Constants::YCBCR_MATRIX,
+                   "ycbcr_matrix", "YCbCr");
+  Tooltip(f, "Luma coefficients used by the YCbCr and YPbPr curves.");
+  Enumeration_knob(f, &ycbcrRange_index, Constants::YCBCR_RANGE, "ycbcr_range",
+                   "");
+  Tooltip(f,
+          "Legal (16-235 luma, 16-240 chroma) or full code range. YPbPr is "
+          "always full range.");
+  ClearFlags(f, Knob::STARTLINE);
+
   Button(f, "swap", "swap in/out");
   SetFlags(f, Knob::STARTLINE);
   Bool_knob(f, &use_bradford_matrix, "bradford_matrix", "Bradford matrix");
+  Bool_knob(f, &bit_exact_curves, "bit_exact", "bit-exact curves");
+  Tooltip(f,
+          "Evaluate every curve with the scalar libm functions instead of "
+          "the vectorized kernels. Slower, but bit for bit identical to "
+          "previous versions.");
+  Enumeration_knob(f, &precision_index, Constants::PRECISION, "precision",
+                   "precision");
+  Tooltip(f,
+          "Exact evaluates every pixel. The LUT modes bake the transform "
+          "once into 1D curve tables or a 3D cube shared by all nodes with "
+          "the same settings, values outside 0-1 are still evaluated "
+          "exactly. Auto times each mode once per transform and CPU model "
+          "and keeps the fastest one within the tolerance.");
+  Float_knob(f, &auto_tolerance, IRange(0, 0.01), "auto_tolerance",
+             "tolerance");
+  Tooltip(f,
+          "Largest error auto precision accepts against the exact result, "
+          "absolute below 1 and relative above.");
+  ClearFlags(f, Knob::STARTLINE);
+  Enumeration_knob(f, &lutStorage_index, Constants::LUT_STORAGE, "lut_storage",
+                   "storage");
+  Tooltip(f,
+          "Entry type and layout of 3D LUTs. Half entries halve the memory, "
+          "tiled layouts keep the corners of a cell close together. Both "
+          "help when the cube does not fit in cache.");
+  ClearFlags(f, Knob::STARTLINE);
+  File_knob(f, &lut_file, "lut_file", "LUT file");
+  Tooltip(f,
+          "Optional .cube LUT (1D, 3D or both) applied in the same pass as "
+          "the colorspace conversion. Parsed files are shared by all nodes "
+          "and read again when they change on disk.");
+  Enumeration_knob(f, &lutFilePosition_index, Constants::LUT_FILE_POSITION,
+                   "lut_position", "");
+  Tooltip(f,
+          "Apply the LUT to the input before the in curve, or to the result "
+          "after the out curve.");
+  ClearFlags(f, Knob::STARTLINE);
+  File_knob(f, &clf_file, "clf_file", "CLF export");
+  Tooltip(f,
+          "Common LUT Format file the export button writes, with an OCIO "
+          "colorspace entry referencing it next to it (.ocio.yaml). Curves "
+          "with a closed form become Log, Exponent and Matrix nodes, the "
+          "others are baked into LUT nodes.");
+  Button(f, "export_clf", "export");
+  ClearFlags(f, Knob::STARTLINE);
+  File_knob(f, &blink_file, "blink_file", "BlinkScript export");
+  Tooltip(f,
+          "Kernel file the export button writes: one BlinkScript kernel "
+          "running this conversion with its constants inlined and the "
+          "matrices folded. A LUT file cannot be exported this way.");
+  Button(f, "export_blink", "export");
+  ClearFlags(f, Knob::STARTLINE);
+  Enumeration_knob(f, &engine_index, Constants::ENGINE, "engine", "engine");
+  Tooltip(f,
+          "Rows converts each row as Nuke asks for it. Bands fetches blocks "
+          "of input rows at once and converts them in one pass, shared by "
+          "all render threads, which saves the per row overhead on large "
+          "formats at the cost of some memory.");
+  Bool_knob(f, &temporal_cache, "temporal_cache", "temporal row cache");
+  Tooltip(f,
+          "Remember converted rows by their input and copy the result when "
+          "the same row comes again, e.g. on locked-off shots and hold "
+          "frames. Shared by all nodes, GCOLORSPACE_ROW_CACHE_MB sets its "
+          "size (512 MB by default). Rows engine only.");
+  String_knob(f, &rowCacheInfo, "row_cache_info", "");
+  SetFlags(f, Knob::OUTPUT_ONLY | Knob::DO_NOT_WRITE | Knob::NO_RERENDER);
+  ClearFlags(f, Knob::STARTLINE);
 
   Divider(f, "color matrix output");
   Array_knob(f, &colormatrix, colormatrix.width, colormatrix.height,
@@ -114,11 +215,11 @@ void GColorspaceIop::setColorMatrix()
 
   // Whitepoint
   const float* catMat = CatDispatcher(use_bradford_matrix);
-  Matrix3 whiteMtx = calcWhite(srcWhite, dstWhite, catMat);
+  XYZMat whiteMtx = calcWhite(srcWhite, dstWhite, catMat);
 
   if(inColorspaceValue != outColorspaceValue || inWhiteValue != outWhiteValue ||
      inPrimaryValue != outPrimaryValue) {
-    knob("colormatrix")->set_values(whiteMtx.array(), 9);
+    knob("colormatrix")->set_values(whiteMtx.data(), 9);
     knob("colormatrix")->enable();
   }
   else if(isInXYZMatrix(inColorspaceValue) &&
@@ -252,6 +353,28 @@ int GColorspaceIop::knob_changed(Knob* k)
         k_primary_out->disable();
         k_white_out->enable();
       }
+
+      // YCbCr matrix and range only apply to the YCbCr and YPbPr curves
+      auto isYCbCr = [](int cs) {
+        return cs == Constants::COLOR_Y_CB_CR || cs == Constants::COLOR_Y_PB_PR;
+      };
+      if(isYCbCr(inColorspaceValue) || isYCbCr(outColorspaceValue)) {
+        knob("ycbcr_matrix")->enable();
+        knob("ycbcr_range")->enable();
+      }
+      else {
+        knob("ycbcr_matrix")->disable();
+        knob("ycbcr_range")->disable();
+      }
+    }
+  }
+
+  if(k->is("precision")) {
+    if(precision_index == Constants::PRECISION_AUTO) {
+      knob("auto_tolerance")->enable();
+    }
+    else {
+      knob("auto_tolerance")->disable();
     }
   }
 
@@ -273,13 +396,144 @@ int GColorspaceIop::knob_changed(Knob* k)
     }
   }
 
+  if(k->is("export_clf")) {
+    exportTransform(clf_file, "CLF", &ExportClf);
+  }
+
+  if(k->is("export_blink")) {
+    exportTransform(blink_file, "BlinkScript", &ExportBlink);
+  }
+
   return 1;
 }
 
+void GColorspaceIop::exportTransform(const std::string& path,
+                                     const char* format, Exporter exporter)
+{
+  if(path.empty()) {
+    critical("Choose a %s file to export to", format);
+    return;
+  }
+
+  // the exact pipeline, nothing to bake in the background
+  TransformSettings s = settings();
+  s.precision = Constants::PRECISION_EXACT;
+  s.backgroundBake = false;
+  std::string message;
+  if(!lut_file.empty()) {
+    s.lutFile = CubeLutCache::instance().load(lut_file, &message);
+    if(s.lutFile == nullptr) {
+      critical("%s", message.c_str());
+      return;
+    }
+  }
+  if(!exporter(MakeTransformPlan(s), path, &message)) {
+    critical("%s", message.c_str());
+  }
+}
+
 void GColorspaceIop::_validate(bool for_real)
 {
+  copy_info();
   set_out_channels(Mask_All);
-  PixelIop::_validate(for_real);
+
+  // resolve everything that is constant for the row loop. Replacing the
+  // plan drops its LUT handle, which cancels a bake nobody waits for anymore.
+  TransformSettings s = settings();
+  if(!lut_file.empty()) {
+    std::string message;
+    s.lutFile = CubeLutCache::instance().load(lut_file, &message);
+    if(s.lutFile == nullptr) {
+      error("%s", message.c_str());
+      return;
+    }
+  }
+  plan = MakeTransformPlan(s);
+  bands.drain();
+  bands.reset();
+  {
+    std::lock_guard<std::mutex> lock(bandChannelsLock);
+    bandChannels = Mask_None;
+  }
+
+  // the hit rate restarts with every new transform, not with every frame
+  const uint64_t salt = LutKeyHash()(TransformDetail::MakeLutKey(plan));
+  if(salt != rowSalt) {
+    rowSalt = salt;
+    rowHits = 0;
+    rowLookups = 0;
+  }
+}
+
+bool GColorspaceIop::updateUI(const OutputContext&)
+{
+  Knob* info = knob("row_cache_info");
+  if(info == nullptr) return true;
+  if(!temporal_cache) {
+    info->set_text("");
+    return true;
+  }
+
+  const uint64_t lookups = rowLookups;
+  const uint64_t hits = rowHits;
+  const RowCache::Stats stats = RowCache::instance().stats();
+  char text[128];
+  std::snprintf(text, sizeof(text), "%.1f%% rows reused, cache %zu/%zu MB",
+                lookups ? 100.0 * hits / lookups : 0.0, stats.bytes >> 20,
+                stats.budget >> 20);
+  info->set_text(text);
+  return true;
+}
+
+void GColorspaceIop::_request(int x, int y, int r, int t, ChannelMask channels,
+                              int count)
+{
+  ChannelSet wanted = channels;
+  in_channels(0, wanted);
+
+  if(engine_index == Constants::ENGINE_BANDS) {
+    // bands hold every channel asked for so far, a new one means the bands
+    // rendered before lack it
+    {
+      std::lock_guard<std::mutex> lock(bandChannelsLock);
+      bool added = false;
+      foreach(z, channels) added = added || !(bandChannels & z);
+      if(added) {
+        bandChannels += channels;
+        bands.reset();
+      }
+    }
+
+    // bands always span whole rows and whole blocks of rows
+    const int rows = bands.rows();
+    x = info().x();
+    r = info().r();
+    y = std::max(bands.bandStart(y), info().y());
+    t = std::min(bands.bandStart(t - 1) + rows, info().t());
+  }
+  input0().request(x, y, r, t, wanted, count);
+}
+
+TransformSettings GColorspaceIop::settings() const
+{
+  TransformSettings s;
+  s.colorIn = colorIn_index;
+  s.colorOut = colorOut_index;
+  s.whiteIn = whiteIn_index;
+  s.whiteOut = whiteOut_index;
+  s.primaryIn = primaryIn_index;
+  s.primaryOut = primaryOut_index;
+  s.ycbcrMatrix = ycbcrMatrix_index;
+  s.ycbcrRange = ycbcrRange_index;
+  s.bradford = use_bradford_matrix;
+  s.bitExact = bit_exact_curves;
+  s.precision = precision_index;
+  s.tolerance = auto_tolerance;
+  s.lutStorage = lutStorage_index;
+  s.lutFilePosition = lutFilePosition_index;
+  // the viewer keeps rendering exact rows while a LUT bakes
+  s.backgroundBake = true;
+  return s;
 }
 
 void GColorspaceIop::in_channels(int, ChannelSet& mask) const
@@ -302,40 +556,36 @@ void GColorspaceIop::in_channels(int, ChannelSet& mask) const
   mask += done;
 }
 
-RGBcolor GColorspaceIop::ToInColorspace(const RGBcolor& p)
+void GColorspaceIop::engine(int rowY, int rowX, int rowXBound,
+                            ChannelMask outputChannels, Row& out)
 {
-  // Dispatchers
-  auto TransformIn = TransformInDispatcher(colorIn_index);
-  const float* srcWhite = WhitepointDispatcher(Constants::WHITE_D65);
-  const float* dstWhite = WhitepointDispatcher(whiteIn_index);
-  const float* catMat = CatDispatcher(use_bradford_matrix);
-
-  Matrix3 mtx = calcWhite(srcWhite, dstWhite, catMat);
-
-  auto rgb = TransformIn(p);
+  // rows outside the data window are not banded
+  const bool inside = rowY >= info().y() && rowY < info().t() &&
+                      rowX >= info().x() && rowXBound <= info().r();
+  if(engine_index == Constants::ENGINE_BANDS && !plan.identity && inside &&
+     bandEngine(rowY, rowX, rowXBound, outputChannels, out)) {
+    return;
+  }
 
-  // rgb to XYZ
-  auto toPrimary = rgb;
-  auto whitepoint = toXYZMat(mtx.array(), toPrimary);
-  auto fromPrimary = whitepoint;
-  // XYZ to rgb
+  ChannelSet wanted = outputChannels;
+  in_channels(0, wanted);
+  Row in(rowX, rowXBound);
+  in.get(input0(), rowY, rowX, rowXBound, wanted);
+  if(aborted()) return;
 
-  return fromPrimary;
+  rowEngine(in, rowY, rowX, rowXBound, outputChannels, out);
 }
 
-RGBcolor GColorspaceIop::ToOutColorspace(const RGBcolor& p)
+void GColorspaceIop::rowEngine(const Row& in, int rowY, int rowX,
+                               int rowXBound, ChannelMask outputChannels,
+                               Row& out)
 {
-  auto TransformOut = TransformOutDispatcher(colorOut_index);
-  auto rgb = TransformOut(p);
+  const int rowWidth = rowXBound - rowX;
 
-  return rgb;
-}
-
-void GColorspaceIop::pixel_engine(const Row& in, int rowY, int rowX,
-                                  int rowXBound, ChannelMask outputChannels,
-                                  Row& out)
-{
-  int rowWidth = rowXBound - rowX;
+  // the RGB triplets of every requested layer go through the kernel
+  // together, flushed when a comp has more layers than fit
+  PlanarLayer layers[kMaxLayers];
+  int count = 0;
 
   ChannelSet done;
 
@@ -357,39 +607,148 @@ void GColorspaceIop::pixel_engine(const Row& in, int rowY, int rowX,
     done += gChannel;
     done += bChannel;
 
-    const float* rIn = in[rChannel] + rowX;
-    const float* gIn = in[gChannel] + rowX;
-    const float* bIn = in[bChannel] + rowX;
+    // read from the input and write the output in a single pass, identity
+    // settings only copy
+    PlanarLayer& layer = layers[count++];
+    layer.r = in[rChannel] + rowX;
+    layer.g = in[gChannel] + rowX;
+    layer.b = in[bChannel] + rowX;
+    layer.rOut = out.writable(rChannel) + rowX;
+    layer.gOut = out.writable(gChannel) + rowX;
+    layer.bOut = out.writable(bChannel) + rowX;
+
+    if(count == kMaxLayers) {
+      convertLayers(layers, count, rowWidth);
+      count = 0;
+    }
+  }
 
-    float* rOut = out.writable(rChannel) + rowX;
-    float* gOut = out.writable(gChannel) + rowX;
-    float* bOut = out.writable(bChannel) + rowX;
+  convertLayers(layers, count, rowWidth);
+}
 
-    if(rOut != rIn) memcpy(rOut, rIn, sizeof(float) * rowWidth);
-    if(gOut != gIn) memcpy(gOut, gIn, sizeof(float) * rowWidth);
-    if(bOut != bIn) memcpy(bOut, bIn, sizeof(float) * rowWidth);
+// The temporal cache serves the layers it has seen with this transform and
+// keeps the others once they are converted. A LUT published since counts as
+// another transform, so cached exact rows do not outlive the bake.
+void GColorspaceIop::convertLayers(PlanarLayer* layers, int count, int n)
+{
+  if(!temporal_cache || plan.identity || count == 0) {
+    ApplyPlanar(plan, layers, count, n);
+    return;
+  }
 
-    const float* END = rIn + (rowXBound - rowX);
+  RowCache& cache = RowCache::instance();
+  const uint64_t salt = rowSalt ^ (TransformDetail::CurrentLut(plan) ? 1 : 0);
+  PlanarLayer misses[kMaxLayers];
+  uint64_t hashes[kMaxLayers];
+  int missCount = 0;
+  for(int i = 0; i < count; ++i) {
+    const uint64_t hash = RowCache::Hash(salt, layers[i], n);
+    if(cache.lookup(hash, salt, layers[i], n)) continue;
+    hashes[missCount] = hash;
+    misses[missCount++] = layers[i];
+  }
+  rowLookups += count;
+  rowHits += count - missCount;
 
-    // if the colorspace matches the output, simply output the entire image
-    if(colorIn_index == colorOut_index && whiteIn_index == whiteOut_index &&
-       primaryIn_index == primaryOut_index) {
-      continue;
-    }
+  ApplyPlanar(plan, misses, missCount, n);
+  for(int i = 0; i < missCount; ++i) {
+    cache.store(hashes[i], salt, misses[i], n);
+  }
+}
+
+// False when there is no band (a prefetch dropped by drain()) or it lacks
+// a channel of 'outputChannels' that _request did not ask for, the row
+// engine converts that row then.
+bool GColorspaceIop::bandEngine(int rowY, int rowX, int rowXBound,
+                                ChannelMask outputChannels, Row& out)
+{
+  auto fill = [this](Band& band) { return renderBand(band); };
+  const BandCache::Entry band = bands.acquire(rowY, fill);
+  if(band == nullptr) {
+    if(!aborted()) return false;
+    out.erase(outputChannels);
+    return true;
+  }
 
-    while(rIn < END) {
-      RGBcolor RGB = {*rIn++, *gIn++, *bIn++};
+  foreach(z, outputChannels) {
+    if(band->line(z, rowY) == nullptr) return false;
+  }
+  const size_t bytes = sizeof(float) * (rowXBound - rowX);
+  foreach(z, outputChannels) {
+    const float* src = band->line(z, rowY);
+    std::memcpy(out.writable(z) + rowX, src + (rowX - band->x), bytes);
+  }
 
-      auto colorspaceIn = ToInColorspace(RGB);
-      auto colorspaceOut = ToOutColorspace(colorspaceIn);
+  // the next band renders on the ThreadPool meanwhile, so the threads that
+  // reach it find it ready instead of all waiting on one
+  if(band->y + band->rows < info().t()) {
+    bands.prefetch(rowY, fill);
+  }
+  return true;
+}
 
-      auto filteredRGB = removeExp(colorspaceOut);
+// The channels asked for in _request for rows [band.y, band.y + band.rows)
+// over the whole data window, only their layers converted, with one
+// ApplyPlanar call.
+bool GColorspaceIop::renderBand(Band& band)
+{
+  const int y = std::max(band.y, info().y());
+  const int t = std::min(band.y + band.rows, info().t());
+  band.y = y;
+  band.rows = t - y;
+  band.x = info().x();
+  band.width = info().r() - info().x();
+  if(band.rows <= 0 || band.width <= 0) return false;
+
+  ChannelSet channels;
+  {
+    std::lock_guard<std::mutex> lock(bandChannelsLock);
+    channels = bandChannels;
+  }
+  in_channels(0, channels);
+  if(channels.empty()) return false;
+
+  Tile tile(input0(), band.x, y, info().r(), t, channels);
+  if(aborted() || !tile.valid()) return false;
+
+  std::vector<int> ids;
+  foreach(z, channels) ids.push_back(z);
+  band.allocate(ids);
+
+  const size_t bytes = sizeof(float) * band.width;
+  foreach(z, channels) {
+    float* plane = band.plane(z);
+    for(int row = y; row < t; ++row) {
+      std::memcpy(plane + static_cast<size_t>(row - y) * band.width,
+                  tile[z][row] + band.x, bytes);
+    }
+  }
+
+  PlanarLayer layers[kMaxLayers];
+  int count = 0;
+  ChannelSet done;
+  foreach(z, channels) {
+    if(colourIndex(z) >= 3 || (done & z)) continue;
+
+    Channel rChannel = brother(z, 0);
+    Channel gChannel = brother(z, 1);
+    Channel bChannel = brother(z, 2);
+    done += rChannel;
+    done += gChannel;
+    done += bChannel;
 
-      *rOut++ = filteredRGB[0];
-      *gOut++ = filteredRGB[1];
-      *bOut++ = filteredRGB[2];
+    float* r = band.plane(rChannel);
+    float* g = band.plane(gChannel);
+    float* b = band.plane(bChannel);
+    if(r == nullptr || g == nullptr || b == nullptr) continue;
+    layers[count++] = {r, g, b, r, g, b};
+    if(count == kMaxLayers) {
+      ApplyPlanar(plan, layers, count, static_cast<int>(band.planeSize()));
+      count = 0;
     }
   }
+  ApplyPlanar(plan, layers, count, static_cast<int>(band.planeSize()));
+  return true;
 }
 
 const Op::Description GColorspaceIop::description("GColorspace", build);
@@ -0,0 +1,312 @@
+// Golden-file checks of the BlinkScript export (BlinkExport.h).
+//
+// Every case's kernel is generated again and compared with its file in
+// tests/golden. The golden files are also compiled into this test as C++,
+// through the few Blink types and keywords they use, and every kernel's
+// process() runs over a sweep of its input range against ApplyPlanar on the
+// same exact plan.
+//
+// After an intended change of the generated code, run
+//   test_blink_export --update
+// to write the golden files again, review their diff and rebuild.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "include/BlinkExport.h"
+#include "include/TransformPlan.h"
+
+namespace Blink
+{
+  struct float3
+  {
+    float x, y, z;
+    float3(float x, float y, float z) : x(x), y(y), z(z) {}
+  };
+
+  struct float4
+  {
+    float x, y, z, w;
+    float4() : x(0), y(0), z(0), w(0) {}
+    float4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+  };
+
+  enum { ePixelWise, eRead, eWrite, eAccessPoint, eEdgeClamped };
+
+  template <int>
+  struct ImageComputationKernel
+  {
+  };
+
+  // one pixel, read and written through operator()
+  template <int...>
+  struct Image
+  {
+    float4 pixel;
+    float4& operator()() { return pixel; }
+  };
+
+  // Blink's maths is float
+  inline float pow(float x, float y) { return std::pow(x, y); }
+  inline float exp(float x) { return std::exp(x); }
+  inline float log(float x) { return std::log(x); }
+  inline float log10(float x) { return std::log10(x); }
+  inline float sqrt(float x) { return std::sqrt(x); }
+  inline float fabs(float x) { return std::fabs(x); }
+  inline float fmod(float x, float y) { return std::fmod(x, y); }
+  inline float sin(float x) { return std::sin(x); }
+  inline float cos(float x) { return std::cos(x); }
+  inline float atan2(float y, float x) { return std::atan2(y, x); }
+  inline float min(float a, float b) { return std::min(a, b); }
+  inline float max(float a, float b) { return std::max(a, b); }
+}  // namespace Blink
+
+#define kernel struct
+#define SampleType(image) float4
+
+// nested in Blink, so its float maths hides the double overloads of
+// <cmath> instead of being ambiguous with them
+namespace Blink
+{
+  namespace ArriLogC4ToSRGB
+  {
+#include "tests/golden/arrilogc4_to_srgb.blink"
+  }
+  namespace CineonToLinear
+  {
+#include "tests/golden/cineon_to_linear.blink"
+  }
+  namespace LinearToSLog3
+  {
+#include "tests/golden/linear_to_slog3.blink"
+  }
+  namespace AlexaV3LogCToRec709
+  {
+#include "tests/golden/alexav3logc_to_rec709.blink"
+  }
+  namespace WhiteInD50Bradford
+  {
+#include "tests/golden/white_in_d50_bradford.blink"
+  }
+  namespace SRGBToYCbCr
+  {
+#include "tests/golden/srgb_to_ycbcr.blink"
+  }
+  namespace LinearToLab
+  {
+#include "tests/golden/linear_to_lab.blink"
+  }
+  namespace HSVToHSL
+  {
+#include "tests/golden/hsv_to_hsl.blink"
+  }
+  namespace St2084ToGamma240
+  {
+#include "tests/golden/st2084_to_gamma240.blink"
+  }
+  namespace CLogToLog3G10
+  {
+#include "tests/golden/clog_to_log3g10.blink"
+  }
+  namespace YxyToLCh
+  {
+#include "tests/golden/yxy_to_lch.blink"
+  }
+}  // namespace Blink
+
+#undef kernel
+#undef SampleType
+
+namespace
+{
+  // relative, absolute below 1
+  constexpr double kTolerance = 1e-5;
+  constexpr int kSteps = 24;
+  // saturation or chroma below which a hue is not compared
+  constexpr float kAchromatic = 1e-4f;
+
+  template <typename Kernel>
+  Blink::float4 Run(float r, float g, float b, float a)
+  {
+    Kernel k;
+    k.src.pixel = Blink::float4(r, g, b, a);
+    k.process();
+    return k.dst.pixel;
+  }
+
+  using RunFn = Blink::float4 (*)(float, float, float, float);
+
+  struct Case
+  {
+    const char* file;
+    RunFn run;
+    TransformSettings settings;
+    // input range swept on every channel
+    float lo, hi;
+    // output channel holding a hue in [0, 1), -1 for none
+    int hue;
+  };
+
+  TransformSettings Settings(int colorIn, int colorOut)
+  {
+    TransformSettings s;
+    s.colorIn = colorIn;
+    s.colorOut = colorOut;
+    return s;
+  }
+
+  Case Make(const char* file, RunFn run, const TransformSettings& s, float lo,
+            float hi, int hue = -1)
+  {
+    Case c;
+    c.file = file;
+    c.run = run;
+    c.settings = s;
+    c.lo = lo;
+    c.hi = hi;
+    c.hue = hue;
+    return c;
+  }
+
+  std::string GoldenPath(const char* file)
+  {
+    return std::string(GCOLORSPACE_GOLDEN_DIR) + "/" + file;
+  }
+
+  std::string ReadFile(const std::string& path)
+  {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+  }
+
+  bool Check(const Case& c, bool update)
+  {
+    const TransformPlan plan = MakeTransformPlan(c.settings);
+    std::string error;
+    const std::string source = BlinkKernelSource(plan, &error);
+    if(source.empty()) {
+      std::printf("%-28s %s\n", c.file, error.c_str());
+      return false;
+    }
+    const std::string path = GoldenPath(c.file);
+    if(update) {
+      std::ofstream out(path.c_str(), std::ios::binary);
+      out << source;
+      std::printf("%-28s written\n", c.file);
+      return static_cast<bool>(out);
+    }
+    const bool same = ReadFile(path) == source;
+
+    double worst = 0;
+    bool alpha = true;
+    for(int i = 0; i <= kSteps; ++i) {
+      for(int j = 0; j <= kSteps; ++j) {
+        for(int k = 0; k <= kSteps; ++k) {
+          const float step = (c.hi - c.lo) / kSteps;
+          float rgb[3] = {c.lo + i * step, c.lo + j * step, c.lo + k * step};
+          const Blink::float4 got = c.run(rgb[0], rgb[1], rgb[2], 0.25f);
+          ApplyPlanar(plan, &rgb[0], &rgb[1], &rgb[2], 1);
+          const float values[3] = {got.x, got.y, got.z};
+          for(int ch = 0; ch < 3; ++ch) {
+            // NaN on both sides, outside the domain of the same curve
+            if(std::isnan(values[ch]) && std::isnan(rgb[ch])) continue;
+            double e = std::fabs(values[ch] - rgb[ch]) /
+                       std::max(1.0, std::fabs(double(rgb[ch])));
+            if(ch == c.hue) {
+              // the hue of a near gray is rounding noise, and 0 and 1 are
+              // the same hue. HSL and LCh keep saturation / chroma in g.
+              if(std::fabs(rgb[1]) < kAchromatic) continue;
+              e = std::min(e, 1.0 - e);
+            }
+            worst = std::max(worst, std::isnan(e) ? INFINITY : e);
+          }
+          alpha = alpha && got.w == 0.25f;
+        }
+      }
+    }
+
+    const bool ok = same && alpha && worst <= kTolerance;
+    std::printf("%-28s %-14s worst %.2e%s  %s\n", c.file,
+                same ? "matches" : "CHANGED", worst,
+                alpha ? "" : ", alpha lost", ok ? "ok" : "FAILED");
+    return ok;
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  const bool update = argc > 1 && !std::strcmp(argv[1], "--update");
+
+  TransformSettings logC4 =
+      Settings(Constants::COLOR_ARRI_LOG_C4, Constants::COLOR_SRGB);
+  logC4.primaryIn = Constants::PRIM_COLOR_ARRI_WIDE_GAMUT4;
+  TransformSettings slog3 =
+      Settings(Constants::COLOR_LINEAR, Constants::COLOR_SLOG3);
+  slog3.primaryOut = Constants::PRIM_COLOR_SONY_S_GAMUT;
+  TransformSettings white =
+      Settings(Constants::COLOR_LINEAR, Constants::COLOR_LINEAR);
+  white.whiteIn = Constants::WHITE_D50;
+  white.bradford = true;
+  TransformSettings ycbcr =
+      Settings(Constants::COLOR_SRGB, Constants::COLOR_Y_CB_CR);
+  ycbcr.ycbcrMatrix = Constants::YCC_REC2020;
+  ycbcr.ycbcrRange = Constants::YCC_RANGE_FULL;
+  TransformSettings pq =
+      Settings(Constants::COLOR_ST2084, Constants::COLOR_GAMMA_2_40);
+  pq.primaryIn = Constants::PRIM_COLOR_REC_2020;
+
+  using namespace Blink;
+  const TransformSettings cineon =
+      Settings(Constants::COLOR_CINEON, Constants::COLOR_LINEAR);
+  const TransformSettings logC3 =
+      Settings(Constants::COLOR_ALEXAV3LOGC, Constants::COLOR_REC709);
+  const TransformSettings lab =
+      Settings(Constants::COLOR_LINEAR, Constants::COLOR_LAB);
+  const TransformSettings hsv =
+      Settings(Constants::COLOR_HSV, Constants::COLOR_HSL);
+  const TransformSettings clog =
+      Settings(Constants::COLOR_CLOG, Constants::COLOR_LOG3G10);
+  const TransformSettings yxy =
+      Settings(Constants::COLOR_CIE_YXY, Constants::COLOR_CIE_LCH);
+
+  const Case cases[] = {
+      Make("arrilogc4_to_srgb.blink",
+           Run<ArriLogC4ToSRGB::GColorspaceKernel>, logC4, 0.0f, 1.0f),
+      Make("cineon_to_linear.blink", Run<CineonToLinear::GColorspaceKernel>,
+           cineon, 0.0f, 1.0f),
+      Make("linear_to_slog3.blink", Run<LinearToSLog3::GColorspaceKernel>,
+           slog3, 0.0f, 8.0f),
+      Make("alexav3logc_to_rec709.blink",
+           Run<AlexaV3LogCToRec709::GColorspaceKernel>, logC3, 0.0f, 1.0f),
+      Make("white_in_d50_bradford.blink",
+           Run<WhiteInD50Bradford::GColorspaceKernel>, white, 0.0f, 4.0f),
+      Make("srgb_to_ycbcr.blink", Run<SRGBToYCbCr::GColorspaceKernel>, ycbcr,
+           0.0f, 1.0f),
+      Make("linear_to_lab.blink", Run<LinearToLab::GColorspaceKernel>, lab,
+           0.0f, 1.0f),
+      Make("hsv_to_hsl.blink", Run<HSVToHSL::GColorspaceKernel>, hsv, 0.0f,
+           1.0f, 0),
+      Make("st2084_to_gamma240.blink",
+           Run<St2084ToGamma240::GColorspaceKernel>, pq, 0.0f, 1.0f),
+      Make("clog_to_log3g10.blink", Run<CLogToLog3G10::GColorspaceKernel>,
+           clog, 0.0f, 1.0f),
+      Make("yxy_to_lch.blink", Run<YxyToLCh::GColorspaceKernel>, yxy, 0.05f,
+           1.0f, 2),
+  };
+
+  int failed = 0;
+  for(const Case& c : cases) {
+    if(!Check(c, update)) ++failed;
+  }
+  if(update) {
+    std::printf("rebuild to compile the new golden files in\n");
+  }
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,413 @@
+// Round trip of the CLF export (ClfExport.h) against ApplyPlanar.
+//
+// Every case's document is written by ClfDocument, read back by the small
+// CLF 3 evaluator below and run over a sweep of its input range, against
+// ApplyPlanar on the same exact plan. The evaluator follows the formulas of
+// the CLF 3 specification, not ClfExport.h, so a node written with the
+// wrong style, parameter or table order shows up as an error. It handles
+// the nodes the exporter writes: Matrix, Log, Exponent, LUT1D (halfDomain
+// too) and LUT3D with tetrahedral interpolation.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "include/ClfExport.h"
+#include "include/TransformPlan.h"
+
+namespace
+{
+  constexpr int kSteps = 24;
+
+  // One node as read from the document
+  struct Node
+  {
+    std::string tag;
+    std::string style;
+    bool halfDomain = false;
+    std::vector<double> params;  // in the order of kParams
+    std::vector<int> dim;
+    std::vector<double> array;
+  };
+
+  enum {
+    BASE,
+    LOG_SLOPE,
+    LOG_OFFSET,
+    LIN_SLOPE,
+    LIN_OFFSET,
+    LIN_BREAK,
+    LINEAR_SLOPE,
+    EXPONENT,
+    OFFSET,
+    PARAM_COUNT
+  };
+  const char* const kParams[PARAM_COUNT] = {
+      "base",         "logSideSlope",  "logSideOffset",
+      "linSideSlope", "linSideOffset", "linSideBreak",
+      "linearSlope",  "exponent",      "offset"};
+
+  // value of name="..." in 'text', empty when missing
+  std::string Attribute(const std::string& text, const char* name)
+  {
+    const std::string key = std::string(" ") + name + "=\"";
+    const size_t at = text.find(key);
+    if(at == std::string::npos) return std::string();
+    const size_t start = at + key.size();
+    return text.substr(start, text.find('"', start) - start);
+  }
+
+  // the process nodes of a document, false when it is not one
+  bool Parse(const std::string& doc, std::vector<Node>& nodes)
+  {
+    if(Attribute(doc, "compCLFversion") != "3.0") return false;
+    static const char* const kTags[] = {"Matrix", "Log", "Exponent", "LUT1D",
+                                        "LUT3D"};
+    size_t at = 0;
+    while((at = doc.find("\n  <", at)) != std::string::npos) {
+      at += 4;
+      const size_t close = doc.find('>', at);
+      const std::string open = doc.substr(at, close - at);
+      Node node;
+      for(const char* tag : kTags) {
+        const size_t n = std::strlen(tag);
+        if(open.compare(0, n, tag) == 0 && open[n] == ' ') node.tag = tag;
+      }
+      if(node.tag.empty()) continue;
+      node.style = Attribute(open, "style");
+      node.halfDomain = Attribute(open, "halfDomain") == "true";
+
+      const size_t end = doc.find("</" + node.tag + ">", close);
+      const std::string body = doc.substr(close + 1, end - close - 1);
+      node.params.assign(PARAM_COUNT, NAN);
+      for(int p = 0; p < PARAM_COUNT; ++p) {
+        const std::string v = Attribute(body, kParams[p]);
+        if(!v.empty()) node.params[p] = std::atof(v.c_str());
+      }
+      const size_t array = body.find("<Array");
+      if(array != std::string::npos) {
+        const std::string dim = Attribute(body.substr(array), "dim");
+        for(const char* p = dim.c_str(); *p;) {
+          char* next;
+          node.dim.push_back(static_cast<int>(std::strtol(p, &next, 10)));
+          p = next;
+        }
+        const char* p = body.c_str() + body.find('>', array) + 1;
+        for(;;) {
+          char* next;
+          const double v = std::strtod(p, &next);
+          if(next == p) break;
+          node.array.push_back(v);
+          p = next;
+        }
+      }
+      nodes.push_back(node);
+      at = end;
+    }
+    return !nodes.empty();
+  }
+
+  double LogBase(const Node& n, double x)
+  {
+    return std::log(x) / std::log(n.params[BASE]);
+  }
+
+  void Matrix(const Node& n, double* rgb)
+  {
+    const int columns = n.dim[1];
+    double out[3];
+    for(int i = 0; i < 3; ++i) {
+      const double* row = &n.array[columns * i];
+      out[i] = row[0] * rgb[0] + row[1] * rgb[1] + row[2] * rgb[2] +
+               (columns == 4 ? row[3] : 0.0);
+    }
+    std::copy(out, out + 3, rgb);
+  }
+
+  double Log(const Node& n, double x)
+  {
+    const double* p = n.params.data();
+    const bool camera = n.style.compare(0, 6, "camera") == 0;
+    const bool toLog = n.style == "linToLog" || n.style == "cameraLinToLog";
+    // the linear segment below the break meets the log side there
+    double linearOffset = 0.0;
+    if(camera) {
+      const double logAtBreak =
+          p[LOG_SLOPE] * LogBase(n, p[LIN_SLOPE] * p[LIN_BREAK] +
+                                        p[LIN_OFFSET]) +
+          p[LOG_OFFSET];
+      linearOffset = logAtBreak - p[LINEAR_SLOPE] * p[LIN_BREAK];
+    }
+    if(toLog) {
+      if(camera && x <= p[LIN_BREAK]) {
+        return p[LINEAR_SLOPE] * x + linearOffset;
+      }
+      return p[LOG_SLOPE] * LogBase(n, p[LIN_SLOPE] * x + p[LIN_OFFSET]) +
+             p[LOG_OFFSET];
+    }
+    if(camera && x <= p[LINEAR_SLOPE] * p[LIN_BREAK] + linearOffset) {
+      return (x - linearOffset) / p[LINEAR_SLOPE];
+    }
+    return (std::pow(p[BASE], (x - p[LOG_OFFSET]) / p[LOG_SLOPE]) -
+            p[LIN_OFFSET]) /
+           p[LIN_SLOPE];
+  }
+
+  double Exponent(const Node& n, double x)
+  {
+    const double g = n.params[EXPONENT];
+    if(n.style == "basicFwd") return std::pow(std::max(0.0, x), g);
+    if(n.style == "basicRev") return std::pow(std::max(0.0, x), 1.0 / g);
+
+    // monCurve, a power with a linear segment below the break
+    const double o = n.params[OFFSET];
+    const double xBreak = o / (g - 1.0);
+    const double yBreak = std::pow(o * g / ((g - 1.0) * (1.0 + o)), g);
+    const double slope = yBreak / xBreak;
+    if(n.style == "monCurveFwd") {
+      return x >= xBreak ? std::pow((x + o) / (1.0 + o), g) : x * slope;
+    }
+    return x >= yBreak ? (1.0 + o) * std::pow(x, 1.0 / g) - o : x / slope;
+  }
+
+  // the half values either side of x, for the interpolation of halfDomain
+  double HalfLookup(const Node& n, int channel, double x)
+  {
+    const int channels = n.dim[1];
+    const float f = static_cast<float>(x);
+    uint16_t lo = FloatToHalf(f);
+    if(HalfToFloat(lo) > f) lo = (lo & 0x8000) ? lo + 1 : lo - 1;
+    uint16_t hi = (lo & 0x8000) ? (lo == 0x8000 ? 0 : lo - 1) : lo + 1;
+    const double a = HalfToFloat(lo);
+    const double b = HalfToFloat(hi);
+    const double va = n.array[lo * channels + channel % channels];
+    const double vb = n.array[hi * channels + channel % channels];
+    return b > a ? va + (vb - va) * (x - a) / (b - a) : va;
+  }
+
+  double Lut1D(const Node& n, int channel, double x)
+  {
+    if(n.halfDomain) return HalfLookup(n, channel, x);
+    const int size = n.dim[0];
+    const int channels = n.dim[1];
+    const double i = std::min(std::max(x, 0.0), 1.0) * (size - 1);
+    const int i0 = std::min(static_cast<int>(i), size - 2);
+    const double t = i - i0;
+    const double v0 = n.array[i0 * channels + channel % channels];
+    const double v1 = n.array[(i0 + 1) * channels + channel % channels];
+    return v0 + (v1 - v0) * t;
+  }
+
+  // tetrahedral, blue varying fastest
+  void Lut3D(const Node& n, double* rgb)
+  {
+    const int size = n.dim[0];
+    double f[3];
+    int i0[3];
+    for(int c = 0; c < 3; ++c) {
+      const double v = std::min(std::max(rgb[c], 0.0), 1.0) * (size - 1);
+      i0[c] = std::min(static_cast<int>(v), size - 2);
+      f[c] = v - i0[c];
+    }
+    auto at = [&](int dr, int dg, int db, int c) {
+      const size_t index =
+          (static_cast<size_t>(i0[0] + dr) * size + (i0[1] + dg)) * size +
+          (i0[2] + db);
+      return n.array[3 * index + c];
+    };
+    const double fr = f[0], fg = f[1], fb = f[2];
+    for(int c = 0; c < 3; ++c) {
+      const double c000 = at(0, 0, 0, c), c111 = at(1, 1, 1, c);
+      double v;
+      if(fr > fg) {
+        if(fg > fb) {
+          v = c000 + fr * (at(1, 0, 0, c) - c000) +
+              fg * (at(1, 1, 0, c) - at(1, 0, 0, c)) +
+              fb * (c111 - at(1, 1, 0, c));
+        }
+        else if(fr > fb) {
+          v = c000 + fr * (at(1, 0, 0, c) - c000) +
+              fb * (at(1, 0, 1, c) - at(1, 0, 0, c)) +
+              fg * (c111 - at(1, 0, 1, c));
+        }
+        else {
+          v = c000 + fb * (at(0, 0, 1, c) - c000) +
+              fr * (at(1, 0, 1, c) - at(0, 0, 1, c)) +
+              fg * (c111 - at(1, 0, 1, c));
+        }
+      }
+      else {
+        if(fb > fg) {
+          v = c000 + fb * (at(0, 0, 1, c) - c000) +
+              fg * (at(0, 1, 1, c) - at(0, 0, 1, c)) +
+              fr * (c111 - at(0, 1, 1, c));
+        }
+        else if(fb > fr) {
+          v = c000 + fg * (at(0, 1, 0, c) - c000) +
+              fb * (at(0, 1, 1, c) - at(0, 1, 0, c)) +
+              fr * (c111 - at(0, 1, 1, c));
+        }
+        else {
+          v = c000 + fg * (at(0, 1, 0, c) - c000) +
+              fr * (at(1, 1, 0, c) - at(0, 1, 0, c)) +
+              fb * (c111 - at(1, 1, 0, c));
+        }
+      }
+      rgb[c] = v;
+    }
+  }
+
+  void Evaluate(const std::vector<Node>& nodes, double* rgb)
+  {
+    for(const Node& n : nodes) {
+      if(n.tag == "Matrix") {
+        Matrix(n, rgb);
+      }
+      else if(n.tag == "LUT3D") {
+        Lut3D(n, rgb);
+      }
+      else {
+        for(int c = 0; c < 3; ++c) {
+          if(n.tag == "Log") {
+            rgb[c] = Log(n, rgb[c]);
+          }
+          else if(n.tag == "Exponent") {
+            rgb[c] = Exponent(n, rgb[c]);
+          }
+          else {
+            rgb[c] = Lut1D(n, c, rgb[c]);
+          }
+        }
+      }
+    }
+  }
+
+  struct Case
+  {
+    const char* name;
+    TransformSettings settings;
+    // input range swept on every channel, in 'steps' steps
+    float lo, hi;
+    int steps;
+    // relative, absolute below 1
+    double tolerance;
+    // node the case has to export, to keep every kind covered
+    const char* tag;
+  };
+
+  TransformSettings Settings(int colorIn, int colorOut)
+  {
+    TransformSettings s;
+    s.colorIn = colorIn;
+    s.colorOut = colorOut;
+    return s;
+  }
+
+  Case Make(const char* name, const TransformSettings& s, float lo, float hi,
+            double tolerance, const char* tag, int steps = kSteps)
+  {
+    Case c;
+    c.name = name;
+    c.settings = s;
+    c.lo = lo;
+    c.hi = hi;
+    c.steps = steps;
+    c.tolerance = tolerance;
+    c.tag = tag;
+    return c;
+  }
+
+  bool Check(const Case& c)
+  {
+    const TransformPlan plan = MakeTransformPlan(c.settings);
+    std::vector<Node> nodes;
+    if(!Parse(ClfDocument(plan), nodes)) {
+      std::printf("%-24s cannot read the document  FAILED\n", c.name);
+      return false;
+    }
+    bool tagged = false;
+    for(const Node& n : nodes) tagged = tagged || n.tag == c.tag;
+
+    double worst = 0;
+    for(int i = 0; i <= c.steps; ++i) {
+      for(int j = 0; j <= c.steps; ++j) {
+        for(int k = 0; k <= c.steps; ++k) {
+          const float step = (c.hi - c.lo) / c.steps;
+          float rgb[3] = {c.lo + i * step, c.lo + j * step, c.lo + k * step};
+          double clf[3] = {rgb[0], rgb[1], rgb[2]};
+          Evaluate(nodes, clf);
+          ApplyPlanar(plan, &rgb[0], &rgb[1], &rgb[2], 1);
+          for(int ch = 0; ch < 3; ++ch) {
+            // a gamma of a negative value, which CLF clamps to 0
+            if(std::isnan(rgb[ch])) continue;
+            const double e = std::fabs(clf[ch] - rgb[ch]) /
+                             std::max(1.0, std::fabs(double(rgb[ch])));
+            worst = std::max(worst, std::isnan(e) ? INFINITY : e);
+          }
+        }
+      }
+    }
+
+    const bool ok = tagged && worst <= c.tolerance;
+    std::printf("%-24s %zu node(s), %-8s worst %.2e  %s\n", c.name,
+                nodes.size(), tagged ? c.tag : "MISSING", worst,
+                ok ? "ok" : "FAILED");
+    return ok;
+  }
+}  // namespace
+
+int main()
+{
+  TransformSettings logC4 =
+      Settings(Constants::COLOR_ARRI_LOG_C4, Constants::COLOR_SRGB);
+  logC4.primaryIn = Constants::PRIM_COLOR_ARRI_WIDE_GAMUT4;
+  TransformSettings slog3 =
+      Settings(Constants::COLOR_LINEAR, Constants::COLOR_SLOG3);
+  slog3.primaryOut = Constants::PRIM_COLOR_SONY_S_GAMUT;
+  TransformSettings white =
+      Settings(Constants::COLOR_LINEAR, Constants::COLOR_GAMMA_2_40);
+  white.whiteIn = Constants::WHITE_D50;
+  white.bradford = true;
+  TransformSettings ycbcr =
+      Settings(Constants::COLOR_SRGB, Constants::COLOR_Y_CB_CR);
+  ycbcr.ycbcrMatrix = Constants::YCC_REC2020;
+  ycbcr.ycbcrRange = Constants::YCC_RANGE_FULL;
+  TransformSettings pq =
+      Settings(Constants::COLOR_ST2084, Constants::COLOR_LINEAR);
+  pq.primaryIn = Constants::PRIM_COLOR_REC_2020;
+
+  // The linear segments of monCurve are steeper than those of ColorLut.h,
+  // sRGB's by 2.5e-4 relative (the negative values of the LogC4 toe show
+  // it) and rec709's by 3e-3, within 3e-4 up to its break. The HSV cube is
+  // checked on its lattice, between its points it cuts the corners of the
+  // piecewise linear hue.
+  const Case cases[] = {
+      Make("cineon -> linear",
+           Settings(Constants::COLOR_CINEON, Constants::COLOR_LINEAR), 0.0f,
+           1.0f, 1e-5, "Log"),
+      Make("arrilogc4 -> srgb", logC4, 0.0f, 1.0f, 1e-4, "Log"),
+      Make("linear -> slog3", slog3, 0.0f, 8.0f, 1e-5, "Log"),
+      Make("d50 -> gamma 2.4", white, 0.0f, 4.0f, 1e-5, "Exponent"),
+      Make("linear -> rec709",
+           Settings(Constants::COLOR_LINEAR, Constants::COLOR_REC709), 0.0f,
+           1.0f, 1e-5, "Exponent"),
+      Make("linear -> rec709 toe",
+           Settings(Constants::COLOR_LINEAR, Constants::COLOR_REC709), 0.0f,
+           0.03f, 3e-4, "Exponent"),
+      Make("srgb -> ycbcr", ycbcr, 0.0f, 1.0f, 1e-5, "Matrix"),
+      Make("st2084 -> linear", pq, 0.0f, 1.0f, 1e-4, "LUT1D"),
+      Make("hsv -> linear",
+           Settings(Constants::COLOR_HSV, Constants::COLOR_LINEAR), 0.0f,
+           1.0f, 1e-5, "LUT3D", ClfDetail::kCubeSize - 1),
+  };
+
+  int failed = 0;
+  for(const Case& c : cases) {
+    if(!Check(c)) ++failed;
+  }
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+// Cross-checks the LogCurve.h kernels against the scalar ColorLut.h
+// functions they replace, for every curve LogCurveFor() describes. Decode
+// runs over the whole code range [0, 1], encode over the linear values the
+// reference decode gives for it. Both then sweep the values below and above
+// those ranges, where the toes, the CLog mirror and range and the poles of
+// the logs are, and NaN / +-Inf mixed with ordinary values: a NaN has to
+// stay NaN and an infinity has to match the reference.
+//
+// AlexaV3LogC decodes with the exact inverse of the published encode, which
+// sits up to 3.2e-5 from the rounded decode formula in ColorLut.h, so its
+// decode is checked by the round trip through the reference encode.
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+#include "include/Dispatcher.h"
+#include "include/LogCurve.h"
+
+namespace
+{
+  constexpr int kSteps = 1 << 20;
+  // relative, absolute below 1
+  constexpr double kDecodeTolerance = 3e-5;
+  // code values
+  constexpr double kEncodeTolerance = 2e-6;
+  // NaN, infinities and ordinary values, an odd count so the tails run
+  constexpr int kSpecials = 37;
+
+  float Reference(TransformDispatcher f, float v)
+  {
+    return f({v, v, v})[0];
+  }
+
+  // the n + 1 values from lo to hi, an odd count so the kernels' tails run
+  std::vector<float> Sweep(float lo, float hi, int n)
+  {
+    std::vector<float> v(n + 1);
+    for(int i = 0; i <= n; ++i) v[i] = lo + (hi - lo) * i / n;
+    return v;
+  }
+
+  std::vector<float> Specials(float ordinary)
+  {
+    const float values[] = {std::numeric_limits<float>::quiet_NaN(),
+                            std::numeric_limits<float>::infinity(),
+                            -std::numeric_limits<float>::infinity(),
+                            ordinary};
+    std::vector<float> v(kSpecials);
+    for(int i = 0; i < kSpecials; ++i) v[i] = values[i % 4];
+    return v;
+  }
+
+  // |got - expected| scaled by 'scale', 0 when both are the same NaN or
+  // infinity and infinite when only one is
+  double Error(float got, float expected, double scale)
+  {
+    if(std::isnan(got) || std::isnan(expected)) {
+      return std::isnan(got) == std::isnan(expected) ? 0.0 : INFINITY;
+    }
+    if(std::isinf(got) || std::isinf(expected)) {
+      return got == expected ? 0.0 : INFINITY;
+    }
+    return std::fabs(static_cast<double>(got) - expected) / scale;
+  }
+
+  // Extra code error of an encode from rounding its log argument, large
+  // next to the pole of the log (below Cineon's black) and nothing
+  // elsewhere
+  double Conditioning(const LogCurveCoeffs& k, float x)
+  {
+    const bool toe = (k.flags & LogCurve::LOG_TOE) && x < k.linBreak;
+    if(toe || !std::isfinite(x)) return 0.0;
+    const double v = (k.flags & LogCurve::LOG_MIRROR) ? std::fabs(x) : x;
+    const double terms = std::fabs(k.linSlope * v) + std::fabs(k.linOffset);
+    const double arg = std::fabs(k.linSlope * v + k.linOffset);
+    if(arg == 0) return 0.0;
+    return 4.0 * std::fabs(k.encodeGain) * FLT_EPSILON * terms / arg;
+  }
+
+  struct Worst
+  {
+    double error = 0;
+    float at = 0;
+
+    void add(double e, float v)
+    {
+      if(!(e <= error)) {
+        error = e;
+        at = v;
+      }
+    }
+  };
+
+  struct Curve
+  {
+    int colorspace;
+    const LogCurveCoeffs& k;
+    TransformDispatcher decode;
+    TransformDispatcher encode;
+  };
+
+  // decode of 'codes', relative error or the round trip of AlexaV3LogC in
+  // code values
+  bool Decode(const Curve& c, const char* what,
+              const std::vector<float>& codes)
+  {
+    const bool roundTrip = c.colorspace == Constants::COLOR_ALEXAV3LOGC;
+    std::vector<float> linear(codes.size());
+    LogCurveIn(c.k, codes.data(), linear.data(),
+               static_cast<int>(codes.size()));
+    Worst worst;
+    for(size_t i = 0; i < codes.size(); ++i) {
+      if(roundTrip) {
+        worst.add(Error(Reference(c.encode, linear[i]), codes[i], 1.0),
+                  codes[i]);
+        continue;
+      }
+      const float expected = Reference(c.decode, codes[i]);
+      const double scale = std::max(1.0, std::fabs(double(expected)));
+      worst.add(Error(linear[i], expected, scale), codes[i]);
+    }
+    const double limit = roundTrip ? kEncodeTolerance : kDecodeTolerance;
+    const bool ok = worst.error <= limit;
+    std::printf("%-30s decode %-10s %.2e at %-12g %s\n",
+                Constants::COLOR_CURVE[c.colorspace], what, worst.error,
+                worst.at, ok ? "ok" : "FAILED");
+    return ok;
+  }
+
+  // encode of 'values', code values beyond the conditioning of the log
+  bool Encode(const Curve& c, const char* what,
+              const std::vector<float>& values)
+  {
+    std::vector<float> encoded(values.size());
+    LogCurveOut(c.k, values.data(), encoded.data(),
+                static_cast<int>(values.size()));
+    Worst worst;
+    for(size_t i = 0; i < values.size(); ++i) {
+      const double e = Error(encoded[i], Reference(c.encode, values[i]), 1.0);
+      worst.add(std::max(0.0, e - Conditioning(c.k, values[i])), values[i]);
+    }
+    const bool ok = worst.error <= kEncodeTolerance;
+    std::printf("%-30s encode %-10s %.2e at %-12g %s\n",
+                Constants::COLOR_CURVE[c.colorspace], what, worst.error,
+                worst.at, ok ? "ok" : "FAILED");
+    return ok;
+  }
+
+  bool Check(int colorspace, const LogCurveCoeffs& k)
+  {
+    const Curve c = {colorspace, k, TransformInDispatcher(colorspace),
+                     TransformOutDispatcher(colorspace)};
+    const float black = Reference(c.decode, 0.0f);
+    const float white = Reference(c.decode, 1.0f);
+
+    // codes [0, 1], [-1, 0] and [1, 2], linear values in the range they
+    // decode to, down to -1 and up to 4 times white
+    bool ok = Decode(c, "in range", Sweep(0.0f, 1.0f, kSteps));
+    ok = Decode(c, "below", Sweep(-1.0f, 0.0f, kSteps)) && ok;
+    ok = Decode(c, "above", Sweep(1.0f, 2.0f, kSteps)) && ok;
+    ok = Decode(c, "NaN / Inf", Specials(0.5f)) && ok;
+
+    ok = Encode(c, "in range", Sweep(black, white, kSteps)) && ok;
+    ok = Encode(c, "below", Sweep(-1.0f, black, kSteps)) && ok;
+    ok = Encode(c, "above", Sweep(white, 4.0f * white, kSteps)) && ok;
+    ok = Encode(c, "NaN / Inf", Specials(0.18f)) && ok;
+    return ok;
+  }
+}  // namespace
+
+int main()
+{
+  int curves = 0;
+  int failed = 0;
+  for(int c = 0; c < Constants::COLORSPACE_COUNT; ++c) {
+    const LogCurveCoeffs* k = LogCurveFor(c);
+    if(k == nullptr) continue;
+    ++curves;
+    if(!Check(c, *k)) ++failed;
+  }
+  std::printf("%d of %d log curves within tolerance\n", curves - failed,
+              curves);
+  return failed == 0 && curves > 0 ? 0 : 1;
+}
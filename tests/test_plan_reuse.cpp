@@ -0,0 +1,239 @@
+// Checks the pixel reuse of the layered ApplyPlanar (ProbeReuse, ApplyRuns,
+// ApplyMemo in TransformPlan.h) against the plain per plane ApplyPlanar,
+// bit for bit. Rows of long runs, of a few posterized colours and of noise,
+// with NaN, infinities and -0 among their colours, go through the layered
+// call as one batch, then through each reuse mode forced, in place and out
+// of place. The probe has to pick the mode each row is built for.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "include/TransformPlan.h"
+
+namespace
+{
+  // odd, so the kernels' tails run
+  constexpr int kPixels = 4099;
+
+  struct Row
+  {
+    const char* name;
+    int mode;  // what ProbeReuse has to find
+    std::vector<float> r, g, b;
+  };
+
+  const char* ModeName(int mode)
+  {
+    switch(mode) {
+      case TransformDetail::REUSE_RUNS:
+        return "runs";
+      case TransformDetail::REUSE_MEMO:
+        return "memo";
+      default:
+        return "none";
+    }
+  }
+
+  // colours every row draws from besides its random ones
+  void Special(std::mt19937& rng, float rgb[3])
+  {
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float inf = std::numeric_limits<float>::infinity();
+    const float colors[][3] = {{nan, 0.5f, 0.25f}, {inf, -inf, 1.0f},
+                               {-0.0f, 0.0f, -0.0f}, {0.18f, 0.18f, 0.18f}};
+    const float* c = colors[rng() % 4];
+    std::copy(c, c + 3, rgb);
+  }
+
+  void Random(std::mt19937& rng, float rgb[3])
+  {
+    std::uniform_real_distribution<float> u(-0.1f, 1.5f);
+    for(int c = 0; c < 3; ++c) rgb[c] = u(rng);
+  }
+
+  Row MakeRow(const char* name, int mode, unsigned seed)
+  {
+    std::mt19937 rng(seed);
+    Row row = {name, mode, {}, {}, {}};
+    float rgb[3] = {0, 0, 0};
+    // pixels left in the current run
+    int left = 0;
+    for(int i = 0; i < kPixels; ++i) {
+      if(left == 0) {
+        if(mode == TransformDetail::REUSE_RUNS) {
+          // runs of 1 to 200 pixels, the short ones stay on the kernel
+          left = 1 + static_cast<int>(rng() % 200);
+          if(rng() % 3 == 0) {
+            Special(rng, rgb);
+          }
+          else {
+            Random(rng, rgb);
+          }
+        }
+        else if(mode == TransformDetail::REUSE_MEMO) {
+          // 8 colours in any order, the specials among them
+          left = 1;
+          std::mt19937 palette(seed + rng() % 8);
+          if(palette() % 2 == 0) {
+            Special(palette, rgb);
+          }
+          else {
+            Random(palette, rgb);
+          }
+        }
+        else {
+          left = 1;
+          if(rng() % 50 == 0) {
+            Special(rng, rgb);
+          }
+          else {
+            Random(rng, rgb);
+          }
+        }
+      }
+      --left;
+      row.r.push_back(rgb[0]);
+      row.g.push_back(rgb[1]);
+      row.b.push_back(rgb[2]);
+    }
+    return row;
+  }
+
+  bool Same(const std::vector<float>& a, const std::vector<float>& b)
+  {
+    return std::memcmp(a.data(), b.data(), sizeof(float) * a.size()) == 0;
+  }
+
+  struct Planes
+  {
+    std::vector<float> r, g, b;
+
+    bool operator==(const Planes& o) const
+    {
+      return Same(r, o.r) && Same(g, o.g) && Same(b, o.b);
+    }
+  };
+
+  // the row converted by 'apply' into separate planes, or in place
+  template <typename Apply>
+  Planes Convert(const Row& row, bool inPlace, Apply apply)
+  {
+    Planes in = {row.r, row.g, row.b};
+    if(inPlace) {
+      apply(PlanarLayer{in.r.data(), in.g.data(), in.b.data(), in.r.data(),
+                        in.g.data(), in.b.data()});
+      return in;
+    }
+    Planes out = {std::vector<float>(kPixels, -1.0f),
+                  std::vector<float>(kPixels, -1.0f),
+                  std::vector<float>(kPixels, -1.0f)};
+    apply(PlanarLayer{in.r.data(), in.g.data(), in.b.data(), out.r.data(),
+                      out.g.data(), out.b.data()});
+    return out;
+  }
+
+  bool Check(const char* label, const TransformSettings& settings,
+             const std::vector<Row>& rows)
+  {
+    const TransformPlan plan = MakeTransformPlan(settings);
+    const BakedLut* lut = TransformDetail::CurrentLut(plan);
+    auto kernel = [&plan, lut](Simd::vfloat& x, Simd::vfloat& y,
+                               Simd::vfloat& z) {
+      TransformDetail::Run(plan, lut, x, y, z);
+    };
+
+    // every row as a layer of one batch, the probe picks the mode
+    std::vector<Planes> batch;
+    std::vector<PlanarLayer> layers;
+    for(const Row& row : rows) {
+      batch.push_back({std::vector<float>(kPixels),
+                       std::vector<float>(kPixels),
+                       std::vector<float>(kPixels)});
+      layers.push_back({row.r.data(), row.g.data(), row.b.data(),
+                        batch.back().r.data(), batch.back().g.data(),
+                        batch.back().b.data()});
+    }
+    ApplyPlanar(plan, layers.data(), static_cast<int>(layers.size()),
+                kPixels);
+
+    bool ok = true;
+    for(size_t i = 0; i < rows.size(); ++i) {
+      const Row& row = rows[i];
+      const Planes plain = Convert(row, false, [&](const PlanarLayer& l) {
+        ApplyPlanar(plan, l.r, l.g, l.b, l.rOut, l.gOut, l.bOut, kPixels);
+      });
+      const int probed = TransformDetail::ProbeReuse(
+          row.r.data(), row.g.data(), row.b.data(), kPixels);
+
+      bool same = batch[i] == plain;
+      for(bool inPlace : {false, true}) {
+        same = same && Convert(row, inPlace, [&](const PlanarLayer& l) {
+                         TransformDetail::ApplyRuns(l.r, l.g, l.b, l.rOut,
+                                                    l.gOut, l.bOut, kPixels,
+                                                    kernel);
+                       }) == plain;
+        same = same && Convert(row, inPlace, [&](const PlanarLayer& l) {
+                         TransformDetail::ApplyMemo(l.r, l.g, l.b, l.rOut,
+                                                    l.gOut, l.bOut, kPixels,
+                                                    kernel);
+                       }) == plain;
+      }
+
+      const bool rowOk = same && probed == row.mode;
+      if(!rowOk) ok = false;
+      std::printf("%-20s %-6s probe %-4s %-9s %s\n", label, row.name,
+                  ModeName(probed), same ? "identical" : "DIFFERS",
+                  rowOk ? "ok" : "FAILED");
+    }
+    return ok;
+  }
+
+  TransformSettings Settings(int colorIn, int colorOut, int precision)
+  {
+    TransformSettings s;
+    s.colorIn = colorIn;
+    s.colorOut = colorOut;
+    s.precision = precision;
+    return s;
+  }
+}  // namespace
+
+int main()
+{
+  const std::vector<Row> rows = {
+      MakeRow("runs", TransformDetail::REUSE_RUNS, 3),
+      MakeRow("poster", TransformDetail::REUSE_MEMO, 5),
+      MakeRow("noise", TransformDetail::REUSE_NONE, 7)};
+
+  TransformSettings gamut = Settings(Constants::COLOR_ALEXAV3LOGC,
+                                     Constants::COLOR_REC709,
+                                     Constants::PRECISION_EXACT);
+  gamut.primaryIn = Constants::PRIM_COLOR_ARRI_WIDE_GAMUT4;
+  gamut.whiteIn = Constants::WHITE_D50;
+  gamut.bradford = true;
+
+  int failed = 0;
+  failed += !Check("cineon -> linear",
+                   Settings(Constants::COLOR_CINEON, Constants::COLOR_LINEAR,
+                            Constants::PRECISION_EXACT),
+                   rows);
+  failed += !Check("logc -> rec709", gamut, rows);
+  failed += !Check("linear -> srgb lut",
+                   Settings(Constants::COLOR_LINEAR, Constants::COLOR_SRGB,
+                            Constants::PRECISION_LUT_3D_33),
+                   rows);
+  failed += !Check("hsv -> hsl",
+                   Settings(Constants::COLOR_HSV, Constants::COLOR_HSL,
+                            Constants::PRECISION_EXACT),
+                   rows);
+  failed += !Check("srgb -> ycbcr",
+                   Settings(Constants::COLOR_SRGB, Constants::COLOR_Y_CB_CR,
+                            Constants::PRECISION_EXACT),
+                   rows);
+  return failed == 0 ? 0 : 1;
+}
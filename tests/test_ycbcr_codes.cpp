@@ -0,0 +1,91 @@
+// Checks the fixed-point Y'CbCr encoder (YCbCrEncodeCodes) against a double
+// precision reference of the same definition: the sRGB curve clipped to
+// [0, 1], the matrix of YCbCrWeights() and the code range of
+// MakeYCbCrCodeRange(), rounded. Every matrix, range and depth from 8 to 12
+// bits, within one code.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "include/YCbCr.h"
+
+namespace
+{
+  constexpr int kPixels = 100003;
+
+  double SRGB(double x)
+  {
+    const double v = x <= 0.0031308 ? 12.92 * x
+                                    : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055;
+    return std::min(std::max(v, 0.0), 1.0);
+  }
+
+  // worst error in codes over the three planes
+  double Check(int matrix, int range, int bits, const std::vector<float>& r,
+               const std::vector<float>& g, const std::vector<float>& b)
+  {
+    const int n = static_cast<int>(r.size());
+    std::vector<uint16_t> y(n), cb(n), cr(n);
+    YCbCrEncodeCodes(MakeYCbCrFixed(matrix, range, bits), r.data(), g.data(),
+                     b.data(), y.data(), cb.data(), cr.data(), n);
+
+    const YCbCrCodeRange codes = MakeYCbCrCodeRange(range, bits);
+    double rows[3][3];
+    YCbCrCodeMatrix(matrix, codes, rows);
+    const double hi = (1 << bits) - 1;
+    double worst = 0;
+    for(int i = 0; i < n; ++i) {
+      const double rgb[3] = {SRGB(r[i]), SRGB(g[i]), SRGB(b[i])};
+      const double offsets[3] = {codes.yLo, codes.cMid, codes.cMid};
+      const uint16_t got[3] = {y[i], cb[i], cr[i]};
+      for(int c = 0; c < 3; ++c) {
+        const double v = rows[c][0] * rgb[0] + rows[c][1] * rgb[1] +
+                         rows[c][2] * rgb[2] + offsets[c];
+        const double expected = std::min(std::max(std::round(v), 0.0), hi);
+        worst = std::max(worst, std::fabs(got[c] - expected));
+      }
+    }
+    return worst;
+  }
+}  // namespace
+
+int main()
+{
+  // linear values around the clip points and beyond them, an odd count so
+  // the vector tails run
+  std::mt19937 rng(11);
+  std::uniform_real_distribution<float> u(-0.1f, 1.2f);
+  std::vector<float> r(kPixels), g(kPixels), b(kPixels);
+  for(int i = 0; i < kPixels; ++i) {
+    r[i] = u(rng);
+    g[i] = u(rng);
+    b[i] = u(rng);
+  }
+  // primaries, black and white land on exact codes
+  const float corners[][3] = {{0, 0, 0}, {1, 1, 1}, {1, 0, 0},
+                              {0, 1, 0}, {0, 0, 1}, {NAN, 0.5f, 2.0f}};
+  for(int i = 0; i < 6; ++i) {
+    r[i] = corners[i][0];
+    g[i] = corners[i][1];
+    b[i] = corners[i][2];
+  }
+
+  int failed = 0;
+  for(int matrix = 0; matrix < Constants::YCC_MATRIX_COUNT; ++matrix) {
+    for(int range = 0; range < Constants::YCC_RANGE_COUNT; ++range) {
+      for(int bits = 8; bits <= 12; ++bits) {
+        const double worst = Check(matrix, range, bits, r, g, b);
+        const bool ok = worst <= 1.0;
+        if(!ok) ++failed;
+        std::printf("%-8s %-5s %2d bits  worst %.0f code(s)  %s\n",
+                    Constants::YCBCR_MATRIX[matrix],
+                    Constants::YCBCR_RANGE[range], bits, worst,
+                    ok ? "ok" : "FAILED");
+      }
+    }
+  }
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,726 @@
+// Converts the RGB layers of an EXR or 10 bit DPX file with a GColorspace
+// transform, outside Nuke.
+//
+// usage: gcolorspace_convert [options] [in.(exr|dpx) out.(exr|dpx|yuv)]
+//        gcolorspace_convert --batch JOB [--worker NAME] [--processes N]
+//                            [--threads N]
+//   --in NAME / --out NAME            colorspace, as in the node ("ARRILogC4")
+//   --white-in NAME / --white-out NAME
+//   --primary-in NAME / --primary-out NAME
+//   --bradford                        Bradford instead of CAT02
+//   --lut FILE [--lut-after]          .cube LUT before the in curve (or after
+//                                     the out curve)
+//   --precision NAME                  exact, 1D LUT, 3D LUT 33, ...
+//   --compression NAME                none, rle, zips, zip (default: input's)
+//   --half / --float                  output channel type (default: input's)
+//   --ycbcr-matrix NAME               Rec.601, Rec.709 (default), Rec.2020
+//   --ycbcr-range NAME                legal (default) or full, for the YCbCr
+//                                     colorspace and --ycbcr codes
+//   --ycbcr 444|422|420 [--bits N]    write raw Y'CbCr codes instead of
+//                                     EXR / DPX (include/YuvIO.h), 8 to 12
+//                                     bits (default 10); --out is then YCbCr
+//                                     or left out
+//   --siting NAME                     chroma siting of 4:2:2 / 4:2:0: left
+//                                     (default), center, top-left
+//   --layout NAME                     planar (default), p010 (P010 / P210)
+//                                     or v210 (4:2:2 10 bit)
+//   --threads N
+//   --export-clf FILE                 also write the transform as CLF and an
+//                                     OCIO colorspace entry next to it, with
+//                                     the extension replaced (x.clf writes
+//                                     x.ocio.yaml)
+//   --export-blink FILE               also write it as a BlinkScript kernel
+//                                     (the files are optional with either)
+//   --batch JOB                       convert the sequences of a job file
+//                                     (include/BatchJob.h) with any number of
+//                                     workers sharing its state directory
+//   --worker NAME                     worker name (default: host-pid)
+//   --processes N                     run N local workers (NAME-1 ...)
+//   --memory                          report peak and committed memory
+//                                     (batch workers always do)
+//
+// Every layer with R, G and B channels ("R", "diffuse.R", ...) is converted,
+// other channels pass through. Conversion runs inside the decode, per chunk.
+// DPX input decodes through the exact in-curve table when the curve is per
+// channel and no LUT comes first (Cineon scans come out linear), DPX output
+// writes R, G, B (and A) as 10 bit codes of the output values, keeping a DPX
+// input's header with the transfer and colorimetric fields of --out and
+// --primary-out. Y'CbCr code output converts R, G and B to linear and the
+// encoder applies the YCbCr curve and matrix (then filters the chroma of
+// 4:2:2 / 4:2:0), so the codes are the YCbCr colorspace's values,
+// quantized, with R'G'B' clipped to [0, 1].
+//
+// A batch job line takes the transform and output options above after its
+// frame range. Batch frames are written to a temporary name and renamed,
+// output directories are created as needed. A worker keeps its frame
+// buffers from frame to frame and the rest comes from the FramePool, so a
+// sequence of one size converts without allocating per frame.
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "include/BatchJob.h"
+#include "include/BlinkExport.h"
+#include "include/ClfExport.h"
+#include "include/DpxIO.h"
+#include "include/ExrIO.h"
+#include "include/FramePool.h"
+#include "include/TransformPlan.h"
+#include "include/YuvIO.h"
+
+namespace
+{
+  // case-insensitive, and the menu's " (~2.20)" style notes are optional
+  bool SameName(const char* menu, const char* name)
+  {
+    for(; *menu && *name; ++menu, ++name) {
+      if(std::tolower(static_cast<unsigned char>(*menu)) !=
+         std::tolower(static_cast<unsigned char>(*name))) {
+        return false;
+      }
+    }
+    return *name == 0 && (*menu == 0 || !std::strncmp(menu, " (", 2));
+  }
+
+  // index of 'name' in a 0 terminated knob menu, or -1
+  int MenuIndex(const char* const* menu, const char* name)
+  {
+    for(int i = 0; menu[i]; ++i) {
+      if(SameName(menu[i], name)) return i;
+    }
+    return -1;
+  }
+
+  void PrintMenu(const char* what, const char* const* menu)
+  {
+    std::fprintf(stderr, "%s:", what);
+    for(int i = 0; menu[i]; ++i) std::fprintf(stderr, " \"%s\"", menu[i]);
+    std::fprintf(stderr, "\n");
+  }
+
+  int Usage()
+  {
+    std::fprintf(stderr,
+                 "usage: gcolorspace_convert [options] [in.(exr|dpx) "
+                 "out.(exr|dpx|yuv)]\n"
+                 "  --in NAME --out NAME --white-in NAME --white-out NAME\n"
+                 "  --primary-in NAME --primary-out NAME --bradford\n"
+                 "  --lut FILE --lut-after\n"
+                 "  --precision NAME --compression NAME --half --float\n"
+                 "  --ycbcr-matrix NAME --ycbcr-range NAME\n"
+                 "  --ycbcr FORMAT --bits N --siting NAME --layout NAME\n"
+                 "  --threads N --memory\n"
+                 "  --export-clf FILE --export-blink FILE\n"
+                 "       gcolorspace_convert --batch JOB [--worker NAME] "
+                 "[--processes N]\n");
+    PrintMenu("colorspaces", Constants::COLOR_CURVE);
+    PrintMenu("whitepoints", Constants::WHITEPOINT);
+    PrintMenu("primaries", Constants::PRIMARY_RGB);
+    PrintMenu("precisions", Constants::PRECISION);
+    PrintMenu("compressions", Exr::COMPRESSION);
+    PrintMenu("YCbCr matrices", Constants::YCBCR_MATRIX);
+    PrintMenu("YCbCr ranges", Constants::YCBCR_RANGE);
+    PrintMenu("YCbCr formats", Yuv::FORMAT);
+    PrintMenu("chroma sitings", Yuv::SITING);
+    PrintMenu("YCbCr layouts", Yuv::LAYOUT);
+    return 2;
+  }
+
+  struct Layer
+  {
+    int r = -1;
+    int g = -1;
+    int b = -1;
+  };
+
+  // index of the channel named <prefix of 'base'><letter>, either case, or -1
+  int Sibling(const Exr::Image& image, const std::string& base, size_t prefix,
+              char letter)
+  {
+    for(size_t c = 0; c < image.channels.size(); ++c) {
+      const std::string& name = image.channels[c].name;
+      if(name.size() == prefix + 1 &&
+         std::toupper(static_cast<unsigned char>(name[prefix])) == letter &&
+         !name.compare(0, prefix, base, 0, prefix)) {
+        return static_cast<int>(c);
+      }
+    }
+    return -1;
+  }
+
+  // RGB layers by prefix: "R" -> "", "diffuse.R" -> "diffuse.". Fills
+  // 'layers' in place, so a kept list allocates nothing frame to frame.
+  void FindLayers(const Exr::Image& image, std::vector<Layer>& layers)
+  {
+    layers.clear();
+    for(size_t c = 0; c < image.channels.size(); ++c) {
+      const std::string& name = image.channels[c].name;
+      const size_t dot = name.rfind('.');
+      const size_t prefix = dot == std::string::npos ? 0 : dot + 1;
+      if(Sibling(image, name, prefix, 'R') != static_cast<int>(c)) continue;
+      Layer layer;
+      layer.r = static_cast<int>(c);
+      layer.g = Sibling(image, name, prefix, 'G');
+      layer.b = Sibling(image, name, prefix, 'B');
+      if(layer.g >= 0 && layer.b >= 0) layers.push_back(layer);
+    }
+  }
+
+  bool IsDpx(const char* path)
+  {
+    const size_t n = std::strlen(path);
+    return n >= 4 && SameName(path + n - 4, ".dpx");
+  }
+
+  // DPX planes become half R, G, B (and A) channels, without a copy. The
+  // image's planes go to the DPX one, for its next frame.
+  void FromDpx(Dpx::Image& dpx, Exr::Image& image)
+  {
+    image.channels.clear();
+    image.compression = Exr::COMPRESSION_ZIP;
+    image.dataWindow = {0, 0, dpx.width - 1, dpx.height - 1};
+    image.displayWindow = image.dataWindow;
+    const char* names[4] = {"R", "G", "B", "A"};
+    for(int c = 0; c < dpx.channels; ++c) {
+      image.addChannel(names[c], Exr::PIXEL_HALF);
+    }
+    image.planes.resize(image.channels.size());
+    for(int c = 0; c < dpx.channels; ++c) {
+      image.planes[image.find(names[c])].swap(dpx.planes[c]);
+    }
+  }
+
+  // R, G, B and A if there is one, false without RGB
+  bool ToDpx(Exr::Image& image, Dpx::Image& dpx)
+  {
+    const int rgba[4] = {image.find("R"), image.find("G"), image.find("B"),
+                         image.find("A")};
+    if(rgba[0] < 0 || rgba[1] < 0 || rgba[2] < 0) return false;
+    dpx.width = image.width();
+    dpx.height = image.height();
+    dpx.channels = rgba[3] < 0 ? 3 : 4;
+    for(int c = 0; c < dpx.channels; ++c) {
+      dpx.planes[c].swap(image.planes[rgba[c]]);
+    }
+    return true;
+  }
+
+  // transform and output options, from the command line or a job line
+  struct Options
+  {
+    TransformSettings settings;
+    int compression = -1;
+    int type = -1;
+    std::string lutFile;
+    // Yuv::Formats of a code output, -1 for EXR / DPX
+    int ycbcr = -1;
+    int bits = 10;
+    int siting = CHROMA_SITING_LEFT;
+    int layout = CHROMA_LAYOUT_PLANAR;
+  };
+
+  enum OptionResult { OPTION_OK, OPTION_BAD, OPTION_OTHER };
+
+  // the option at args[i], 'i' moves past its value
+  OptionResult ParseOption(const std::vector<std::string>& args, size_t& i,
+                           Options& o)
+  {
+    const std::string& arg = args[i];
+    const bool hasValue = i + 1 < args.size();
+    auto menu = [&](const char* const* names, int& value) {
+      if(!hasValue) return OPTION_BAD;
+      value = MenuIndex(names, args[++i].c_str());
+      if(value < 0) {
+        std::fprintf(stderr, "unknown value \"%s\"\n", args[i].c_str());
+      }
+      return value >= 0 ? OPTION_OK : OPTION_BAD;
+    };
+    if(arg == "--in") return menu(Constants::COLOR_CURVE, o.settings.colorIn);
+    if(arg == "--out") {
+      return menu(Constants::COLOR_CURVE, o.settings.colorOut);
+    }
+    if(arg == "--white-in") {
+      return menu(Constants::WHITEPOINT, o.settings.whiteIn);
+    }
+    if(arg == "--white-out") {
+      return menu(Constants::WHITEPOINT, o.settings.whiteOut);
+    }
+    if(arg == "--primary-in") {
+      return menu(Constants::PRIMARY_RGB, o.settings.primaryIn);
+    }
+    if(arg == "--primary-out") {
+      return menu(Constants::PRIMARY_RGB, o.settings.primaryOut);
+    }
+    if(arg == "--precision") {
+      return menu(Constants::PRECISION, o.settings.precision);
+    }
+    if(arg == "--compression") return menu(Exr::COMPRESSION, o.compression);
+    if(arg == "--ycbcr-matrix") {
+      return menu(Constants::YCBCR_MATRIX, o.settings.ycbcrMatrix);
+    }
+    if(arg == "--ycbcr-range") {
+      return menu(Constants::YCBCR_RANGE, o.settings.ycbcrRange);
+    }
+    if(arg == "--ycbcr") return menu(Yuv::FORMAT, o.ycbcr);
+    if(arg == "--siting") return menu(Yuv::SITING, o.siting);
+    if(arg == "--layout") return menu(Yuv::LAYOUT, o.layout);
+    if(arg == "--bits") {
+      if(!hasValue) return OPTION_BAD;
+      o.bits = std::atoi(args[++i].c_str());
+      return o.bits >= 8 && o.bits <= 12 ? OPTION_OK : OPTION_BAD;
+    }
+    if(arg == "--bradford") {
+      o.settings.bradford = true;
+      return OPTION_OK;
+    }
+    if(arg == "--lut") {
+      if(!hasValue) return OPTION_BAD;
+      o.lutFile = args[++i];
+      return OPTION_OK;
+    }
+    if(arg == "--lut-after") {
+      o.settings.lutFilePosition = Constants::LUT_FILE_AFTER;
+      return OPTION_OK;
+    }
+    if(arg == "--half" || arg == "--float") {
+      o.type = arg == "--half" ? Exr::PIXEL_HALF : Exr::PIXEL_FLOAT;
+      return OPTION_OK;
+    }
+    return OPTION_OTHER;
+  }
+
+  bool LoadLut(Options& o, std::string* error)
+  {
+    if(o.lutFile.empty()) return true;
+    o.settings.lutFile = ReadCubeLut(o.lutFile, error);
+    return o.settings.lutFile != nullptr;
+  }
+
+  // what converting a file takes besides its pixels, made once per set of
+  // options and used for every frame
+  struct Pipeline
+  {
+    Options options;
+    TransformPlan plan;
+    // a DPX input's decode table (the in-curve, exact and free) and the
+    // plan going on from linear, made with the first DPX frame
+    bool dpxReady = false;
+    std::vector<float> table;
+    TransformPlan restPlan;
+  };
+
+  // buffers of one converting thread, kept from frame to frame so a
+  // sequence reuses them instead of allocating per frame
+  struct Frame
+  {
+    Exr::Image image;
+    Dpx::Image dpx;     // a DPX input
+    Dpx::Image dpxOut;  // a DPX output
+    std::vector<Layer> layers;
+    // the layers are found by the first chunk decoded
+    std::mutex mutex;
+    bool found = false;
+  };
+
+  struct Converted
+  {
+    int width = 0;
+    int height = 0;
+    size_t layers = 0;
+  };
+
+  void PrepareDpx(Pipeline& p)
+  {
+    if(p.dpxReady) return;
+    const TransformSettings& settings = p.options.settings;
+    TransformSettings rest = settings;
+    const bool lutFirst =
+        settings.lutFile != nullptr &&
+        settings.lutFilePosition == Constants::LUT_FILE_BEFORE;
+    if(!p.plan.curvesIdentity && !lutFirst) {
+      p.table = Dpx::CurveTable(settings.colorIn);
+    }
+    if(!p.table.empty()) rest.colorIn = Constants::COLOR_LINEAR;
+    p.restPlan = MakeTransformPlan(rest);
+    p.dpxReady = true;
+  }
+
+  bool MakePipeline(const Options& options, Pipeline& p, std::string* error)
+  {
+    p.options = options;
+    // the code encoder applies the YCbCr curve, the plan stops at linear
+    int& colorOut = p.options.settings.colorOut;
+    if(options.ycbcr >= 0) {
+      if(colorOut != Constants::COLOR_LINEAR &&
+         colorOut != Constants::COLOR_Y_CB_CR) {
+        if(error != nullptr) {
+          *error = "--ycbcr writes YCbCr codes, --out has to be YCbCr";
+        }
+        return false;
+      }
+      colorOut = Constants::COLOR_LINEAR;
+    }
+    if(!LoadLut(p.options, error)) return false;
+    p.plan = MakeTransformPlan(p.options.settings);
+    return true;
+  }
+
+  // 'in' to 'out', written to 'writePath' ('out' decides the format)
+  bool ConvertFile(Pipeline& p, Frame& frame, const char* in, const char* out,
+                   const char* writePath, int threads, Converted& result,
+                   std::string* error)
+  {
+    const Options& o = p.options;
+    Exr::Image& image = frame.image;
+    std::vector<Layer>& layers = frame.layers;
+    bool read;
+    // header and byte order of a DPX input, for a DPX output
+    Dpx::Image& source = frame.dpx;
+
+    if(IsDpx(in)) {
+      // the in-curve runs as the decode table and the plan goes on from
+      // linear
+      PrepareDpx(p);
+      const TransformPlan& restPlan = p.restPlan;
+      read = Dpx::Read(
+          in, source, error, p.table.empty() ? nullptr : p.table.data(),
+          [&restPlan](Dpx::Image& img, int row, int rows) {
+            if(restPlan.identity) return;
+            for(int y = row; y < row + rows; ++y) {
+              ApplyPlanar(restPlan, img.line(0, y), img.line(1, y),
+                          img.line(2, y), img.width);
+            }
+          },
+          threads);
+      if(read) {
+        FromDpx(source, image);
+        FindLayers(image, layers);
+      }
+    }
+    else {
+      const Dpx::Image defaults;
+      source.header.clear();
+      source.bigEndian = defaults.bigEndian;
+      frame.found = false;
+      read = Exr::Read(
+          in, image, error,
+          [&frame, &p](Exr::Image& img, int row, int rows) {
+            {
+              std::lock_guard<std::mutex> lock(frame.mutex);
+              if(!frame.found) FindLayers(img, frame.layers);
+              frame.found = true;
+            }
+            const std::vector<Layer>& found = frame.layers;
+            if(p.plan.identity || found.empty()) return;
+            ScratchArena::Scope scratch;
+            PlanarLayer* batch = scratch.take<PlanarLayer>(found.size());
+            for(int y = row; y < row + rows; ++y) {
+              for(size_t l = 0; l < found.size(); ++l) {
+                float* r = img.line(found[l].r, y);
+                float* g = img.line(found[l].g, y);
+                float* b = img.line(found[l].b, y);
+                batch[l] = {r, g, b, r, g, b};
+              }
+              ApplyPlanar(p.plan, batch, static_cast<int>(found.size()),
+                          img.width());
+            }
+          },
+          threads);
+    }
+    if(!read) return false;
+    if(layers.empty()) {
+      std::fprintf(stderr, "%s: no R, G, B channels, copied as is\n", in);
+    }
+
+    bool written;
+    if(o.ycbcr >= 0) {
+      const int rgb[3] = {image.find("R"), image.find("G"), image.find("B")};
+      if(rgb[0] < 0 || rgb[1] < 0 || rgb[2] < 0) {
+        if(error != nullptr) {
+          *error = std::string(in) + ": Y'CbCr output needs R, G and B";
+        }
+        return false;
+      }
+      Yuv::Settings yuv;
+      yuv.format = o.ycbcr;
+      yuv.matrix = o.settings.ycbcrMatrix;
+      yuv.range = o.settings.ycbcrRange;
+      yuv.bits = o.bits;
+      yuv.siting = o.siting;
+      yuv.layout = o.layout;
+      written = Yuv::Write(writePath, image.planes[rgb[0]].data(),
+                           image.planes[rgb[1]].data(),
+                           image.planes[rgb[2]].data(), image.width(),
+                           image.height(), yuv, error, threads);
+    }
+    else if(IsDpx(out)) {
+      Dpx::Image& dpx = frame.dpxOut;
+      if(!ToDpx(image, dpx)) {
+        if(error != nullptr) {
+          *error = std::string(in) + ": DPX output needs R, G and B";
+        }
+        return false;
+      }
+      dpx.header.swap(source.header);
+      dpx.bigEndian = source.bigEndian;
+      Dpx::Describe(dpx, o.settings.colorOut, o.settings.primaryOut);
+      written = Dpx::Write(writePath, dpx, error, threads);
+    }
+    else {
+      if(o.compression >= 0) image.compression = o.compression;
+      if(o.type >= 0) {
+        for(const Layer& l : layers) {
+          for(int c : {l.r, l.g, l.b}) image.channels[c].type = o.type;
+        }
+      }
+      written = Exr::Write(writePath, image, error, threads);
+    }
+    if(!written) return false;
+    result.width = image.width();
+    result.height = image.height();
+    result.layers = layers.size();
+    return true;
+  }
+
+  uint64_t FileBytes(const std::string& path)
+  {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 ? info.st_size : 0;
+  }
+
+  // one batch worker until the job has no unclaimed chunk left
+  int BatchWorker(const Batch::Job& job, std::vector<Options>& options,
+                  const std::string& name, int threads)
+  {
+    Batch::Worker worker(job, name);
+    std::string error;
+    if(!worker.open(&error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+
+    // pipelines per sequence, made when the worker first gets one of its
+    // chunks; one set of frame buffers for all of them
+    std::vector<std::unique_ptr<Pipeline>> pipelines(options.size());
+    Frame buffers;
+    long frames = 0;
+    auto convert = [&](int s, int frame, Batch::Record& record,
+                       std::string* message) {
+      const Batch::Sequence& seq = job.sequences[s];
+      if(pipelines[s] == nullptr) {
+        std::unique_ptr<Pipeline> p(new Pipeline);
+        if(!MakePipeline(options[s], *p, message)) return false;
+        pipelines[s] = std::move(p);
+      }
+      const std::string in = Batch::FramePath(seq.in, frame);
+      const std::string out = Batch::FramePath(seq.out, frame);
+      const size_t slash = out.rfind('/');
+      if(slash != std::string::npos && slash > 0 &&
+         !BatchDetail::MakeDirs(out.substr(0, slash))) {
+        *message = out.substr(0, slash) + ": " + std::strerror(errno);
+        return false;
+      }
+      const std::string temp = out + ".tmp-" + worker.id();
+      Converted converted;
+      if(!ConvertFile(*pipelines[s], buffers, in.c_str(), out.c_str(),
+                      temp.c_str(), threads, converted, message)) {
+        std::remove(temp.c_str());
+        return false;
+      }
+      if(std::rename(temp.c_str(), out.c_str()) != 0) {
+        *message = out + ": " + std::strerror(errno);
+        std::remove(temp.c_str());
+        return false;
+      }
+      record.bytesIn += FileBytes(in);
+      record.bytesOut += FileBytes(out);
+      ++frames;
+      return true;
+    };
+    const int failed = Batch::Run(job, worker, convert);
+
+    std::string summary;
+    if(!Batch::WriteSummary(job, worker.id(), summary, &error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+    }
+    std::printf("%s: %ld frame(s) converted, %d chunk(s) failed\n%s: %s\n",
+                worker.id().c_str(), frames, failed, worker.id().c_str(),
+                MemoryReport().c_str());
+    return failed ? 1 : 0;
+  }
+
+  int RunBatch(const char* path, std::string name, int processes, int threads)
+  {
+    Batch::Job job;
+    std::string error;
+    if(!Batch::ReadJob(path, job, &error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+    // every line is checked before any worker starts
+    std::vector<Options> options(job.sequences.size());
+    for(size_t s = 0; s < job.sequences.size(); ++s) {
+      const std::vector<std::string>& args = job.sequences[s].options;
+      for(size_t i = 0; i < args.size(); ++i) {
+        if(ParseOption(args, i, options[s]) != OPTION_OK) {
+          std::fprintf(stderr, "%s:%d: bad option \"%s\"\n", path,
+                       job.sequences[s].line, args[i].c_str());
+          return 2;
+        }
+      }
+    }
+    const std::string host = BatchDetail::HostName();
+    if(processes <= 1) {
+      if(name.empty()) name = host + "-" + std::to_string(getpid());
+      return BatchWorker(job, options, name, threads);
+    }
+
+    // local workers share the cores, forked before any thread exists
+    if(threads <= 0) {
+      const int cores = static_cast<int>(std::thread::hardware_concurrency());
+      threads = std::max(1, cores / processes);
+    }
+    std::vector<pid_t> children;
+    std::fflush(stdout);
+    for(int p = 1; p <= processes; ++p) {
+      const pid_t pid = fork();
+      if(pid == 0) {
+        const std::string child =
+            (name.empty() ? host + "-" + std::to_string(getpid()) : name) +
+            "-" + std::to_string(p);
+        const int status = BatchWorker(job, options, child, threads);
+        std::fflush(stdout);
+        _exit(status);
+      }
+      if(pid < 0) {
+        std::perror("fork");
+        break;
+      }
+      children.push_back(pid);
+    }
+    int result = children.size() == static_cast<size_t>(processes) ? 0 : 1;
+    for(pid_t pid : children) {
+      int status = 0;
+      if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+         WEXITSTATUS(status) != 0) {
+        result = 1;
+      }
+    }
+    std::string summary;
+    if(!Batch::WriteSummary(job, host + "-" + std::to_string(getpid()),
+                            summary, &error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+    std::printf("%s", summary.c_str());
+    return result;
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  Options options;
+  int threads = 0;
+  const char* clfFile = nullptr;
+  const char* blinkFile = nullptr;
+  const char* batchFile = nullptr;
+  std::string worker;
+  int processes = 0;
+  bool memory = false;
+  std::vector<const char*> files;
+
+  const std::vector<std::string> args(argv + 1, argv + argc);
+  for(size_t i = 0; i < args.size(); ++i) {
+    const std::string& arg = args[i];
+    const bool hasValue = i + 1 < args.size();
+    const OptionResult parsed = ParseOption(args, i, options);
+    if(parsed == OPTION_BAD) return Usage();
+    if(parsed == OPTION_OK) continue;
+    if(arg == "--export-clf" && hasValue) {
+      clfFile = argv[++i + 1];
+    }
+    else if(arg == "--export-blink" && hasValue) {
+      blinkFile = argv[++i + 1];
+    }
+    else if(arg == "--threads" && hasValue) {
+      threads = std::atoi(args[++i].c_str());
+    }
+    else if(arg == "--batch" && hasValue) {
+      batchFile = argv[++i + 1];
+    }
+    else if(arg == "--worker" && hasValue) {
+      worker = args[++i];
+    }
+    else if(arg == "--processes" && hasValue) {
+      processes = std::atoi(args[++i].c_str());
+    }
+    else if(arg == "--memory") {
+      memory = true;
+    }
+    else if(arg[0] == '-') {
+      return Usage();
+    }
+    else {
+      files.push_back(argv[i + 1]);
+    }
+  }
+  if(batchFile != nullptr) {
+    if(!files.empty()) return Usage();
+    return RunBatch(batchFile, worker, processes, threads);
+  }
+  const bool exporting = clfFile != nullptr || blinkFile != nullptr;
+  if(files.size() != 2 && !(files.empty() && exporting)) {
+    return Usage();
+  }
+
+  std::string error;
+  Pipeline pipeline;
+  if(!MakePipeline(options, pipeline, &error)) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  if(exporting) {
+    TransformSettings exact = pipeline.options.settings;
+    exact.precision = Constants::PRECISION_EXACT;
+    const TransformPlan plan = MakeTransformPlan(exact);
+    if((clfFile != nullptr && !ExportClf(plan, clfFile, &error)) ||
+       (blinkFile != nullptr && !ExportBlink(plan, blinkFile, &error))) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      return 1;
+    }
+    if(files.empty()) return 0;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  Frame frame;
+  Converted converted;
+  if(!ConvertFile(pipeline, frame, files[0], files[1], files[1], threads,
+                  converted, &error)) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  std::printf("%s -> %s: %dx%d, %zu layer(s), %.1f ms\n", files[0], files[1],
+              converted.width, converted.height, converted.layers,
+              seconds * 1e3);
+  if(memory) std::printf("%s\n", MemoryReport().c_str());
+  return 0;
+}
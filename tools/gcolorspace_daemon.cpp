@@ -0,0 +1,524 @@
+// Long-running conversion service for tools that run many small
+// conversions (thumbnails, swatches, proxies), so they skip process startup,
+// transform setup and LUT bakes. Clients go through the C API client
+// (gcs_client_*), see include/DaemonProtocol.h for the wire format.
+//
+// usage: gcolorspace_daemon [--socket PATH] [--threads N] [--plans N]
+//   --socket PATH   default GCOLORSPACE_DAEMON_SOCKET, else
+//                   $XDG_RUNTIME_DIR/gcolorspace.sock or
+//                   /tmp/gcolorspace-<uid>.sock
+//   --threads N     request threads (default: all cores)
+//   --plans N       compiled transforms kept (default 64)
+//
+// The main thread polls idle connections and hands the readable ones to the
+// request threads, one request at a time, so a busy client cannot hold a
+// thread while it is idle. Frames are memfds the client sealed against
+// shrinking; a connection keeps its last mapping while the client sends the
+// same memfd. Large frames also get the C API's worker team (threads hint of
+// the request, GCOLORSPACE_API_THREADS). Compiled transforms are kept by
+// settings (and LUT file stamp), baked LUTs stay in the process LUT cache.
+// SIGINT/SIGTERM finish the running requests and remove the socket.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "capi/gcolorspace.h"
+#include "include/DaemonProtocol.h"
+
+namespace
+{
+  int wakeWrite = -1;
+  std::atomic<bool> stopping{false};
+
+  void OnSignal(int)
+  {
+    stopping = true;
+    const char byte = 0;
+    if(write(wakeWrite, &byte, 1) < 0) {
+      // the loop also checks 'stopping' on its next wakeup
+    }
+  }
+
+  // Compiled transforms by request settings, least recently used dropped.
+  // Transforms still in use by a request outlive their eviction.
+  class PlanCache
+  {
+   public:
+    using Entry = std::shared_ptr<gcs_transform>;
+
+    explicit PlanCache(size_t capacity)
+        : capacity(std::max<size_t>(capacity, 1))
+    {
+    }
+
+    Entry get(const DaemonProtocol::Spec& spec, const std::string& lutPath,
+              gcs_status& status, std::string& error)
+    {
+      std::string key(reinterpret_cast<const char*>(&spec), sizeof(spec));
+      key += lutPath;
+      if(!lutPath.empty()) {
+        // an edited .cube file makes a new transform
+        struct stat info;
+        if(stat(lutPath.c_str(), &info) == 0) {
+          key.append(reinterpret_cast<const char*>(&info.st_mtim),
+                     sizeof(info.st_mtim));
+          key.append(reinterpret_cast<const char*>(&info.st_size),
+                     sizeof(info.st_size));
+        }
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(key);
+        if(found != index.end()) {
+          order.splice(order.begin(), order, found->second);
+          ++hits;
+          status = GCS_OK;
+          return found->second->second;
+        }
+      }
+
+      // created outside the lock, a concurrent miss on the same settings at
+      // worst compiles it twice (the LUT cache shares the bake)
+      gcs_settings s;
+      gcs_settings_init(&s, sizeof(s));
+      s.color_in = spec.colorIn;
+      s.color_out = spec.colorOut;
+      s.white_in = spec.whiteIn;
+      s.white_out = spec.whiteOut;
+      s.primary_in = spec.primaryIn;
+      s.primary_out = spec.primaryOut;
+      s.cat = spec.cat;
+      s.ycbcr_matrix = spec.ycbcrMatrix;
+      s.ycbcr_range = spec.ycbcrRange;
+      s.precision = spec.precision;
+      s.tolerance = spec.tolerance;
+      s.bit_exact = spec.bitExact;
+      s.lut_file = lutPath.empty() ? nullptr : lutPath.c_str();
+      s.lut_after = spec.lutAfter;
+      gcs_transform* created = nullptr;
+      char message[DaemonProtocol::kMaxMessage];
+      message[0] = 0;
+      status = gcs_transform_create(&s, sizeof(s), &created, message,
+                                    sizeof(message));
+      if(status != GCS_OK) {
+        error = message;
+        return nullptr;
+      }
+      Entry entry(created, gcs_transform_destroy);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      ++misses;
+      auto found = index.find(key);
+      if(found != index.end()) return found->second->second;
+      order.emplace_front(key, entry);
+      index[key] = order.begin();
+      if(order.size() > capacity) {
+        index.erase(order.back().first);
+        order.pop_back();
+      }
+      return entry;
+    }
+
+    void counts(uint64_t& hitCount, uint64_t& missCount)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      hitCount = hits;
+      missCount = misses;
+    }
+
+   private:
+    using Order = std::list<std::pair<std::string, Entry>>;
+
+    size_t capacity;
+    std::mutex mutex;
+    Order order;
+    std::map<std::string, Order::iterator> index;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+
+  struct Connection
+  {
+    explicit Connection(int socket) : socket(socket) {}
+
+    ~Connection()
+    {
+      if(data != nullptr) munmap(data, size);
+      close(socket);
+    }
+
+    // the frame behind 'fd' mapped, reusing the last mapping for the same
+    // memfd. Null with 'error' set when it cannot be mapped safely.
+    char* map(int fd, std::string& error)
+    {
+      struct stat info;
+      if(fstat(fd, &info) != 0) {
+        error = "cannot stat the frame";
+        return nullptr;
+      }
+      if(data != nullptr && info.st_dev == device && info.st_ino == inode &&
+         static_cast<size_t>(info.st_size) == size) {
+        return static_cast<char*>(data);
+      }
+      const int seals = fcntl(fd, F_GET_SEALS);
+      if(seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        error = "the frame must be a memfd sealed against shrinking "
+                "(gcs_frame_create)";
+        return nullptr;
+      }
+      if(data != nullptr) munmap(data, size);
+      data = nullptr;
+      size = static_cast<size_t>(info.st_size);
+      if(size == 0) {
+        error = "empty frame";
+        return nullptr;
+      }
+      void* mapped =
+          mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if(mapped == MAP_FAILED) {
+        error = std::string("cannot map the frame: ") + std::strerror(errno);
+        return nullptr;
+      }
+      data = mapped;
+      device = info.st_dev;
+      inode = info.st_ino;
+      return static_cast<char*>(data);
+    }
+
+    int socket;
+    void* data = nullptr;
+    size_t size = 0;
+    dev_t device = 0;
+    ino_t inode = 0;
+  };
+
+  // true when 'rows' rows of 'rowBytes' bytes, 'stride' apart, start at
+  // 'offset' and end within 'size' bytes
+  bool Fits(uint64_t offset, int rows, uint64_t rowBytes, uint64_t stride,
+            uint64_t size)
+  {
+    if(rows == 0 || rowBytes == 0) return offset <= size;
+    if(stride < rowBytes || offset > size || rowBytes > size - offset) {
+      return false;
+    }
+    const uint64_t gaps = static_cast<uint64_t>(rows - 1);
+    return rows == 1 || stride <= (size - offset - rowBytes) / gaps;
+  }
+
+  gcs_status Apply(Connection& connection, const DaemonProtocol::Request& r,
+                   const gcs_transform* transform, int fd, std::string& error)
+  {
+    if(r.width < 0 || r.height < 0 ||
+       (r.type != GCS_FLOAT32 && r.type != GCS_FLOAT16) ||
+       (r.channels != 0 && r.channels != 3 && r.channels != 4) ||
+       r.rowStride < 0) {
+      error = "invalid image description";
+      return GCS_ERROR_ARGUMENT;
+    }
+    if(fd < 0) {
+      error = "no frame attached";
+      return GCS_ERROR_ARGUMENT;
+    }
+    char* data = connection.map(fd, error);
+    if(data == nullptr) return GCS_ERROR_ARGUMENT;
+
+    const gcs_pixel_type type = static_cast<gcs_pixel_type>(r.type);
+    const uint64_t bytes = type == GCS_FLOAT32 ? 4 : 2;
+    const uint64_t rowBytes =
+        static_cast<uint64_t>(r.width) * (r.channels ? r.channels : 1) * bytes;
+    const uint64_t stride = r.rowStride ? r.rowStride : rowBytes;
+    const int planes = r.channels ? 1 : 3;
+    for(int p = 0; p < planes; ++p) {
+      if(!Fits(r.offset[p], r.height, rowBytes, stride, connection.size)) {
+        error = "the image does not fit the frame";
+        return GCS_ERROR_ARGUMENT;
+      }
+    }
+    if(r.channels) {
+      return gcs_apply_interleaved(transform, type, data + r.offset[0],
+                                   r.width, r.height, r.channels,
+                                   r.rowStride, r.threads);
+    }
+    return gcs_apply_planar(transform, type, data + r.offset[0],
+                            data + r.offset[1], data + r.offset[2], r.width,
+                            r.height, r.rowStride, r.threads);
+  }
+
+  class Server
+  {
+   public:
+    Server(int listener, int wakeRead, int threads, size_t plans)
+        : listener(listener), wakeRead(wakeRead), plans(plans)
+    {
+      for(int i = 0; i < threads; ++i) {
+        workers.emplace_back([this]() { work(); });
+      }
+    }
+
+    ~Server()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+      }
+      ready.notify_all();
+      for(std::thread& t : workers) t.join();
+    }
+
+    // until SIGINT/SIGTERM
+    void run()
+    {
+      std::vector<pollfd> fds;
+      std::vector<std::unique_ptr<Connection>> idle;
+      while(!stopping) {
+        fds.clear();
+        fds.push_back({wakeRead, POLLIN, 0});
+        fds.push_back({listener, POLLIN, 0});
+        for(const auto& c : idle) fds.push_back({c->socket, POLLIN, 0});
+        if(poll(fds.data(), fds.size(), -1) < 0) {
+          if(errno == EINTR) continue;
+          std::perror("poll");
+          return;
+        }
+
+        std::vector<std::unique_ptr<Connection>> waiting;
+        for(size_t i = 0; i < idle.size(); ++i) {
+          if(fds[i + 2].revents) {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(std::move(idle[i]));
+            ready.notify_one();
+          }
+          else {
+            waiting.push_back(std::move(idle[i]));
+          }
+        }
+        idle.swap(waiting);
+
+        if(fds[0].revents) {
+          char drain[64];
+          while(read(wakeRead, drain, sizeof(drain)) == sizeof(drain)) {
+          }
+          std::lock_guard<std::mutex> lock(mutex);
+          for(auto& c : returned) idle.push_back(std::move(c));
+          returned.clear();
+        }
+        if(fds[1].revents & POLLIN) {
+          const int socket = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+          if(socket >= 0) {
+            // a client that stalls mid request gives its thread back
+            timeval timeout = {10, 0};
+            setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                       sizeof(timeout));
+            idle.emplace_back(new Connection(socket));
+          }
+        }
+      }
+    }
+
+    void report()
+    {
+      uint64_t hits, misses;
+      plans.counts(hits, misses);
+      std::fprintf(stderr,
+                   "gcolorspace_daemon: %llu requests, %llu failed, "
+                   "transforms %llu compiled, %llu reused\n",
+                   static_cast<unsigned long long>(requests.load()),
+                   static_cast<unsigned long long>(failed.load()),
+                   static_cast<unsigned long long>(misses),
+                   static_cast<unsigned long long>(hits));
+    }
+
+   private:
+    void work()
+    {
+      for(;;) {
+        std::unique_ptr<Connection> c;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          ready.wait(lock, [this]() { return done || !queue.empty(); });
+          if(done) return;
+          c = std::move(queue.front());
+          queue.pop_front();
+        }
+        if(!serve(*c)) continue;  // closed by the client or broken
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          returned.push_back(std::move(c));
+        }
+        const char byte = 0;
+        if(write(wakeWrite, &byte, 1) < 0) {
+          // a full pipe already wakes the loop
+        }
+      }
+    }
+
+    // one request, false when the connection should close
+    bool serve(Connection& c)
+    {
+      DaemonProtocol::Request request;
+      int fd = -1;
+      if(!DaemonProtocol::RecvWithFd(c.socket, &request, sizeof(request),
+                                     fd)) {
+        return false;
+      }
+      std::unique_ptr<int, void (*)(int*)> owned(&fd, [](int* f) {
+        if(*f >= 0) close(*f);
+      });
+      if(request.magic != DaemonProtocol::kMagic ||
+         request.version != DaemonProtocol::kVersion ||
+         request.spec.lutPathBytes > DaemonProtocol::kMaxPath) {
+        return false;
+      }
+      std::string lutPath(request.spec.lutPathBytes, '\0');
+      if(!DaemonProtocol::RecvAll(c.socket, &lutPath[0], lutPath.size())) {
+        return false;
+      }
+
+      ++requests;
+      gcs_status status;
+      std::string error;
+      PlanCache::Entry transform =
+          plans.get(request.spec, lutPath, status, error);
+      if(transform != nullptr) {
+        status = Apply(c, request, transform.get(), fd, error);
+      }
+      if(status != GCS_OK) ++failed;
+
+      if(error.size() > DaemonProtocol::kMaxMessage) {
+        error.resize(DaemonProtocol::kMaxMessage);
+      }
+      DaemonProtocol::Reply reply;
+      reply.magic = DaemonProtocol::kMagic;
+      reply.status = status;
+      reply.messageBytes = static_cast<uint32_t>(error.size());
+      reply.reserved = 0;
+      return DaemonProtocol::SendAll(c.socket, &reply, sizeof(reply)) &&
+             DaemonProtocol::SendAll(c.socket, error.data(), error.size());
+    }
+
+    int listener;
+    int wakeRead;
+    PlanCache plans;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::unique_ptr<Connection>> queue;
+    std::vector<std::unique_ptr<Connection>> returned;
+    bool done = false;
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> failed{0};
+  };
+
+  // a socket only this user can connect to, replacing a stale one
+  int Listen(const std::string& path)
+  {
+    sockaddr_un address;
+    if(!DaemonProtocol::Address(path, address)) {
+      std::fprintf(stderr, "%s: invalid socket path\n", path.c_str());
+      return -1;
+    }
+    const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(connect(probe, reinterpret_cast<const sockaddr*>(&address),
+               sizeof(address)) == 0) {
+      std::fprintf(stderr, "%s: a daemon is already running\n",
+                   path.c_str());
+      close(probe);
+      return -1;
+    }
+    close(probe);
+    unlink(path.c_str());
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const mode_t mask = umask(077);
+    const bool bound =
+        bind(listener, reinterpret_cast<const sockaddr*>(&address),
+             sizeof(address)) == 0;
+    umask(mask);
+    if(!bound || listen(listener, 128) != 0) {
+      std::fprintf(stderr, "%s: %s\n", path.c_str(), std::strerror(errno));
+      close(listener);
+      return -1;
+    }
+    return listener;
+  }
+
+  int Usage()
+  {
+    std::fprintf(stderr,
+                 "usage: gcolorspace_daemon [--socket PATH] [--threads N] "
+                 "[--plans N]\n");
+    return 2;
+  }
+}  // namespace
+
+int main(int argc, char** argv)
+{
+  std::string path = DaemonProtocol::DefaultSocketPath();
+  int threads = static_cast<int>(std::thread::hardware_concurrency());
+  int plans = 64;
+  for(int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if(arg == "--socket" && i + 1 < argc) {
+      path = argv[++i];
+    }
+    else if(arg == "--threads" && i + 1 < argc) {
+      threads = std::atoi(argv[++i]);
+    }
+    else if(arg == "--plans" && i + 1 < argc) {
+      plans = std::atoi(argv[++i]);
+    }
+    else {
+      return Usage();
+    }
+  }
+  threads = std::max(threads, 1);
+
+  int wake[2];
+  if(pipe2(wake, O_CLOEXEC | O_NONBLOCK) != 0) {
+    std::perror("pipe");
+    return 1;
+  }
+  wakeWrite = wake[1];
+  const int listener = Listen(path);
+  if(listener < 0) return 1;
+
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = OnSignal;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  std::fprintf(stderr, "gcolorspace_daemon: listening on %s, %d threads\n",
+               path.c_str(), threads);
+  {
+    Server server(listener, wake[0], threads, static_cast<size_t>(plans));
+    server.run();
+    close(listener);
+    unlink(path.c_str());
+    server.report();
+  }
+  return 0;
+}